@@ -11,7 +11,8 @@
 
 #include <driver/i2c_master.h>
 
-#define DEBUG
+// Logs every config register change, each one holds the conversion for a UART line
+// #define DEBUG
 
 /*
  * Pointer register address
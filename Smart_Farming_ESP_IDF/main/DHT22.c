@@ -17,8 +17,6 @@
 
 ---------------------------------------------------------------------------------*/
 
-#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
-
 #include <stdio.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
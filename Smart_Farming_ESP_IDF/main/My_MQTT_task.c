@@ -11,37 +11,51 @@
 #include "esp_random.h"
 #include "esp_wifi.h"
 #include "mqtt_client.h"
-#include "esp_sleep.h"    // Include library to enable deep sleep 
-#include "driver/gpio.h"
-#include "driver/rtc_io.h"
 
 #include "My_MQTT_task.h"
 #include "sensor_interface_task.h"
 #include "error_handler.h"
+#include "cycle_profiler.h"
+#include "deferred_log.h"
+#include "device_identity.h"
+#include "remote_config.h"
+#include "sensor_payload.h"
+#include "sleep_manager.h"
+#include "static_alloc.h"
+#include "task_monitor.h"
+#include "mqtt_fsm.h"
+#include "wake_budget.h"
 
 static const char TAG[] = "MQTT";
 
 // MQTT client handle
 esp_mqtt_client_handle_t client = NULL;
 
-// Queue handle used to manipulate the main queue of events
-static QueueHandle_t mqtt_task_queue_handle;
+// Per-device topics, built once when the task starts
+static char data_topic[DEVICE_TOPIC_MAX_LEN];
+static char diag_topic[DEVICE_TOPIC_MAX_LEN];
+static char config_topic[DEVICE_TOPIC_MAX_LEN];
+static char log_topic[DEVICE_TOPIC_MAX_LEN];
+
+// MQTT task handle, the event handler notifies the task directly
+static TaskHandle_t mqtt_task_handle = NULL;
+
+// Sensor data is waiting in the client outbox for PUBACK
+static bool sensor_data_queued = false;
+
+// Session open, it survives light sleep
+static volatile bool mqtt_connected = false;
 
 /**
- * @brief Send message to the MQTT task message queue
- * @param msgID MQTT task message enum
- * @return pdTRUE if success, otherwise errQUEUE_FULL
+ * @brief Notify the MQTT task of a state machine event
+ * @param event MQTT_FSM_EVT_* bit
  */
-static BaseType_t My_MQTT_task_send_message(mqtt_task_message_e msgID)
+static void My_MQTT_task_notify(uint32_t event)
 {
-    mqtt_task_queue_message_t msg;
-    msg.msgID = msgID;
-    BaseType_t ret = xQueueSend(mqtt_task_queue_handle, &msg, pdMS_TO_TICKS(100));
-    if(ret != pdTRUE)
+    if (mqtt_task_handle != NULL)
     {
-        ESP_LOGW(TAG, "MQTT queue full, message not sent");
+        xTaskNotify(mqtt_task_handle, event, eSetBits);
     }
-    return ret;
 }
 
 /**
@@ -71,37 +85,57 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch ((esp_mqtt_event_id_t)event_id) 
     {
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            My_MQTT_task_send_message(MY_MQTT_TASK_CONNECTED);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_CONNECTED, "MQTT_EVENT_CONNECTED");
+            cycle_profiler_mark(CYCLE_PHASE_MQTT_CONNACK);
+            mqtt_connected = true;
+            if (remote_config_needs_subscribe(event->session_present))
+            {
+                int msg_id = esp_mqtt_client_subscribe(client, config_topic, MY_MQTT_CONFIG_QOS);
+                DEFERRED_LOGI(TAG, DLOG_MQTT_SUBSCRIBING, "Subscribing to the config topic, msg_id=%d", msg_id);
+            }
+            My_MQTT_task_notify(MQTT_FSM_EVT_CONNECTED);
             break;
 
         case MQTT_EVENT_DISCONNECTED:
-            ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
-            My_MQTT_task_send_message(MY_MQTT_TASK_DISCONNECTED);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_DISCONNECTED, "MQTT_EVENT_DISCONNECTED");
+            mqtt_connected = false;
+            My_MQTT_task_notify(MQTT_FSM_EVT_DISCONNECTED);
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
-            ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
-            My_MQTT_task_send_message(MY_MQTT_TASK_SUBSCRIBED);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_SUBSCRIBED, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+            remote_config_set_subscribed();
             break;
 
         case MQTT_EVENT_UNSUBSCRIBED:
-            ESP_LOGI(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_UNSUBSCRIBED, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
             break;
 
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
-            My_MQTT_task_send_message(MY_MQTT_TASK_PUBLISHED);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_PUBLISHED, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            // Only the sensor data is published with QoS > 0
+            My_MQTT_task_notify(MQTT_FSM_EVT_PUBLISHED);
             break;
 
         case MQTT_EVENT_DATA:
-            ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-            printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-            printf("DATA=%.*s\r\n", event->data_len, event->data);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_DATA, "MQTT_EVENT_DATA, %d bytes", event->data_len);
+            if (event->topic_len == strlen(config_topic) &&
+                strncmp(event->topic, config_topic, event->topic_len) == 0)
+            {
+                // Config messages are small, fragmented ones are not valid
+                if (event->data_len != event->total_data_len)
+                {
+                    ESP_LOGW(TAG, "Config message too large, ignored");
+                }
+                else if (remote_config_apply_json(event->data, event->data_len) == ESP_OK)
+                {
+                    My_MQTT_task_notify(MQTT_FSM_EVT_DATA);
+                }
+            }
             break;
 
         case MQTT_EVENT_ERROR:
-            ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
+            DEFERRED_LOGI(TAG, DLOG_MQTT_ERROR, "MQTT_EVENT_ERROR, type %d", event->error_handle->error_type);
             if (event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) 
             {
                 log_error_if_nonzero("reported from esp-tls", event->error_handle->esp_tls_last_esp_err);
@@ -113,58 +147,155 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             {
                 ESP_LOGE(TAG, "MQTT_ERROR_TYPE_CONNECTION_REFUSED");
             }
-            My_MQTT_task_send_message(MY_MQTT_TASK_ERROR);
+            My_MQTT_task_notify(MQTT_FSM_EVT_ERROR);
             break;
 
         default:
-            ESP_LOGI(TAG, "Other event id:%d", event->event_id);
+            DEFERRED_LOGI(TAG, DLOG_MQTT_OTHER_EVENT, "Other event id:%d", event->event_id);
             break;
     }
 }
 
 /**
  * @brief Format sensor data to JSON then publish them
+ * @return Message ID of the publish, -1 if failed
+ * @note With QoS 0 the data is written to the socket before this function returns
  */
-static void publish_sensor_data(void)
+static int publish_sensor_data(void)
 {
-    char topic[] = MY_MQTT_TOPIC;
-
-    // Create JSON object
-    cJSON *json_data = cJSON_CreateObject();
-    cJSON_AddNumberToObject(json_data, "temperature", get_temperature());
-    cJSON_AddNumberToObject(json_data, "humidity", get_humidity());
-    cJSON_AddNumberToObject(json_data, "soil_moisture", get_soil_moisture());
+    int msg_id = -1;
 
-    // Convert JSON object to string
-    char *json_string = cJSON_PrintUnformatted(json_data);
+    // A CONNACK from the fast reconnect can come before the first DHT22 reading, as on the other transports
+    sensor_interface_wait_ready(SENSOR_INTERFACE_READY_TIMEOUT_MS);
+    char *json_string = sensor_payload_create();
 
     if (json_string != NULL)
     {
-        // Publish JSON data
-        esp_mqtt_client_publish(client, topic, json_string, strlen(json_string), MY_MQTT_QOS, 0);
+        // Publish JSON data, the client copies it to its outbox
+        static_alloc_guard_pause();
+        msg_id = esp_mqtt_client_publish(client, data_topic, json_string, strlen(json_string), remote_config_get_qos(), 0);
+        static_alloc_guard_resume();
+        cycle_profiler_mark(CYCLE_PHASE_PUBLISH);
         ESP_LOGI(TAG, "Published: %s", json_string);
 
         // Free allocated memory
         cJSON_free(json_string);
     }
 
-    // Delete JSON object
-    cJSON_Delete(json_data);
+    return msg_id;
 }
 
 /**
- * @brief Configure ESP deep sleep then start the deep sleep
+ * @brief Publish phase timings and task monitor snapshot of the previous wake cycle to the diagnostics topic
+ * @note Also publishes the deferred log when the remote config asked for it
  */
-static void go_to_deep_sleep(void)
+static void publish_cycle_profile(void)
 {
-    const int wakeup_time_sec = 60;
-    ESP_LOGI(TAG, "Enabling timer wakeup, %ds\n", wakeup_time_sec);
-    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(wakeup_time_sec * 1000000));
-    rtc_gpio_isolate(GPIO_NUM_12);
-    esp_wifi_stop();
-    ESP_LOGW(TAG, "Entering deep sleep...");
-    vTaskDelay(pdMS_TO_TICKS(200));
-    esp_deep_sleep_start();
+    char record[192];
+    size_t len = cycle_profiler_format_previous(record, sizeof(record));
+    if (len == 0)
+    {
+        ESP_LOGI(TAG, "No previous cycle profile");
+    }
+    else
+    {
+        static_alloc_guard_pause();
+        esp_mqtt_client_publish(client, diag_topic, record, len, 0, 0);
+        static_alloc_guard_resume();
+        ESP_LOGI(TAG, "Cycle profile: %s", record);
+    }
+
+    // Static, the record would take a tenth of the stack it measures
+    static char task_record[TASK_MONITOR_RECORD_SIZE];
+    len = task_monitor_format_previous(task_record, sizeof(task_record));
+    if (len > 0)
+    {
+        static_alloc_guard_pause();
+        esp_mqtt_client_publish(client, diag_topic, task_record, len, 0, 0);
+        static_alloc_guard_resume();
+        ESP_LOGI(TAG, "Task monitor: %s", task_record);
+    }
+
+    const uint8_t *log_record;
+    len = deferred_log_drain_requested(&log_record);
+    if (len > 0)
+    {
+        static_alloc_guard_pause();
+        esp_mqtt_client_publish(client, log_topic, (const char *) log_record, len, 0, 0);
+        static_alloc_guard_resume();
+        ESP_LOGI(TAG, "Deferred log published, %u bytes", (unsigned) len);
+    }
+}
+
+/**
+ * @brief Run the entry action of a state
+ * @param state State just entered
+ * @return Events raised by the entry action, handled before waiting for new ones
+ */
+static uint32_t My_MQTT_task_enter_state(mqtt_fsm_state_e state)
+{
+    switch (state)
+    {
+        case MQTT_FSM_CONNECTING:
+            // Resumed from light sleep with the session still open
+            if (mqtt_connected)
+            {
+                cycle_profiler_mark(CYCLE_PHASE_MQTT_CONNACK);
+                return MQTT_FSM_EVT_CONNECTED;
+            }
+            break;
+
+        case MQTT_FSM_CONNECTED:
+        {
+            // After a reconnect, QoS 1 data is still in the client outbox
+            if (sensor_data_queued)
+            {
+                return MQTT_FSM_EVT_PUBLISH_QUEUED;
+            }
+
+            publish_cycle_profile();
+            int msg_id = publish_sensor_data();
+            if (msg_id < 0)
+            {
+                ESP_LOGE(TAG, "Sensor data publish failed");
+                return MQTT_FSM_EVT_TIMEOUT;
+            }
+
+            // QoS 0 has no PUBACK, the data is already written
+            if (msg_id == 0)
+            {
+                return MQTT_FSM_EVT_PUBLISHED;
+            }
+            sensor_data_queued = true;
+            return MQTT_FSM_EVT_PUBLISH_QUEUED;
+        }
+
+        case MQTT_FSM_FLUSHED:
+            sensor_data_queued = false;
+            wake_budget_set_uplink_ok();
+            wake_budget_phase_done(WAKE_BUDGET_PHASE_MQTT);
+            sensor_payload_clear_pending();
+            break;
+
+        case MQTT_FSM_SLEEP:
+            // The Wi-Fi driver allocates when it stops and starts again
+            static_alloc_guard_pause();
+            if (sleep_manager_light_sleep())
+            {
+                static_alloc_guard_resume();
+                // Events from before the light sleep are stale, the connection state is in mqtt_connected
+                ulTaskNotifyValueClear(NULL, UINT32_MAX);
+                return MQTT_FSM_EVT_RESUME;
+            }
+            esp_mqtt_client_disconnect(client);
+            sleep_manager_enter_deep_sleep();
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
 }
 
 /**
@@ -173,55 +304,70 @@ static void go_to_deep_sleep(void)
  */
 void My_MQTT_task(void *pvParameters)
 {
-    mqtt_task_queue_message_t msg;
+    // Before the client exists, the create call may not have stored the handle yet when the first event comes
+    mqtt_task_handle = xTaskGetCurrentTaskHandle();
+
+    device_identity_topic(MY_MQTT_DATA_LEAF, data_topic, sizeof(data_topic));
+    device_identity_topic(MY_MQTT_DIAG_LEAF, diag_topic, sizeof(diag_topic));
+    device_identity_topic(MY_MQTT_LOG_LEAF, log_topic, sizeof(log_topic));
+    device_identity_topic(MY_MQTT_CONFIG_LEAF, config_topic, sizeof(config_topic));
 
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = BROKER_ADDRESS,
         .credentials.username = BROKER_USERNAME,
         .credentials.authentication.password = BROKER_PASSWORD,
-        .credentials.client_id = MY_MQTT_CLIENT_ID,
+        .credentials.client_id = device_identity_get_id(),
         .session.keepalive = MY_MQTT_KEEPALIVE,
         .session.disable_clean_session = true,
         .session.protocol_ver = MY_MQTT_PROTOCOL,
+        .network.reconnect_timeout_ms = MY_MQTT_RECONNECT_MS,
     };
 
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    mqtt_fsm_state_e state = MQTT_FSM_CONNECTING;
+    TickType_t state_entered = xTaskGetTickCount();
+    uint32_t pending = 0;
+
     esp_mqtt_client_start(client);
+    static_alloc_guard_arm();
 
     while(1)
     {
-        if(xQueueReceive(mqtt_task_queue_handle, &msg, portMAX_DELAY))
+        if (pending == 0)
         {
-            switch(msg.msgID)
+            // Wait for events until the state times out
+            TickType_t timeout = pdMS_TO_TICKS(mqtt_fsm_timeout_ms(state));
+            TickType_t elapsed = xTaskGetTickCount() - state_entered;
+            TickType_t wait = (elapsed < timeout) ? timeout - elapsed : 0;
+
+            if (xTaskNotifyWait(0, UINT32_MAX, &pending, wait) == pdFALSE)
             {
-                case MY_MQTT_TASK_CONNECTED:
-                case MY_MQTT_TASK_PUBLISHED:
-                    // Publish data using QoS = 0
-                    publish_sensor_data();
-                    vTaskDelay(pdMS_TO_TICKS(2000));
-                    esp_mqtt_client_disconnect(client);
-                    go_to_deep_sleep();
-                    break;
-
-                case MY_MQTT_TASK_DISCONNECTED:
-                case MY_MQTT_TASK_ERROR:
-                    // Wait 5 seconds before reconnecting
-                    // Just put ESP to sleep maybe
-                    vTaskDelay(pdMS_TO_TICKS(5000));  
-                    esp_mqtt_client_reconnect(client);
-                    break;
-
-                default:
-                    break;
+                pending = MQTT_FSM_EVT_TIMEOUT;
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(20));
+
+        // Handle the lowest pending event bit first
+        uint32_t event = pending & (~pending + 1);
+        pending &= ~event;
+
+        mqtt_fsm_state_e next = mqtt_fsm_next(state, event);
+        if (next != state)
+        {
+            ESP_LOGI(TAG, "%s -> %s", mqtt_fsm_state_name(state), mqtt_fsm_state_name(next));
+            state = next;
+            state_entered = xTaskGetTickCount();
+            // Events from before the transition do not apply to the new state
+            pending = My_MQTT_task_enter_state(state);
+        }
     }
 }
 
 static bool mqtt_started = false;
 
+STATIC_ALLOC_TASK(mqtt_task_buffers, MY_MQTT_TASK_STACK_SIZE);
+
 /**
  * @brief Start an MQTT task
  * @note There should be only one instance of this task
@@ -234,17 +380,12 @@ void My_MQTT_task_start(void)
     }
     mqtt_started = true;
 
-    mqtt_task_queue_handle = xQueueCreate(5, sizeof(mqtt_task_queue_message_t));
-    if (mqtt_task_queue_handle == NULL) 
-    {
-        ESP_LOGE(TAG, "Failed to create MQTT task queue");
-        return;
-    }
+    wake_budget_register(WAKE_BUDGET_PHASE_MQTT, WAKE_BUDGET_MQTT_MS);
 
-    BaseType_t err = xTaskCreate(&My_MQTT_task, "My_MQTT_task", MY_MQTT_TASK_STACK_SIZE, NULL, MY_MQTT_TASK_PRIORITY, NULL);
+    BaseType_t err = static_alloc_task_create(&mqtt_task_buffers, &My_MQTT_task, "My_MQTT_task", NULL, MY_MQTT_TASK_PRIORITY, &mqtt_task_handle, tskNO_AFFINITY);
     if (err != pdPASS)
     {
         ESP_LOGE(TAG, "MQTT task create failed");
         my_error_handler(TAG);
     }
-}
\ No newline at end of file
+}
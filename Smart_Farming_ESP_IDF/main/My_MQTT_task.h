@@ -6,34 +6,29 @@
 #ifndef MY_MQTT_TASK_H_
 #define MY_MQTT_TASK_H_
 
+#include "sdkconfig.h"
+
 #define MY_MQTT_TASK_STACK_SIZE    8192
 #define MY_MQTT_TASK_PRIORITY      5
 
+#if CONFIG_IDF_TARGET_LINUX
+#define BROKER_ADDRESS          "mqtt://localhost:1883"     // Host build, local Mosquitto
+#else
 #define BROKER_ADDRESS          "mqtt://192.168.0.248:1883"
+#endif
 #define BROKER_USERNAME         "Your_MQTT_Broker_Username"
 #define BROKER_PASSWORD         "Your_MQTT_Broker_Password"
-#define MY_MQTT_CLIENT_ID       "ESP32-SmartFarming"
 #define MY_MQTT_PROTOCOL        MQTT_PROTOCOL_V_3_1_1
 #define MY_MQTT_KEEPALIVE       30
-#define MY_MQTT_QOS             0
-#define MY_MQTT_TOPIC           "/smartfarming"
-
-// MQTT task message enum
-typedef enum mqtt_task_message
-{
-    MY_MQTT_TASK_CONNECTED = 0,
-    MY_MQTT_TASK_DISCONNECTED,
-    MY_MQTT_TASK_SUBSCRIBED,
-    MY_MQTT_TASK_UNSUBSCRIBED,
-    MY_MQTT_TASK_PUBLISHED,
-    MY_MQTT_TASK_DATA_RECEIVED,
-    MY_MQTT_TASK_ERROR,
-} mqtt_task_message_e;
+#define MY_MQTT_RECONNECT_MS    1000
 
-typedef struct mqtt_task_queue_message
-{
-    mqtt_task_message_e msgID;
-} mqtt_task_queue_message_t;
+// Topic leaves, the full topic is /smartfarming/<device id>/<leaf> (see device_identity.h)
+// The client ID is the device ID
+#define MY_MQTT_DATA_LEAF       "data"
+#define MY_MQTT_DIAG_LEAF       "diag"
+#define MY_MQTT_CONFIG_LEAF     "config"
+#define MY_MQTT_LOG_LEAF        "log"       // Deferred log, binary, on request (see deferred_log.h)
+#define MY_MQTT_CONFIG_QOS      1
 
 /**
  * @brief Start MQTT task
@@ -10,21 +10,67 @@
 
 #include "sensor_interface_task.h"
 #include "network_connection.h"
+#include "benchmark.h"
 #include "My_MQTT_task.h"
+#include "continuous_mode.h"
+#include "cycle_profiler.h"
+#include "deferred_log.h"
+#include "error_handler.h"
+#include "espnow_link.h"
+#include "remote_config.h"
+#include "run_to_completion.h"
+#include "static_alloc.h"
+#include "udp_uplink.h"
+#include "ulp_sampler.h"
+#include "wake_budget.h"
+#include "wall_clock.h"
 
 static const char TAG[] = "main";
 
+// Uplink transport chosen for this wake
+static uint8_t uplink_transport = UPLINK_TRANSPORT_MQTT;
+
 /**
  * @brief Network connected event callback function
  */
 void network_connected_events(void)
 {
+	cycle_profiler_mark(CYCLE_PHASE_NETWORK_READY);
 	ESP_LOGI(TAG, "Network Connected!!");
-    My_MQTT_task_start();
+
+    if (uplink_transport == UPLINK_TRANSPORT_UDP)
+    {
+        udp_uplink_start();
+    }
+    else
+    {
+        My_MQTT_task_start();
+    }
 }
 
 void app_main(void)
 {
+    // Before anything else, a node in a restart loop goes back to sleep here
+    error_handler_init();
+    deferred_log_init();
+    wall_clock_init();
+
+    // Before anything builds a JSON payload
+    static_alloc_init();
+
+#if BENCHMARK_ENABLE
+    // Benchmark build, no wake cycle
+    benchmark_run();
+    return;
+#endif
+
+    cycle_profiler_init();
+#if DEVICE_ROLE == DEVICE_ROLE_SENSOR && OPERATING_MODE == OPERATING_MODE_DEEP_SLEEP
+    wake_budget_start();
+    // Before the sensor task takes the I2C pins back
+    ulp_sampler_collect();
+#endif
+
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES)
@@ -33,14 +79,46 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    cycle_profiler_mark(CYCLE_PHASE_NVS_INIT);
 
     esp_log_level_set("*", ESP_LOG_INFO);
 
     ESP_LOGI(TAG, "Main start...");
-    
+
+#if DEVICE_ROLE == DEVICE_ROLE_GATEWAY
+    // Always-on ESP-NOW gateway, no sensors and no deep sleep
+    network_start();
+    network_connection_set_callback(&espnow_gateway_start);
+#elif OPERATING_MODE == OPERATING_MODE_CONTINUOUS
+    // Always-on sensor node, light sleep between samples
+    continuous_mode_pm_init();
     sensor_interface_start();
+    network_start();
+    network_connection_set_callback(&continuous_mode_start);
+#else
+    uplink_transport = remote_config_select_transport();
+
+#if RUN_TO_COMPLETION_ENABLE
+    if (uplink_transport == UPLINK_TRANSPORT_MQTT)
+    {
+        // One task runs the whole wake, no sensor, network or MQTT task
+        run_to_completion_start();
+        return;
+    }
+#endif
+
+    sensor_interface_start();
+
+    if (uplink_transport == UPLINK_TRANSPORT_ESPNOW)
+    {
+        // The node does not join the Wi-Fi network
+        espnow_node_start();
+        return;
+    }
+
     network_start();
 
     // Set connected event callback
 	network_connection_set_callback(&network_connected_events);
+#endif
 }
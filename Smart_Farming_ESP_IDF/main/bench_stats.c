@@ -0,0 +1,68 @@
+#include "bench_stats.h"
+
+#include <stdio.h>
+
+/**
+ * @brief Sort samples in ascending order
+ * @note Insertion sort, there are at most BENCH_STATS_MAX_SAMPLES
+ */
+static void bench_stats_sort(uint32_t *samples, size_t count)
+{
+    for (size_t i = 1; i < count; i++)
+    {
+        uint32_t value = samples[i];
+        size_t j = i;
+        while (j > 0 && samples[j - 1] > value)
+        {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = value;
+    }
+}
+
+uint32_t bench_stats_percentile(const uint32_t *sorted, size_t count, uint32_t percent)
+{
+    size_t rank = (count * percent + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    if (rank > count)
+        rank = count;
+
+    return sorted[rank - 1];
+}
+
+void bench_stats_compute(uint32_t *samples, size_t count, bench_stats_t *stats)
+{
+    stats->count = (uint32_t) count;
+    if (count == 0)
+    {
+        stats->min = 0;
+        stats->median = 0;
+        stats->p99 = 0;
+        stats->max = 0;
+        return;
+    }
+
+    bench_stats_sort(samples, count);
+    stats->min = samples[0];
+    stats->median = bench_stats_percentile(samples, count, 50);
+    stats->p99 = bench_stats_percentile(samples, count, 99);
+    stats->max = samples[count - 1];
+}
+
+size_t bench_stats_format(const bench_result_t *result, char *buf, size_t size)
+{
+    int len = snprintf(buf, size,
+                       "{\"name\":\"%s\",\"unit\":\"%s\",\"cpu_mhz\":%lu,\"n\":%lu,\"errors\":%lu,"
+                       "\"min\":%lu,\"median\":%lu,\"p99\":%lu,\"max\":%lu,\"alloc_bytes\":%lu,\"allocs\":%lu}",
+                       result->name, result->unit, (unsigned long) result->cpu_mhz,
+                       (unsigned long) result->time.count, (unsigned long) result->errors,
+                       (unsigned long) result->time.min, (unsigned long) result->time.median,
+                       (unsigned long) result->time.p99, (unsigned long) result->time.max,
+                       (unsigned long) result->alloc_bytes, (unsigned long) result->allocs);
+    if (len < 0 || (size_t) len >= size)
+        return 0;
+
+    return (size_t) len;
+}
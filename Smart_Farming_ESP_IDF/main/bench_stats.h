@@ -0,0 +1,69 @@
+/**
+ * Benchmark statistics. Summarizes the per-call samples of one benchmark case
+ * (min, median, p99, max) and formats the result as one JSON record, the format
+ * read by tools/bench_compare.py. Pure logic, no ESP-IDF dependencies, so it can
+ * be compiled and checked on the host.
+ *
+ * Percentiles use the nearest rank: the p-th percentile of n sorted samples is
+ * sample ceil(p * n / 100), so the p99 of fewer than 100 samples is the max.
+ */
+
+#ifndef BENCH_STATS_H_
+#define BENCH_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most samples kept for one case
+#define BENCH_STATS_MAX_SAMPLES     64
+
+typedef struct bench_stats
+{
+    uint32_t count;         // Samples
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+    uint32_t max;
+} bench_stats_t;
+
+// Result of one benchmark case
+typedef struct bench_result
+{
+    const char *name;
+    const char *unit;       // "cycles" on the chip, "ns" on the host
+    uint32_t cpu_mhz;       // To compare cycles between CPU frequencies, 0 on the host
+    uint32_t errors;        // Calls that returned an error, still timed
+    bench_stats_t time;     // Time per call
+    uint32_t alloc_bytes;   // Most heap bytes allocated by one call
+    uint32_t allocs;        // Most heap allocations by one call
+} bench_result_t;
+
+/**
+ * @brief Summarize samples
+ * @param samples Samples, sorted in place
+ * @param count Number of samples
+ * @param stats Output statistics, all zero if there are no samples
+ */
+void bench_stats_compute(uint32_t *samples, size_t count, bench_stats_t *stats);
+
+/**
+ * @brief Get a percentile of sorted samples
+ * @param sorted Samples in ascending order
+ * @param count Number of samples, at least 1
+ * @param percent Percentile, 1 to 100
+ * @return Sample at the nearest rank
+ */
+uint32_t bench_stats_percentile(const uint32_t *sorted, size_t count, uint32_t percent);
+
+/**
+ * @brief Format a result as one JSON record
+ * @param result Benchmark result
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ * @return Length of the record, 0 if it does not fit
+ * @note Example: {"name":"dht22_read","unit":"cycles","cpu_mhz":240,"n":5,"errors":0,
+ *       "min":1180000,"median":1190000,"p99":1210000,"max":1210000,"alloc_bytes":0,"allocs":0}
+ */
+size_t bench_stats_format(const bench_result_t *result, char *buf, size_t size);
+
+#endif /* BENCH_STATS_H_ */
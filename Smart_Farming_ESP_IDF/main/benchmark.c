@@ -0,0 +1,269 @@
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+
+#include "bench_stats.h"
+#include "sensor_interface_task.h"
+#include "sensor_payload.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#include "fake_heap.h"
+#else
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#endif
+
+static const char TAG[] = "benchmark";
+
+typedef struct benchmark_case
+{
+    const char *name;
+    int (*run)(void);           // One call, returns 0 on success
+    uint16_t iterations;        // At most BENCH_STATS_MAX_SAMPLES
+    uint16_t gap_ms;            // Pause between calls, not timed
+} benchmark_case_t;
+
+// Fixed reading for the serialization case
+static const sensor_reading_t benchmark_reading = {
+    .temperature = 25.1f,
+    .humidity = 60.4f,
+    .soil_moisture = 12000.0f,
+};
+
+static uint32_t time_samples[BENCH_STATS_MAX_SAMPLES];
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#define BENCHMARK_UNIT "ns"
+
+/**
+ * @brief Get the time stamp of the host build
+ * @return Monotonic time in ns, wraps after 4.2 s
+ */
+static uint32_t benchmark_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+/**
+ * @brief Get the heap allocations so far
+ * @param allocs Output, number of allocations
+ * @param bytes Output, bytes allocated
+ */
+static void benchmark_heap_counters(uint32_t *allocs, uint32_t *bytes)
+{
+    fake_heap_stats_t stats;
+    fake_heap_get_stats(&stats);
+    *allocs = stats.allocs;
+    *bytes = stats.alloc_bytes;
+}
+
+#else
+
+#define BENCHMARK_UNIT "cycles"
+
+/**
+ * @brief Get the time stamp of the chip
+ * @return CPU cycle count of the current core, wraps after 17 s at 240 MHz
+ * @note The main task is pinned to one core, so all calls read the same counter
+ */
+static uint32_t benchmark_now(void)
+{
+    return (uint32_t) esp_cpu_get_cycle_count();
+}
+
+#if BENCHMARK_ENABLE && CONFIG_HEAP_USE_HOOKS
+static uint32_t hook_allocs = 0;
+static uint32_t hook_bytes = 0;
+
+/**
+ * @brief Heap hook, called by the heap after each successful allocation
+ * @param ptr Allocated block
+ * @param size Requested size
+ * @param caps Capabilities of the block
+ * @note Can be called from an ISR and from both cores
+ */
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    (void) ptr;
+    (void) caps;
+    __atomic_add_fetch(&hook_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hook_bytes, (uint32_t) size, __ATOMIC_RELAXED);
+}
+#endif
+
+/**
+ * @brief Get the heap allocations so far
+ * @param allocs Output, number of allocations
+ * @param bytes Output, bytes allocated
+ * @note Always zero without CONFIG_HEAP_USE_HOOKS
+ */
+static void benchmark_heap_counters(uint32_t *allocs, uint32_t *bytes)
+{
+#if BENCHMARK_ENABLE && CONFIG_HEAP_USE_HOOKS
+    *allocs = __atomic_load_n(&hook_allocs, __ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&hook_bytes, __ATOMIC_RELAXED);
+#else
+    *allocs = 0;
+    *bytes = 0;
+#endif
+}
+
+#endif
+
+static int benchmark_dht22_read(void)
+{
+    return (readDHT() == DHT_OK) ? 0 : -1;
+}
+
+static int benchmark_ads111x_measure_raw(void)
+{
+    uint16_t raw;
+    return (ads111x_measure_raw(&my_ads111x_cfg, &raw) == ESP_OK) ? 0 : -1;
+}
+
+static int benchmark_ads111x_measure_voltage(void)
+{
+    float voltage;
+    return (ads111x_measure_voltage(&my_ads111x_cfg, &voltage) == ESP_OK) ? 0 : -1;
+}
+
+static int benchmark_sensor_payload_format(void)
+{
+    char *json_string = sensor_payload_format(&benchmark_reading);
+    if (json_string == NULL)
+        return -1;
+
+    cJSON_free(json_string);
+    return 0;
+}
+
+static int benchmark_sensor_payload_create(void)
+{
+    char *json_string = sensor_payload_create();
+    if (json_string == NULL)
+        return -1;
+
+    cJSON_free(json_string);
+    return 0;
+}
+
+static const benchmark_case_t benchmark_cases[] = {
+    { "dht22_read",                 &benchmark_dht22_read,              5,  BENCHMARK_DHT22_GAP_MS },
+    { "ads111x_measure_raw",        &benchmark_ads111x_measure_raw,     16, 0 },
+    { "ads111x_measure_voltage",    &benchmark_ads111x_measure_voltage, 16, 0 },
+    { "sensor_payload_format",      &benchmark_sensor_payload_format,   64, 0 },
+    { "sensor_payload_create",      &benchmark_sensor_payload_create,   16, 0 },
+};
+
+/**
+ * @brief Run one benchmark case
+ * @param bench Case to run
+ * @param result Output result
+ */
+static void benchmark_run_case(const benchmark_case_t *bench, bench_result_t *result)
+{
+    uint16_t iterations = bench->iterations;
+    if (iterations > BENCH_STATS_MAX_SAMPLES)
+        iterations = BENCH_STATS_MAX_SAMPLES;
+
+    result->name = bench->name;
+    result->unit = BENCHMARK_UNIT;
+#if CONFIG_IDF_TARGET_LINUX
+    result->cpu_mhz = 0;
+#else
+    result->cpu_mhz = esp_rom_get_cpu_ticks_per_us();
+#endif
+    result->errors = 0;
+    result->alloc_bytes = 0;
+    result->allocs = 0;
+
+    for (uint16_t i = 0; i < iterations; i++)
+    {
+        if (bench->gap_ms > 0 && i > 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(bench->gap_ms));
+        }
+
+        uint32_t allocs_before, bytes_before;
+        benchmark_heap_counters(&allocs_before, &bytes_before);
+
+        uint32_t start = benchmark_now();
+        int ret = bench->run();
+        time_samples[i] = benchmark_now() - start;
+
+        uint32_t allocs_after, bytes_after;
+        benchmark_heap_counters(&allocs_after, &bytes_after);
+
+        if (ret != 0)
+        {
+            result->errors++;
+        }
+        if (allocs_after - allocs_before > result->allocs)
+        {
+            result->allocs = allocs_after - allocs_before;
+        }
+        if (bytes_after - bytes_before > result->alloc_bytes)
+        {
+            result->alloc_bytes = bytes_after - bytes_before;
+        }
+    }
+
+    bench_stats_compute(time_samples, iterations, &result->time);
+}
+
+void benchmark_run(void)
+{
+    esp_err_t err = sensor_interface_init();
+    if (err != ESP_OK)
+    {
+        // The ADS111x cases count errors, the others still run
+        ESP_LOGE(TAG, "Sensor setup failed, ADS111x cases will fail");
+    }
+
+#if CONFIG_PM_ENABLE
+    // Same CPU frequency for all calls, and no light sleep in the DHT22 gap
+    esp_pm_lock_handle_t pm_lock = NULL;
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "benchmark", &pm_lock));
+    esp_pm_lock_acquire(pm_lock);
+#endif
+
+    printf("bench_start {\"target\":\"%s\",\"idf\":\"%s\"}\n", CONFIG_IDF_TARGET, IDF_VER);
+
+    uint32_t errors = 0;
+    size_t case_count = sizeof(benchmark_cases) / sizeof(benchmark_cases[0]);
+    for (size_t i = 0; i < case_count; i++)
+    {
+        bench_result_t result;
+        benchmark_run_case(&benchmark_cases[i], &result);
+        errors += result.errors;
+
+        char record[256];
+        if (bench_stats_format(&result, record, sizeof(record)) > 0)
+        {
+            printf("bench %s\n", record);
+        }
+    }
+
+    printf("bench_done {\"cases\":%u,\"errors\":%lu}\n", (unsigned) case_count, (unsigned long) errors);
+    fflush(stdout);
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(pm_lock);
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX
+    exit(errors == 0 ? 0 : 1);
+#endif
+}
@@ -0,0 +1,37 @@
+/**
+ * Micro-benchmarks of the sensor drivers and the payload serialization. With
+ * BENCHMARK_ENABLE set, app_main runs the cases below instead of the wake cycle and
+ * prints the results on the console, one line per case:
+ *
+ *   bench_start {"target":"esp32","idf":"v5.5.1"}
+ *   bench {"name":"dht22_read","unit":"cycles","cpu_mhz":240,"n":5,...}
+ *   bench_done {"cases":5,"errors":0}
+ *
+ * Each call is timed with the CPU cycle counter on the chip and clock_gettime on
+ * the host build, and the heap allocations of the call are counted (heap hooks on
+ * the chip, the malloc wrappers of host/fake_heap.h on the host). Compare two
+ * builds with tools/bench_compare.py.
+ *
+ *   dht22_read               readDHT(), the whole DHT22 transaction
+ *   ads111x_measure_raw      Single shot conversion and read over I2C
+ *   ads111x_measure_voltage  Same plus the conversion to volts
+ *   sensor_payload_format    JSON of a fixed reading, what publish_sensor_data formats
+ *   sensor_payload_create    Same with the sensor reads, publish_sensor_data without the socket write
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+// 1 = run the benchmarks instead of the application
+#define BENCHMARK_ENABLE            0
+
+// The DHT22 needs 2 s between readings, the pause is not timed
+#define BENCHMARK_DHT22_GAP_MS      2000
+
+/**
+ * @brief Set up the sensors, run all benchmark cases and print the results
+ * @note Ends the process on the host build, returns on the chip
+ */
+void benchmark_run(void);
+
+#endif /* BENCHMARK_H_ */
@@ -0,0 +1,321 @@
+#include "continuous_mode.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "cJSON.h"
+
+#include "My_MQTT_task.h"
+#include "deferred_log.h"
+#include "device_identity.h"
+#include "energy_model.h"
+#include "error_handler.h"
+#include "link_adapt.h"
+#include "remote_config.h"
+#include "sensor_interface_task.h"
+#include "sensor_payload.h"
+#include "static_alloc.h"
+#include "task_monitor.h"
+
+static const char TAG[] = "continuous";
+
+// Sample statistics of one report period
+typedef struct continuous_stats
+{
+    uint32_t samples;
+    uint32_t dropped;
+    int64_t period_start_us;
+    int64_t latency_sum_us;
+    int64_t latency_max_us;
+    int64_t active_us;          // Sampling and publishing, CPU and radio busy
+    int64_t sensor_us;          // DHT22 reading
+} continuous_stats_t;
+
+static esp_mqtt_client_handle_t continuous_client = NULL;
+static TaskHandle_t continuous_task_handle = NULL;
+static bool continuous_started = false;
+
+static char data_topic[DEVICE_TOPIC_MAX_LEN];
+static char diag_topic[DEVICE_TOPIC_MAX_LEN];
+static char config_topic[DEVICE_TOPIC_MAX_LEN];
+static char log_topic[DEVICE_TOPIC_MAX_LEN];
+
+esp_err_t continuous_mode_pm_init(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONTINUOUS_MAX_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONTINUOUS_MIN_CPU_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "DFS %d-%d MHz, light sleep %s", CONTINUOUS_MIN_CPU_FREQ_MHZ, CONTINUOUS_MAX_CPU_FREQ_MHZ,
+             pm_config.light_sleep_enable ? "on" : "off");
+    return ESP_OK;
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_ENABLE is off, running at full speed");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Event handler registered to receive MQTT events
+ * @param handler_args user data registered to the event
+ * @param base Event base for the handler
+ * @param event_id The id for the received event
+ * @param event_data The data for the event, esp_mqtt_event_handle_t
+ */
+static void continuous_mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+    switch ((esp_mqtt_event_id_t)event_id)
+    {
+        case MQTT_EVENT_CONNECTED:
+            DEFERRED_LOGI(TAG, DLOG_CONTINUOUS_MQTT_CONNECTED, "MQTT_EVENT_CONNECTED");
+            if (remote_config_needs_subscribe(event->session_present))
+            {
+                esp_mqtt_client_subscribe(continuous_client, config_topic, MY_MQTT_CONFIG_QOS);
+            }
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            DEFERRED_LOGI(TAG, DLOG_CONTINUOUS_MQTT_DISCONNECTED, "MQTT_EVENT_DISCONNECTED");
+            break;
+
+        case MQTT_EVENT_SUBSCRIBED:
+            remote_config_set_subscribed();
+            break;
+
+        case MQTT_EVENT_PUBLISHED:
+            if (continuous_task_handle != NULL)
+            {
+                xTaskNotify(continuous_task_handle, (uint32_t) event->msg_id, eSetValueWithOverwrite);
+            }
+            break;
+
+        case MQTT_EVENT_DATA:
+            if (event->topic_len == strlen(config_topic) &&
+                strncmp(event->topic, config_topic, event->topic_len) == 0 &&
+                event->data_len == event->total_data_len)
+            {
+                remote_config_apply_json(event->data, event->data_len);
+            }
+            break;
+
+        case MQTT_EVENT_ERROR:
+            DEFERRED_LOGI(TAG, DLOG_CONTINUOUS_MQTT_ERROR, "MQTT_EVENT_ERROR, type %d", event->error_handle->error_type);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Wait for the PUBACK of a message
+ * @param msg_id Message ID returned by the MQTT client
+ * @return true if acked before CONTINUOUS_PUBACK_TIMEOUT_MS
+ */
+static bool continuous_wait_puback(int msg_id)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(CONTINUOUS_PUBACK_TIMEOUT_MS);
+
+    while (xTaskGetTickCount() - start < timeout)
+    {
+        uint32_t acked_id = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &acked_id, timeout - (xTaskGetTickCount() - start)) != pdTRUE)
+            return false;
+
+        if ((int) acked_id == msg_id)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Publish the sample latency and estimated current of the last report period
+ * @param stats Statistics of the period
+ */
+static void continuous_publish_report(const continuous_stats_t *stats)
+{
+    int64_t period_us = esp_timer_get_time() - stats->period_start_us;
+    uint32_t published = stats->samples - stats->dropped;
+
+    energy_continuous_durations_t durations = {
+        .period_ms = (uint32_t) (period_us / 1000),
+        .active_ms = (uint32_t) (stats->active_us / 1000),
+        .sensor_on_ms = (uint32_t) (stats->sensor_us / 1000),
+    };
+    energy_coefficients_t coeff;
+    energy_model_default_coefficients(&coeff);
+    energy_report_t report = { 0 };
+    energy_model_continuous(&coeff, &durations, &report);
+
+    char record[256];
+    int len = snprintf(record, sizeof(record),
+                       "{\"mode\":\"continuous\",\"samples\":%lu,\"dropped\":%lu,\"period_ms\":%lu,"
+                       "\"lat_ms_avg\":%lu,\"lat_ms_max\":%lu,\"active_ms\":%lu,\"sensor_ms\":%lu,\"avg_ma\":%.2f,\"batt_life_h\":%.1f}",
+                       (unsigned long) stats->samples, (unsigned long) stats->dropped, (unsigned long) durations.period_ms,
+                       (unsigned long) (published ? stats->latency_sum_us / published / 1000 : 0),
+                       (unsigned long) (stats->latency_max_us / 1000), (unsigned long) durations.active_ms,
+                       (unsigned long) durations.sensor_on_ms,
+                       report.average_ma, report.battery_life_h);
+    if (len <= 0 || (size_t) len >= sizeof(record))
+        return;
+
+    static_alloc_guard_pause();
+    esp_mqtt_client_enqueue(continuous_client, diag_topic, record, len, 0, 0, true);
+    static_alloc_guard_resume();
+    ESP_LOGI(TAG, "Report: %s", record);
+
+#if STATIC_ALLOC_ENABLE
+    size_t arena_peak = 0;
+    uint32_t arena_failures = 0;
+    static_alloc_get_arena_stats(&arena_peak, &arena_failures);
+    ESP_LOGI(TAG, "cJSON arena peak %u of %u bytes, %lu failed", (unsigned) arena_peak,
+             (unsigned) STATIC_ALLOC_ARENA_SIZE, (unsigned long) arena_failures);
+#endif
+
+    // Stack, CPU and heap use over the same period, static to stay off the task stack
+    static task_monitor_snapshot_t snapshot;
+    static char task_record[TASK_MONITOR_RECORD_SIZE];
+    if (task_monitor_capture(&snapshot))
+    {
+        size_t task_len = task_monitor_format(&snapshot, task_record, sizeof(task_record));
+        if (task_len > 0)
+        {
+            static_alloc_guard_pause();
+            esp_mqtt_client_enqueue(continuous_client, diag_topic, task_record, task_len, 0, 0, true);
+            static_alloc_guard_resume();
+            ESP_LOGI(TAG, "Task monitor: %s", task_record);
+        }
+    }
+
+    // Deferred log, when the remote config asked for it
+    const uint8_t *log_record;
+    size_t log_len = deferred_log_drain_requested(&log_record);
+    if (log_len > 0)
+    {
+        static_alloc_guard_pause();
+        esp_mqtt_client_enqueue(continuous_client, log_topic, (const char *) log_record, log_len, 0, 0, true);
+        static_alloc_guard_resume();
+        ESP_LOGI(TAG, "Deferred log published, %u bytes", (unsigned) log_len);
+    }
+}
+
+/**
+ * @brief Continuous mode task to run
+ * @param pvParameters
+ */
+static void continuous_mode_task(void *pvParameters)
+{
+    continuous_stats_t stats = { .period_start_us = esp_timer_get_time() };
+
+    static_alloc_guard_arm();
+
+    while (1)
+    {
+        // Sensor task samples every CONTINUOUS_SAMPLE_SEC, light sleep in between
+        sensor_interface_wait_sample(portMAX_DELAY);
+
+        int64_t sample_start_us = 0;
+        int64_t sample_end_us = 0;
+        sensor_interface_get_sample_time(&sample_start_us, &sample_end_us);
+
+        stats.samples++;
+        int qos = remote_config_get_qos();
+        char *json_string = sensor_payload_create();
+        int msg_id = -1;
+        if (json_string != NULL)
+        {
+            // Stored in the outbox, sent by the MQTT client task even while reconnecting
+            static_alloc_guard_pause();
+            msg_id = esp_mqtt_client_enqueue(continuous_client, data_topic, json_string, strlen(json_string), qos, 0, true);
+            static_alloc_guard_resume();
+            cJSON_free(json_string);
+        }
+
+        // QoS 0 latency ends at the outbox, QoS 1 at the PUBACK
+        if (msg_id < 0 || (qos > 0 && !continuous_wait_puback(msg_id)))
+        {
+            ESP_LOGW(TAG, "Sample not delivered");
+            stats.dropped++;
+            link_adapt_update(false);
+        }
+        else
+        {
+            link_adapt_update(true);
+            error_handler_clear();
+            int64_t latency_us = esp_timer_get_time() - sample_start_us;
+            stats.latency_sum_us += latency_us;
+            if (latency_us > stats.latency_max_us)
+                stats.latency_max_us = latency_us;
+        }
+
+        stats.active_us += esp_timer_get_time() - sample_start_us;
+        stats.sensor_us += sample_end_us - sample_start_us;
+
+        if (stats.samples >= CONTINUOUS_REPORT_EVERY)
+        {
+            continuous_publish_report(&stats);
+            memset(&stats, 0, sizeof(stats));
+            stats.period_start_us = esp_timer_get_time();
+        }
+    }
+}
+
+STATIC_ALLOC_TASK(continuous_task_buffers, CONTINUOUS_TASK_STACK_SIZE);
+
+void continuous_mode_start(void)
+{
+    if (continuous_started) {
+        ESP_LOGW(TAG, "Continuous mode task already started, skipping.");
+        return;
+    }
+    continuous_started = true;
+
+    device_identity_topic(MY_MQTT_DATA_LEAF, data_topic, sizeof(data_topic));
+    device_identity_topic(MY_MQTT_DIAG_LEAF, diag_topic, sizeof(diag_topic));
+    device_identity_topic(MY_MQTT_CONFIG_LEAF, config_topic, sizeof(config_topic));
+    device_identity_topic(MY_MQTT_LOG_LEAF, log_topic, sizeof(log_topic));
+
+    // Persistent session, the connection stays open between samples
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = BROKER_ADDRESS,
+        .credentials.username = BROKER_USERNAME,
+        .credentials.authentication.password = BROKER_PASSWORD,
+        .credentials.client_id = device_identity_get_id(),
+        .session.keepalive = CONTINUOUS_MQTT_KEEPALIVE,
+        .session.disable_clean_session = true,
+        .session.protocol_ver = MY_MQTT_PROTOCOL,
+        .network.reconnect_timeout_ms = MY_MQTT_RECONNECT_MS,
+    };
+    continuous_client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_mqtt_client_register_event(continuous_client, ESP_EVENT_ANY_ID, continuous_mqtt_event_handler, NULL);
+    ESP_ERROR_CHECK(esp_mqtt_client_start(continuous_client));
+
+    BaseType_t err = static_alloc_task_create(&continuous_task_buffers, &continuous_mode_task, "continuous_task", NULL, CONTINUOUS_TASK_PRIORITY, &continuous_task_handle, tskNO_AFFINITY);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "Continuous mode task create failed");
+        my_error_handler(TAG);
+    }
+}
@@ -0,0 +1,44 @@
+/**
+ * Always-on continuous mode for mains-powered nodes (greenhouse). The node stays
+ * connected to Wi-Fi and MQTT and publishes every CONTINUOUS_SAMPLE_SEC. Between
+ * samples esp_pm lowers the CPU frequency and enters automatic light sleep, and
+ * Wi-Fi uses modem sleep. Needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE.
+ */
+
+#ifndef CONTINUOUS_MODE_H_
+#define CONTINUOUS_MODE_H_
+
+#include "esp_err.h"
+
+// Operating mode, chosen at build time
+#define OPERATING_MODE_DEEP_SLEEP       0
+#define OPERATING_MODE_CONTINUOUS       1
+#define OPERATING_MODE                  OPERATING_MODE_DEEP_SLEEP
+
+// Continuous mode config
+#define CONTINUOUS_SAMPLE_SEC           15
+#define CONTINUOUS_MAX_CPU_FREQ_MHZ     160
+#define CONTINUOUS_MIN_CPU_FREQ_MHZ     40      // XTAL frequency
+#define CONTINUOUS_MQTT_KEEPALIVE       120     // Fewer pings, the broker drops the node after 1.5x this
+#define CONTINUOUS_PUBACK_TIMEOUT_MS    5000
+#define CONTINUOUS_REPORT_EVERY         20      // Samples per report on the diagnostics topic
+
+// Continuous mode task config
+#define CONTINUOUS_TASK_STACK_SIZE      6144
+#define CONTINUOUS_TASK_PRIORITY        5
+
+/**
+ * @brief Enable dynamic frequency scaling and automatic light sleep
+ * @return ESP_OK or error code, ESP_ERR_NOT_SUPPORTED if CONFIG_PM_ENABLE is off
+ */
+esp_err_t continuous_mode_pm_init(void);
+
+/**
+ * @brief Start continuous mode task. Call this once the network is connected.
+ * @note It keeps one MQTT session open and publishes each new sensor sample.
+ *       Every CONTINUOUS_REPORT_EVERY samples it publishes the sample latency and
+ *       the estimated average current to the diagnostics topic.
+ */
+void continuous_mode_start(void);
+
+#endif /* CONTINUOUS_MODE_H_ */
@@ -0,0 +1,149 @@
+#include "cycle_profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#define CYCLE_PROFILER_MAGIC 0x50524F46 // "PROF"
+
+typedef struct cycle_record
+{
+    uint32_t magic;
+    uint32_t cycle;
+    uint32_t sleep_ms;
+    uint32_t flags;
+    uint32_t stamp_us[CYCLE_PHASE_MAX];
+} cycle_record_t;
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR cycle_record_t current_cycle;
+static RTC_DATA_ATTR cycle_record_t previous_cycle;
+
+// Start of the current cycle, 0 after boot so cold wake stamps count from boot
+static int64_t cycle_start_us = 0;
+
+/**
+ * @brief Get the time since the cycle started
+ * @return Microseconds, never 0 so a reached phase is not mistaken for a missing one
+ */
+static uint32_t cycle_profiler_now(void)
+{
+    uint32_t now = (uint32_t) (esp_timer_get_time() - cycle_start_us);
+    return now ? now : 1;
+}
+
+/**
+ * @brief Rotate the current record to the previous one and start a new record
+ * @note Helper function for cycle_profiler_init and cycle_profiler_resume
+ */
+static void cycle_profiler_start(void)
+{
+    if (current_cycle.magic == CYCLE_PROFILER_MAGIC && current_cycle.stamp_us[CYCLE_PHASE_SLEEP] != 0)
+    {
+        previous_cycle = current_cycle;
+    }
+    else
+    {
+        // First boot or the last cycle ended without sleep (reset, crash)
+        memset(&previous_cycle, 0, sizeof(previous_cycle));
+    }
+
+    uint32_t cycle = (current_cycle.magic == CYCLE_PROFILER_MAGIC) ? current_cycle.cycle + 1 : 0;
+    memset(&current_cycle, 0, sizeof(current_cycle));
+    current_cycle.magic = CYCLE_PROFILER_MAGIC;
+    current_cycle.cycle = cycle;
+    current_cycle.stamp_us[CYCLE_PHASE_BOOT] = cycle_profiler_now();
+}
+
+void cycle_profiler_init(void)
+{
+    cycle_start_us = 0;
+    cycle_profiler_start();
+}
+
+void cycle_profiler_resume(void)
+{
+    cycle_start_us = esp_timer_get_time();
+    cycle_profiler_start();
+    current_cycle.flags = CYCLE_FLAG_RESUMED;
+}
+
+void cycle_profiler_mark(cycle_phase_e phase)
+{
+    if (phase >= CYCLE_PHASE_MAX || current_cycle.stamp_us[phase] != 0)
+        return;
+
+    current_cycle.stamp_us[phase] = cycle_profiler_now();
+}
+
+void cycle_profiler_set_flags(uint32_t flags)
+{
+    current_cycle.flags |= flags;
+}
+
+void cycle_profiler_clear_flags(uint32_t flags)
+{
+    current_cycle.flags &= ~flags;
+}
+
+uint32_t cycle_profiler_get_us(cycle_phase_e phase)
+{
+    if (phase >= CYCLE_PHASE_MAX)
+        return 0;
+
+    return current_cycle.stamp_us[phase];
+}
+
+uint32_t cycle_profiler_get_previous_us(cycle_phase_e phase)
+{
+    if (phase >= CYCLE_PHASE_MAX)
+        return 0;
+
+    return previous_cycle.stamp_us[phase];
+}
+
+uint32_t cycle_profiler_get_previous_flags(void)
+{
+    return previous_cycle.flags;
+}
+
+void cycle_profiler_set_sleep_duration(uint32_t sleep_ms)
+{
+    current_cycle.sleep_ms = sleep_ms;
+}
+
+uint32_t cycle_profiler_get_previous_sleep_ms(void)
+{
+    return previous_cycle.sleep_ms;
+}
+
+bool cycle_profiler_has_previous(void)
+{
+    return previous_cycle.magic == CYCLE_PROFILER_MAGIC;
+}
+
+size_t cycle_profiler_format_previous(char *buffer, size_t buffer_len)
+{
+    if (!cycle_profiler_has_previous() || buffer == NULL)
+        return 0;
+
+    int len = snprintf(buffer, buffer_len, "{\"cycle\":%lu,\"sleep_ms\":%lu,\"flags\":%lu,\"t_ms\":[",
+                       (unsigned long) previous_cycle.cycle, (unsigned long) previous_cycle.sleep_ms,
+                       (unsigned long) previous_cycle.flags);
+    for (int i = 0; i < CYCLE_PHASE_MAX && len > 0 && (size_t) len < buffer_len; i++)
+    {
+        // Round up so a reached phase never shows as 0
+        unsigned long ms = (previous_cycle.stamp_us[i] + 999) / 1000;
+        len += snprintf(buffer + len, buffer_len - len, (i == 0) ? "%lu" : ",%lu", ms);
+    }
+
+    if (len > 0 && (size_t) len < buffer_len)
+        len += snprintf(buffer + len, buffer_len - len, "]}");
+
+    if (len <= 0 || (size_t) len >= buffer_len)
+        return 0;
+
+    return (size_t) len;
+}
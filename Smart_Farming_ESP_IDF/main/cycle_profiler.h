@@ -0,0 +1,120 @@
+/**
+ * Wake-cycle phase profiler. Records when each phase of a wake cycle was reached
+ * and keeps the record in RTC memory so the next wake can publish it.
+ */
+
+#ifndef CYCLE_PROFILER_H_
+#define CYCLE_PROFILER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Phases of one wake cycle, in the order they are normally reached
+typedef enum cycle_phase
+{
+    CYCLE_PHASE_BOOT = 0,       // app_main entered
+    CYCLE_PHASE_NVS_INIT,       // nvs_flash_init done
+    CYCLE_PHASE_WIFI_START,     // esp_wifi_start called, radio on
+    CYCLE_PHASE_WIFI_ASSOC,     // Associated with the AP
+    CYCLE_PHASE_DHCP,           // Got IP
+    CYCLE_PHASE_NETWORK_READY,  // Network connected callback called
+    CYCLE_PHASE_MQTT_CONNACK,   // MQTT_EVENT_CONNECTED
+    CYCLE_PHASE_SENSOR_READ,    // First complete sensor reading
+    CYCLE_PHASE_PUBLISH,        // Sensor data handed to the MQTT client
+    CYCLE_PHASE_SLEEP,          // About to enter deep sleep or light sleep
+    CYCLE_PHASE_MAX,
+} cycle_phase_e;
+
+// Flags of one wake cycle, published with the record so the phase timings can be split
+#define CYCLE_FLAG_FAST_CONNECT     0x01    // Wi-Fi connected to the cached BSSID and channel
+#define CYCLE_FLAG_STATIC_IP        0x02    // Cached DHCP lease used, no DHCP exchange
+#define CYCLE_FLAG_RESUMED          0x04    // Cycle started from light sleep, Wi-Fi and MQTT session kept
+#define CYCLE_FLAG_LIGHT_SLEEP      0x08    // Cycle ended with light sleep instead of deep sleep
+#define CYCLE_FLAG_RUN_TO_COMPLETION 0x10   // Cycle ran on the single run-to-completion task
+#define CYCLE_FLAG_CLOCK_SYNC       0x20    // SNTP sync started in this cycle
+
+/**
+ * @brief Start profiling a new wake cycle
+ * @note Call this first thing in app_main. The record of the cycle that ended
+ *       with deep sleep becomes the previous record.
+ */
+void cycle_profiler_init(void);
+
+/**
+ * @brief Start profiling a new cycle after a light sleep
+ * @note The record of the cycle that ended with light sleep becomes the previous record.
+ *       Timestamps of the new cycle count from this call.
+ */
+void cycle_profiler_resume(void);
+
+/**
+ * @brief Record the time a phase was reached
+ * @param phase Phase enum
+ * @note Only the first mark of each phase per cycle is kept
+ */
+void cycle_profiler_mark(cycle_phase_e phase);
+
+/**
+ * @brief Set flags of the current cycle
+ * @param flags CYCLE_FLAG_* bits, added to the flags already set
+ */
+void cycle_profiler_set_flags(uint32_t flags);
+
+/**
+ * @brief Clear flags of the current cycle
+ * @param flags CYCLE_FLAG_* bits
+ */
+void cycle_profiler_clear_flags(uint32_t flags);
+
+/**
+ * @brief Get the timestamp of a phase of the current cycle
+ * @param phase Phase enum
+ * @return Microseconds since the cycle started, 0 if the phase was not reached yet
+ */
+uint32_t cycle_profiler_get_us(cycle_phase_e phase);
+
+/**
+ * @brief Get the timestamp of a phase of the previous cycle
+ * @param phase Phase enum
+ * @return Microseconds since the cycle started, 0 if the phase was not reached or there is no previous record
+ */
+uint32_t cycle_profiler_get_previous_us(cycle_phase_e phase);
+
+/**
+ * @brief Get the flags of the previous cycle
+ * @return CYCLE_FLAG_* bits, 0 if there is no previous record
+ */
+uint32_t cycle_profiler_get_previous_flags(void);
+
+/**
+ * @brief Store the sleep duration that follows the current cycle
+ * @param sleep_ms Sleep duration in milliseconds
+ */
+void cycle_profiler_set_sleep_duration(uint32_t sleep_ms);
+
+/**
+ * @brief Get the sleep duration that followed the previous cycle
+ * @return Sleep duration in milliseconds, 0 if there is no previous record
+ */
+uint32_t cycle_profiler_get_previous_sleep_ms(void);
+
+/**
+ * @brief Check if the previous cycle record is available
+ * @return true if the previous cycle reached sleep and was recorded
+ */
+bool cycle_profiler_has_previous(void);
+
+/**
+ * @brief Format the previous cycle record as compact JSON
+ * @param buffer Output buffer
+ * @param buffer_len Size of the output buffer
+ * @return Number of characters written, 0 if there is no previous record or the buffer is too small
+ * @note Format: {"cycle":N,"sleep_ms":S,"flags":F,"t_ms":[boot,nvs,wifi_start,wifi,dhcp,net,connack,sensor,publish,sleep]}
+ *       Each t_ms value is milliseconds since the cycle started (boot or light sleep resume), 0 means
+ *       the phase was not reached. sleep_ms is the sleep duration that followed the cycle, flags are
+ *       the CYCLE_FLAG_* bits.
+ */
+size_t cycle_profiler_format_previous(char *buffer, size_t buffer_len);
+
+#endif /* CYCLE_PROFILER_H_ */
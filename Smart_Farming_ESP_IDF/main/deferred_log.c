@@ -0,0 +1,174 @@
+#include "deferred_log.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+
+#include "remote_config.h"
+
+#if DEFERRED_LOG_ENABLE
+// Marks the RTC memory below as written by this firmware, it is random after power-on
+#define DEFERRED_LOG_MAGIC  0x444C4F47u // "DLOG"
+
+typedef struct deferred_log_entry
+{
+    uint32_t time_ms;       // esp_log_timestamp of the wake
+    uint16_t id;
+    uint8_t level;
+    uint8_t wake;           // Low byte of the wake number, separates the wakes in the ring
+    uint32_t args[DEFERRED_LOG_MAX_ARGS];
+} deferred_log_entry_t;
+
+_Static_assert(sizeof(deferred_log_entry_t) == DEFERRED_LOG_ENTRY_SIZE, "Entry layout is part of the record format");
+_Static_assert(DLOG_ID_MAX <= UINT16_MAX, "Message ID does not fit the entry");
+
+typedef struct deferred_log_ring
+{
+    uint32_t magic;
+    uint32_t wake;
+    uint32_t head;              // Next entry to write
+    uint32_t count;
+    uint32_t dropped;           // Overwritten since the last drain
+    uint32_t drained_request;   // "log_req" of the last drain
+    deferred_log_entry_t entries[DEFERRED_LOG_ENTRIES];
+} deferred_log_ring_t;
+
+// Kept across deep sleep and restarts, a crash loop can be read out afterwards
+static RTC_NOINIT_ATTR deferred_log_ring_t ring;
+
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Drained ring, handed to the MQTT client
+static uint8_t drain_record[DEFERRED_LOG_RECORD_SIZE];
+
+/**
+ * @brief Write a 32-bit value little endian
+ * @note Helper function for deferred_log_drain
+ */
+static uint8_t *deferred_log_put_u32(uint8_t *out, uint32_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+    return out + 4;
+}
+#endif
+
+void deferred_log_init(void)
+{
+#if DEFERRED_LOG_ENABLE
+    if (ring.magic != DEFERRED_LOG_MAGIC || ring.head >= DEFERRED_LOG_ENTRIES || ring.count > DEFERRED_LOG_ENTRIES)
+    {
+        memset(&ring, 0, sizeof(ring));
+        ring.magic = DEFERRED_LOG_MAGIC;
+    }
+    ring.wake++;
+#endif
+}
+
+void deferred_log_write(esp_log_level_t level, deferred_log_id_e id, uint32_t nargs, ...)
+{
+#if DEFERRED_LOG_ENABLE
+    // Before deferred_log_init the ring may hold random data
+    if (ring.magic != DEFERRED_LOG_MAGIC)
+        return;
+
+    deferred_log_entry_t entry = {
+        .time_ms = esp_log_timestamp(),
+        .id = (uint16_t) id,
+        .level = (uint8_t) level,
+        .wake = (uint8_t) ring.wake,
+    };
+
+    va_list args;
+    va_start(args, nargs);
+    for (uint32_t i = 0; i < nargs && i < DEFERRED_LOG_MAX_ARGS; i++)
+    {
+        entry.args[i] = va_arg(args, uint32_t);
+    }
+    va_end(args);
+
+    portENTER_CRITICAL(&ring_lock);
+    ring.entries[ring.head] = entry;
+    ring.head = (ring.head + 1) % DEFERRED_LOG_ENTRIES;
+    if (ring.count < DEFERRED_LOG_ENTRIES)
+        ring.count++;
+    else
+        ring.dropped++;
+    portEXIT_CRITICAL(&ring_lock);
+#else
+    (void) level;
+    (void) id;
+    (void) nargs;
+#endif
+}
+
+uint32_t deferred_log_float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+size_t deferred_log_drain(const uint8_t **record)
+{
+#if DEFERRED_LOG_ENABLE
+    uint8_t *out = drain_record;
+
+    portENTER_CRITICAL(&ring_lock);
+    uint32_t count = ring.count;
+    out[0] = DEFERRED_LOG_VERSION;
+    out[1] = DEFERRED_LOG_ENTRY_SIZE;
+    out[2] = count & 0xFF;
+    out[3] = (count >> 8) & 0xFF;
+    out = deferred_log_put_u32(&out[4], ring.dropped);
+
+    uint32_t index = (ring.head + DEFERRED_LOG_ENTRIES - count) % DEFERRED_LOG_ENTRIES;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const deferred_log_entry_t *entry = &ring.entries[index];
+        out = deferred_log_put_u32(out, entry->time_ms);
+        out[0] = entry->id & 0xFF;
+        out[1] = (entry->id >> 8) & 0xFF;
+        out[2] = entry->level;
+        out[3] = entry->wake;
+        out += 4;
+        for (int j = 0; j < DEFERRED_LOG_MAX_ARGS; j++)
+        {
+            out = deferred_log_put_u32(out, entry->args[j]);
+        }
+        index = (index + 1) % DEFERRED_LOG_ENTRIES;
+    }
+
+    ring.count = 0;
+    ring.dropped = 0;
+    portEXIT_CRITICAL(&ring_lock);
+
+    *record = drain_record;
+    return (count > 0) ? (size_t) (out - drain_record) : 0;
+#else
+    *record = NULL;
+    return 0;
+#endif
+}
+
+size_t deferred_log_drain_requested(const uint8_t **record)
+{
+#if DEFERRED_LOG_ENABLE
+    uint32_t request = remote_config_get_log_request();
+    if (request == ring.drained_request)
+    {
+        *record = NULL;
+        return 0;
+    }
+
+    ring.drained_request = request;
+    return deferred_log_drain(record);
+#else
+    *record = NULL;
+    return 0;
+#endif
+}
@@ -0,0 +1,164 @@
+/**
+ * Deferred binary logging. The event handlers of the wake cycle log on every
+ * Wi-Fi and MQTT event; at 115200 baud each line holds the calling task for a
+ * few milliseconds. With DEFERRED_LOG_ENABLE set, the DEFERRED_LOGx macros
+ * store a 20 byte entry instead (time, message ID, level and up to three
+ * 32-bit arguments) in a ring in RTC memory. The ring survives deep sleep and
+ * restarts, so it holds the last few wakes, and it is only read out on request:
+ *
+ *   - over MQTT, when the "log_req" number of the remote config changes the next
+ *     MQTT wake publishes the ring as binary on /smartfarming/<device id>/log
+ *   - in the host build, each run prints the ring as a "host/log" line
+ *
+ * tools/log_decode.py turns the entries back into log lines. It reads the
+ * message IDs from deferred_log_id_e below and the format and tag of each ID
+ * from its DEFERRED_LOGx call in main/, so the decoder needs the source of the
+ * firmware that wrote the log.
+ *
+ * Rules for a deferred message: one ID per message, the format is a single
+ * string literal, and the arguments are integers (%d, %u, %x) or floats passed
+ * through DEFERRED_LOG_FLOAT (%f). Strings and pointers cannot be deferred, keep
+ * ESP_LOGx for those and for errors, which should reach the console at once.
+ * Without DEFERRED_LOG_ENABLE the macros are the ESP_LOGx calls they replace.
+ */
+
+#ifndef DEFERRED_LOG_H_
+#define DEFERRED_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_log.h"
+
+// 1 = hot path messages go to the RTC ring, 0 = they are printed at once
+#define DEFERRED_LOG_ENABLE         1
+
+// Ring size in entries, the oldest entry is overwritten when full
+#define DEFERRED_LOG_ENTRIES        64
+#define DEFERRED_LOG_MAX_ARGS       3
+
+// Record published on the log topic: version, entry size, entry count and
+// entries dropped since the last drain, then the entries oldest first, little endian
+#define DEFERRED_LOG_VERSION        1
+#define DEFERRED_LOG_HEADER_SIZE    8
+#define DEFERRED_LOG_ENTRY_SIZE     (8 + 4 * DEFERRED_LOG_MAX_ARGS)
+#define DEFERRED_LOG_RECORD_SIZE    (DEFERRED_LOG_HEADER_SIZE + DEFERRED_LOG_ENTRIES * DEFERRED_LOG_ENTRY_SIZE)
+
+// Message IDs, append only so older logs still decode
+typedef enum deferred_log_id
+{
+    // My_MQTT_task
+    DLOG_MQTT_CONNECTED = 0,
+    DLOG_MQTT_SUBSCRIBING,
+    DLOG_MQTT_DISCONNECTED,
+    DLOG_MQTT_SUBSCRIBED,
+    DLOG_MQTT_UNSUBSCRIBED,
+    DLOG_MQTT_PUBLISHED,
+    DLOG_MQTT_DATA,
+    DLOG_MQTT_ERROR,
+    DLOG_MQTT_OTHER_EVENT,
+
+    // network_connection
+    DLOG_NETWORK_IP_EVENT,
+    DLOG_NETWORK_LOST_IP,
+    DLOG_NETWORK_IP_NOT_HANDLED,
+    DLOG_NETWORK_WIFI_EVENT,
+    DLOG_NETWORK_WIFI_READY,
+    DLOG_NETWORK_WIFI_SCAN_DONE,
+    DLOG_NETWORK_WIFI_STARTED,
+    DLOG_NETWORK_WIFI_STOPPED,
+    DLOG_NETWORK_WIFI_CONNECTED,
+    DLOG_NETWORK_WIFI_DISCONNECTED,
+    DLOG_NETWORK_WIFI_RETRY,
+    DLOG_NETWORK_WIFI_AUTHMODE,
+    DLOG_NETWORK_WIFI_NOT_HANDLED,
+
+    // sensor_interface_task
+    DLOG_SENSOR_ADC_READY,
+    DLOG_SENSOR_READING_DHT,
+    DLOG_SENSOR_VALUES,
+
+    // run_to_completion
+    DLOG_CYCLE_MQTT_CONNECTED,
+    DLOG_CYCLE_MQTT_DISCONNECTED,
+    DLOG_CYCLE_MQTT_PUBLISHED,
+
+    // continuous_mode
+    DLOG_CONTINUOUS_MQTT_CONNECTED,
+    DLOG_CONTINUOUS_MQTT_DISCONNECTED,
+    DLOG_CONTINUOUS_MQTT_ERROR,
+
+    // sleep_manager
+    DLOG_SLEEP_RESUMED,
+
+    DLOG_ID_MAX
+} deferred_log_id_e;
+
+#if DEFERRED_LOG_ENABLE
+// Number of arguments, a fourth one fails with DEFERRED_LOG_CAST_TOO_MANY
+#define DEFERRED_LOG_NARGS(...)                 DEFERRED_LOG_NARGS_(0, ##__VA_ARGS__, TOO_MANY, 3, 2, 1, 0)
+#define DEFERRED_LOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define DEFERRED_LOG_CAT(a, b)                  DEFERRED_LOG_CAT_(a, b)
+#define DEFERRED_LOG_CAT_(a, b)                 a##b
+#define DEFERRED_LOG_CAST_0()
+#define DEFERRED_LOG_CAST_1(a)                  , (uint32_t) (a)
+#define DEFERRED_LOG_CAST_2(a, b)               , (uint32_t) (a), (uint32_t) (b)
+#define DEFERRED_LOG_CAST_3(a, b, c)            , (uint32_t) (a), (uint32_t) (b), (uint32_t) (c)
+
+#define DEFERRED_LOG(level, id, ...) \
+    deferred_log_write(level, id, DEFERRED_LOG_NARGS(__VA_ARGS__) \
+                       DEFERRED_LOG_CAT(DEFERRED_LOG_CAST_, DEFERRED_LOG_NARGS(__VA_ARGS__))(__VA_ARGS__))
+
+#define DEFERRED_LOGW(tag, id, format, ...)     DEFERRED_LOG(ESP_LOG_WARN, id, ##__VA_ARGS__)
+#define DEFERRED_LOGI(tag, id, format, ...)     DEFERRED_LOG(ESP_LOG_INFO, id, ##__VA_ARGS__)
+#define DEFERRED_LOGD(tag, id, format, ...)     DEFERRED_LOG(ESP_LOG_DEBUG, id, ##__VA_ARGS__)
+
+// Float argument, stored as its bits
+#define DEFERRED_LOG_FLOAT(value)               deferred_log_float_bits(value)
+#else
+#define DEFERRED_LOGW(tag, id, format, ...)     ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define DEFERRED_LOGI(tag, id, format, ...)     ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define DEFERRED_LOGD(tag, id, format, ...)     ESP_LOGD(tag, format, ##__VA_ARGS__)
+
+#define DEFERRED_LOG_FLOAT(value)               ((double) (value))
+#endif
+
+/**
+ * @brief Check the ring kept in RTC memory and start a new wake in it
+ * @note Call early in app_main, after error_handler_init
+ */
+void deferred_log_init(void);
+
+/**
+ * @brief Store a log entry
+ * @param level ESP log level
+ * @param id Message ID
+ * @param nargs Number of arguments, at most DEFERRED_LOG_MAX_ARGS
+ * @param ... uint32_t arguments
+ * @note Use the DEFERRED_LOGx macros. Safe from any task on both cores.
+ */
+void deferred_log_write(esp_log_level_t level, deferred_log_id_e id, uint32_t nargs, ...);
+
+/**
+ * @brief Get the bits of a float argument
+ * @param value Float value
+ * @return IEEE 754 bits
+ */
+uint32_t deferred_log_float_bits(float value);
+
+/**
+ * @brief Move the ring into the log record and empty it
+ * @param record Output, the record, valid until the next drain
+ * @return Record length in bytes, 0 if the ring is empty or DEFERRED_LOG_ENABLE is not set
+ */
+size_t deferred_log_drain(const uint8_t **record);
+
+/**
+ * @brief Drain the ring if the remote config asked for the log since the last drain
+ * @param record Output, the record, valid until the next drain
+ * @return Record length in bytes, 0 if there is no new request
+ * @note Called by the MQTT uplinks before the sensor data, the record goes to the log topic
+ */
+size_t deferred_log_drain_requested(const uint8_t **record);
+
+#endif /* DEFERRED_LOG_H_ */
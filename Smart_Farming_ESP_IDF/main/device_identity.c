@@ -0,0 +1,50 @@
+#include "device_identity.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_mac.h"
+
+static const char TAG[] = "device_id";
+
+static char device_id[DEVICE_ID_MAX_LEN];
+static bool device_id_ready = false;
+
+void device_identity_format_id(const uint8_t mac[6], char *buffer)
+{
+    snprintf(buffer, DEVICE_ID_MAX_LEN, DEVICE_ID_PREFIX "%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+const char *device_identity_get_id(void)
+{
+    if (!device_id_ready)
+    {
+        // Read from eFuse, the Wi-Fi driver does not have to be started
+        uint8_t mac[6] = { 0 };
+        esp_err_t err = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to read MAC address: %s", esp_err_to_name(err));
+        }
+
+        device_identity_format_id(mac, device_id);
+        device_id_ready = true;
+        ESP_LOGI(TAG, "Device ID %s", device_id);
+    }
+
+    return device_id;
+}
+
+size_t device_identity_topic(const char *leaf, char *buffer, size_t size)
+{
+    int len = snprintf(buffer, size, DEVICE_TOPIC_ROOT "/%s/%s", device_identity_get_id(), leaf);
+    if (len < 0 || (size_t) len >= size)
+    {
+        ESP_LOGE(TAG, "Topic for %s does not fit", leaf);
+        return 0;
+    }
+
+    return (size_t) len;
+}
@@ -0,0 +1,43 @@
+/**
+ * Device identity. Every node derives its MQTT client ID and topics from the
+ * factory MAC address, so nodes running the same firmware do not share a
+ * persistent session and the ingest side can tell them apart.
+ *
+ * Topic layout: DEVICE_TOPIC_ROOT "/" <device id> "/" <leaf>, for example
+ * /smartfarming/sf-240ac4123456/data
+ */
+
+#ifndef DEVICE_IDENTITY_H_
+#define DEVICE_IDENTITY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEVICE_ID_PREFIX        "sf-"
+#define DEVICE_ID_MAX_LEN       (sizeof(DEVICE_ID_PREFIX) - 1 + 12 + 1)
+#define DEVICE_TOPIC_ROOT       "/smartfarming"
+#define DEVICE_TOPIC_MAX_LEN    64
+
+/**
+ * @brief Get the ID of this device, DEVICE_ID_PREFIX followed by the station MAC address in hex
+ * @return Device ID
+ */
+const char *device_identity_get_id(void);
+
+/**
+ * @brief Format the ID of another device, e.g. an ESP-NOW node seen by the gateway
+ * @param mac MAC address
+ * @param buffer Output buffer, at least DEVICE_ID_MAX_LEN bytes
+ */
+void device_identity_format_id(const uint8_t mac[6], char *buffer);
+
+/**
+ * @brief Build a per-device topic
+ * @param leaf Last topic level, e.g. "data"
+ * @param buffer Output buffer
+ * @param size Buffer size, DEVICE_TOPIC_MAX_LEN is enough for the topics used here
+ * @return Topic length, 0 if it did not fit
+ */
+size_t device_identity_topic(const char *leaf, char *buffer, size_t size);
+
+#endif /* DEVICE_IDENTITY_H_ */
@@ -0,0 +1,14 @@
+/**
+ * Device role, chosen at build time. A sensor node reads the sensors and sleeps,
+ * the ESP-NOW gateway is always on and forwards the frames of the nodes (see
+ * espnow_link.h).
+ */
+
+#ifndef DEVICE_ROLE_H_
+#define DEVICE_ROLE_H_
+
+#define DEVICE_ROLE_SENSOR          0
+#define DEVICE_ROLE_GATEWAY         1
+#define DEVICE_ROLE                 DEVICE_ROLE_SENSOR
+
+#endif /* DEVICE_ROLE_H_ */
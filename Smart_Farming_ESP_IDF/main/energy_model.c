@@ -0,0 +1,105 @@
+#include "energy_model.h"
+
+#include <stddef.h>
+
+#include "cycle_profiler.h"
+
+#define MS_PER_HOUR 3600000.0f
+
+void energy_model_default_coefficients(energy_coefficients_t *coeff)
+{
+    coeff->cpu_active_ma = ENERGY_CPU_ACTIVE_MA;
+    coeff->wifi_on_ma = ENERGY_WIFI_ON_MA;
+    coeff->sensor_ma = ENERGY_SENSOR_MA;
+    coeff->deep_sleep_ma = ENERGY_DEEP_SLEEP_MA;
+    coeff->light_sleep_ma = ENERGY_LIGHT_SLEEP_MA;
+    coeff->wifi_modem_ma = ENERGY_WIFI_MODEM_MA;
+    coeff->battery_mah = ENERGY_BATTERY_MAH;
+}
+
+bool energy_model_compute(const energy_coefficients_t *coeff, const energy_phase_durations_t *durations, energy_report_t *report)
+{
+    if (coeff == NULL || durations == NULL || report == NULL)
+        return false;
+
+    float period_ms = (float) durations->cpu_active_ms + (float) durations->deep_sleep_ms + (float) durations->light_sleep_ms;
+    if (period_ms <= 0.0f)
+        return false;
+
+    // mA * ms
+    float wake_charge = coeff->cpu_active_ma * (float) durations->cpu_active_ms
+                      + coeff->wifi_on_ma * (float) durations->wifi_on_ms
+                      + coeff->sensor_ma * (float) durations->sensor_on_ms;
+    // The board current applies in both sleep modes
+    float charge = wake_charge
+                 + coeff->deep_sleep_ma * (float) durations->deep_sleep_ms
+                 + (coeff->deep_sleep_ma + coeff->light_sleep_ma + coeff->wifi_modem_ma) * (float) durations->light_sleep_ms;
+
+    report->cycle_mah = charge / MS_PER_HOUR;
+    report->wake_mah = wake_charge / MS_PER_HOUR;
+    report->average_ma = charge / period_ms;
+    report->battery_life_h = (report->average_ma > 0.0f) ? coeff->battery_mah / report->average_ma : 0.0f;
+
+    return true;
+}
+
+bool energy_model_continuous(const energy_coefficients_t *coeff, const energy_continuous_durations_t *durations, energy_report_t *report)
+{
+    if (coeff == NULL || durations == NULL || report == NULL || durations->period_ms == 0)
+        return false;
+
+    uint32_t active_ms = (durations->active_ms < durations->period_ms) ? durations->active_ms : durations->period_ms;
+    float idle_ms = (float) (durations->period_ms - active_ms);
+
+    // mA * ms
+    float wake_charge = (coeff->cpu_active_ma + coeff->wifi_on_ma) * (float) active_ms
+                      + coeff->sensor_ma * (float) durations->sensor_on_ms;
+    float charge = wake_charge
+                 + (coeff->light_sleep_ma + coeff->wifi_modem_ma) * idle_ms
+                 + coeff->deep_sleep_ma * (float) durations->period_ms;
+
+    report->cycle_mah = charge / MS_PER_HOUR;
+    report->wake_mah = wake_charge / MS_PER_HOUR;
+    report->average_ma = charge / (float) durations->period_ms;
+    report->battery_life_h = (report->average_ma > 0.0f) ? coeff->battery_mah / report->average_ma : 0.0f;
+
+    return true;
+}
+
+bool energy_model_previous_cycle(energy_report_t *report)
+{
+    if (!cycle_profiler_has_previous())
+        return false;
+
+    uint32_t boot_us = cycle_profiler_get_previous_us(CYCLE_PHASE_BOOT);
+    uint32_t sleep_us = cycle_profiler_get_previous_us(CYCLE_PHASE_SLEEP);
+    uint32_t wifi_us = cycle_profiler_get_previous_us(CYCLE_PHASE_WIFI_START);
+    uint32_t nvs_us = cycle_profiler_get_previous_us(CYCLE_PHASE_NVS_INIT);
+    uint32_t sensor_us = cycle_profiler_get_previous_us(CYCLE_PHASE_SENSOR_READ);
+    uint32_t flags = cycle_profiler_get_previous_flags();
+
+    if (sleep_us == 0 || sleep_us < boot_us)
+        return false;
+
+    energy_phase_durations_t durations = {
+        // esp_timer counts from early boot (or from the resume), so this covers the whole awake time
+        .cpu_active_ms = sleep_us / 1000,
+        .wifi_on_ms = (wifi_us != 0 && wifi_us < sleep_us) ? (sleep_us - wifi_us) / 1000 : 0,
+        // Sensor task starts right after NVS init
+        .sensor_on_ms = (sensor_us > nvs_us && nvs_us != 0) ? (sensor_us - nvs_us) / 1000 : 0,
+    };
+
+    // Wi-Fi stayed connected through the light sleep
+    if (flags & CYCLE_FLAG_RESUMED)
+        durations.wifi_on_ms = durations.cpu_active_ms;
+
+    if (flags & CYCLE_FLAG_LIGHT_SLEEP)
+        durations.light_sleep_ms = cycle_profiler_get_previous_sleep_ms();
+    else
+        durations.deep_sleep_ms = cycle_profiler_get_previous_sleep_ms();
+
+    energy_coefficients_t coeff;
+    energy_model_default_coefficients(&coeff);
+
+    return energy_model_compute(&coeff, &durations, report);
+}
@@ -0,0 +1,95 @@
+/**
+ * Energy accounting per wake cycle. Combines the measured phase durations with
+ * per-state current coefficients to estimate the charge used by each cycle.
+ */
+
+#ifndef ENERGY_MODEL_H_
+#define ENERGY_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Current coefficients in mA, measured on ESP32 DevKitC (see Pictures directory)
+// Wi-Fi current is on top of the CPU active current (45 + 85 = ~130 mA while connected)
+#define ENERGY_CPU_ACTIVE_MA    45.0f
+#define ENERGY_WIFI_ON_MA       85.0f
+#define ENERGY_SENSOR_MA        1.5f    // DHT22 and ADS111x while measuring
+#define ENERGY_DEEP_SLEEP_MA    20.0f   // Includes the power LED and the DHT22 idle current
+#define ENERGY_LIGHT_SLEEP_MA   0.8f    // Chip in automatic light sleep, on top of the board current
+#define ENERGY_WIFI_MODEM_MA    4.0f    // Average Wi-Fi current in modem sleep (DTIM 1), on top of the board current
+#define ENERGY_BATTERY_MAH      2000.0f
+
+// Per-state current coefficients
+typedef struct energy_coefficients
+{
+    float cpu_active_ma;
+    float wifi_on_ma;
+    float sensor_ma;
+    float deep_sleep_ma;
+    float light_sleep_ma;
+    float wifi_modem_ma;
+    float battery_mah;
+} energy_coefficients_t;
+
+// Time spent in each power state during one cycle
+typedef struct energy_phase_durations
+{
+    uint32_t cpu_active_ms;     // Boot or resume to sleep
+    uint32_t wifi_on_ms;        // esp_wifi_start to sleep, the whole awake time after a resume
+    uint32_t sensor_on_ms;      // Sensors measuring
+    uint32_t deep_sleep_ms;     // Deep sleep that followed the cycle
+    uint32_t light_sleep_ms;    // Light sleep with Wi-Fi in modem sleep that followed the cycle
+} energy_phase_durations_t;
+
+// Time spent in each power state during one report period of the continuous mode
+typedef struct energy_continuous_durations
+{
+    uint32_t period_ms;         // Report period
+    uint32_t active_ms;         // CPU and radio busy with sampling and publishing
+    uint32_t sensor_on_ms;      // Sensors measuring
+} energy_continuous_durations_t;
+
+typedef struct energy_report
+{
+    float cycle_mah;            // Charge used by one cycle
+    float wake_mah;             // Charge used by the awake part of the cycle
+    float average_ma;           // Average current over one cycle
+    float battery_life_h;       // Projected battery life at this cycle cost
+} energy_report_t;
+
+/**
+ * @brief Fill coefficient structure with the configured values
+ * @param coeff Address of coefficient structure
+ */
+void energy_model_default_coefficients(energy_coefficients_t *coeff);
+
+/**
+ * @brief Compute the charge used by one cycle and the projected battery life
+ * @note A cycle is followed by either deep sleep or light sleep, the other duration is 0
+ * @param coeff Address of coefficient structure
+ * @param durations Address of phase duration structure
+ * @param report Address of the output report structure
+ * @return true if success, false if the cycle has zero length
+ */
+bool energy_model_compute(const energy_coefficients_t *coeff, const energy_phase_durations_t *durations, energy_report_t *report);
+
+/**
+ * @brief Compute the average current of the continuous mode
+ * @param coeff Address of coefficient structure
+ * @param durations Address of continuous duration structure
+ * @param report Address of the output report structure, cycle_mah is the charge of the whole period
+ *        and wake_mah the charge of the active time
+ * @return true if success, false if the period has zero length
+ * @note Outside the active time the chip is in light sleep and Wi-Fi in modem sleep.
+ *       The board current (power LED, DHT22 idle) is the deep sleep coefficient and applies all the time.
+ */
+bool energy_model_continuous(const energy_coefficients_t *coeff, const energy_continuous_durations_t *durations, energy_report_t *report);
+
+/**
+ * @brief Compute the energy report of the previous wake cycle from the cycle profiler record
+ * @param report Address of the output report structure
+ * @return true if success, false if there is no complete previous cycle record
+ */
+bool energy_model_previous_cycle(energy_report_t *report);
+
+#endif /* ENERGY_MODEL_H_ */
@@ -1,8 +1,86 @@
 #include "error_handler.h"
 
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
+
+#include "device_role.h"
+#include "wake_budget.h"
+
+// Marks the RTC memory below as written by this firmware, it is random after power-on
+#define ERROR_HANDLER_MAGIC 0x5F4C7A3Du
+
+// Kept across restarts and deep sleep
+static RTC_NOINIT_ATTR uint32_t restart_magic;
+static RTC_NOINIT_ATTR uint32_t restart_count;
+
+/**
+ * @brief Deep sleep with the fault backoff
+ * @param error_source TAG for the log
+ * @note Helper function, does not return
+ */
+static void error_handler_sleep(const char* error_source)
+{
+    uint32_t sleep_sec = wake_budget_backoff_sec(ERROR_HANDLER_SLEEP_SEC, restart_count - ERROR_HANDLER_RESTARTS_BEFORE_SLEEP);
+    ESP_LOGW(error_source, "%lu restarts in a row, sleeping %lus instead", (unsigned long) restart_count, (unsigned long) sleep_sec);
+
+    esp_wifi_stop();
+    esp_sleep_enable_timer_wakeup((uint64_t) sleep_sec * 1000000);
+    esp_deep_sleep_start();
+}
+
+void error_handler_init(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (restart_magic != ERROR_HANDLER_MAGIC || reason == ESP_RST_POWERON)
+    {
+        restart_magic = ERROR_HANDLER_MAGIC;
+        restart_count = 0;
+        return;
+    }
+
+    // my_error_handler counted its own restart, these are the crashes
+    if (reason != ESP_RST_PANIC && reason != ESP_RST_INT_WDT && reason != ESP_RST_TASK_WDT &&
+        reason != ESP_RST_WDT && reason != ESP_RST_BROWNOUT)
+        return;
+
+    restart_count++;
+    ESP_LOGW("error_handler", "Reset reason %d, %lu restarts in a row", (int) reason, (unsigned long) restart_count);
+#if DEVICE_ROLE != DEVICE_ROLE_GATEWAY
+    if (restart_count >= ERROR_HANDLER_RESTARTS_BEFORE_SLEEP)
+    {
+        error_handler_sleep("error_handler");
+    }
+#endif
+#else
+    // Every run of the host build is a power-on
+    restart_magic = ERROR_HANDLER_MAGIC;
+    restart_count = 0;
+#endif
+}
+
+void error_handler_clear(void)
+{
+    restart_count = 0;
+}
+
+uint32_t error_handler_restart_count(void)
+{
+    return restart_count;
+}
+
 void my_error_handler(const char* error_source)
 {
+    restart_count++;
+#if DEVICE_ROLE != DEVICE_ROLE_GATEWAY
+    if (restart_count >= ERROR_HANDLER_RESTARTS_BEFORE_SLEEP)
+    {
+        error_handler_sleep(error_source);
+    }
+#endif
+
     ESP_LOGI(error_source, "Restarting device...");
-    vTaskDelay(pdMS_TO_TICKS(3000));
+    vTaskDelay(pdMS_TO_TICKS(ERROR_HANDLER_RESTART_DELAY_MS));
     esp_restart();
 }
\ No newline at end of file
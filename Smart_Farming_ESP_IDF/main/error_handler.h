@@ -1,3 +1,22 @@
+/**
+ * Fault recovery. A failing sensor does not reboot the node, the sensor interface
+ * climbs a ladder and only the last step gets here:
+ *
+ *   1. retry the operation
+ *   2. reset the I2C bus and probe the ADS111x again, re-initialise the DHT22 pin
+ *   3. mark the sensor unavailable and publish without its fields
+ *   4. my_error_handler(), for the faults the node cannot work around
+ *      (task and event group creation, sensor interface init on the benchmark)
+ *
+ * A failed Wi-Fi or broker connection is not a fault, the wake budget backs off
+ * the deep sleep. The restarts of my_error_handler and the crashes (panic,
+ * watchdog, brownout) are counted in RTC memory that survives a restart. After
+ * ERROR_HANDLER_RESTARTS_BEFORE_SLEEP of them without a delivered uplink the node
+ * deep sleeps with an exponential backoff instead of rebooting straight away,
+ * so a broken part does not drain the battery in a reboot loop. The always-on
+ * gateway has nothing to sleep for and keeps restarting.
+ */
+
 #ifndef ERROR_HANDLER_H_
 #define ERROR_HANDLER_H_
 
@@ -6,10 +25,38 @@
 #include "esp_log.h"
 #include "esp_system.h"
 
+// Restarts in a row before the node sleeps instead
+#define ERROR_HANDLER_RESTARTS_BEFORE_SLEEP 3
+
+// First fault sleep, doubled for each further restart up to WAKE_BUDGET_MAX_SLEEP_SEC
+#define ERROR_HANDLER_SLEEP_SEC             60
+
+// Delay before the restart, lets the log reach the console
+#define ERROR_HANDLER_RESTART_DELAY_MS      3000
+
+/**
+ * @brief Count a crash of the previous boot and back off if the node is in a restart loop
+ * @note Call first in app_main. Does not return if the node has to sleep.
+ */
+void error_handler_init(void);
+
+/**
+ * @brief Reset the restart count
+ * @note Called when an uplink is delivered, the node works again
+ */
+void error_handler_clear(void);
+
+/**
+ * @brief Get the restarts and crashes since the last delivered uplink
+ * @return Restart count
+ */
+uint32_t error_handler_restart_count(void);
+
 /**
- * @brief General error handler
+ * @brief General error handler, last step of the recovery ladder
  * @param error_source Appropriate TAG where the error happened
- * @note Just restart the device for now
+ * @note Restarts the device, or deep sleeps with a backoff once the node
+ *       restarted ERROR_HANDLER_RESTARTS_BEFORE_SLEEP times in a row
  */
 void my_error_handler(const char* error_source);
 
@@ -0,0 +1,199 @@
+#include "espnow_frame.h"
+
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief CRC-16/CCITT-FALSE
+ * @note Helper function for frame encoding and decoding
+ */
+static uint16_t espnow_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t) data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+    return crc;
+}
+
+static void espnow_put_u16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = (uint8_t) (value >> 8);
+    buffer[1] = (uint8_t) value;
+}
+
+static void espnow_put_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t) (value >> 24);
+    buffer[1] = (uint8_t) (value >> 16);
+    buffer[2] = (uint8_t) (value >> 8);
+    buffer[3] = (uint8_t) value;
+}
+
+static uint16_t espnow_get_u16(const uint8_t *buffer)
+{
+    return (uint16_t) ((buffer[0] << 8) | buffer[1]);
+}
+
+static uint32_t espnow_get_u32(const uint8_t *buffer)
+{
+    return ((uint32_t) buffer[0] << 24) | ((uint32_t) buffer[1] << 16) | ((uint32_t) buffer[2] << 8) | buffer[3];
+}
+
+size_t espnow_frame_encode(uint32_t session, uint32_t sequence, const espnow_reading_t *readings, uint8_t count, uint8_t *buffer)
+{
+    if (count == 0 || count > ESPNOW_FRAME_MAX_READINGS)
+        return 0;
+
+    buffer[0] = 'S';
+    buffer[1] = 'N';
+    buffer[2] = ESPNOW_FRAME_VERSION;
+    buffer[3] = count;
+    espnow_put_u32(&buffer[4], session);
+    espnow_put_u32(&buffer[8], sequence);
+
+    uint8_t *out = &buffer[ESPNOW_FRAME_HEADER_LEN];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        espnow_put_u16(&out[0], (uint16_t) readings[i].temperature_dc);
+        espnow_put_u16(&out[2], readings[i].humidity_dpct);
+        espnow_put_u16(&out[4], readings[i].soil_raw);
+        espnow_put_u32(&out[6], readings[i].age_sec);
+        out += ESPNOW_FRAME_READING_LEN;
+    }
+
+    size_t len = (size_t) (out - buffer);
+    espnow_put_u16(out, espnow_crc16(buffer, len));
+
+    return len + ESPNOW_FRAME_CRC_LEN;
+}
+
+bool espnow_frame_decode(const uint8_t *mac, const uint8_t *data, size_t len, espnow_frame_t *frame)
+{
+    if (len < ESPNOW_FRAME_HEADER_LEN + ESPNOW_FRAME_READING_LEN + ESPNOW_FRAME_CRC_LEN)
+        return false;
+
+    if (data[0] != 'S' || data[1] != 'N' || data[2] != ESPNOW_FRAME_VERSION)
+        return false;
+
+    uint8_t count = data[3];
+    if (count == 0 || count > ESPNOW_FRAME_MAX_READINGS ||
+        len != ESPNOW_FRAME_HEADER_LEN + (size_t) count * ESPNOW_FRAME_READING_LEN + ESPNOW_FRAME_CRC_LEN)
+        return false;
+
+    if (espnow_get_u16(&data[len - ESPNOW_FRAME_CRC_LEN]) != espnow_crc16(data, len - ESPNOW_FRAME_CRC_LEN))
+        return false;
+
+    memcpy(frame->mac, mac, sizeof(frame->mac));
+    frame->session = espnow_get_u32(&data[4]);
+    frame->sequence = espnow_get_u32(&data[8]);
+    frame->count = count;
+    frame->received_sec = 0;
+
+    const uint8_t *in = &data[ESPNOW_FRAME_HEADER_LEN];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        frame->readings[i].temperature_dc = (int16_t) espnow_get_u16(&in[0]);
+        frame->readings[i].humidity_dpct = espnow_get_u16(&in[2]);
+        frame->readings[i].soil_raw = espnow_get_u16(&in[4]);
+        frame->readings[i].age_sec = espnow_get_u32(&in[6]);
+        in += ESPNOW_FRAME_READING_LEN;
+    }
+
+    return true;
+}
+
+espnow_reading_t espnow_reading_from_float(float temperature, float humidity, float soil_moisture, uint32_t age_sec)
+{
+    float temperature_dc = temperature * 10.0f;
+    float humidity_dpct = humidity * 10.0f;
+
+    // NAN is a sensor that did not answer
+    espnow_reading_t reading = {
+        .temperature_dc = isnan(temperature) ? ESPNOW_READING_NO_TEMPERATURE : (int16_t) (temperature_dc + (temperature_dc < 0 ? -0.5f : 0.5f)),
+        .humidity_dpct = isnan(humidity) ? ESPNOW_READING_NO_VALUE : (humidity_dpct <= 0.0f) ? 0 : (uint16_t) (humidity_dpct + 0.5f),
+        .soil_raw = isnan(soil_moisture) ? ESPNOW_READING_NO_VALUE : (soil_moisture <= 0.0f) ? 0 :
+                    (soil_moisture >= ESPNOW_READING_NO_VALUE - 1) ? ESPNOW_READING_NO_VALUE - 1 : (uint16_t) (soil_moisture + 0.5f),
+        .age_sec = age_sec,
+    };
+
+    return reading;
+}
+
+bool espnow_dedup_accept(espnow_dedup_t *dedup, const espnow_frame_t *frame, uint32_t now_ms)
+{
+    int free_slot = -1;
+    int oldest_slot = 0;
+
+    for (int i = 0; i < ESPNOW_DEDUP_MAX_NODES; i++)
+    {
+        if (!dedup->nodes[i].used)
+        {
+            if (free_slot < 0)
+                free_slot = i;
+            continue;
+        }
+
+        if (memcmp(dedup->nodes[i].mac, frame->mac, sizeof(frame->mac)) == 0)
+        {
+            if (dedup->nodes[i].session == frame->session && frame->sequence <= dedup->nodes[i].sequence)
+                return false;
+
+            dedup->nodes[i].session = frame->session;
+            dedup->nodes[i].sequence = frame->sequence;
+            dedup->nodes[i].last_seen_ms = now_ms;
+            return true;
+        }
+
+        if ((uint32_t) (now_ms - dedup->nodes[i].last_seen_ms) > (uint32_t) (now_ms - dedup->nodes[oldest_slot].last_seen_ms))
+            oldest_slot = i;
+    }
+
+    // New node, take a free slot or forget the node not heard from for the longest time
+    int slot = (free_slot >= 0) ? free_slot : oldest_slot;
+    memcpy(dedup->nodes[slot].mac, frame->mac, sizeof(frame->mac));
+    dedup->nodes[slot].used = true;
+    dedup->nodes[slot].session = frame->session;
+    dedup->nodes[slot].sequence = frame->sequence;
+    dedup->nodes[slot].last_seen_ms = now_ms;
+
+    return true;
+}
+
+bool espnow_batch_add(espnow_batch_t *batch, const espnow_frame_t *frame, uint32_t now_ms)
+{
+    if (batch->count >= ESPNOW_BATCH_MAX_FRAMES)
+        return false;
+
+    if (batch->count == 0)
+        batch->first_ms = now_ms;
+
+    batch->frames[batch->count++] = *frame;
+    return true;
+}
+
+bool espnow_batch_ready(const espnow_batch_t *batch, uint32_t now_ms)
+{
+    if (batch->count == 0)
+        return false;
+
+    return batch->count >= ESPNOW_BATCH_MAX_FRAMES || (uint32_t) (now_ms - batch->first_ms) >= ESPNOW_BATCH_MAX_AGE_MS;
+}
+
+uint32_t espnow_batch_wait_ms(const espnow_batch_t *batch, uint32_t now_ms)
+{
+    if (batch->count == 0)
+        return UINT32_MAX;
+
+    uint32_t age = now_ms - batch->first_ms;
+    return (age >= ESPNOW_BATCH_MAX_AGE_MS) ? 0 : ESPNOW_BATCH_MAX_AGE_MS - age;
+}
+
+void espnow_batch_clear(espnow_batch_t *batch)
+{
+    batch->count = 0;
+    batch->first_ms = 0;
+}
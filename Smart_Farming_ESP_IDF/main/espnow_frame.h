@@ -0,0 +1,161 @@
+/**
+ * ESP-NOW sensor frames: encoding, duplicate filter and gateway batching.
+ * Pure logic, no ESP-IDF dependencies, so it can be compiled and checked on the host.
+ * The radio is reached through espnow_radio_t, so a local stand-in can replace it.
+ *
+ * Frame layout (multi-byte fields are big-endian):
+ *   0  magic "SN"
+ *   2  version
+ *   3  reading count n
+ *   4  session, random per power-on
+ *   8  sequence number
+ *  12  n readings, 10 bytes each: temperature (int16, 0.1 C), humidity (uint16, 0.1 %), soil moisture (uint16, raw),
+ *      age (uint32, seconds since the reading was taken)
+ *  ..  CRC-16/CCITT of all previous bytes
+ */
+
+#ifndef ESPNOW_FRAME_H_
+#define ESPNOW_FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ESPNOW_FRAME_VERSION        2
+#define ESPNOW_FRAME_HEADER_LEN     12
+#define ESPNOW_FRAME_READING_LEN    10
+#define ESPNOW_FRAME_CRC_LEN        2
+#define ESPNOW_FRAME_MAX_READINGS   9       // Current reading plus SENSOR_PAYLOAD_MAX_PENDING
+#define ESPNOW_FRAME_MAX_LEN        (ESPNOW_FRAME_HEADER_LEN + ESPNOW_FRAME_MAX_READINGS * ESPNOW_FRAME_READING_LEN + ESPNOW_FRAME_CRC_LEN)
+
+#define ESPNOW_DEDUP_MAX_NODES      32
+#define ESPNOW_BATCH_MAX_FRAMES     16
+#define ESPNOW_BATCH_MAX_AGE_MS     5000
+
+// Values of a sensor that did not answer, the gateway leaves the field out
+#define ESPNOW_READING_NO_TEMPERATURE   INT16_MIN
+#define ESPNOW_READING_NO_VALUE         UINT16_MAX
+
+// One sensor reading in frame units
+typedef struct espnow_reading
+{
+    int16_t temperature_dc;     // 0.1 C
+    uint16_t humidity_dpct;     // 0.1 %
+    uint16_t soil_raw;
+    uint32_t age_sec;           // The node has no wall clock, the gateway turns the age into a time
+} espnow_reading_t;
+
+// Decoded frame
+typedef struct espnow_frame
+{
+    uint8_t mac[6];
+    uint32_t session;
+    uint32_t sequence;
+    uint8_t count;
+    uint32_t received_sec;      // Unix time the gateway received the frame, 0 if its clock is not set
+    espnow_reading_t readings[ESPNOW_FRAME_MAX_READINGS];
+} espnow_frame_t;
+
+// Duplicate filter, remembers the last frame of each node
+typedef struct espnow_dedup
+{
+    struct
+    {
+        uint8_t mac[6];
+        bool used;
+        uint32_t session;
+        uint32_t sequence;
+        uint32_t last_seen_ms;
+    } nodes[ESPNOW_DEDUP_MAX_NODES];
+} espnow_dedup_t;
+
+// Frames waiting to be published by the gateway
+typedef struct espnow_batch
+{
+    espnow_frame_t frames[ESPNOW_BATCH_MAX_FRAMES];
+    uint8_t count;
+    uint32_t first_ms;          // Arrival time of the oldest frame
+} espnow_batch_t;
+
+// Radio interface, esp_now_send on target or a stand-in on the host
+typedef struct espnow_radio
+{
+    int (*send)(void *ctx, const uint8_t *peer_mac, const uint8_t *data, size_t len);
+    void *ctx;
+} espnow_radio_t;
+
+/**
+ * @brief Encode a frame
+ * @param session Session id
+ * @param sequence Sequence number
+ * @param readings Readings to send
+ * @param count Number of readings, 1 to ESPNOW_FRAME_MAX_READINGS
+ * @param buffer Output buffer, at least ESPNOW_FRAME_MAX_LEN bytes
+ * @return Frame length, 0 if count is out of range
+ */
+size_t espnow_frame_encode(uint32_t session, uint32_t sequence, const espnow_reading_t *readings, uint8_t count, uint8_t *buffer);
+
+/**
+ * @brief Decode and check a frame
+ * @param mac Sender MAC address
+ * @param data Received data
+ * @param len Received length
+ * @param frame Output frame
+ * @return true if the frame is valid
+ * @note received_sec is left at 0, the gateway sets it
+ */
+bool espnow_frame_decode(const uint8_t *mac, const uint8_t *data, size_t len, espnow_frame_t *frame);
+
+/**
+ * @brief Convert sensor values to frame units
+ * @param temperature Temperature in C
+ * @param humidity Relative humidity in %
+ * @param soil_moisture Raw soil moisture value
+ * @param age_sec Seconds since the reading was taken
+ * @return Reading in frame units
+ * @note NAN maps to ESPNOW_READING_NO_TEMPERATURE or ESPNOW_READING_NO_VALUE
+ */
+espnow_reading_t espnow_reading_from_float(float temperature, float humidity, float soil_moisture, uint32_t age_sec);
+
+/**
+ * @brief Check a frame against the duplicate filter and remember it
+ * @param dedup Duplicate filter
+ * @param frame Decoded frame
+ * @param now_ms Current time in milliseconds
+ * @return true if the frame is new, false if it was already received
+ * @note A new session id means the node was power cycled
+ */
+bool espnow_dedup_accept(espnow_dedup_t *dedup, const espnow_frame_t *frame, uint32_t now_ms);
+
+/**
+ * @brief Add a frame to the batch
+ * @param batch Batch
+ * @param frame Decoded frame
+ * @param now_ms Current time in milliseconds
+ * @return false if the batch is full, publish it first
+ */
+bool espnow_batch_add(espnow_batch_t *batch, const espnow_frame_t *frame, uint32_t now_ms);
+
+/**
+ * @brief Check if the batch has to be published
+ * @param batch Batch
+ * @param now_ms Current time in milliseconds
+ * @return true if the batch is full or the oldest frame waited ESPNOW_BATCH_MAX_AGE_MS
+ */
+bool espnow_batch_ready(const espnow_batch_t *batch, uint32_t now_ms);
+
+/**
+ * @brief Get time until the batch has to be published
+ * @param batch Batch
+ * @param now_ms Current time in milliseconds
+ * @return Milliseconds, UINT32_MAX if the batch is empty
+ */
+uint32_t espnow_batch_wait_ms(const espnow_batch_t *batch, uint32_t now_ms);
+
+/**
+ * @brief Empty the batch after publishing
+ * @param batch Batch
+ */
+void espnow_batch_clear(espnow_batch_t *batch);
+
+#endif /* ESPNOW_FRAME_H_ */
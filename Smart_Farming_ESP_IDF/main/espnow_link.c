@@ -0,0 +1,382 @@
+#include "espnow_link.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "mqtt_client.h"
+#include "cJSON.h"
+
+#include "My_MQTT_task.h"
+#include "cycle_profiler.h"
+#include "device_identity.h"
+#include "error_handler.h"
+#include "link_adapt.h"
+#include "sensor_interface_task.h"
+#include "sensor_payload.h"
+#include "sleep_manager.h"
+#include "static_alloc.h"
+#include "wake_budget.h"
+#include "wall_clock.h"
+
+#define ESPNOW_SEND_OK_BIT      BIT0
+#define ESPNOW_SEND_FAIL_BIT    BIT1
+
+static const char TAG[] = "espnow";
+
+// Received frame handed from the Wi-Fi task to the gateway task
+typedef struct espnow_rx_item
+{
+    uint8_t mac[6];
+    uint8_t len;
+    uint8_t data[ESPNOW_FRAME_MAX_LEN];
+} espnow_rx_item_t;
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR uint32_t espnow_session = 0;
+static RTC_DATA_ATTR uint32_t espnow_sequence = 0;
+
+static const uint8_t gateway_mac[6] = ESPNOW_GATEWAY_MAC;
+
+static TaskHandle_t espnow_node_task_handle = NULL;
+static QueueHandle_t espnow_rx_queue = NULL;
+static esp_mqtt_client_handle_t gateway_client = NULL;
+static char batch_topic[DEVICE_TOPIC_MAX_LEN];
+
+// Shared by the node and the gateway task, a device runs only one of them
+STATIC_ALLOC_TASK(espnow_task_buffers, ESPNOW_TASK_STACK_SIZE);
+STATIC_ALLOC_QUEUE(espnow_rx_queue_buffers, ESPNOW_GATEWAY_QUEUE_LEN, sizeof(espnow_rx_item_t));
+static bool espnow_started = false;
+
+/**
+ * @brief Send data with esp_now_send
+ * @note espnow_radio_t implementation for the target
+ */
+static int espnow_radio_send(void *ctx, const uint8_t *peer_mac, const uint8_t *data, size_t len)
+{
+    return esp_now_send(peer_mac, data, len);
+}
+
+static const espnow_radio_t espnow_radio = {
+    .send = &espnow_radio_send,
+    .ctx = NULL,
+};
+
+/**
+ * @brief ESP-NOW send callback, called from the Wi-Fi task
+ * @param tx_info Transmit information
+ * @param status Delivery status (MAC layer ack)
+ */
+static void espnow_send_cb(const esp_now_send_info_t *tx_info, esp_now_send_status_t status)
+{
+    if (espnow_node_task_handle != NULL)
+    {
+        xTaskNotify(espnow_node_task_handle, (status == ESP_NOW_SEND_SUCCESS) ? ESPNOW_SEND_OK_BIT : ESPNOW_SEND_FAIL_BIT, eSetBits);
+    }
+}
+
+/**
+ * @brief ESP-NOW receive callback, called from the Wi-Fi task
+ * @param recv_info Receive information
+ * @param data Received data
+ * @param len Received length
+ */
+static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    if (len <= 0 || len > ESPNOW_FRAME_MAX_LEN)
+        return;
+
+    espnow_rx_item_t item;
+    memcpy(item.mac, recv_info->src_addr, sizeof(item.mac));
+    item.len = (uint8_t) len;
+    memcpy(item.data, data, len);
+
+    // Never block the Wi-Fi task, the node retries if the frame is dropped here
+    if (xQueueSend(espnow_rx_queue, &item, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Receive queue full, frame dropped");
+    }
+}
+
+/**
+ * @brief Bring up the radio for ESP-NOW only, without joining a network
+ * @return ESP_OK or error code
+ */
+static esp_err_t espnow_node_radio_init(void)
+{
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    link_adapt_apply_phy();
+
+    cycle_profiler_mark(CYCLE_PHASE_WIFI_START);
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_channel(ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE));
+    link_adapt_apply_power();
+
+    esp_err_t err = esp_now_init();
+    if (err != ESP_OK)
+        return err;
+
+    ESP_ERROR_CHECK(esp_now_register_send_cb(&espnow_send_cb));
+
+    esp_now_peer_info_t peer = {
+        .channel = ESPNOW_CHANNEL,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, gateway_mac, sizeof(peer.peer_addr));
+
+    return esp_now_add_peer(&peer);
+}
+
+/**
+ * @brief Send one frame and wait for the MAC layer ack, with retries
+ * @param radio Radio interface
+ * @param frame Encoded frame
+ * @param len Frame length
+ * @return true if acked
+ */
+static bool espnow_node_send(const espnow_radio_t *radio, const uint8_t *frame, size_t len)
+{
+    for (int attempt = 0; attempt < ESPNOW_RETRIES; attempt++)
+    {
+        xTaskNotifyStateClear(NULL);
+        if (radio->send(radio->ctx, gateway_mac, frame, len) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Send failed");
+            continue;
+        }
+
+        uint32_t status = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &status, pdMS_TO_TICKS(ESPNOW_SEND_TIMEOUT_MS)) == pdTRUE &&
+            (status & ESPNOW_SEND_OK_BIT))
+        {
+            return true;
+        }
+
+        ESP_LOGW(TAG, "No ack for seq %lu, attempt %d", (unsigned long) espnow_sequence, attempt + 1);
+        link_adapt_record_retry();
+    }
+
+    return false;
+}
+
+/**
+ * @brief ESP-NOW node task to run
+ * @param pvParameters
+ */
+static void espnow_node_task(void *pvParameters)
+{
+    esp_err_t err = espnow_node_radio_init();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        wake_budget_abort(TAG);
+    }
+
+    sensor_interface_wait_ready(SENSOR_INTERFACE_READY_TIMEOUT_MS);
+
+    sensor_reading_t readings[ESPNOW_FRAME_MAX_READINGS];
+    espnow_reading_t frame_readings[ESPNOW_FRAME_MAX_READINGS];
+    size_t count = sensor_payload_get_readings(readings, ESPNOW_FRAME_MAX_READINGS);
+    for (size_t i = 0; i < count; i++)
+    {
+        frame_readings[i] = espnow_reading_from_float(readings[i].temperature, readings[i].humidity, readings[i].soil_moisture,
+                                                      wall_clock_age(readings[i].stamp));
+    }
+
+    if (espnow_session == 0)
+    {
+        espnow_session = esp_random() | 1;
+    }
+
+    uint8_t frame[ESPNOW_FRAME_MAX_LEN];
+    size_t len = espnow_frame_encode(espnow_session, ++espnow_sequence, frame_readings, (uint8_t) count, frame);
+
+    if (len > 0 && espnow_node_send(&espnow_radio, frame, len))
+    {
+        cycle_profiler_mark(CYCLE_PHASE_PUBLISH);
+        wake_budget_set_uplink_ok();
+        wake_budget_phase_done(WAKE_BUDGET_PHASE_ESPNOW);
+        sensor_payload_clear_pending();
+        ESP_LOGI(TAG, "Sent seq %lu with %u readings", (unsigned long) espnow_sequence, (unsigned) count);
+    }
+
+    esp_now_deinit();
+    sleep_manager_enter_deep_sleep();
+}
+
+void espnow_node_start(void)
+{
+    if (espnow_started) {
+        ESP_LOGW(TAG, "ESP-NOW task already started, skipping.");
+        return;
+    }
+    espnow_started = true;
+
+    wake_budget_register(WAKE_BUDGET_PHASE_ESPNOW, WAKE_BUDGET_ESPNOW_MS);
+
+    BaseType_t err = static_alloc_task_create(&espnow_task_buffers, &espnow_node_task, "espnow_node_task", NULL, ESPNOW_TASK_PRIORITY, &espnow_node_task_handle, tskNO_AFFINITY);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "ESP-NOW node task create failed");
+        my_error_handler(TAG);
+    }
+}
+
+/**
+ * @brief Format the batch to JSON and hand it to the MQTT client
+ * @param batch Batch to publish
+ * @note Format: [{"device":"sf-240ac4000001","seq":N,"readings":[{"temperature":T,"humidity":H,"soil_moisture":S,"ts":U}, ...]}, ...]
+ */
+static void espnow_gateway_publish(const espnow_batch_t *batch)
+{
+    cJSON *json_batch = cJSON_CreateArray();
+    if (json_batch == NULL)
+        return;
+
+    for (uint8_t i = 0; i < batch->count; i++)
+    {
+        const espnow_frame_t *frame = &batch->frames[i];
+        char device_id[DEVICE_ID_MAX_LEN];
+        device_identity_format_id(frame->mac, device_id);
+
+        cJSON *json_frame = cJSON_CreateObject();
+        cJSON_AddStringToObject(json_frame, "device", device_id);
+        cJSON_AddNumberToObject(json_frame, "seq", frame->sequence);
+        cJSON *json_readings = cJSON_AddArrayToObject(json_frame, "readings");
+        for (uint8_t j = 0; j < frame->count; j++)
+        {
+            // Same fields as the MQTT payload, a sensor that did not answer is left out
+            const espnow_reading_t *reading = &frame->readings[j];
+            cJSON *json_reading = cJSON_CreateObject();
+            if (reading->temperature_dc != ESPNOW_READING_NO_TEMPERATURE)
+                cJSON_AddNumberToObject(json_reading, "temperature", reading->temperature_dc / 10.0);
+            if (reading->humidity_dpct != ESPNOW_READING_NO_VALUE)
+                cJSON_AddNumberToObject(json_reading, "humidity", reading->humidity_dpct / 10.0);
+            if (reading->soil_raw != ESPNOW_READING_NO_VALUE)
+                cJSON_AddNumberToObject(json_reading, "soil_moisture", reading->soil_raw);
+            // Reading time from the age sent by the node, left out while the gateway clock is not set
+            if (frame->received_sec != 0)
+                cJSON_AddNumberToObject(json_reading, "ts", frame->received_sec - reading->age_sec);
+            cJSON_AddItemToArray(json_readings, json_reading);
+        }
+        cJSON_AddItemToArray(json_batch, json_frame);
+    }
+
+    char *json_string = cJSON_PrintUnformatted(json_batch);
+    if (json_string != NULL)
+    {
+        // Stored in the outbox, sent by the MQTT client task even while reconnecting
+        static_alloc_guard_pause();
+        int msg_id = esp_mqtt_client_enqueue(gateway_client, batch_topic, json_string, strlen(json_string), ESPNOW_BATCH_QOS, 0, true);
+        static_alloc_guard_resume();
+        ESP_LOGI(TAG, "Batch of %u frames queued, msg_id=%d", (unsigned) batch->count, msg_id);
+        cJSON_free(json_string);
+    }
+
+    cJSON_Delete(json_batch);
+}
+
+/**
+ * @brief ESP-NOW gateway task to run
+ * @param pvParameters
+ */
+static void espnow_gateway_task(void *pvParameters)
+{
+    static espnow_dedup_t dedup;
+    static espnow_batch_t batch;
+    espnow_rx_item_t item;
+    espnow_frame_t frame;
+
+    static_alloc_guard_arm();
+
+    while (1)
+    {
+        uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        uint32_t wait_ms = espnow_batch_wait_ms(&batch, now_ms);
+        TickType_t wait = (wait_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+
+        if (xQueueReceive(espnow_rx_queue, &item, wait) == pdTRUE)
+        {
+            now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+            if (!espnow_frame_decode(item.mac, item.data, item.len, &frame))
+            {
+                ESP_LOGW(TAG, "Invalid frame");
+            }
+            else if (espnow_dedup_accept(&dedup, &frame, now_ms))
+            {
+                uint32_t received_sec;
+                frame.received_sec = wall_clock_to_unix(wall_clock_stamp(), &received_sec) ? received_sec : 0;
+                if (!espnow_batch_add(&batch, &frame, now_ms))
+                {
+                    espnow_gateway_publish(&batch);
+                    espnow_batch_clear(&batch);
+                    espnow_batch_add(&batch, &frame, now_ms);
+                }
+            }
+        }
+
+        now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        if (espnow_batch_ready(&batch, now_ms))
+        {
+            espnow_gateway_publish(&batch);
+            espnow_batch_clear(&batch);
+        }
+    }
+}
+
+void espnow_gateway_start(void)
+{
+    if (espnow_started) {
+        return;
+    }
+    espnow_started = true;
+
+    espnow_rx_queue = static_alloc_queue_create(&espnow_rx_queue_buffers, ESPNOW_GATEWAY_QUEUE_LEN, sizeof(espnow_rx_item_t));
+    if (espnow_rx_queue == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create ESP-NOW receive queue");
+        my_error_handler(TAG);
+    }
+
+    device_identity_topic(ESPNOW_BATCH_LEAF, batch_topic, sizeof(batch_topic));
+
+    // Persistent MQTT connection, the gateway never sleeps
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = BROKER_ADDRESS,
+        .credentials.username = BROKER_USERNAME,
+        .credentials.authentication.password = BROKER_PASSWORD,
+        .credentials.client_id = device_identity_get_id(),
+        .session.keepalive = MY_MQTT_KEEPALIVE,
+        .session.protocol_ver = MY_MQTT_PROTOCOL,
+        .network.reconnect_timeout_ms = MY_MQTT_RECONNECT_MS,
+    };
+    gateway_client = esp_mqtt_client_init(&mqtt_cfg);
+    ESP_ERROR_CHECK(esp_mqtt_client_start(gateway_client));
+
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(&espnow_recv_cb));
+
+    BaseType_t err = static_alloc_task_create(&espnow_task_buffers, &espnow_gateway_task, "espnow_gateway_task", NULL, ESPNOW_TASK_PRIORITY, NULL, tskNO_AFFINITY);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "ESP-NOW gateway task create failed");
+        my_error_handler(TAG);
+    }
+
+    ESP_LOGI(TAG, "ESP-NOW gateway ready");
+}
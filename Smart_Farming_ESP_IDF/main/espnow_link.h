@@ -0,0 +1,41 @@
+/**
+ * ESP-NOW uplink. Sensor nodes send their readings straight to a mains-powered
+ * gateway ESP32 without joining the Wi-Fi network. The gateway runs this codebase
+ * with DEVICE_ROLE_GATEWAY, batches the frames of all nodes and publishes them
+ * over its persistent MQTT connection.
+ */
+
+#ifndef ESPNOW_LINK_H_
+#define ESPNOW_LINK_H_
+
+#include "device_role.h"
+#include "espnow_frame.h"
+
+// ESP-NOW config
+// The channel must be the channel of the AP the gateway is connected to
+#define ESPNOW_CHANNEL              1
+#define ESPNOW_GATEWAY_MAC          { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x00 }
+#define ESPNOW_SEND_TIMEOUT_MS      100
+#define ESPNOW_RETRIES              3
+
+// ESP-NOW task config
+#define ESPNOW_TASK_STACK_SIZE      4096
+#define ESPNOW_TASK_PRIORITY        5
+#define ESPNOW_GATEWAY_QUEUE_LEN    16
+
+// Gateway publishes the batches to /smartfarming/<gateway device id>/batch
+#define ESPNOW_BATCH_LEAF           "batch"
+#define ESPNOW_BATCH_QOS            1
+
+/**
+ * @brief Start ESP-NOW node task. It sends the sensor data to the gateway then puts the device to deep sleep.
+ * @note Do not start the network task in this mode, the node does not join the Wi-Fi network
+ */
+void espnow_node_start(void);
+
+/**
+ * @brief Start ESP-NOW gateway. Call this once the Wi-Fi network is connected.
+ */
+void espnow_gateway_start(void);
+
+#endif /* ESPNOW_LINK_H_ */
@@ -0,0 +1,25 @@
+#include "fake_env.h"
+
+#include <stdlib.h>
+
+int32_t fake_env_int(const char *name, int32_t default_value)
+{
+    const char *value = getenv(name);
+    if (value == NULL || *value == '\0')
+        return default_value;
+
+    char *end;
+    long parsed = strtol(value, &end, 0);
+    return (*end == '\0') ? (int32_t) parsed : default_value;
+}
+
+float fake_env_float(const char *name, float default_value)
+{
+    const char *value = getenv(name);
+    if (value == NULL || *value == '\0')
+        return default_value;
+
+    char *end;
+    float parsed = strtof(value, &end);
+    return (*end == '\0') ? parsed : default_value;
+}
@@ -0,0 +1,39 @@
+/**
+ * Settings of the host build fakes, read from environment variables so one binary
+ * can simulate different sensors and links.
+ *
+ *   SF_FAKE_TEMPERATURE    DHT22 temperature in C (25.0)
+ *   SF_FAKE_HUMIDITY       DHT22 humidity in % (60.0)
+ *   SF_FAKE_DHT_FAIL       1 = DHT22 does not answer (0)
+ *   SF_FAKE_SOIL           ADS111x raw soil moisture reading (12000)
+ *   SF_FAKE_I2C_NACK       1 = ADS111x does not ack (0)
+ *   SF_FAKE_I2C_STUCK      1 = ADS111x holds the bus until an I2C bus reset (0)
+ *   SF_FAKE_WIFI_MS        Time from Wi-Fi start to association (250)
+ *   SF_FAKE_DHCP_MS        Time from association to IP (50)
+ *   SF_FAKE_WIFI_FAIL      1 = the AP is never found (0)
+ *   SF_FAKE_RSSI           RSSI of the AP in dBm (-60)
+ *   SF_FAKE_NODE           Node number in the MAC address and device ID (1)
+ */
+
+#ifndef FAKE_ENV_H_
+#define FAKE_ENV_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Get an integer setting
+ * @param name Environment variable
+ * @param default_value Value if the variable is not set or not a number
+ * @return Setting value
+ */
+int32_t fake_env_int(const char *name, int32_t default_value);
+
+/**
+ * @brief Get a floating point setting
+ * @param name Environment variable
+ * @param default_value Value if the variable is not set or not a number
+ * @return Setting value
+ */
+float fake_env_float(const char *name, float default_value);
+
+#endif /* FAKE_ENV_H_ */
@@ -0,0 +1,129 @@
+/**
+ * Host build fake of the GPIO driver. The DHT22 pin answers a start pulse with the
+ * sensor waveform built from SF_FAKE_TEMPERATURE and SF_FAKE_HUMIDITY.
+ *
+ * The waveform runs on a virtual clock that advances 1 us per gpio_get_level call,
+ * which is how the DHT22 driver polls the pin, so the decoded bits do not depend
+ * on host scheduling.
+ */
+
+#include "driver/gpio.h"
+
+#include <stdbool.h>
+
+#include "fake_env.h"
+#include "sensor_interface_task.h"
+
+// Bit timings of the DHT22 answer in us
+#define FAKE_DHT_RESPONSE_US    80
+#define FAKE_DHT_BIT_LOW_US     50
+#define FAKE_DHT_ZERO_HIGH_US   26
+#define FAKE_DHT_ONE_HIGH_US    70
+#define FAKE_DHT_BITS           40
+
+static uint32_t gpio_levels[GPIO_NUM_MAX];
+static gpio_mode_t gpio_modes[GPIO_NUM_MAX];
+
+// DHT22 answer in progress
+static bool dht_answering = false;
+static bool dht_start_seen = false;
+static uint32_t dht_clock_us = 0;
+static uint8_t dht_data[FAKE_DHT_BITS / 8];
+
+/**
+ * @brief Build the 5 data bytes of the DHT22 answer
+ */
+static void fake_dht_encode(void)
+{
+    float humidity = fake_env_float("SF_FAKE_HUMIDITY", 60.0f);
+    float temperature = fake_env_float("SF_FAKE_TEMPERATURE", 25.0f);
+
+    uint16_t raw_humidity = (uint16_t) (humidity * 10.0f + 0.5f);
+    uint16_t raw_temperature = (uint16_t) ((temperature < 0 ? -temperature : temperature) * 10.0f + 0.5f);
+    if (temperature < 0)
+        raw_temperature |= 0x8000;
+
+    dht_data[0] = raw_humidity >> 8;
+    dht_data[1] = raw_humidity & 0xFF;
+    dht_data[2] = raw_temperature >> 8;
+    dht_data[3] = raw_temperature & 0xFF;
+    dht_data[4] = dht_data[0] + dht_data[1] + dht_data[2] + dht_data[3];
+}
+
+/**
+ * @brief Level of the DHT22 line at a time of its answer
+ * @param t_us Time since the host released the line
+ * @return Line level
+ */
+static int fake_dht_level(uint32_t t_us)
+{
+    if (t_us < FAKE_DHT_RESPONSE_US)
+        return 0;
+    t_us -= FAKE_DHT_RESPONSE_US;
+    if (t_us < FAKE_DHT_RESPONSE_US)
+        return 1;
+    t_us -= FAKE_DHT_RESPONSE_US;
+
+    for (int bit = 0; bit < FAKE_DHT_BITS; bit++)
+    {
+        if (t_us < FAKE_DHT_BIT_LOW_US)
+            return 0;
+        t_us -= FAKE_DHT_BIT_LOW_US;
+
+        uint32_t high_us = (dht_data[bit / 8] & (0x80 >> (bit % 8))) ? FAKE_DHT_ONE_HIGH_US : FAKE_DHT_ZERO_HIGH_US;
+        if (t_us < high_us)
+            return 1;
+        t_us -= high_us;
+    }
+
+    // Last low then the pull-up
+    return (t_us < FAKE_DHT_BIT_LOW_US) ? 0 : 1;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    gpio_modes[gpio_num] = mode;
+
+    // Released after the start pulse, the sensor answers
+    if (gpio_num == DHT_GPIO && mode == GPIO_MODE_INPUT && dht_start_seen)
+    {
+        dht_start_seen = false;
+        dht_answering = !fake_env_int("SF_FAKE_DHT_FAIL", 0);
+        dht_clock_us = 0;
+        fake_dht_encode();
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    gpio_levels[gpio_num] = level ? 1 : 0;
+    if (gpio_num == DHT_GPIO && level == 0 && gpio_modes[gpio_num] == GPIO_MODE_OUTPUT)
+    {
+        dht_start_seen = true;
+        dht_answering = false;
+    }
+
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return 0;
+
+    if (gpio_num == DHT_GPIO && gpio_modes[gpio_num] == GPIO_MODE_INPUT)
+    {
+        // A missing sensor leaves the line at the pull-up
+        return dht_answering ? fake_dht_level(dht_clock_us++) : 1;
+    }
+
+    return gpio_levels[gpio_num];
+}
@@ -0,0 +1,90 @@
+#include "fake_heap.h"
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static fake_heap_stats_t heap_stats;
+
+/**
+ * @brief Count an allocation
+ * @param ptr Allocated block, NULL if the allocation failed
+ * @note The usable size is counted, free subtracts the same value
+ */
+static void fake_heap_count_alloc(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    uint32_t size = (uint32_t) malloc_usable_size(ptr);
+    __atomic_add_fetch(&heap_stats.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&heap_stats.alloc_bytes, size, __ATOMIC_RELAXED);
+    uint32_t in_use = __atomic_add_fetch(&heap_stats.in_use_bytes, size, __ATOMIC_RELAXED);
+
+    uint32_t peak = __atomic_load_n(&heap_stats.peak_bytes, __ATOMIC_RELAXED);
+    while (in_use > peak && !__atomic_compare_exchange_n(&heap_stats.peak_bytes, &peak, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+/**
+ * @brief Count a free
+ * @param ptr Block about to be freed
+ */
+static void fake_heap_count_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    __atomic_add_fetch(&heap_stats.frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&heap_stats.in_use_bytes, (uint32_t) malloc_usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    fake_heap_count_alloc(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+    fake_heap_count_alloc(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    // Counted as a free of the old block and an allocation of the new one
+    fake_heap_count_free(ptr);
+    void *new_ptr = __real_realloc(ptr, size);
+    if (new_ptr == NULL && ptr != NULL && size != 0)
+    {
+        // Old block still valid
+        fake_heap_count_alloc(ptr);
+        return NULL;
+    }
+    fake_heap_count_alloc(new_ptr);
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    fake_heap_count_free(ptr);
+    __real_free(ptr);
+}
+
+void fake_heap_get_stats(fake_heap_stats_t *stats)
+{
+    stats->allocs = __atomic_load_n(&heap_stats.allocs, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&heap_stats.frees, __ATOMIC_RELAXED);
+    stats->alloc_bytes = __atomic_load_n(&heap_stats.alloc_bytes, __ATOMIC_RELAXED);
+    stats->in_use_bytes = __atomic_load_n(&heap_stats.in_use_bytes, __ATOMIC_RELAXED);
+    stats->peak_bytes = __atomic_load_n(&heap_stats.peak_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,27 @@
+/**
+ * Heap use of the host build. malloc, calloc, realloc and free are wrapped at link
+ * time (-Wl,--wrap, see main/CMakeLists.txt) and counted, so a change in the
+ * allocations of one wake shows up in the host/cycle record.
+ */
+
+#ifndef FAKE_HEAP_H_
+#define FAKE_HEAP_H_
+
+#include <stdint.h>
+
+typedef struct fake_heap_stats
+{
+    uint32_t allocs;            // malloc, calloc and realloc calls that returned memory
+    uint32_t frees;             // free calls with a pointer
+    uint32_t alloc_bytes;       // Total bytes allocated
+    uint32_t in_use_bytes;      // Bytes allocated and not freed
+    uint32_t peak_bytes;        // Highest in_use_bytes
+} fake_heap_stats_t;
+
+/**
+ * @brief Get the heap use since the process started
+ * @param stats Output statistics
+ */
+void fake_heap_get_stats(fake_heap_stats_t *stats);
+
+#endif /* FAKE_HEAP_H_ */
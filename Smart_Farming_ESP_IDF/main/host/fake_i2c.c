@@ -0,0 +1,154 @@
+/**
+ * Host build fake of the I2C master driver with one simulated ADS111x. The device
+ * has the four ADS111x registers behind the address pointer. A config write that
+ * starts a single shot conversion loads SF_FAKE_SOIL into the conversion register.
+ * With SF_FAKE_I2C_STUCK the device holds the bus until i2c_master_bus_reset().
+ */
+
+#include "driver/i2c_master.h"
+
+#include <stdlib.h>
+
+#include "fake_env.h"
+
+#define FAKE_ADS111X_ADDR           0x48
+#define FAKE_ADS111X_REG_CONVERSION 0x00
+#define FAKE_ADS111X_REG_CONFIG     0x01
+#define FAKE_ADS111X_REG_COUNT      4
+#define FAKE_ADS111X_OS_BIT         0x8000  // Write: start a conversion, read: not converting
+
+struct fake_i2c_bus
+{
+    i2c_port_num_t port;
+};
+
+struct fake_i2c_dev
+{
+    uint16_t address;
+};
+
+// ADS111x registers, power-on values
+static uint16_t ads_registers[FAKE_ADS111X_REG_COUNT] = { 0x0000, 0x8583, 0x8000, 0x7FFF };
+static uint8_t ads_pointer = FAKE_ADS111X_REG_CONVERSION;
+
+// -1 until read from SF_FAKE_I2C_STUCK
+static int bus_stuck = -1;
+
+/**
+ * @brief Check that the ADS111x is on the bus and answers
+ * @param address 7-bit device address
+ * @return ESP_OK if it acks
+ */
+static esp_err_t fake_i2c_ack(uint16_t address)
+{
+    if (bus_stuck < 0)
+        bus_stuck = fake_env_int("SF_FAKE_I2C_STUCK", 0) != 0;
+
+    if (bus_stuck)
+        return ESP_ERR_TIMEOUT;
+
+    if (address != FAKE_ADS111X_ADDR || fake_env_int("SF_FAKE_I2C_NACK", 0))
+        return ESP_ERR_NOT_FOUND;
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle)
+{
+    if (bus_config == NULL || ret_bus_handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    struct fake_i2c_bus *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL)
+        return ESP_ERR_NO_MEM;
+
+    bus->port = bus_config->i2c_port;
+    *ret_bus_handle = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config, i2c_master_dev_handle_t *ret_handle)
+{
+    if (bus_handle == NULL || dev_config == NULL || ret_handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    struct fake_i2c_dev *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL)
+        return ESP_ERR_NO_MEM;
+
+    dev->address = dev_config->device_address;
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle)
+{
+    if (bus_handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    // The clock pulses free the bus, the ADS111x keeps its registers
+    bus_stuck = 0;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms)
+{
+    (void) xfer_timeout_ms;
+    if (bus_handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    return fake_i2c_ack(address);
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size, int xfer_timeout_ms)
+{
+    (void) xfer_timeout_ms;
+    if (i2c_dev == NULL || write_buffer == NULL || write_size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = fake_i2c_ack(i2c_dev->address);
+    if (err != ESP_OK)
+        return err;
+
+    ads_pointer = write_buffer[0] % FAKE_ADS111X_REG_COUNT;
+    if (write_size < 3)
+        return ESP_OK;
+
+    uint16_t value = (write_buffer[1] << 8) | write_buffer[2];
+    if (ads_pointer == FAKE_ADS111X_REG_CONFIG)
+    {
+        if (value & FAKE_ADS111X_OS_BIT)
+        {
+            // Conversion is done by the time the driver reads it back
+            ads_registers[FAKE_ADS111X_REG_CONVERSION] = (uint16_t) fake_env_int("SF_FAKE_SOIL", 12000);
+        }
+        // OS reads 1 once the conversion is done
+        ads_registers[FAKE_ADS111X_REG_CONFIG] = value | FAKE_ADS111X_OS_BIT;
+    }
+    else if (ads_pointer != FAKE_ADS111X_REG_CONVERSION)
+    {
+        ads_registers[ads_pointer] = value;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    (void) xfer_timeout_ms;
+    if (i2c_dev == NULL || read_buffer == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = fake_i2c_ack(i2c_dev->address);
+    if (err != ESP_OK)
+        return err;
+
+    // Registers are read MSB first, further bytes repeat the register
+    uint16_t value = ads_registers[ads_pointer];
+    for (size_t i = 0; i < read_size; i++)
+    {
+        read_buffer[i] = (i % 2 == 0) ? (value >> 8) : (value & 0xFF);
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,207 @@
+/**
+ * Host build fake of the Wi-Fi link. The host is already on a network, so
+ * network_start() and network_begin() only simulate the association and DHCP
+ * delays, mark the same cycle phases as network_connection.c and call the
+ * connected callback. The MQTT client then connects to the broker over the host
+ * network.
+ *
+ * ESP-NOW and the UDP uplink need the radio or the lwIP port and are not in the
+ * host build, selecting them ends the wake like a failed uplink.
+ */
+
+#include "network_connection.h"
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "freertos/task.h"
+
+#include "continuous_mode.h"
+#include "cycle_profiler.h"
+#include "espnow_link.h"
+#include "fake_env.h"
+#include "link_adapt.h"
+#include "udp_uplink.h"
+#include "wake_budget.h"
+
+static const char TAG[] = "fake_network";
+
+static network_connected_event_callback_t network_connected_event_cb = NULL;
+static bool network_connected = false;
+static bool network_connected_cb_called = false;
+
+// Simulated radio settings
+static int8_t wifi_tx_power = 80;
+static uint8_t wifi_protocol = WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N;
+
+esp_err_t esp_wifi_stop(void)
+{
+    network_connected = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    (void) type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap)
+{
+    (void) ifx;
+    wifi_protocol = protocol_bitmap;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_max_tx_power(int8_t power)
+{
+    wifi_tx_power = power;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi)
+{
+    if (!network_connected)
+        return ESP_FAIL;
+
+    *rssi = fake_env_int("SF_FAKE_RSSI", -60);
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    // Locally administered, like the nodes simulated by tools/fleet_loadgen.py
+    uint32_t node = (uint32_t) fake_env_int("SF_FAKE_NODE", 1);
+    mac[0] = 0x02;
+    mac[1] = 0x53;
+    mac[2] = 0x46;
+    mac[3] = (node >> 16) & 0xFF;
+    mac[4] = (node >> 8) & 0xFF;
+    mac[5] = (node & 0xFF) + (uint8_t) type;
+    return ESP_OK;
+}
+
+/**
+ * @brief Simulated join, same phases as network_task and the event callbacks
+ * @param pvParameters
+ */
+static void fake_network_task(void *pvParameters)
+{
+    link_adapt_apply_power();
+    link_adapt_apply_phy();
+    cycle_profiler_mark(CYCLE_PHASE_WIFI_START);
+    wake_budget_register(WAKE_BUDGET_PHASE_WIFI, WAKE_BUDGET_WIFI_MS);
+
+    if (fake_env_int("SF_FAKE_WIFI_FAIL", 0))
+    {
+        ESP_LOGE(TAG, "Failed to connect to Wi-Fi network");
+#if DEVICE_ROLE == DEVICE_ROLE_SENSOR && OPERATING_MODE == OPERATING_MODE_DEEP_SLEEP
+        wake_budget_abort(TAG);
+#else
+        my_error_handler(TAG);
+#endif
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(fake_env_int("SF_FAKE_WIFI_MS", 250)));
+    cycle_profiler_mark(CYCLE_PHASE_WIFI_ASSOC);
+    vTaskDelay(pdMS_TO_TICKS(fake_env_int("SF_FAKE_DHCP_MS", 50)));
+    cycle_profiler_mark(CYCLE_PHASE_DHCP);
+    wake_budget_phase_done(WAKE_BUDGET_PHASE_WIFI);
+
+    network_connected = true;
+    ESP_LOGI(TAG, "Simulated join done, tx power %d, protocol 0x%x", wifi_tx_power, wifi_protocol);
+    network_connection_call_callback();
+    network_record_ap_info();
+
+    vTaskDelete(NULL);
+}
+
+void network_record_ap_info(void)
+{
+    int rssi;
+    if (esp_wifi_sta_get_rssi(&rssi) == ESP_OK)
+    {
+        link_adapt_record_rssi(rssi);
+    }
+}
+
+void network_connection_set_callback(network_connected_event_callback_t cb)
+{
+    network_connected_event_cb = cb;
+
+    // Connected before the callback was set
+    if (network_connected)
+    {
+        network_connection_call_callback();
+    }
+}
+
+void network_connection_set_disconnect_callback(network_disconnected_event_callback_t cb)
+{
+    // The host network does not drop
+    (void) cb;
+}
+
+void network_connection_set_reconnect_callback(network_reconnected_event_callback_t cb)
+{
+    (void) cb;
+}
+
+void network_connection_call_callback(void)
+{
+    if (network_connected_event_cb == NULL)
+        return;
+
+    if (!__atomic_exchange_n(&network_connected_cb_called, true, __ATOMIC_ACQ_REL))
+    {
+        network_connected_event_cb();
+    }
+}
+
+void network_start(void)
+{
+    BaseType_t err = xTaskCreate(&fake_network_task, "Network_task", NETWORK_TASK_STACK_SIZE, NULL, NETWORK_TASK_PRIORITY, NULL);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "Network task creation failed");
+        my_error_handler(TAG);
+    }
+}
+
+esp_err_t network_begin(void)
+{
+    network_start();
+    return ESP_OK;
+}
+
+esp_err_t network_wait_connected(uint32_t timeout_ms)
+{
+    // The simulated join has no event group, poll the state it sets
+    TickType_t start = xTaskGetTickCount();
+    while (!network_connected)
+    {
+        if (timeout_ms != portMAX_DELAY && xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms))
+            return ESP_ERR_TIMEOUT;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    return ESP_OK;
+}
+
+void espnow_node_start(void)
+{
+    ESP_LOGE(TAG, "ESP-NOW is not available in the host build");
+    wake_budget_abort(TAG);
+}
+
+void espnow_gateway_start(void)
+{
+    ESP_LOGE(TAG, "ESP-NOW is not available in the host build");
+}
+
+void udp_uplink_start(void)
+{
+    ESP_LOGE(TAG, "The UDP uplink is not available in the host build");
+    wake_budget_abort(TAG);
+}
@@ -0,0 +1,136 @@
+/**
+ * Host build fake of deep sleep and power management. esp_deep_sleep_start()
+ * rotates the cycle profile like the next boot would, prints the record the node
+ * would publish on its diag topic, the heap use of the wake and the deferred log
+ * as hex, then ends the process. Run the binary in a loop for more wakes.
+ *
+ * The wake stub runs from RTC memory on the chip only, the host build has no stub
+ * wakes.
+ */
+
+#include "esp_sleep.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "driver/rtc_io.h"
+
+#include "cycle_profiler.h"
+#include "deferred_log.h"
+#include "fake_heap.h"
+#include "wake_stub.h"
+
+static const char TAG[] = "fake_sleep";
+
+static uint64_t timer_wakeup_us = 0;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    timer_wakeup_us = time_in_us;
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    // Every run is a power-on
+    return ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+void esp_deep_sleep_start(void)
+{
+    char record[192];
+    uint32_t awake_us = cycle_profiler_get_us(CYCLE_PHASE_SLEEP);
+
+    // Same rotation as the next boot, the record is what the diag topic would get
+    cycle_profiler_init();
+    if (cycle_profiler_format_previous(record, sizeof(record)) > 0)
+    {
+        printf("host/diag %s\n", record);
+    }
+
+    fake_heap_stats_t heap;
+    fake_heap_get_stats(&heap);
+    printf("host/cycle {\"awake_ms\":%lu,\"allocs\":%lu,\"frees\":%lu,\"alloc_bytes\":%lu,\"heap_peak\":%lu,\"heap_in_use\":%lu}\n",
+           (unsigned long) ((awake_us + 999) / 1000), (unsigned long) heap.allocs, (unsigned long) heap.frees,
+           (unsigned long) heap.alloc_bytes, (unsigned long) heap.peak_bytes, (unsigned long) heap.in_use_bytes);
+
+    // Decoded with tools/log_decode.py
+    const uint8_t *log_record;
+    size_t log_len = deferred_log_drain(&log_record);
+    if (log_len > 0)
+    {
+        printf("host/log ");
+        for (size_t i = 0; i < log_len; i++)
+        {
+            printf("%02x", log_record[i]);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+
+    ESP_LOGI(TAG, "Deep sleep for %llu ms, ending the simulated wake", (unsigned long long) (timer_wakeup_us / 1000));
+    exit(0);
+}
+
+esp_err_t rtc_gpio_isolate(gpio_num_t gpio_num)
+{
+    (void) gpio_num;
+    return ESP_OK;
+}
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num)
+{
+    (void) gpio_num;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    (void) config;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    (void) lock_type;
+    (void) arg;
+    (void) name;
+    *out_handle = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    (void) handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    (void) handle;
+    return ESP_OK;
+}
+
+uint32_t wake_stub_arm(uint32_t sleep_sec)
+{
+    return sleep_sec;
+}
+
+wake_stub_boot_reason_e wake_stub_boot_reason(void)
+{
+    return WAKE_STUB_BOOT_OTHER;
+}
+
+size_t wake_stub_get_samples(uint16_t *samples, uint32_t *stamps, size_t max_samples)
+{
+    (void) samples;
+    (void) stamps;
+    (void) max_samples;
+    return 0;
+}
+
+void wake_stub_clear_samples(void)
+{
+}
@@ -0,0 +1,15 @@
+/**
+ * Host build fake of the ESP-IDF RTC IO driver, the subset used by the application.
+ */
+
+#ifndef FAKE_DRIVER_RTC_IO_H_
+#define FAKE_DRIVER_RTC_IO_H_
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+esp_err_t rtc_gpio_isolate(gpio_num_t gpio_num);
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num);
+
+#endif /* FAKE_DRIVER_RTC_IO_H_ */
@@ -0,0 +1,22 @@
+/**
+ * Host build fake of the ESP-IDF MAC address API, the subset used by the application.
+ */
+
+#ifndef FAKE_ESP_MAC_H_
+#define FAKE_ESP_MAC_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_MAC_WIFI_STA = 0,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+#endif /* FAKE_ESP_MAC_H_ */
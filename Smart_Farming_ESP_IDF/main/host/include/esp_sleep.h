@@ -0,0 +1,30 @@
+/**
+ * Host build fake of the ESP-IDF sleep API, the subset used by the application.
+ * Deep sleep ends the process after printing the cycle record, see host/fake_sleep.c.
+ */
+
+#ifndef FAKE_ESP_SLEEP_H_
+#define FAKE_ESP_SLEEP_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+} esp_sleep_wakeup_cause_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
+
+void esp_deep_sleep_start(void) __attribute__((noreturn));
+
+#endif /* FAKE_ESP_SLEEP_H_ */
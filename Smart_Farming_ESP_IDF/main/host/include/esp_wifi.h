@@ -0,0 +1,48 @@
+/**
+ * Host build fake of the ESP-IDF Wi-Fi API, the subset used outside
+ * network_connection.c. The host uses its own network, see host/fake_network.c.
+ */
+
+#ifndef FAKE_ESP_WIFI_H_
+#define FAKE_ESP_WIFI_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define WIFI_PROTOCOL_11B   0x01
+#define WIFI_PROTOCOL_11G   0x02
+#define WIFI_PROTOCOL_11N   0x04
+
+typedef enum
+{
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum
+{
+    WIFI_PS_NONE = 0,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+typedef enum
+{
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+} wifi_auth_mode_t;
+
+esp_err_t esp_wifi_stop(void);
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap);
+
+esp_err_t esp_wifi_set_max_tx_power(int8_t power);
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi);
+
+#endif /* FAKE_ESP_WIFI_H_ */
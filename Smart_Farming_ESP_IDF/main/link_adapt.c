@@ -0,0 +1,194 @@
+#include "link_adapt.h"
+
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+
+#include "static_alloc.h"
+
+static const char TAG[] = "link_adapt";
+
+#define LINK_ADAPT_MAGIC    0x4C494E4B // "LINK"
+
+typedef struct link_adapt_state
+{
+    uint32_t magic;
+    uint8_t consecutive_failures;
+    link_adapt_stats_t stats;
+} link_adapt_state_t;
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR link_adapt_state_t link_state;
+
+// Retries and RSSI of the current uplink attempt
+static uint32_t attempt_retries = 0;
+static int8_t attempt_rssi = 0;
+
+/**
+ * @brief Initialize the state on power-on
+ * @note Helper function, the node starts at full power
+ */
+static void link_adapt_init(void)
+{
+    if (link_state.magic == LINK_ADAPT_MAGIC)
+        return;
+
+    memset(&link_state, 0, sizeof(link_state));
+    link_state.magic = LINK_ADAPT_MAGIC;
+    link_state.stats.tx_power = LINK_ADAPT_MAX_POWER;
+}
+
+void link_adapt_apply_phy(void)
+{
+    link_adapt_init();
+
+#if LINK_ADAPT_ENABLE
+    uint8_t protocol = link_state.stats.phy_11b ? WIFI_PROTOCOL_11B : (WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
+    // Driver call, may allocate in a task with the allocation guard armed
+    static_alloc_guard_pause();
+    esp_err_t err = esp_wifi_set_protocol(WIFI_IF_STA, protocol);
+    static_alloc_guard_resume();
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "PHY mode not set: %s", esp_err_to_name(err));
+    }
+#endif
+}
+
+void link_adapt_apply_power(void)
+{
+    link_adapt_init();
+
+#if LINK_ADAPT_ENABLE
+    static_alloc_guard_pause();
+    esp_err_t err = esp_wifi_set_max_tx_power(link_state.stats.tx_power);
+    static_alloc_guard_resume();
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "TX power not set: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "TX power %d.%02d dBm%s", link_state.stats.tx_power / 4, (link_state.stats.tx_power % 4) * 25,
+             link_state.stats.phy_11b ? ", 802.11b" : "");
+#endif
+}
+
+void link_adapt_record_rssi(int8_t rssi)
+{
+    if (rssi != 0)
+        attempt_rssi = rssi;
+}
+
+void link_adapt_record_retry(void)
+{
+    attempt_retries++;
+}
+
+/**
+ * @brief Choose the TX power and PHY mode from the link history
+ * @param delivered true if the sensor data of this attempt was delivered
+ * @note Helper function for link_adapt_update
+ */
+static void link_adapt_choose(bool delivered)
+{
+    link_adapt_stats_t *stats = &link_state.stats;
+    int power = stats->tx_power;
+
+    if (!delivered)
+    {
+        // Do not save energy on a link that just failed
+        if (link_state.consecutive_failures < UINT8_MAX)
+            link_state.consecutive_failures++;
+        if (power >= LINK_ADAPT_MAX_POWER && link_state.consecutive_failures >= LINK_ADAPT_PHY_FAILURES && !stats->phy_11b)
+        {
+            ESP_LOGW(TAG, "Uplink failed %u times at full power, falling back to 802.11b", link_state.consecutive_failures);
+            stats->phy_11b = true;
+        }
+        power = LINK_ADAPT_MAX_POWER;
+    }
+    else
+    {
+        link_state.consecutive_failures = 0;
+
+        if (stats->rssi_avg != 0)
+        {
+            // RSSI of the node frames at the AP, lower by the power reduction
+            int uplink_rssi = stats->rssi_avg - (LINK_ADAPT_MAX_POWER - power) / 4;
+
+            if (attempt_retries > 0 || uplink_rssi < LINK_ADAPT_TARGET_RSSI)
+                power += LINK_ADAPT_POWER_STEP;
+            else if (uplink_rssi > LINK_ADAPT_TARGET_RSSI + LINK_ADAPT_MARGIN_DB)
+                power -= LINK_ADAPT_POWER_STEP;
+
+            // Back to the faster PHY once the signal is good at full power
+            if (stats->phy_11b && stats->rssi_avg > LINK_ADAPT_TARGET_RSSI + LINK_ADAPT_MARGIN_DB)
+            {
+                ESP_LOGI(TAG, "Signal recovered, leaving 802.11b");
+                stats->phy_11b = false;
+            }
+        }
+        else if (attempt_retries > 0)
+        {
+            // No RSSI (ESP-NOW), only retries tell the link is weak
+            power += LINK_ADAPT_POWER_STEP;
+        }
+    }
+
+    if (power > LINK_ADAPT_MAX_POWER)
+        power = LINK_ADAPT_MAX_POWER;
+    if (power < LINK_ADAPT_MIN_POWER)
+        power = LINK_ADAPT_MIN_POWER;
+
+    if (power != stats->tx_power)
+    {
+        stats->tx_power = (int8_t) power;
+        stats->power_changes++;
+    }
+}
+
+void link_adapt_update(bool delivered)
+{
+    link_adapt_init();
+
+    // Freshest RSSI, the station may still be connected
+    int rssi = 0;
+    if (esp_wifi_sta_get_rssi(&rssi) == ESP_OK)
+        link_adapt_record_rssi((int8_t) rssi);
+
+    link_adapt_stats_t *stats = &link_state.stats;
+    stats->uplinks++;
+    stats->retries += attempt_retries;
+    if (!delivered)
+        stats->failures++;
+
+    if (attempt_rssi != 0)
+    {
+        stats->rssi = attempt_rssi;
+        stats->rssi_avg = (stats->rssi_avg == 0) ? attempt_rssi
+                        : (int8_t) (stats->rssi_avg + (attempt_rssi - stats->rssi_avg) / LINK_ADAPT_RSSI_WEIGHT);
+    }
+
+#if LINK_ADAPT_ENABLE
+    int8_t previous_power = stats->tx_power;
+    link_adapt_choose(delivered);
+    if (stats->tx_power != previous_power)
+    {
+        // Takes effect now if the radio is still on (continuous mode, light sleep)
+        link_adapt_apply_power();
+    }
+#endif
+
+    ESP_LOGI(TAG, "RSSI %d (avg %d), retries %lu, %s", stats->rssi, stats->rssi_avg,
+             (unsigned long) attempt_retries, delivered ? "delivered" : "failed");
+
+    attempt_retries = 0;
+    attempt_rssi = 0;
+}
+
+void link_adapt_get_stats(link_adapt_stats_t *stats)
+{
+    link_adapt_init();
+    *stats = link_state.stats;
+}
@@ -0,0 +1,85 @@
+/**
+ * Wi-Fi link adaptation. Tracks the RSSI and the retry and failure history of the
+ * uplink in RTC memory and sets the TX power to what the link needs. Power goes down
+ * while the link has margin and back up on weak signal, retries or a failed uplink.
+ * When the uplink keeps failing at full power, the station falls back to 802.11b,
+ * which is slower but more robust.
+ *
+ * The node only measures the RSSI of the AP frames. The RSSI of its own frames at
+ * the AP is estimated as that value minus the power reduction, assuming the AP
+ * transmits at about LINK_ADAPT_MAX_POWER.
+ */
+
+#ifndef LINK_ADAPT_H_
+#define LINK_ADAPT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 1 = adapt TX power and PHY mode, 0 = default maximum power, statistics only
+#define LINK_ADAPT_ENABLE           1
+
+// TX power in units of 0.25 dBm, as used by esp_wifi_set_max_tx_power
+#define LINK_ADAPT_MAX_POWER        80      // 20 dBm
+#define LINK_ADAPT_MIN_POWER        34      // 8.5 dBm
+#define LINK_ADAPT_POWER_STEP       8       // 2 dBm per uplink
+
+// Estimated RSSI of the node frames at the AP to keep, and the margin before lowering the power
+#define LINK_ADAPT_TARGET_RSSI      -70
+#define LINK_ADAPT_MARGIN_DB        6
+#define LINK_ADAPT_RSSI_WEIGHT      4       // New RSSI counts 1/4 in the average
+
+// 802.11b fallback after this many failed uplinks in a row at full power
+#define LINK_ADAPT_PHY_FAILURES     2
+
+// Link statistics, kept across deep sleep
+typedef struct link_adapt_stats
+{
+    int8_t rssi;                // Last measured RSSI in dBm, 0 if not measured yet
+    int8_t rssi_avg;            // Average RSSI in dBm
+    int8_t tx_power;            // Current TX power limit in 0.25 dBm
+    bool phy_11b;               // Station limited to 802.11b
+    uint32_t uplinks;           // Uplink attempts since power-on
+    uint32_t failures;          // Failed uplinks since power-on
+    uint32_t retries;           // Wi-Fi connect and ESP-NOW send retries since power-on
+    uint32_t power_changes;     // TX power changes since power-on
+} link_adapt_stats_t;
+
+/**
+ * @brief Set the PHY mode chosen by the link history
+ * @note Call after esp_wifi_set_mode and before esp_wifi_start
+ */
+void link_adapt_apply_phy(void);
+
+/**
+ * @brief Set the TX power chosen by the link history
+ * @note Call after esp_wifi_start, before the first frame is sent
+ */
+void link_adapt_apply_power(void);
+
+/**
+ * @brief Record the RSSI of the AP
+ * @param rssi RSSI in dBm
+ */
+void link_adapt_record_rssi(int8_t rssi);
+
+/**
+ * @brief Record one retry of the link layer (Wi-Fi reconnect, ESP-NOW send without ack)
+ */
+void link_adapt_record_retry(void);
+
+/**
+ * @brief Update the statistics and the TX power at the end of an uplink attempt
+ * @param delivered true if the sensor data was delivered
+ * @note Reads the current RSSI if the station is connected. The new TX power applies
+ *       right away if the radio is on, the PHY mode from the next connection.
+ */
+void link_adapt_update(bool delivered);
+
+/**
+ * @brief Get the link statistics
+ * @param stats Address of the output statistics structure
+ */
+void link_adapt_get_stats(link_adapt_stats_t *stats);
+
+#endif /* LINK_ADAPT_H_ */
@@ -0,0 +1,81 @@
+#include "mqtt_fsm.h"
+
+mqtt_fsm_state_e mqtt_fsm_next(mqtt_fsm_state_e state, uint32_t event)
+{
+    switch (state)
+    {
+        case MQTT_FSM_CONNECTING:
+            if (event == MQTT_FSM_EVT_CONNECTED)
+                return MQTT_FSM_CONNECTED;
+            // The client reconnects on its own, errors only end the wait on timeout
+            if (event == MQTT_FSM_EVT_TIMEOUT)
+                return MQTT_FSM_SLEEP;
+            break;
+
+        case MQTT_FSM_CONNECTED:
+            if (event == MQTT_FSM_EVT_PUBLISHED)
+                return MQTT_FSM_FLUSHED;
+            if (event == MQTT_FSM_EVT_PUBLISH_QUEUED)
+                return MQTT_FSM_PUBLISHING;
+            if (event == MQTT_FSM_EVT_DISCONNECTED)
+                return MQTT_FSM_CONNECTING;
+            if (event == MQTT_FSM_EVT_TIMEOUT)
+                return MQTT_FSM_SLEEP;
+            break;
+
+        case MQTT_FSM_PUBLISHING:
+            if (event == MQTT_FSM_EVT_PUBLISHED)
+                return MQTT_FSM_FLUSHED;
+            // QoS 1 data stays in the client outbox and is sent again after reconnecting
+            if (event == MQTT_FSM_EVT_DISCONNECTED)
+                return MQTT_FSM_CONNECTING;
+            if (event == MQTT_FSM_EVT_TIMEOUT)
+                return MQTT_FSM_SLEEP;
+            break;
+
+        case MQTT_FSM_FLUSHED:
+            if (event == MQTT_FSM_EVT_DATA || event == MQTT_FSM_EVT_TIMEOUT || event == MQTT_FSM_EVT_DISCONNECTED)
+                return MQTT_FSM_SLEEP;
+            break;
+
+        case MQTT_FSM_SLEEP:
+            if (event == MQTT_FSM_EVT_RESUME)
+                return MQTT_FSM_CONNECTING;
+            break;
+
+        default:
+            break;
+    }
+
+    return state;
+}
+
+uint32_t mqtt_fsm_timeout_ms(mqtt_fsm_state_e state)
+{
+    switch (state)
+    {
+        case MQTT_FSM_CONNECTING:
+            return MQTT_FSM_CONNECT_TIMEOUT_MS;
+        case MQTT_FSM_CONNECTED:
+            return MQTT_FSM_CONNECTED_TIMEOUT_MS;
+        case MQTT_FSM_PUBLISHING:
+            return MQTT_FSM_PUBLISH_TIMEOUT_MS;
+        case MQTT_FSM_FLUSHED:
+            return MQTT_FSM_FLUSH_LINGER_MS;
+        default:
+            return 0;
+    }
+}
+
+const char *mqtt_fsm_state_name(mqtt_fsm_state_e state)
+{
+    static const char *const names[MQTT_FSM_STATE_MAX] = {
+        "CONNECTING",
+        "CONNECTED",
+        "PUBLISHING",
+        "FLUSHED",
+        "SLEEP",
+    };
+
+    return (state < MQTT_FSM_STATE_MAX) ? names[state] : "UNKNOWN";
+}
@@ -0,0 +1,66 @@
+/**
+ * MQTT wake cycle state machine. Pure transition logic, no ESP-IDF dependencies,
+ * so it can be compiled and checked on the host.
+ *
+ * CONNECTING -> CONNECTED -> PUBLISHING -> FLUSHED -> SLEEP
+ *
+ * After a light sleep the session is still open, SLEEP goes back to CONNECTING
+ * which completes right away.
+ */
+
+#ifndef MQTT_FSM_H_
+#define MQTT_FSM_H_
+
+#include <stdint.h>
+
+// States
+typedef enum mqtt_fsm_state
+{
+    MQTT_FSM_CONNECTING = 0,    // Waiting for CONNACK
+    MQTT_FSM_CONNECTED,         // Connected, data is being handed to the client
+    MQTT_FSM_PUBLISHING,        // Waiting for PUBACK (QoS 1)
+    MQTT_FSM_FLUSHED,           // Data delivered, short linger for downlink config
+    MQTT_FSM_SLEEP,             // Light sleep with the session kept, or disconnect and deep sleep
+    MQTT_FSM_STATE_MAX,
+} mqtt_fsm_state_e;
+
+// Events, used as task notification bits. Handled in this order when several are pending.
+#define MQTT_FSM_EVT_CONNECTED      (1UL << 0)  // MQTT_EVENT_CONNECTED
+#define MQTT_FSM_EVT_PUBLISH_QUEUED (1UL << 1)  // Data handed to the client, waiting for PUBACK
+#define MQTT_FSM_EVT_PUBLISHED      (1UL << 2)  // MQTT_EVENT_PUBLISHED or QoS 0 data written
+#define MQTT_FSM_EVT_DATA           (1UL << 3)  // Downlink config received
+#define MQTT_FSM_EVT_DISCONNECTED   (1UL << 4)  // MQTT_EVENT_DISCONNECTED
+#define MQTT_FSM_EVT_ERROR          (1UL << 5)  // MQTT_EVENT_ERROR
+#define MQTT_FSM_EVT_TIMEOUT        (1UL << 6)  // State timeout expired
+#define MQTT_FSM_EVT_RESUME         (1UL << 7)  // Woke up from light sleep
+#define MQTT_FSM_EVT_COUNT          8
+
+// State timeouts in milliseconds
+#define MQTT_FSM_CONNECT_TIMEOUT_MS     10000
+#define MQTT_FSM_CONNECTED_TIMEOUT_MS   1000
+#define MQTT_FSM_PUBLISH_TIMEOUT_MS     3000
+#define MQTT_FSM_FLUSH_LINGER_MS        500
+
+/**
+ * @brief Get next state
+ * @param state Current state
+ * @param event One MQTT_FSM_EVT_* bit
+ * @return Next state, the current state if the event is ignored
+ */
+mqtt_fsm_state_e mqtt_fsm_next(mqtt_fsm_state_e state, uint32_t event);
+
+/**
+ * @brief Get timeout of a state
+ * @param state State
+ * @return Timeout in milliseconds, 0 if the state has no timeout
+ */
+uint32_t mqtt_fsm_timeout_ms(mqtt_fsm_state_e state);
+
+/**
+ * @brief Get state name for logging
+ * @param state State
+ * @return State name
+ */
+const char *mqtt_fsm_state_name(mqtt_fsm_state_e state);
+
+#endif /* MQTT_FSM_H_ */
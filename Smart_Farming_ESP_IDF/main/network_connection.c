@@ -5,23 +5,222 @@
 #include <string.h>
 
 #include "freertos/event_groups.h"
+#include "esp_attr.h"
+#include "esp_netif.h"
+
+#include "continuous_mode.h"
+#include "cycle_profiler.h"
+#include "deferred_log.h"
+#include "device_role.h"
+#include "link_adapt.h"
+#include "static_alloc.h"
+#include "wake_budget.h"
+#include "wall_clock.h"
+#include "wifi_ap_store.h"
 
 #define WIFI_CONNECTED_BIT 	BIT0
 #define WIFI_FAIL_BIT 		BIT1
 
+#define NETWORK_CACHE_MAGIC	0x4E455443 // "NETC"
+
+// Last successful connection, kept across deep sleep
+typedef struct network_cache
+{
+    uint32_t magic;
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    bool lease_valid;
+    uint16_t wakes_since_dhcp;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns;
+} network_cache_t;
+
 static const char TAG[] = "network";
 
-// Network connection callback
-static network_connected_event_callback_t network_connected_event_cb;
+// Network connection callbacks
+static network_connected_event_callback_t network_connected_event_cb = NULL;
+static network_disconnected_event_callback_t network_disconnected_event_cb = NULL;
+static network_reconnected_event_callback_t network_reconnected_event_cb = NULL;
+
+// Connection state, only changed from the event loop task
+static bool network_connected = false;
+static bool network_was_connected = false;
+// Connected callback already called
+static bool network_connected_cb_called = false;
 
 static const int WIFI_RETRY_ATTEMPT = 3;
 static int wifi_retry_count = 0;
 
+// Stored APs in ranked order, the one being joined is candidates[candidate_index]
+static uint8_t candidates[WIFI_AP_STORE_MAX];
+static uint8_t candidate_count = 0;
+static uint8_t candidate_index = 0;
+
 static esp_netif_t *mynetwork_netif = NULL;
 static esp_event_handler_instance_t ip_event_handler;
 static esp_event_handler_instance_t wifi_event_handler;
 
 static EventGroupHandle_t s_wifi_event_group = NULL;
+STATIC_ALLOC_EVENT_GROUP(s_wifi_event_group_buffer);
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR network_cache_t network_cache;
+
+// Connecting with the cached BSSID and channel, cleared once connected
+static bool fast_connect_active = false;
+// Cached lease applied, DHCP client stopped
+static bool static_ip_active = false;
+
+/**
+ * @brief Save the current AP and lease to the RTC cache
+ * @param ip_info IP information from the got IP event
+ * @note Helper function for ip_event_cb
+ */
+static void network_cache_save(const esp_netif_ip_info_t *ip_info)
+{
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+        return;
+
+    memcpy(network_cache.ssid, ap_info.ssid, sizeof(network_cache.ssid));
+    memcpy(network_cache.bssid, ap_info.bssid, sizeof(network_cache.bssid));
+    network_cache.channel = ap_info.primary;
+    wifi_ap_store_connected(candidates[candidate_index], ap_info.rssi);
+
+    if (static_ip_active)
+    {
+        network_cache.wakes_since_dhcp++;
+    }
+    else
+    {
+        network_cache.ip_info = *ip_info;
+        network_cache.lease_valid = (esp_netif_get_dns_info(mynetwork_netif, ESP_NETIF_DNS_MAIN, &network_cache.dns) == ESP_OK);
+        network_cache.wakes_since_dhcp = 0;
+    }
+
+    network_cache.magic = NETWORK_CACHE_MAGIC;
+}
+
+/**
+ * @brief Apply the cached lease to the station interface
+ * @return ESP_OK or error code, DHCP is used on error
+ * @note Call before esp_wifi_start. The got IP event is raised as soon as the station is connected.
+ */
+static esp_err_t network_cache_apply_ip(void)
+{
+    esp_err_t err = esp_netif_dhcpc_stop(mynetwork_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED)
+        return err;
+
+    err = esp_netif_set_ip_info(mynetwork_netif, &network_cache.ip_info);
+    if (err == ESP_OK)
+    {
+        err = esp_netif_set_dns_info(mynetwork_netif, ESP_NETIF_DNS_MAIN, &network_cache.dns);
+    }
+
+    if (err != ESP_OK)
+    {
+        esp_netif_dhcpc_start(mynetwork_netif);
+        return err;
+    }
+
+    static_ip_active = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Drop the cache and connect the normal way: full scan and DHCP
+ * @note Helper function for wifi_event_cb, the caller reconnects
+ */
+static void network_cache_fallback(void)
+{
+    fast_connect_active = false;
+    network_cache.magic = 0;
+    cycle_profiler_clear_flags(CYCLE_FLAG_FAST_CONNECT | CYCLE_FLAG_STATIC_IP);
+
+    if (static_ip_active)
+    {
+        static_ip_active = false;
+        esp_netif_dhcpc_start(mynetwork_netif);
+    }
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK)
+    {
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    }
+}
+
+/**
+ * @brief Get the number of retries allowed for the AP being joined
+ * @return Retries before falling back to the next AP
+ * @note Helper function for wifi_event_cb. With several APs, moving on is cheaper than retrying.
+ */
+static int network_retry_limit(void)
+{
+    return (candidate_index + 1 < candidate_count) ? 1 : WIFI_RETRY_ATTEMPT;
+}
+
+/**
+ * @brief Fill the station config with a stored AP
+ * @param wifi_config Station config
+ * @param index Index in the ranked candidates
+ * @note Helper function
+ */
+static void network_candidate_config(wifi_config_t *wifi_config, uint8_t index)
+{
+    const wifi_ap_entry_t *ap = wifi_ap_store_get(candidates[index]);
+
+    memset(wifi_config, 0, sizeof(*wifi_config));
+    // this sets the weakest authmode accepted in fast scan mode (default)
+    wifi_config->sta.threshold.authmode = WIFI_AUTHMODE;
+    if (ap != NULL)
+    {
+        strncpy((char*)wifi_config->sta.ssid, ap->ssid, sizeof(wifi_config->sta.ssid));
+        strncpy((char*)wifi_config->sta.password, ap->password, sizeof(wifi_config->sta.password));
+    }
+}
+
+/**
+ * @brief Give up on the AP being joined and move to the next ranked one
+ * @return true if there is a next AP, the caller reconnects
+ * @note Helper function for wifi_event_cb
+ */
+static bool network_next_candidate(void)
+{
+    wifi_ap_store_failed(candidates[candidate_index]);
+    if (candidate_index + 1 >= candidate_count)
+        return false;
+
+    candidate_index++;
+    wifi_retry_count = 0;
+
+    wifi_config_t wifi_config;
+    network_candidate_config(&wifi_config, candidate_index);
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    ESP_LOGW(TAG, "Falling back to Wi-Fi network: %s", wifi_config.sta.ssid);
+
+    return true;
+}
+
+/**
+ * @brief Call the disconnected callback once per lost connection
+ * @note Helper function for the event callbacks
+ */
+static void network_connection_lost(void)
+{
+    if (!network_connected)
+        return;
+
+    network_connected = false;
+    if (network_disconnected_event_cb)
+    {
+        network_disconnected_event_cb();
+    }
+}
 
 /** 
  * @brief IP events callback
@@ -32,20 +231,40 @@ static EventGroupHandle_t s_wifi_event_group = NULL;
  */
 static void ip_event_cb(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-    ESP_LOGI(TAG, "Handling IP event, event code 0x%" PRIx32, event_id);
+    DEFERRED_LOGI(TAG, DLOG_NETWORK_IP_EVENT, "Handling IP event, event code 0x%x", (unsigned) event_id);
     switch (event_id)
     {
 		case (IP_EVENT_STA_GOT_IP):
 			ip_event_got_ip_t *event_ip = (ip_event_got_ip_t *)event_data;
 			ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event_ip->ip_info.ip));
+			cycle_profiler_mark(CYCLE_PHASE_DHCP);
+			network_cache_save(&event_ip->ip_info);
+			fast_connect_active = false;
 			wifi_retry_count = 0;
+			network_connected = true;
+
+			// Start the uplink right away, the network task only logs
+			if (!network_was_connected)
+			{
+				network_was_connected = true;
+				network_connection_call_callback();
+			}
+			else if (network_reconnected_event_cb)
+			{
+				network_reconnected_event_cb();
+			}
+
+			// After the uplink, the SNTP request goes out while MQTT connects
+			wall_clock_sync_start();
+
 			xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 			break;
 
 		case (IP_EVENT_STA_LOST_IP):
-			ESP_LOGI(TAG, "Lost IP");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_LOST_IP, "Lost IP");
             wifi_retry_count = 0;
             xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+			network_connection_lost();
 			break;
 
 		case (IP_EVENT_GOT_IP6):
@@ -56,7 +275,7 @@ static void ip_event_cb(void *arg, esp_event_base_t event_base, int32_t event_id
 			break;
 
 		default:
-			ESP_LOGI(TAG, "IP event not handled");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_IP_NOT_HANDLED, "IP event not handled");
 			break;
     }
 }
@@ -70,41 +289,60 @@ static void ip_event_cb(void *arg, esp_event_base_t event_base, int32_t event_id
  */
 static void wifi_event_cb(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-    ESP_LOGI(TAG, "Handling Wi-Fi event, event code 0x%" PRIx32, event_id);
+    DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_EVENT, "Handling Wi-Fi event, event code 0x%x", (unsigned) event_id);
 
     switch (event_id)
     {
 		case (WIFI_EVENT_WIFI_READY):
-			ESP_LOGI(TAG, "Wi-Fi ready");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_READY, "Wi-Fi ready");
 			break;
 
 		case (WIFI_EVENT_SCAN_DONE):
-			ESP_LOGI(TAG, "Wi-Fi scan done");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_SCAN_DONE, "Wi-Fi scan done");
 			break;
 
 		case (WIFI_EVENT_STA_START):
-			ESP_LOGI(TAG, "Wi-Fi started, connecting to AP...");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_STARTED, "Wi-Fi started, connecting to AP...");
+			link_adapt_apply_power();
 			esp_wifi_connect();
 			break;
 
 		case (WIFI_EVENT_STA_STOP):
-			ESP_LOGI(TAG, "Wi-Fi stopped");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_STOPPED, "Wi-Fi stopped");
 			break;
 
 		case (WIFI_EVENT_STA_CONNECTED):
-			ESP_LOGI(TAG, "Wi-Fi connected");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_CONNECTED, "Wi-Fi connected");
+			cycle_profiler_mark(CYCLE_PHASE_WIFI_ASSOC);
 			break;
 
 		case (WIFI_EVENT_STA_DISCONNECTED):
-			ESP_LOGI(TAG, "Wi-Fi disconnected");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_DISCONNECTED, "Wi-Fi disconnected");
+			network_connection_lost();
+
+			if (fast_connect_active)
+			{
+				// Cached AP gone or moved to another channel, do not count this as a retry
+				ESP_LOGW(TAG, "Cached AP not reachable, falling back to full scan");
+				network_cache_fallback();
+				esp_wifi_connect();
+			}
 
-			if (wifi_retry_count < WIFI_RETRY_ATTEMPT) 
+			else if (wifi_retry_count < network_retry_limit()) 
 			{
-				ESP_LOGI(TAG, "Retrying to connect to Wi-Fi network...");
+				DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_RETRY, "Retrying to connect to Wi-Fi network, reason %d...",
+						 ((wifi_event_sta_disconnected_t *) event_data)->reason);
+				link_adapt_record_retry();
 				esp_wifi_connect();
 				wifi_retry_count++;
 			} 
 
+			else if (network_next_candidate())
+			{
+				link_adapt_record_retry();
+				esp_wifi_connect();
+			}
+
 			else 
 			{
 				ESP_LOGI(TAG, "Failed to connect to Wi-Fi network");
@@ -113,11 +351,11 @@ static void wifi_event_cb(void *arg, esp_event_base_t event_base, int32_t event_
 			break;
 
 		case (WIFI_EVENT_STA_AUTHMODE_CHANGE):
-			ESP_LOGI(TAG, "Wi-Fi authmode changed");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_AUTHMODE, "Wi-Fi authmode changed");
 			break;
 
 		default:
-			ESP_LOGI(TAG, "Wi-Fi event not handled");
+			DEFERRED_LOGI(TAG, DLOG_NETWORK_WIFI_NOT_HANDLED, "Wi-Fi event not handled");
 			break;
     }
 }
@@ -128,7 +366,7 @@ static void wifi_event_cb(void *arg, esp_event_base_t event_base, int32_t event_
  */
 esp_err_t network_init(void)
 {
-    s_wifi_event_group = xEventGroupCreate();
+    s_wifi_event_group = static_alloc_event_group_create(&s_wifi_event_group_buffer);
 
     esp_err_t ret = esp_netif_init();
     if (ret != ESP_OK) 
@@ -176,48 +414,99 @@ esp_err_t network_init(void)
 }
 
 /**
- * @brief Connecting to network and set appropriate event bits
- * @param wifi_ssid WiFi SSID
- * @param wifi_password WiFi password
- * @return ESP_OK or ESP_FAIL
+ * @brief Configure the station and start joining the network
+ * @return ESP_OK once the join started, ESP_FAIL if no network is stored
+ * @note Joins the best ranked stored AP first and falls back to the others in ranked order.
+ *       The result is reported through the event bits, see network_wait_connected.
  */
-esp_err_t network_connect(char* wifi_ssid, char* wifi_password)
+static esp_err_t network_connect_start(void)
 {
-    wifi_config_t wifi_config = {
-        .sta = {
-            // this sets the weakest authmode accepted in fast scan mode (default)
-            .threshold.authmode = WIFI_AUTHMODE,
-        },
-    };
+    wifi_ap_store_load();
+    candidate_count = wifi_ap_store_rank(candidates, WIFI_AP_STORE_MAX);
+    candidate_index = 0;
+    if (candidate_count == 0)
+    {
+        ESP_LOGE(TAG, "No Wi-Fi network stored");
+        return ESP_FAIL;
+    }
 
-    strncpy((char*)wifi_config.sta.ssid, wifi_ssid, sizeof(wifi_config.sta.ssid));
-    strncpy((char*)wifi_config.sta.password, wifi_password, sizeof(wifi_config.sta.password));
+    wifi_config_t wifi_config;
+    network_candidate_config(&wifi_config, 0);
 
+    // A wake that failed to deliver may have failed because of a stale cache.
+    // The cache only applies if the best ranked AP is the one it was saved for.
+    if (NETWORK_FAST_CONNECT && network_cache.magic == NETWORK_CACHE_MAGIC && wake_budget_previous_failures() == 0 &&
+        strncmp(network_cache.ssid, (const char *) wifi_config.sta.ssid, sizeof(network_cache.ssid)) == 0)
+    {
+        memcpy(wifi_config.sta.bssid, network_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.bssid_set = true;
+        wifi_config.sta.channel = network_cache.channel;
+        fast_connect_active = true;
+        cycle_profiler_set_flags(CYCLE_FLAG_FAST_CONNECT);
+        ESP_LOGI(TAG, "Fast connect, channel %d", network_cache.channel);
+
+        if (NETWORK_FAST_STATIC_IP && network_cache.lease_valid && network_cache.wakes_since_dhcp < NETWORK_DHCP_EVERY)
+        {
+            esp_err_t err = network_cache_apply_ip();
+            if (err == ESP_OK)
+            {
+                cycle_profiler_set_flags(CYCLE_FLAG_STATIC_IP);
+                ESP_LOGI(TAG, "Using cached IP " IPSTR, IP2STR(&network_cache.ip_info.ip));
+            }
+            else
+            {
+                ESP_LOGW(TAG, "Cached IP not applied: %s", esp_err_to_name(err));
+            }
+        }
+    }
+
+#if OPERATING_MODE == OPERATING_MODE_CONTINUOUS
+    // Modem sleep between DTIM beacons, lets the chip enter light sleep
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MIN_MODEM));
+#else
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE)); // default is WIFI_PS_MIN_MODEM
+#endif
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM)); // default is WIFI_STORAGE_FLASH
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    link_adapt_apply_phy();
 
     ESP_LOGI(TAG, "Connecting to Wi-Fi network: %s", wifi_config.sta.ssid);
+    cycle_profiler_mark(CYCLE_PHASE_WIFI_START);
+    wake_budget_register(WAKE_BUDGET_PHASE_WIFI, WAKE_BUDGET_WIFI_MS);
     ESP_ERROR_CHECK(esp_wifi_start());
 
+    return ESP_OK;
+}
+
+esp_err_t network_begin(void)
+{
+    ESP_ERROR_CHECK(network_init());
+
+    return network_connect_start();
+}
+
+esp_err_t network_wait_connected(uint32_t timeout_ms)
+{
+    TickType_t timeout = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
     EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-        pdFALSE, pdFALSE, portMAX_DELAY);
+        pdFALSE, pdFALSE, timeout);
 
     if (bits & WIFI_CONNECTED_BIT) 
 	{
-        ESP_LOGI(TAG, "Connected to Wi-Fi network: %s", wifi_config.sta.ssid);
+        ESP_LOGI(TAG, "Connected to Wi-Fi network: %s", wifi_ap_store_get(candidates[candidate_index])->ssid);
+        wake_budget_phase_done(WAKE_BUDGET_PHASE_WIFI);
         return ESP_OK;
     } 
 	else if (bits & WIFI_FAIL_BIT) 
 	{
-        ESP_LOGE(TAG, "Failed to connect to Wi-Fi network: %s", wifi_config.sta.ssid);
+        ESP_LOGE(TAG, "Failed to connect to any of the %u stored Wi-Fi networks", candidate_count);
         return ESP_FAIL;
     }
 
-    ESP_LOGE(TAG, "Unexpected Wi-Fi error");
-    return ESP_FAIL;
+    ESP_LOGE(TAG, "Wi-Fi connection timed out");
+    return ESP_ERR_TIMEOUT;
 }
 
 /**
@@ -264,72 +553,94 @@ esp_err_t network_connect(char* wifi_ssid, char* wifi_password)
 void network_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Network connecting...");
-    ESP_ERROR_CHECK(network_init());
-
-    esp_err_t ret = network_connect(WIFI_SSID, WIFI_PASSWORD);
+    esp_err_t ret = network_begin();
+    if (ret == ESP_OK)
+    {
+        ret = network_wait_connected(portMAX_DELAY);
+    }
+    // Ranking changes are saved once the join is settled, off the critical path
+    wifi_ap_store_commit();
     if(ret != ESP_OK) 
 	{
         ESP_LOGE(TAG, "Failed to connect to Wi-Fi network");
+#if DEVICE_ROLE == DEVICE_ROLE_SENSOR && OPERATING_MODE == OPERATING_MODE_DEEP_SLEEP
+        // Keep the reading and try again next wake, with backoff
+        wake_budget_abort(TAG);
+#else
+        // The gateway and the continuous mode have no wake to end, restart
         my_error_handler(TAG);
+#endif
     }
 
-    wifi_ap_record_t ap_info;
-    ret = esp_wifi_sta_get_ap_info(&ap_info);
-    if (ret == ESP_ERR_WIFI_CONN) 
-	{
-        ESP_LOGE(TAG, "Wi-Fi station interface not initialized");
-        my_error_handler(TAG);
-    }
+    // The connected callback already ran from the got IP event, this is off the critical path
+    network_record_ap_info();
 
-    else if (ret == ESP_ERR_WIFI_NOT_CONNECT) 
-	{
-        ESP_LOGE(TAG, "Wi-Fi station is not connected");
-        my_error_handler(TAG);
-    } 
+    // Later connection changes are reported through the callbacks
+    vTaskDelete(NULL);
+}
 
-	else 
-	{
+void network_record_ap_info(void)
+{
+    // A failure here is only logged, the uplink handles a lost connection itself
+    wifi_ap_record_t ap_info;
+    esp_err_t ret = esp_wifi_sta_get_ap_info(&ap_info);
+    if (ret == ESP_ERR_WIFI_CONN)
+    {
+        ESP_LOGW(TAG, "Wi-Fi station interface not initialized");
+    }
+    else if (ret == ESP_ERR_WIFI_NOT_CONNECT)
+    {
+        ESP_LOGW(TAG, "Wi-Fi station is not connected");
+    }
+    else
+    {
         ESP_LOGI(TAG, "--- Access Point Information ---");
         ESP_LOG_BUFFER_HEX("MAC Address", ap_info.bssid, sizeof(ap_info.bssid));
         ESP_LOG_BUFFER_CHAR("SSID", ap_info.ssid, sizeof(ap_info.ssid));
         ESP_LOGI(TAG, "Primary Channel: %d", ap_info.primary);
         ESP_LOGI(TAG, "RSSI: %d", ap_info.rssi);
-
-        vTaskDelay(pdMS_TO_TICKS(3000));
+        link_adapt_record_rssi(ap_info.rssi);
     }
+}
 
-	while(1)
+void network_connection_set_callback(network_connected_event_callback_t cb)
+{
+	network_connected_event_cb = cb;
+
+	// Connected before the callback was set
+	if (network_connected)
 	{
-        EventBits_t ux_wifi_event = xEventGroupGetBits(s_wifi_event_group);
-        if(ux_wifi_event & WIFI_CONNECTED_BIT)
-        {
-            // Check for connection callback
-            if (network_connected_event_cb)
-            {
-                network_connection_call_callback();
-            }
-        }
-        else
-        {
-            ESP_LOGI(TAG, "Getting new IP");
-        }
-		vTaskDelay(pdMS_TO_TICKS(5000));
+		network_connection_call_callback();
 	}
 }
 
-void network_connection_set_callback(network_connected_event_callback_t cb)
+void network_connection_set_disconnect_callback(network_disconnected_event_callback_t cb)
 {
-	network_connected_event_cb = cb;
+	network_disconnected_event_cb = cb;
+}
+
+void network_connection_set_reconnect_callback(network_reconnected_event_callback_t cb)
+{
+	network_reconnected_event_cb = cb;
 }
 
 void network_connection_call_callback(void)
 {
-	network_connected_event_cb();
+	if (network_connected_event_cb == NULL)
+		return;
+
+	// Called from the event loop task or from network_connection_set_callback, only the first call goes through
+	if (!__atomic_exchange_n(&network_connected_cb_called, true, __ATOMIC_ACQ_REL))
+	{
+		network_connected_event_cb();
+	}
 }
 
+STATIC_ALLOC_TASK(network_task_buffers, NETWORK_TASK_STACK_SIZE);
+
 void network_start(void)
 {
-	BaseType_t err = xTaskCreatePinnedToCore(&network_task, "Network_task", NETWORK_TASK_STACK_SIZE, NULL, NETWORK_TASK_PRIORITY, NULL, NETWORK_TASK_CORE_ID);
+	BaseType_t err = static_alloc_task_create(&network_task_buffers, &network_task, "Network_task", NULL, NETWORK_TASK_PRIORITY, NULL, NETWORK_TASK_CORE_ID);
     if (err != pdPASS)
     {
         ESP_LOGE(TAG, "Network task creation failed");
@@ -12,20 +12,27 @@
 
 // Callback typedef
 typedef void (*network_connected_event_callback_t)(void);
+typedef void (*network_disconnected_event_callback_t)(void);
+typedef void (*network_reconnected_event_callback_t)(void);
 
 // Network task config
 #define NETWORK_TASK_STACK_SIZE 4096
 #define NETWORK_TASK_PRIORITY	3
 #define NETWORK_TASK_CORE_ID	0
 
-// Enter the Wi-Fi credentials here
+// Enter the Wi-Fi credentials here. More APs can be added to WIFI_AP_STORE_SEED in wifi_ap_store.h
 #define WIFI_SSID 				"Your_WiFi_SSID"
 #define WIFI_PASSWORD 			"Your_WiFi_Password"
 #define WIFI_AUTHMODE 			WIFI_AUTH_WPA2_PSK
 
-// esp_err_t network_init(void);
+// Fast reconnect after deep sleep
+// The BSSID, channel and DHCP lease of the last connection are kept in RTC memory.
+// The cache is dropped when the cached AP is not found, and not used after a wake that failed to deliver.
+#define NETWORK_FAST_CONNECT	1		// Connect to the cached BSSID and channel, no full scan
+#define NETWORK_FAST_STATIC_IP	1		// Reuse the cached DHCP lease, no DHCP exchange
+#define NETWORK_DHCP_EVERY		30		// Renew the lease through DHCP every N wakes, keep it below the router lease time
 
-// esp_err_t network_connect(char* wifi_ssid, char* wifi_password);
+// esp_err_t network_init(void);
 
 // esp_err_t network_disconnect(void);
 
@@ -34,11 +41,28 @@ typedef void (*network_connected_event_callback_t)(void);
 /**
  * @brief Sets the callback function
  * @param cb Address of callback function
+ * @note Called once, from the event loop task, as soon as the first IP is acquired.
+ *       If the network is already connected, it is called right away.
  */
 void network_connection_set_callback(network_connected_event_callback_t cb);
 
+/**
+ * @brief Sets the disconnected callback function
+ * @param cb Address of callback function
+ * @note Called from the event loop task, once per lost connection
+ */
+void network_connection_set_disconnect_callback(network_disconnected_event_callback_t cb);
+
+/**
+ * @brief Sets the reconnected callback function
+ * @param cb Address of callback function
+ * @note Called from the event loop task each time the IP is acquired again after a disconnect
+ */
+void network_connection_set_reconnect_callback(network_reconnected_event_callback_t cb);
+
 /**
  * @brief Calls the callback function.
+ * @note Only the first call calls the callback, later calls do nothing
  */
 void network_connection_call_callback(void);
 
@@ -47,4 +71,25 @@ void network_connection_call_callback(void);
  */
 void network_start(void);
 
+/**
+ * @brief Bring up the network stack and start joining the Wi-Fi network, without a task
+ * @return ESP_OK once the join started, ESP_FAIL if no network is stored
+ * @note For the run-to-completion cycle, the caller waits with network_wait_connected.
+ *       The connected callback is still called from the got IP event if one is set.
+ */
+esp_err_t network_begin(void);
+
+/**
+ * @brief Wait for the join started by network_begin
+ * @param timeout_ms Longest wait in milliseconds, portMAX_DELAY waits forever
+ * @return ESP_OK when connected, ESP_FAIL if every stored network failed, ESP_ERR_TIMEOUT on timeout
+ */
+esp_err_t network_wait_connected(uint32_t timeout_ms);
+
+/**
+ * @brief Log the AP of the connection and record its RSSI for the link adaptation
+ * @note Off the critical path, call after the uplink
+ */
+void network_record_ap_info(void);
+
 #endif /* NETWORK_CONNECTION_H_ */
\ No newline at end of file
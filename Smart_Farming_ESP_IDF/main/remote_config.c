@@ -0,0 +1,165 @@
+#include "remote_config.h"
+
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#define REMOTE_CONFIG_MAGIC 0x52434647 // "RCFG"
+
+static const char TAG[] = "remote_config";
+
+typedef struct remote_config
+{
+    uint32_t magic;
+    uint32_t revision;
+    uint32_t sleep_sec;
+    uint8_t qos;
+    uint8_t soil_samples;
+    uint8_t transport;
+    uint32_t log_request;
+} remote_config_t;
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR remote_config_t cached_config;
+static RTC_DATA_ATTR bool config_subscribed = false;
+static RTC_DATA_ATTR uint32_t wake_count = 0;
+
+/**
+ * @brief Check if the cached config is valid
+ * @return true if a config was received since power-on
+ * @note Helper function for the getters
+ */
+static bool remote_config_valid(void)
+{
+    return cached_config.magic == REMOTE_CONFIG_MAGIC;
+}
+
+/**
+ * @brief Read an optional number from a JSON object and check its range
+ * @param json JSON object
+ * @param name Field name
+ * @param min Minimum accepted value
+ * @param max Maximum accepted value
+ * @param value Output value, untouched if the field is missing
+ * @return false if the field is present but not a number or out of range
+ * @note Helper function for remote_config_apply_json
+ */
+static bool remote_config_get_field(const cJSON *json, const char *name, double min, double max, uint32_t *value)
+{
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(json, name);
+    if (item == NULL)
+        return true;
+
+    if (!cJSON_IsNumber(item) || item->valuedouble < min || item->valuedouble > max)
+    {
+        ESP_LOGW(TAG, "Invalid %s", name);
+        return false;
+    }
+
+    *value = (uint32_t) item->valuedouble;
+    return true;
+}
+
+esp_err_t remote_config_apply_json(const char *data, int data_len)
+{
+    cJSON *json = cJSON_ParseWithLength(data, data_len);
+    if (json == NULL || !cJSON_IsObject(json))
+    {
+        ESP_LOGW(TAG, "Config is not a JSON object");
+        cJSON_Delete(json);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t revision = remote_config_get_revision();
+    uint32_t sleep_sec = remote_config_get_sleep_sec();
+    uint32_t qos = remote_config_get_qos();
+    uint32_t soil_samples = remote_config_get_soil_samples();
+    uint32_t transport = remote_config_get_transport();
+    uint32_t log_request = remote_config_get_log_request();
+
+    bool valid = remote_config_get_field(json, "rev", 0, UINT32_MAX, &revision)
+              && remote_config_get_field(json, "sleep_sec", REMOTE_CONFIG_MIN_SLEEP_SEC, REMOTE_CONFIG_MAX_SLEEP_SEC, &sleep_sec)
+              && remote_config_get_field(json, "qos", 0, REMOTE_CONFIG_MAX_QOS, &qos)
+              && remote_config_get_field(json, "soil_samples", 1, REMOTE_CONFIG_MAX_SOIL_SAMPLES, &soil_samples)
+              && remote_config_get_field(json, "transport", UPLINK_TRANSPORT_MQTT, UPLINK_TRANSPORT_ESPNOW, &transport)
+              && remote_config_get_field(json, "log_req", 0, UINT32_MAX, &log_request);
+
+    cJSON_Delete(json);
+
+    if (!valid)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // A retained message is delivered again on each new subscription, and an older one can still be queued
+    if (remote_config_valid() && revision <= cached_config.revision)
+    {
+        ESP_LOGI(TAG, "Config rev %lu not newer than rev %lu, ignored", (unsigned long) revision,
+                 (unsigned long) cached_config.revision);
+        return ESP_OK;
+    }
+
+    cached_config.revision = revision;
+    cached_config.sleep_sec = sleep_sec;
+    cached_config.qos = (uint8_t) qos;
+    cached_config.soil_samples = (uint8_t) soil_samples;
+    cached_config.transport = (uint8_t) transport;
+    cached_config.log_request = log_request;
+    cached_config.magic = REMOTE_CONFIG_MAGIC;
+
+    ESP_LOGI(TAG, "Config rev %lu applied: sleep %lus, QoS %u, soil samples %u, transport %u", (unsigned long) revision,
+             (unsigned long) sleep_sec, (unsigned) qos, (unsigned) soil_samples, (unsigned) transport);
+
+    return ESP_OK;
+}
+
+bool remote_config_needs_subscribe(bool session_present)
+{
+    return !session_present || !config_subscribed;
+}
+
+void remote_config_set_subscribed(void)
+{
+    config_subscribed = true;
+}
+
+uint32_t remote_config_get_sleep_sec(void)
+{
+    return remote_config_valid() ? cached_config.sleep_sec : REMOTE_CONFIG_DEFAULT_SLEEP_SEC;
+}
+
+int remote_config_get_qos(void)
+{
+    return remote_config_valid() ? cached_config.qos : REMOTE_CONFIG_DEFAULT_QOS;
+}
+
+uint8_t remote_config_get_soil_samples(void)
+{
+    return remote_config_valid() ? cached_config.soil_samples : REMOTE_CONFIG_DEFAULT_SOIL_SAMPLES;
+}
+
+uint8_t remote_config_get_transport(void)
+{
+    return remote_config_valid() ? cached_config.transport : REMOTE_CONFIG_DEFAULT_TRANSPORT;
+}
+
+uint8_t remote_config_select_transport(void)
+{
+    uint8_t transport = remote_config_get_transport();
+    if (transport != UPLINK_TRANSPORT_MQTT && (wake_count++ % REMOTE_CONFIG_MQTT_EVERY) == 0)
+    {
+        return UPLINK_TRANSPORT_MQTT;
+    }
+
+    return transport;
+}
+
+uint32_t remote_config_get_log_request(void)
+{
+    return remote_config_valid() ? cached_config.log_request : 0;
+}
+
+uint32_t remote_config_get_revision(void)
+{
+    return remote_config_valid() ? cached_config.revision : 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * Downlink configuration. Settings received on the per-device config topic are
+ * validated and cached in RTC memory, so later wakes use them without waiting
+ * for the broker.
+ */
+
+#ifndef REMOTE_CONFIG_H_
+#define REMOTE_CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+// Uplink transports
+#define UPLINK_TRANSPORT_MQTT               0
+#define UPLINK_TRANSPORT_UDP                1
+#define UPLINK_TRANSPORT_ESPNOW             2
+
+// With UDP or ESP-NOW, every Nth wake still uses MQTT so the node gets config updates and publishes diagnostics
+#define REMOTE_CONFIG_MQTT_EVERY            10
+
+// Defaults used until a valid config is received
+// Build-time transport choice, can be changed at runtime with the "transport" field
+#define REMOTE_CONFIG_DEFAULT_TRANSPORT     UPLINK_TRANSPORT_MQTT
+#define REMOTE_CONFIG_DEFAULT_SLEEP_SEC     60
+#define REMOTE_CONFIG_DEFAULT_QOS           0
+#define REMOTE_CONFIG_DEFAULT_SOIL_SAMPLES  1
+
+// Accepted ranges
+#define REMOTE_CONFIG_MIN_SLEEP_SEC         10
+#define REMOTE_CONFIG_MAX_SLEEP_SEC         86400
+#define REMOTE_CONFIG_MAX_QOS               1
+#define REMOTE_CONFIG_MAX_SOIL_SAMPLES      16
+
+/**
+ * @brief Apply a config message received from the broker
+ * @param data JSON payload, e.g. {"rev":3,"sleep_sec":300,"qos":1,"soil_samples":4,"transport":0,"log_req":1}
+ * @param data_len Payload length
+ * @return ESP_OK if applied or not newer than the applied config, ESP_ERR_INVALID_ARG if the payload is not valid
+ * @note All fields are optional. Nothing is applied if any present field is out of range, or if "rev"
+ *       is not greater than the revision of the applied config (a missing "rev" keeps the current one).
+ */
+esp_err_t remote_config_apply_json(const char *data, int data_len);
+
+/**
+ * @brief Check if the config topic has to be subscribed in this wake
+ * @param session_present Session present flag of the CONNACK
+ * @return true if the broker has no session for us or we have not subscribed since power-on
+ * @note With a persistent session the broker keeps the subscription across wakes and
+ *       queues config updates, so there is no SUBSCRIBE round trip on every wake.
+ */
+bool remote_config_needs_subscribe(bool session_present);
+
+/**
+ * @brief Remember that the config topic was subscribed
+ */
+void remote_config_set_subscribed(void);
+
+/**
+ * @brief Get deep sleep interval
+ * @return Sleep interval in seconds
+ */
+uint32_t remote_config_get_sleep_sec(void);
+
+/**
+ * @brief Get QoS used to publish sensor data
+ * @return QoS level
+ */
+int remote_config_get_qos(void);
+
+/**
+ * @brief Get number of soil moisture samples averaged per reading
+ * @return Number of samples
+ */
+uint8_t remote_config_get_soil_samples(void);
+
+/**
+ * @brief Get uplink transport for sensor data
+ * @return UPLINK_TRANSPORT_MQTT, UPLINK_TRANSPORT_UDP or UPLINK_TRANSPORT_ESPNOW
+ */
+uint8_t remote_config_get_transport(void);
+
+/**
+ * @brief Get uplink transport for this wake
+ * @return The configured transport, or UPLINK_TRANSPORT_MQTT every REMOTE_CONFIG_MQTT_EVERY wakes
+ * @note Call this once per wake
+ */
+uint8_t remote_config_select_transport(void);
+
+/**
+ * @brief Get the log request number
+ * @return Last "log_req" received, 0 if none
+ * @note The deferred log is published once each time the number changes, so a retained config does not repeat it
+ */
+uint32_t remote_config_get_log_request(void);
+
+/**
+ * @brief Get revision of the applied config
+ * @return Revision number, 0 if the defaults are used
+ */
+uint32_t remote_config_get_revision(void);
+
+#endif /* REMOTE_CONFIG_H_ */
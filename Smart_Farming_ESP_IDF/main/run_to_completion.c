@@ -0,0 +1,299 @@
+#include "run_to_completion.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "mqtt_client.h"
+#include "cJSON.h"
+
+#include "My_MQTT_task.h"
+#include "cycle_profiler.h"
+#include "deferred_log.h"
+#include "device_identity.h"
+#include "error_handler.h"
+#include "mqtt_fsm.h"
+#include "network_connection.h"
+#include "remote_config.h"
+#include "sensor_interface_task.h"
+#include "sensor_payload.h"
+#include "sleep_manager.h"
+#include "static_alloc.h"
+#include "task_monitor.h"
+#include "wake_budget.h"
+#include "wifi_ap_store.h"
+
+static const char TAG[] = "run_to_completion";
+
+#if RUN_TO_COMPLETION_ENABLE
+// MQTT events, set from the esp-mqtt task
+#define MQTT_CONNECTED_BIT  BIT0
+#define MQTT_PUBLISHED_BIT  BIT1
+#define MQTT_CONFIG_BIT     BIT2
+
+static EventGroupHandle_t mqtt_events = NULL;
+STATIC_ALLOC_EVENT_GROUP(mqtt_events_buffer);
+STATIC_ALLOC_TASK(cycle_task_buffers, RUN_TO_COMPLETION_STACK_SIZE);
+
+static esp_mqtt_client_handle_t cycle_client = NULL;
+
+static char data_topic[DEVICE_TOPIC_MAX_LEN];
+static char diag_topic[DEVICE_TOPIC_MAX_LEN];
+static char config_topic[DEVICE_TOPIC_MAX_LEN];
+static char log_topic[DEVICE_TOPIC_MAX_LEN];
+
+/**
+ * @brief MQTT event handler, only turns the events into event group bits
+ * @param handler_args user data registered to the event
+ * @param base Event base for the handler
+ * @param event_id The id for the received event
+ * @param event_data The data for the event, esp_mqtt_event_handle_t
+ */
+static void run_to_completion_mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+    switch ((esp_mqtt_event_id_t) event_id)
+    {
+        case MQTT_EVENT_CONNECTED:
+            DEFERRED_LOGI(TAG, DLOG_CYCLE_MQTT_CONNECTED, "MQTT_EVENT_CONNECTED");
+            cycle_profiler_mark(CYCLE_PHASE_MQTT_CONNACK);
+            if (remote_config_needs_subscribe(event->session_present))
+            {
+                esp_mqtt_client_subscribe(cycle_client, config_topic, MY_MQTT_CONFIG_QOS);
+            }
+            xEventGroupSetBits(mqtt_events, MQTT_CONNECTED_BIT);
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            DEFERRED_LOGI(TAG, DLOG_CYCLE_MQTT_DISCONNECTED, "MQTT_EVENT_DISCONNECTED");
+            xEventGroupClearBits(mqtt_events, MQTT_CONNECTED_BIT);
+            break;
+
+        case MQTT_EVENT_SUBSCRIBED:
+            remote_config_set_subscribed();
+            break;
+
+        case MQTT_EVENT_PUBLISHED:
+            // Only the sensor data is published with QoS > 0
+            DEFERRED_LOGI(TAG, DLOG_CYCLE_MQTT_PUBLISHED, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            xEventGroupSetBits(mqtt_events, MQTT_PUBLISHED_BIT);
+            break;
+
+        case MQTT_EVENT_DATA:
+            if (event->topic_len == strlen(config_topic) &&
+                strncmp(event->topic, config_topic, event->topic_len) == 0 &&
+                event->data_len == event->total_data_len &&
+                remote_config_apply_json(event->data, event->data_len) == ESP_OK)
+            {
+                xEventGroupSetBits(mqtt_events, MQTT_CONFIG_BIT);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Wait for an MQTT event bit
+ * @param bit Event bit
+ * @param clear pdTRUE to clear the bit when it is set
+ * @param timeout_ms Longest wait in milliseconds
+ * @return true if the bit is set
+ */
+static bool run_to_completion_wait(EventBits_t bit, BaseType_t clear, uint32_t timeout_ms)
+{
+    EventBits_t bits = xEventGroupWaitBits(mqtt_events, bit, clear, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & bit) != 0;
+}
+
+/**
+ * @brief Hand a message to the MQTT client
+ * @param topic Topic
+ * @param data Message
+ * @param len Message length
+ * @param qos QoS
+ * @return Message ID, -1 if failed
+ */
+static int run_to_completion_publish(const char *topic, const char *data, int len, int qos)
+{
+    // The client copies the message to its outbox
+    static_alloc_guard_pause();
+    int msg_id = esp_mqtt_client_publish(cycle_client, topic, data, len, qos, 0);
+    static_alloc_guard_resume();
+
+    return msg_id;
+}
+
+/**
+ * @brief Publish the cycle profile and task monitor record of the previous wake
+ * @note Also publishes the deferred log when the remote config asked for it
+ */
+static void run_to_completion_publish_diag(void)
+{
+    char record[192];
+    size_t len = cycle_profiler_format_previous(record, sizeof(record));
+    if (len > 0)
+    {
+        run_to_completion_publish(diag_topic, record, len, 0);
+        ESP_LOGI(TAG, "Cycle profile: %s", record);
+    }
+
+    static char task_record[TASK_MONITOR_RECORD_SIZE];
+    len = task_monitor_format_previous(task_record, sizeof(task_record));
+    if (len > 0)
+    {
+        run_to_completion_publish(diag_topic, task_record, len, 0);
+    }
+
+    const uint8_t *log_record;
+    len = deferred_log_drain_requested(&log_record);
+    if (len > 0)
+    {
+        run_to_completion_publish(log_topic, (const char *) log_record, len, 0);
+    }
+}
+
+/**
+ * @brief Publish the sensor data and wait until it is delivered
+ * @return true if delivered
+ */
+static bool run_to_completion_publish_data(void)
+{
+    char *json_string = sensor_payload_create();
+    if (json_string == NULL)
+        return false;
+
+    int qos = remote_config_get_qos();
+    xEventGroupClearBits(mqtt_events, MQTT_PUBLISHED_BIT);
+    int msg_id = run_to_completion_publish(data_topic, json_string, strlen(json_string), qos);
+    cycle_profiler_mark(CYCLE_PHASE_PUBLISH);
+    ESP_LOGI(TAG, "Published: %s", json_string);
+    cJSON_free(json_string);
+
+    if (msg_id < 0)
+        return false;
+
+    // QoS 0 has no PUBACK, the data is already written
+    return (qos == 0) || run_to_completion_wait(MQTT_PUBLISHED_BIT, pdTRUE, MQTT_FSM_PUBLISH_TIMEOUT_MS);
+}
+
+/**
+ * @brief Give up on this wake
+ * @param reason Step that failed, for the log
+ * @note Saving the data and stopping Wi-Fi may allocate, the guard is paused for good
+ */
+static void run_to_completion_abort(const char *reason)
+{
+    ESP_LOGE(TAG, "%s", reason);
+    static_alloc_guard_pause();
+    wake_budget_abort(TAG);
+}
+
+/**
+ * @brief Run-to-completion task, one pass per wake
+ * @param pvParameters
+ */
+static void run_to_completion_task(void *pvParameters)
+{
+    cycle_profiler_set_flags(CYCLE_FLAG_RUN_TO_COMPLETION);
+
+    // Radio on first, the association runs in the Wi-Fi driver while the sensors are read
+    if (network_begin() != ESP_OK)
+    {
+        run_to_completion_abort("No Wi-Fi network stored");
+    }
+
+    // Without the ADS111x the soil moisture is left out, each reading probes it again
+    if (sensor_interface_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ADC configuration error");
+    }
+    sensor_interface_read();
+
+    esp_err_t err = network_wait_connected(wake_budget_remaining_ms());
+    if (err != ESP_OK)
+    {
+        wifi_ap_store_commit();
+        run_to_completion_abort("Failed to connect to Wi-Fi network");
+    }
+    cycle_profiler_mark(CYCLE_PHASE_NETWORK_READY);
+
+    device_identity_topic(MY_MQTT_DATA_LEAF, data_topic, sizeof(data_topic));
+    device_identity_topic(MY_MQTT_DIAG_LEAF, diag_topic, sizeof(diag_topic));
+    device_identity_topic(MY_MQTT_CONFIG_LEAF, config_topic, sizeof(config_topic));
+    device_identity_topic(MY_MQTT_LOG_LEAF, log_topic, sizeof(log_topic));
+
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = BROKER_ADDRESS,
+        .credentials.username = BROKER_USERNAME,
+        .credentials.authentication.password = BROKER_PASSWORD,
+        .credentials.client_id = device_identity_get_id(),
+        .session.keepalive = MY_MQTT_KEEPALIVE,
+        .session.disable_clean_session = true,
+        .session.protocol_ver = MY_MQTT_PROTOCOL,
+        .network.reconnect_timeout_ms = MY_MQTT_RECONNECT_MS,
+    };
+    wake_budget_register(WAKE_BUDGET_PHASE_MQTT, WAKE_BUDGET_MQTT_MS);
+    cycle_client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_mqtt_client_register_event(cycle_client, ESP_EVENT_ANY_ID, run_to_completion_mqtt_event_handler, NULL);
+    esp_mqtt_client_start(cycle_client);
+    static_alloc_guard_arm();
+
+    while (1)
+    {
+        if (!run_to_completion_wait(MQTT_CONNECTED_BIT, pdFALSE, MQTT_FSM_CONNECT_TIMEOUT_MS))
+        {
+            run_to_completion_abort("MQTT connect timed out");
+        }
+        // Resumed from light sleep with the session still open
+        cycle_profiler_mark(CYCLE_PHASE_MQTT_CONNACK);
+
+        run_to_completion_publish_diag();
+        if (!run_to_completion_publish_data())
+        {
+            run_to_completion_abort("Sensor data not delivered");
+        }
+        wake_budget_set_uplink_ok();
+        wake_budget_phase_done(WAKE_BUDGET_PHASE_MQTT);
+        sensor_payload_clear_pending();
+
+        // Short linger for a downlink config, like the FLUSHED state of the MQTT task
+        run_to_completion_wait(MQTT_CONFIG_BIT, pdTRUE, MQTT_FSM_FLUSH_LINGER_MS);
+
+        // Off the critical path, NVS writes and the driver allocate
+        static_alloc_guard_pause();
+        wifi_ap_store_commit();
+        network_record_ap_info();
+
+        if (!sleep_manager_light_sleep())
+            break;
+        static_alloc_guard_resume();
+
+        cycle_profiler_set_flags(CYCLE_FLAG_RUN_TO_COMPLETION);
+        sensor_interface_read();
+    }
+
+    esp_mqtt_client_disconnect(cycle_client);
+    sleep_manager_enter_deep_sleep();
+}
+#endif
+
+void run_to_completion_start(void)
+{
+#if RUN_TO_COMPLETION_ENABLE
+    mqtt_events = static_alloc_event_group_create(&mqtt_events_buffer);
+
+    BaseType_t err = static_alloc_task_create(&cycle_task_buffers, &run_to_completion_task, "cycle_task", NULL,
+                                              RUN_TO_COMPLETION_PRIORITY, NULL, RUN_TO_COMPLETION_CORE_ID);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "Run-to-completion task create failed");
+        my_error_handler(TAG);
+    }
+#else
+    ESP_LOGW(TAG, "RUN_TO_COMPLETION_ENABLE is not set");
+#endif
+}
@@ -0,0 +1,41 @@
+/**
+ * Run-to-completion wake cycle. The default deep sleep wake runs the sensor task,
+ * the network task and My_MQTT_task on both cores; they hand off through the
+ * connected callback, task notifications and the sensor event group. With
+ * RUN_TO_COMPLETION_ENABLE set, a wake with the MQTT uplink is instead one
+ * straight sequence on a single task pinned to core 0:
+ *
+ *   start the Wi-Fi join -> read the sensors while the radio associates ->
+ *   wait for the IP -> connect MQTT -> publish -> wait for the PUBACK and the
+ *   downlink config -> sleep
+ *
+ * Each step starts its work and only waits when the next step needs the result,
+ * on one event group for the Wi-Fi and MQTT events, with the same timeouts as the
+ * MQTT state machine. The Wi-Fi, lwIP, event loop and esp-mqtt tasks still run,
+ * they are part of those libraries.
+ *
+ * The cycle record carries CYCLE_FLAG_RUN_TO_COMPLETION, so the wake-to-sleep time
+ * and the heap low-water mark of both topologies can be compared from the diag
+ * topic with tools/topology_compare.py. The UDP and ESP-NOW uplinks keep their
+ * own tasks.
+ */
+
+#ifndef RUN_TO_COMPLETION_H_
+#define RUN_TO_COMPLETION_H_
+
+// 1 = deep sleep MQTT wakes run on a single task, 0 = sensor, network and MQTT tasks
+#define RUN_TO_COMPLETION_ENABLE        0
+
+// Same stack and priority as My_MQTT_task, core 0 like the Wi-Fi task
+#define RUN_TO_COMPLETION_STACK_SIZE    8192
+#define RUN_TO_COMPLETION_PRIORITY      5
+#define RUN_TO_COMPLETION_CORE_ID       0
+
+/**
+ * @brief Start the task that runs the whole wake cycle
+ * @note Called from app_main after the NVS init, instead of the sensor, network and MQTT tasks.
+ *       Does nothing without RUN_TO_COMPLETION_ENABLE.
+ */
+void run_to_completion_start(void);
+
+#endif /* RUN_TO_COMPLETION_H_ */
@@ -1,47 +1,120 @@
 #include "sensor_interface_task.h"
 
+#include <math.h>
+
+#include "esp_pm.h"
+
+#include "deferred_log.h"
+#include "static_alloc.h"
+
 static const char TAG[] = "sensor_interface";
 
 static bool sensor_interface_started = false;
 
+#define SENSOR_READY_BIT    BIT0
+#define SENSOR_SAMPLE_BIT   BIT1
+#define SENSOR_RUN_BIT      BIT2    // Cleared while paused
+
+static EventGroupHandle_t sensor_event_group = NULL;
+
+STATIC_ALLOC_TASK(sensor_task_buffers, SENSOR_INTERFACE_TASK_STACK_SIZE);
+STATIC_ALLOC_EVENT_GROUP(sensor_event_group_buffer);
+
+// Time of the last DHT22 reading
+static int64_t sample_start_us = 0;
+static int64_t sample_end_us = 0;
+
+#if CONFIG_PM_ENABLE
+// DHT22 bit timing needs a fixed CPU frequency, this also keeps light sleep off while reading
+static esp_pm_lock_handle_t pm_lock = NULL;
+#endif
+
+// Kept to reset the bus and probe the ADS111x again, see error_handler.h
+static i2c_master_bus_handle_t bus_handle = NULL;
+static i2c_master_dev_handle_t device_handle = NULL;
+
+// Sensors that answered their last reading, the payload leaves out the others
+static bool soil_available = false;
+static bool climate_available = false;
+
+static esp_err_t ADC_config(void);
+static esp_err_t ADC_recover(void);
+
 float get_temperature(void)
 {
-    return getTemperature();
+    return climate_available ? getTemperature() : NAN;
 }
 
 float get_humidity(void)
 {
-    return getHumidity();
+    return climate_available ? getHumidity() : NAN;
+}
+
+/**
+ * @brief Read the soil moisture sensor once, with the recovery ladder
+ * @return Raw reading, NAN if the ADS111x does not answer after the bus reset
+ * @note Helper function for get_soil_moisture
+ */
+static float sensor_interface_read_soil(void)
+{
+    // Marked unavailable earlier, one bus reset per reading until it answers again
+    if (!soil_available && ADC_recover() != ESP_OK)
+        return NAN;
+
+    // Retry
+    for (int attempt = 0; attempt <= SENSOR_INTERFACE_RETRIES; attempt++)
+    {
+        float value = getSoilMoisture();
+        if (!isnan(value))
+            return value;
+
+        vTaskDelay(pdMS_TO_TICKS(SENSOR_INTERFACE_RETRY_DELAY_MS));
+    }
+
+    // Reset the bus and probe the ADS111x again
+    if (ADC_recover() == ESP_OK)
+    {
+        float value = getSoilMoisture();
+        if (!isnan(value))
+            return value;
+    }
+
+    // Publish without the soil moisture
+    ESP_LOGE(TAG, "Soil moisture sensor unavailable");
+    soil_available = false;
+    return NAN;
 }
 
 float get_soil_moisture(void)
 {
-    return getSoilMoisture();
+    // Average the number of samples set by the remote config
+    uint8_t samples = remote_config_get_soil_samples();
+    float sum = 0;
+    for (uint8_t i = 0; i < samples; i++)
+    {
+        float sample = sensor_interface_read_soil();
+        if (isnan(sample))
+            return NAN;
+
+        sum += sample;
+    }
+    return sum / samples;
 }
 
 // ADS111x config structure
 ads111x_cfg_t my_ads111x_cfg;
 
 /**
- * @brief Configure ADC for soil moisture sensor
+ * @brief Probe the ADS111x and write its configuration
  * @return ESP_OK if success, ESP_FAIL otherwise
- * @note Helper function for sensor_interface_task
+ * @note Helper function for ADC_config and ADC_recover, the device may have lost its configuration
  */
-static esp_err_t ADC_config(void)
+static esp_err_t ADC_probe(void)
 {
-    // I2C master bus configuration
-    i2c_master_bus_config_t i2c_bus_config = {
-        .clk_source = I2C_CLK_SRC_DEFAULT,
-        .i2c_port = ADC_I2C,
-        .scl_io_num = ADC_SCL,
-        .sda_io_num = ADC_SDA,
-        .glitch_ignore_cnt = 7,
-    };
-
-    i2c_master_bus_handle_t bus_handle;
-    esp_err_t err = i2c_new_master_bus(&i2c_bus_config, &bus_handle);
+    // Connection test to the ADS111x
+    esp_err_t err = i2c_master_probe(bus_handle, (uint16_t) my_ads111x_cfg.device_addr, 100);
     if (err != ESP_OK)
-    {
+    {    
         ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
         return ESP_FAIL;
     }
@@ -49,55 +122,169 @@ static esp_err_t ADC_config(void)
     // Reset ADS111x config structure to default
     // ALWAYS CALL THIS TO MAKE SURE THE LIBRARY HAS THE SAME DEFAULT CONFIG AS THE DEVICE
     ads111x_reset_config_reg(&my_ads111x_cfg);
+    ads111x_configure_address(ADDRPIN_TO_GND, &my_ads111x_cfg);
 
-    // Set device address
-    err = ads111x_configure_address(ADDRPIN_TO_GND, &my_ads111x_cfg);
+    // ADS111x device configuration
+    my_ads111x_cfg.mux_config = ADS111x_MUX_SNGL_AIN0_GND;
+    my_ads111x_cfg.gain_amp = ADS111x_FSR_4V096;
+    my_ads111x_cfg.data_rate = ADS111x_DR_8SPS;
+    my_ads111x_cfg.operating_mode = ADS111x_SINGLE_SHOT;
+
+    // Initialize device 
+    err = initialize_ads111x(device_handle, &my_ads111x_cfg);
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
         return ESP_FAIL;
     }
 
-    // ADS111x I2C configuration
-    i2c_device_config_t i2C_device_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = (uint16_t) my_ads111x_cfg.device_addr,
-        .scl_speed_hz = I2C_SPEED_HZ,
-    };
+    soil_available = true;
+    DEFERRED_LOGI(TAG, DLOG_SENSOR_ADC_READY, "ADC ready");
 
-    i2c_master_dev_handle_t device_handle;
-    err = i2c_master_bus_add_device(bus_handle, &i2C_device_cfg, &device_handle);
-    if (err != ESP_OK)
+    return ESP_OK;
+}
+
+/**
+ * @brief Configure ADC for soil moisture sensor
+ * @return ESP_OK if success, ESP_FAIL otherwise
+ * @note Helper function for sensor_interface_task. The bus and the device are added once,
+ *       a later call only probes the ADS111x again
+ */
+static esp_err_t ADC_config(void)
+{
+    esp_err_t err;
+    if (bus_handle == NULL)
     {
-        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
-        return ESP_FAIL;
+        // I2C master bus configuration
+        i2c_master_bus_config_t i2c_bus_config = {
+            .clk_source = I2C_CLK_SRC_DEFAULT,
+            .i2c_port = ADC_I2C,
+            .scl_io_num = ADC_SCL,
+            .sda_io_num = ADC_SDA,
+            .glitch_ignore_cnt = 7,
+        };
+
+        err = i2c_new_master_bus(&i2c_bus_config, &bus_handle);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+            bus_handle = NULL;
+            return ESP_FAIL;
+        }
     }
 
-    // Connection test to the ADS111x
-    err = i2c_master_probe(bus_handle, (uint16_t) my_ads111x_cfg.device_addr, 100);
-    if (err != ESP_OK)
-    {    
-        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
-        return ESP_FAIL;
+    if (device_handle == NULL)
+    {
+        // Set device address
+        ads111x_reset_config_reg(&my_ads111x_cfg);
+        err = ads111x_configure_address(ADDRPIN_TO_GND, &my_ads111x_cfg);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+            return ESP_FAIL;
+        }
+
+        // ADS111x I2C configuration
+        i2c_device_config_t i2C_device_cfg = {
+            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+            .device_address = (uint16_t) my_ads111x_cfg.device_addr,
+            .scl_speed_hz = I2C_SPEED_HZ,
+        };
+
+        err = i2c_master_bus_add_device(bus_handle, &i2C_device_cfg, &device_handle);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+            device_handle = NULL;
+            return ESP_FAIL;
+        }
     }
 
-    // ADS111x device configuration
-    my_ads111x_cfg.mux_config = ADS111x_MUX_SNGL_AIN0_GND;
-    my_ads111x_cfg.gain_amp = ADS111x_FSR_4V096;
-    my_ads111x_cfg.data_rate = ADS111x_DR_8SPS;
-    my_ads111x_cfg.operating_mode = ADS111x_SINGLE_SHOT;
+    return ADC_probe();
+}
 
-    // Initialize device 
-    err = initialize_ads111x(device_handle, &my_ads111x_cfg);
-    if (err != ESP_OK)
+/**
+ * @brief Reset the I2C bus and set up the ADS111x again
+ * @return ESP_OK if the ADS111x answers
+ * @note The bus reset clocks out a device that holds SDA low after an interrupted transfer
+ */
+static esp_err_t ADC_recover(void)
+{
+    if (bus_handle != NULL)
     {
-        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
-        return ESP_FAIL;
+        esp_err_t err = i2c_master_bus_reset(bus_handle);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "I2C bus reset: %s (0x%x)", esp_err_to_name(err), err);
+        }
     }
 
-    ESP_LOGI(TAG, "ADC ready");
+    ESP_LOGW(TAG, "Probing the ADS111x again");
+    return ADC_config();
+}
+
+esp_err_t sensor_interface_init(void)
+{
+    setDHTgpio(DHT_GPIO);
 
-    return ESP_OK;
+#if CONFIG_PM_ENABLE
+    if (pm_lock == NULL)
+    {
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "sensor", &pm_lock));
+    }
+#endif
+
+    return ADC_config();
+}
+
+/**
+ * @brief Read the DHT22 and keep the time of the reading
+ * @return DHT_OK or the DHT22 error code
+ * @note Helper function for sensor_interface_read
+ */
+static int sensor_interface_read_dht(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(pm_lock);
+#endif
+    sample_start_us = esp_timer_get_time();
+    int ret = readDHT();
+    sample_end_us = esp_timer_get_time();
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(pm_lock);
+#endif
+
+    return ret;
+}
+
+int sensor_interface_read(void)
+{
+    DEFERRED_LOGI(TAG, DLOG_SENSOR_READING_DHT, "=== Reading DHT ===");
+    int ret = sensor_interface_read_dht();
+    if (ret != DHT_OK)
+    {
+        // Set the pin up again and retry once the DHT22 can answer
+        errorHandler(ret);
+        setDHTgpio(DHT_GPIO);
+        vTaskDelay(pdMS_TO_TICKS(SENSOR_INTERFACE_DHT_RETRY_MS));
+        ret = sensor_interface_read_dht();
+    }
+
+    errorHandler(ret);
+    climate_available = (ret == DHT_OK);
+    if (ret == DHT_OK)
+    {
+        cycle_profiler_mark(CYCLE_PHASE_SENSOR_READ);
+    }
+    else
+    {
+        // Publish without the temperature and humidity
+        ESP_LOGE(TAG, "DHT22 unavailable");
+    }
+
+    DEFERRED_LOGI(TAG, DLOG_SENSOR_VALUES, "Hum: %.1f Tmp: %.1f", DEFERRED_LOG_FLOAT(get_humidity()), DEFERRED_LOG_FLOAT(get_temperature()));
+
+    return ret;
 }
 
 /**
@@ -106,30 +293,74 @@ static esp_err_t ADC_config(void)
  */
 void sensor_interface_task(void *pvParameter)
 {
-    setDHTgpio(DHT_GPIO);
-
-    esp_err_t err = ADC_config();
+    // Without the ADS111x the soil moisture is left out, each reading probes it again
+    esp_err_t err = sensor_interface_init();
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "ADC configuration error");
-        my_error_handler(TAG);
     }
+    static_alloc_guard_arm();
 
+    TickType_t last_wake = xTaskGetTickCount();
     while (1)
     {
-        ESP_LOGI(TAG, "=== Reading DHT ===");
-        int ret = readDHT();
-
-        errorHandler(ret);
+        if (!(xEventGroupGetBits(sensor_event_group) & SENSOR_RUN_BIT))
+        {
+            xEventGroupWaitBits(sensor_event_group, SENSOR_RUN_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+            last_wake = xTaskGetTickCount();
+        }
 
-        ESP_LOGI(TAG, "Hum: %.1f Tmp: %.1f", get_humidity(), get_temperature());
+        sensor_interface_read();
+        // Failed readings also release the waiters, they should not wait for a broken sensor
+        xEventGroupSetBits(sensor_event_group, SENSOR_READY_BIT | SENSOR_SAMPLE_BIT);
 
         // -- wait at least 2 sec before reading again ------------
         // The interval of whole process must be beyond 2 seconds !!
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SENSOR_INTERFACE_READ_INTERVAL_MS));
     }
 }
 
+bool sensor_interface_wait_ready(uint32_t timeout_ms)
+{
+    if (sensor_event_group == NULL)
+        return false;
+
+    EventBits_t bits = xEventGroupWaitBits(sensor_event_group, SENSOR_READY_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & SENSOR_READY_BIT) != 0;
+}
+
+bool sensor_interface_wait_sample(uint32_t timeout_ms)
+{
+    if (sensor_event_group == NULL)
+        return false;
+
+    TickType_t timeout = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    EventBits_t bits = xEventGroupWaitBits(sensor_event_group, SENSOR_SAMPLE_BIT, pdTRUE, pdFALSE, timeout);
+    return (bits & SENSOR_SAMPLE_BIT) != 0;
+}
+
+void sensor_interface_pause(void)
+{
+    if (sensor_event_group != NULL)
+        xEventGroupClearBits(sensor_event_group, SENSOR_RUN_BIT);
+}
+
+void sensor_interface_resume(void)
+{
+    if (sensor_event_group == NULL)
+        return;
+
+    // The readings from before the pause are stale
+    xEventGroupClearBits(sensor_event_group, SENSOR_READY_BIT | SENSOR_SAMPLE_BIT);
+    xEventGroupSetBits(sensor_event_group, SENSOR_RUN_BIT);
+}
+
+void sensor_interface_get_sample_time(int64_t *start_us, int64_t *end_us)
+{
+    *start_us = sample_start_us;
+    *end_us = sample_end_us;
+}
+
 void sensor_interface_start(void)
 {
     if (sensor_interface_started) {
@@ -138,7 +369,10 @@ void sensor_interface_start(void)
     }
     sensor_interface_started = true;
 
-    BaseType_t err = xTaskCreatePinnedToCore(&sensor_interface_task, "sensor_interface_task", SENSOR_INTERFACE_TASK_STACK_SIZE, NULL, SENSOR_INTERFACE_TASK_PRIORITY, NULL, SENSOR_INTERFACE_TASK_CORE_ID);
+    sensor_event_group = static_alloc_event_group_create(&sensor_event_group_buffer);
+    xEventGroupSetBits(sensor_event_group, SENSOR_RUN_BIT);
+
+    BaseType_t err = static_alloc_task_create(&sensor_task_buffers, &sensor_interface_task, "sensor_interface_task", NULL, SENSOR_INTERFACE_TASK_PRIORITY, NULL, SENSOR_INTERFACE_TASK_CORE_ID);
     if (err != pdPASS)
     {
         ESP_LOGE(TAG, "Sensor interface task create fail...");
@@ -8,12 +8,17 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"
 
 #include "error_handler.h"
+#include "cycle_profiler.h"
+#include "remote_config.h"
+#include "continuous_mode.h"
 #include "ADS111x.h"
 #include "soil_moisture.h"
 #include "DHT22.h"
@@ -40,27 +45,94 @@
 // Must be accessible from soil_moisture.c, so it uses extern
 extern ads111x_cfg_t my_ads111x_cfg;
 
+// Time between DHT22 readings, at least 2 seconds
+#if OPERATING_MODE == OPERATING_MODE_CONTINUOUS
+#define SENSOR_INTERFACE_READ_INTERVAL_MS (CONTINUOUS_SAMPLE_SEC * 1000)
+#else
+#define SENSOR_INTERFACE_READ_INTERVAL_MS 3000
+#endif
+
+// Longest wait for the first sensor reading before sending data anyway
+#define SENSOR_INTERFACE_READY_TIMEOUT_MS 2000
+
 // ADC parameters
 #define I2C_SPEED_HZ 100000
 
+// Fault recovery, see error_handler.h
+#define SENSOR_INTERFACE_RETRIES          2       // Soil moisture retries before the I2C bus reset
+#define SENSOR_INTERFACE_RETRY_DELAY_MS   20
+#define SENSOR_INTERFACE_DHT_RETRY_MS     2000    // DHT22 retry after a failed reading, at least 2 seconds
+
 /**
  * @brief Get temperature data from any temperature sensor 
- * @return Temperature sensor data
+ * @return Temperature sensor data, NAN if the last reading failed
  */
 float get_temperature(void);
 
 /**
  * @brief Get humidity data from any humidity sensor 
- * @return Humidity sensor data
+ * @return Humidity sensor data, NAN if the last reading failed
  */
 float get_humidity(void);
 
 /**
  * @brief Get soil moisture data from any soil moisture sensor 
- * @return Soil moisture sensor data 
+ * @return Soil moisture sensor data, NAN if the sensor does not answer after the I2C bus reset
+ * @note A failed reading is retried, then the bus is reset and the ADS111x probed again
  */
 float get_soil_moisture(void);
 
+/**
+ * @brief Set up the DHT22 pin and the ADS111x without starting the task
+ * @return ESP_OK if success, ESP_FAIL if the ADS111x is not ready
+ * @note Called by the sensor interface task, and by the benchmarks that drive the sensors directly.
+ *       A missing ADS111x is not fatal, get_soil_moisture probes it again.
+ */
+esp_err_t sensor_interface_init(void);
+
+/**
+ * @brief Read the DHT22 once, on the calling task
+ * @return DHT_OK or the DHT22 error code, the error is already logged
+ * @note Call sensor_interface_init first. Used by the sensor interface task and the run-to-completion cycle.
+ *       A failed reading is retried once after SENSOR_INTERFACE_DHT_RETRY_MS, if that fails too
+ *       get_temperature and get_humidity return NAN until the next good reading.
+ */
+int sensor_interface_read(void);
+
+/**
+ * @brief Wait until the first sensor reading of this wake is done
+ * @param timeout_ms Longest wait in milliseconds
+ * @return true if the reading is done, false on timeout
+ */
+bool sensor_interface_wait_ready(uint32_t timeout_ms);
+
+/**
+ * @brief Wait for a new sensor reading
+ * @param timeout_ms Longest wait in milliseconds, portMAX_DELAY waits forever
+ * @return true if a reading was done since the last call, false on timeout
+ * @note For a single consumer, the continuous mode task
+ */
+bool sensor_interface_wait_sample(uint32_t timeout_ms);
+
+/**
+ * @brief Stop the periodic readings, e.g. for a planned light sleep
+ * @note A reading in progress is finished. No DHT22 reading and no PM lock until sensor_interface_resume.
+ */
+void sensor_interface_pause(void);
+
+/**
+ * @brief Restart the periodic readings with a reading right away
+ * @note Clears the ready state first, sensor_interface_wait_ready waits for the new reading
+ */
+void sensor_interface_resume(void);
+
+/**
+ * @brief Get the time of the last sensor reading
+ * @param start_us Output, esp_timer time the reading started
+ * @param end_us Output, esp_timer time the reading ended
+ */
+void sensor_interface_get_sample_time(int64_t *start_us, int64_t *end_us);
+
 /**
  * @brief Start sensor interface task
  */
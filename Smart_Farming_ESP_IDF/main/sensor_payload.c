@@ -0,0 +1,362 @@
+#include "sensor_payload.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cJSON.h"  // Include cJSON library for JSON handling
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "sensor_interface_task.h"
+#include "energy_model.h"
+#include "link_adapt.h"
+#include "ulp_sampler.h"
+#include "wake_stub.h"
+#include "wall_clock.h"
+
+// Large enough for a pending reading with all fields
+#define SENSOR_PAYLOAD_ITEM_MAX_LEN 160
+
+static const char TAG[] = "sensor_payload";
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR sensor_reading_t pending_readings[SENSOR_PAYLOAD_MAX_PENDING];
+static RTC_DATA_ATTR uint8_t pending_count = 0;
+static RTC_DATA_ATTR uint8_t pending_head = 0;
+
+/**
+ * @brief Add sensor values to a JSON object
+ * @note Helper function for sensor_payload_format. A sensor that is unavailable reads NAN
+ *       and its field is left out.
+ */
+static void sensor_payload_add_reading(cJSON *json, const sensor_reading_t *reading)
+{
+    if (!isnan(reading->temperature))
+        cJSON_AddNumberToObject(json, "temperature", reading->temperature);
+    if (!isnan(reading->humidity))
+        cJSON_AddNumberToObject(json, "humidity", reading->humidity);
+    if (!isnan(reading->soil_moisture))
+        cJSON_AddNumberToObject(json, "soil_moisture", reading->soil_moisture);
+
+    // Time the reading was taken, not when it is delivered
+    uint32_t unix_sec;
+    if (wall_clock_to_unix(reading->stamp, &unix_sec))
+        cJSON_AddNumberToObject(json, "ts", unix_sec);
+}
+
+/**
+ * @brief Get the length an array item takes in the printed JSON
+ * @param item Array item
+ * @return Length with the separating comma, SENSOR_PAYLOAD_ITEM_MAX_LEN if it does not fit the buffer
+ * @note Helper function for sensor_payload_drop_oldest
+ */
+static size_t sensor_payload_item_len(cJSON *item)
+{
+    char buffer[SENSOR_PAYLOAD_ITEM_MAX_LEN];
+    if (!cJSON_PrintPreallocated(item, buffer, sizeof(buffer), false))
+        return sizeof(buffer);
+
+    return strlen(buffer) + 1;
+}
+
+/**
+ * @brief Drop the oldest entries of an array until about excess bytes are saved
+ * @param json JSON object
+ * @param name Array name, the array is removed once empty
+ * @param excess Bytes still to save, decreased by the length of the dropped entries
+ * @return Number of entries dropped
+ * @note Helper function for sensor_payload_format_max
+ */
+static size_t sensor_payload_drop_oldest(cJSON *json, const char *name, size_t *excess)
+{
+    cJSON *array = cJSON_GetObjectItemCaseSensitive(json, name);
+    size_t dropped = 0;
+
+    while (array != NULL && array->child != NULL && *excess > 0)
+    {
+        size_t len = sensor_payload_item_len(array->child);
+        cJSON_DeleteItemFromArray(array, 0);
+        *excess -= len < *excess ? len : *excess;
+        dropped++;
+    }
+
+    if (array != NULL && array->child == NULL)
+    {
+        cJSON_DeleteItemFromObjectCaseSensitive(json, name);
+    }
+
+    return dropped;
+}
+
+/**
+ * @brief Drop the oldest soil history samples until about excess bytes are saved
+ * @param json JSON object
+ * @param excess Bytes still to save, decreased by the length of the dropped samples
+ * @return Number of samples dropped
+ * @note Helper function for sensor_payload_format_max. The "ts" of a run moves to its new first sample.
+ */
+static size_t sensor_payload_drop_history(cJSON *json, size_t *excess)
+{
+    cJSON *history = cJSON_GetObjectItemCaseSensitive(json, "soil_history");
+    size_t dropped = 0;
+
+    while (history != NULL && history->child != NULL && *excess > 0)
+    {
+        cJSON *run = history->child;
+        size_t run_dropped = sensor_payload_drop_oldest(run, "soil_moisture", excess);
+        dropped += run_dropped;
+
+        if (cJSON_GetObjectItemCaseSensitive(run, "soil_moisture") == NULL)
+        {
+            cJSON_DeleteItemFromArray(history, 0);
+            continue;
+        }
+
+        cJSON *ts = cJSON_GetObjectItemCaseSensitive(run, "ts");
+        cJSON *period = cJSON_GetObjectItemCaseSensitive(run, "period_s");
+        if (ts != NULL && period != NULL)
+        {
+            cJSON_SetNumberValue(ts, ts->valuedouble + run_dropped * period->valuedouble);
+        }
+    }
+
+    if (history != NULL && history->child == NULL)
+    {
+        cJSON_DeleteItemFromObjectCaseSensitive(json, "soil_history");
+    }
+
+    return dropped;
+}
+
+/**
+ * @brief Add the soil moisture samples as runs of evenly spaced samples
+ * @param json JSON object
+ * @param samples Raw ADC values, oldest first
+ * @param stamps wall_clock_stamp of each sample
+ * @param count Number of samples
+ * @note Helper function for sensor_payload_format_max. A new run starts where the spacing changes: a failed
+ *       upload, a failed stub read or a new ULP batch. Each run has the "ts" of its first sample (left out while
+ *       the clock was never set), "period_s" and the raw values in "soil_moisture".
+ */
+static void sensor_payload_add_history(cJSON *json, const uint16_t *samples, const uint32_t *stamps, size_t count)
+{
+    cJSON *history = cJSON_AddArrayToObject(json, "soil_history");
+    cJSON *values = NULL;
+    uint32_t period_sec = 0;
+
+    for (size_t i = 0; i < count && history != NULL; i++)
+    {
+        if (values == NULL || stamps[i] - stamps[i - 1] != period_sec)
+        {
+            cJSON *run = cJSON_CreateObject();
+            if (run == NULL)
+                return;
+            cJSON_AddItemToArray(history, run);
+
+            uint32_t unix_sec;
+            if (wall_clock_to_unix(stamps[i], &unix_sec))
+                cJSON_AddNumberToObject(run, "ts", unix_sec);
+
+            // The next sample sets the spacing of the run, a run of one sample has none
+            period_sec = (i + 1 < count && stamps[i + 1] > stamps[i]) ? stamps[i + 1] - stamps[i] : 0;
+            if (period_sec > 0)
+                cJSON_AddNumberToObject(run, "period_s", period_sec);
+
+            values = cJSON_AddArrayToObject(run, "soil_moisture");
+            if (values == NULL)
+                return;
+        }
+
+        cJSON_AddItemToArray(values, cJSON_CreateNumber(samples[i]));
+    }
+}
+
+void sensor_payload_save_pending(void)
+{
+    sensor_reading_t *slot = &pending_readings[(pending_head + pending_count) % SENSOR_PAYLOAD_MAX_PENDING];
+    if (pending_count == SENSOR_PAYLOAD_MAX_PENDING)
+    {
+        // Full, overwrite the oldest
+        pending_head = (pending_head + 1) % SENSOR_PAYLOAD_MAX_PENDING;
+    }
+    else
+    {
+        pending_count++;
+    }
+
+    slot->temperature = get_temperature();
+    slot->humidity = get_humidity();
+    slot->soil_moisture = get_soil_moisture();
+    slot->stamp = wall_clock_stamp();
+}
+
+size_t sensor_payload_get_readings(sensor_reading_t *readings, size_t max_readings)
+{
+    if (max_readings == 0)
+        return 0;
+
+    readings[0].temperature = get_temperature();
+    readings[0].humidity = get_humidity();
+    readings[0].soil_moisture = get_soil_moisture();
+    readings[0].stamp = wall_clock_stamp();
+
+    size_t count = 1;
+    for (uint8_t i = 0; i < pending_count && count < max_readings; i++)
+    {
+        readings[count++] = pending_readings[(pending_head + i) % SENSOR_PAYLOAD_MAX_PENDING];
+    }
+
+    return count;
+}
+
+void sensor_payload_clear_pending(void)
+{
+    pending_count = 0;
+    pending_head = 0;
+    wake_stub_clear_samples();
+    ulp_sampler_clear_samples();
+}
+
+/**
+ * @brief Format a reading as JSON, dropping the oldest history samples and pending readings to fit
+ * @param reading Current reading
+ * @param max_len Maximum string length, without the terminator
+ * @return JSON string, or NULL if out of memory or if the payload does not fit without them
+ * @note Helper function for the create and format functions
+ */
+static char *sensor_payload_format_max(const sensor_reading_t *reading, size_t max_len)
+{
+    // Create JSON object
+    cJSON *json_data = cJSON_CreateObject();
+    if (json_data == NULL)
+        return NULL;
+
+    sensor_payload_add_reading(json_data, reading);
+
+    // Readings of earlier wakes that could not be delivered, oldest first
+    if (pending_count > 0)
+    {
+        cJSON *pending = cJSON_AddArrayToObject(json_data, "pending");
+        for (uint8_t i = 0; i < pending_count && pending != NULL; i++)
+        {
+            cJSON *item = cJSON_CreateObject();
+            sensor_payload_add_reading(item, &pending_readings[(pending_head + i) % SENSOR_PAYLOAD_MAX_PENDING]);
+            cJSON_AddItemToArray(pending, item);
+        }
+    }
+
+    // Soil moisture sampled by the wake stub or the ULP since the last delivery, oldest first
+    uint16_t history_samples[WAKE_STUB_MAX_SAMPLES + ULP_BATCH_MAX_SAMPLES];
+    uint32_t history_stamps[WAKE_STUB_MAX_SAMPLES + ULP_BATCH_MAX_SAMPLES];
+    size_t history_count = wake_stub_get_samples(history_samples, history_stamps, WAKE_STUB_MAX_SAMPLES);
+    history_count += ulp_sampler_get_samples(&history_samples[history_count], &history_stamps[history_count],
+                                             ULP_BATCH_MAX_SAMPLES);
+    if (history_count > 0)
+    {
+        sensor_payload_add_history(json_data, history_samples, history_stamps, history_count);
+    }
+
+    static const char *const boot_reasons[] = { "other", "scheduled", "threshold", "sensor_error" };
+    wake_stub_boot_reason_e boot_reason = wake_stub_boot_reason();
+    if (ulp_sampler_boot_reason() != ULP_BATCH_REASON_NONE)
+    {
+        cJSON_AddStringToObject(json_data, "boot", ulp_batch_reason_name(ulp_sampler_boot_reason()));
+    }
+    else if (boot_reason != WAKE_STUB_BOOT_OTHER && boot_reason < sizeof(boot_reasons) / sizeof(boot_reasons[0]))
+    {
+        cJSON_AddStringToObject(json_data, "boot", boot_reasons[boot_reason]);
+    }
+
+    // Restarts and crashes since the last delivered uplink
+    uint32_t restarts = error_handler_restart_count();
+    if (restarts > 0)
+    {
+        cJSON_AddNumberToObject(json_data, "restarts", restarts);
+    }
+
+    // Energy cost of the previous cycle
+    energy_report_t energy;
+    if (energy_model_previous_cycle(&energy))
+    {
+        cJSON_AddNumberToObject(json_data, "cycle_mah", energy.cycle_mah);
+        cJSON_AddNumberToObject(json_data, "batt_life_h", energy.battery_life_h);
+    }
+
+    // Link quality and TX power, to weigh the energy against the reliability
+    link_adapt_stats_t link;
+    link_adapt_get_stats(&link);
+    cJSON *link_json = cJSON_AddObjectToObject(json_data, "link");
+    if (link_json != NULL)
+    {
+        cJSON_AddNumberToObject(link_json, "rssi", link.rssi);
+        cJSON_AddNumberToObject(link_json, "tx_dbm", link.tx_power / 4.0);
+        cJSON_AddBoolToObject(link_json, "phy_11b", link.phy_11b);
+        cJSON_AddNumberToObject(link_json, "uplinks", link.uplinks);
+        cJSON_AddNumberToObject(link_json, "failures", link.failures);
+        cJSON_AddNumberToObject(link_json, "retries", link.retries);
+    }
+
+    // Convert JSON object to string
+    char *json_string = cJSON_PrintUnformatted(json_data);
+
+    // Too large for the transport, the soil history goes first, then the oldest readings
+    size_t history_dropped = 0;
+    size_t pending_dropped = 0;
+    while (json_string != NULL && strlen(json_string) > max_len)
+    {
+        size_t excess = strlen(json_string) - max_len;
+        cJSON_free(json_string);
+        json_string = NULL;
+
+        size_t dropped = sensor_payload_drop_history(json_data, &excess);
+        history_dropped += dropped;
+        if (excess > 0)
+        {
+            size_t pending = sensor_payload_drop_oldest(json_data, "pending", &excess);
+            pending_dropped += pending;
+            dropped += pending;
+        }
+
+        if (dropped == 0)
+        {
+            ESP_LOGE(TAG, "Payload does not fit %u bytes", (unsigned) max_len);
+            break;
+        }
+
+        json_string = cJSON_PrintUnformatted(json_data);
+    }
+
+    if (history_dropped > 0 || pending_dropped > 0)
+    {
+        ESP_LOGW(TAG, "Payload over %u bytes, dropped %u history samples and %u pending readings", (unsigned) max_len,
+                 (unsigned) history_dropped, (unsigned) pending_dropped);
+    }
+
+    // Delete JSON object
+    cJSON_Delete(json_data);
+
+    return json_string;
+}
+
+char *sensor_payload_create(void)
+{
+    return sensor_payload_create_max(SIZE_MAX);
+}
+
+char *sensor_payload_create_max(size_t max_len)
+{
+    sensor_reading_t reading = {
+        .temperature = get_temperature(),
+        .humidity = get_humidity(),
+        .soil_moisture = get_soil_moisture(),
+        .stamp = wall_clock_stamp(),
+    };
+
+    return sensor_payload_format_max(&reading, max_len);
+}
+
+char *sensor_payload_format(const sensor_reading_t *reading)
+{
+    return sensor_payload_format_max(reading, SIZE_MAX);
+}
@@ -0,0 +1,69 @@
+/**
+ * Sensor data payload shared by the uplink transports
+ */
+
+#ifndef SENSOR_PAYLOAD_H_
+#define SENSOR_PAYLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Readings kept in RTC memory when the uplink fails, oldest is dropped first
+#define SENSOR_PAYLOAD_MAX_PENDING  8
+
+// NAN for a sensor that did not answer, the field is left out of the payload
+typedef struct sensor_reading
+{
+    float temperature;
+    float humidity;
+    float soil_moisture;
+    uint32_t stamp;         // wall_clock_stamp when the reading was taken, sent as "ts" (Unix time)
+} sensor_reading_t;
+
+/**
+ * @brief Read the sensors and format the data as JSON
+ * @return JSON string or NULL if out of memory
+ * @note The caller must free the string with cJSON_free
+ * @note Readings saved by earlier failed wakes are added as "pending"
+ * @note "restarts" counts the fault restarts since the last delivered uplink, left out when 0
+ * @note Each reading has its "ts", left out while the clock was never set (see wall_clock.h)
+ * @note "soil_history" holds the wake stub and ULP samples as runs, {"ts":T,"period_s":P,"soil_moisture":[...]}
+ */
+char *sensor_payload_create(void);
+
+/**
+ * @brief Read the sensors and format the data as JSON, at most max_len bytes
+ * @param max_len Maximum string length, without the terminator
+ * @return JSON string or NULL if out of memory
+ * @note Same payload as sensor_payload_create, except that the oldest "soil_history" samples, then the
+ *       oldest "pending" readings, are left out until it fits. They are dropped for good once it is delivered.
+ */
+char *sensor_payload_create_max(size_t max_len);
+
+/**
+ * @brief Format a reading as JSON, without reading the sensors
+ * @param reading Current reading
+ * @return JSON string or NULL if out of memory
+ * @note Same payload and rules as sensor_payload_create
+ */
+char *sensor_payload_format(const sensor_reading_t *reading);
+
+/**
+ * @brief Read the sensors and collect the pending readings
+ * @param readings Output array, the current reading first then the pending ones, oldest first
+ * @param max_readings Size of the output array
+ * @return Number of readings written
+ */
+size_t sensor_payload_get_readings(sensor_reading_t *readings, size_t max_readings);
+
+/**
+ * @brief Read the sensors and keep the reading in RTC memory for the next wake
+ */
+void sensor_payload_save_pending(void);
+
+/**
+ * @brief Drop the pending readings after they were delivered
+ */
+void sensor_payload_clear_pending(void);
+
+#endif /* SENSOR_PAYLOAD_H_ */
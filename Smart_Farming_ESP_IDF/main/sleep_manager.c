@@ -0,0 +1,186 @@
+#include "sleep_manager.h"
+
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_sleep.h"    // Include library to enable deep sleep 
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+
+#include "continuous_mode.h"
+#include "cycle_profiler.h"
+#include "deferred_log.h"
+#include "energy_model.h"
+#include "link_adapt.h"
+#include "remote_config.h"
+#include "sensor_interface_task.h"
+#include "sensor_payload.h"
+#include "sleep_planner.h"
+#include "task_monitor.h"
+#include "ulp_sampler.h"
+#include "wake_budget.h"
+#include "wake_stub.h"
+#include "wall_clock.h"
+
+static const char TAG[] = "sleep_manager";
+
+// Light sleep needs automatic light sleep from the power management
+#define SLEEP_MANAGER_LIGHT_SLEEP   (SLEEP_MANAGER_ADAPTIVE && CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+
+static bool sleep_started = false;
+
+#if SLEEP_MANAGER_LIGHT_SLEEP
+// Measured wake costs, kept across deep sleep and zeroed on power-on
+static RTC_DATA_ATTR sleep_planner_t planner;
+static RTC_DATA_ATTR bool planner_valid = false;
+
+// Automatic light sleep configured
+static bool light_sleep_ready = false;
+
+/**
+ * @brief Feed the cost of the previous wake to the planner and choose the sleep mode
+ * @param interval_ms Sleep interval in milliseconds
+ * @return Cheaper sleep mode
+ */
+static sleep_plan_e sleep_manager_plan(uint32_t interval_ms)
+{
+    if (!planner_valid)
+    {
+        sleep_planner_init(&planner);
+        planner_valid = true;
+    }
+
+    energy_report_t previous;
+    if (energy_model_previous_cycle(&previous))
+    {
+        sleep_plan_e woke_from = (cycle_profiler_get_previous_flags() & CYCLE_FLAG_RESUMED) ? SLEEP_PLAN_LIGHT : SLEEP_PLAN_DEEP;
+        sleep_planner_record(&planner, woke_from, previous.wake_mah * 3600.0f);
+    }
+
+    energy_coefficients_t coeff;
+    energy_model_default_coefficients(&coeff);
+    const sleep_planner_currents_t currents = {
+        .deep_sleep_ma = coeff.deep_sleep_ma,
+        .light_sleep_ma = coeff.deep_sleep_ma + coeff.light_sleep_ma + coeff.wifi_modem_ma,
+    };
+
+    sleep_plan_e plan = sleep_planner_choose(&planner, &currents, interval_ms);
+    ESP_LOGI(TAG, "Wake cost cold %.1f mAs, resume %.1f mAs, break-even %" PRIu32 " ms: %s sleep",
+             planner.cold_wake_mas, planner.resume_mas, sleep_planner_break_even_ms(&planner, &currents),
+             (plan == SLEEP_PLAN_LIGHT) ? "light" : "deep");
+
+    return plan;
+}
+#endif
+
+void sleep_manager_enter_deep_sleep(void)
+{
+    // The budget timer and the uplink task can both get here, only the first one continues
+    if (__atomic_exchange_n(&sleep_started, true, __ATOMIC_SEQ_CST))
+    {
+        while (1)
+        {
+            vTaskDelay(portMAX_DELAY);
+        }
+    }
+
+    if (!wake_budget_uplink_ok())
+    {
+        sensor_payload_save_pending();
+    }
+    link_adapt_update(wake_budget_uplink_ok());
+
+    const uint32_t wakeup_time_sec = wake_budget_next_sleep_sec(remote_config_get_sleep_sec());
+    esp_err_t ulp_err = ulp_sampler_start(wakeup_time_sec);
+    if (ulp_err == ESP_OK)
+    {
+        // The ULP samples the soil moisture in between and wakes the CPU when the batch is full,
+        // the timer only if the ULP stalls
+        wake_stub_arm(0);
+        ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup((uint64_t) (wakeup_time_sec + ULP_SAMPLER_BACKSTOP_SEC) * 1000000));
+    }
+    else if (ulp_err == ESP_ERR_INVALID_STATE)
+    {
+        // The soil moisture sensor failed, no sampling until the next upload
+        wake_stub_arm(0);
+        ESP_LOGI(TAG, "Enabling timer wakeup, %" PRIu32 "s\n", wakeup_time_sec);
+        ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup((uint64_t) wakeup_time_sec * 1000000));
+    }
+    else
+    {
+        // The wake stub samples the soil moisture in between, without booting
+        const uint32_t first_wakeup_sec = wake_stub_arm(wakeup_time_sec);
+        ESP_LOGI(TAG, "Enabling timer wakeup, %" PRIu32 "s\n", first_wakeup_sec);
+        ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup((uint64_t) first_wakeup_sec * 1000000));
+    }
+    cycle_profiler_set_sleep_duration(wakeup_time_sec * 1000);
+    rtc_gpio_isolate(GPIO_NUM_12);
+    // Only a wake that started SNTP waits, within what is left of the wake budget
+    const uint32_t remaining_ms = wake_budget_remaining_ms();
+    wall_clock_sync_finish((remaining_ms < WALL_CLOCK_SYNC_WAIT_MS) ? remaining_ms : WALL_CLOCK_SYNC_WAIT_MS);
+    esp_wifi_stop();
+    ESP_LOGW(TAG, "Entering deep sleep...");
+    vTaskDelay(pdMS_TO_TICKS(200));
+    // Every task of the wake has run, the next wake publishes the stack and heap use
+    task_monitor_save();
+    cycle_profiler_mark(CYCLE_PHASE_SLEEP);
+    esp_deep_sleep_start();
+}
+
+bool sleep_manager_light_sleep(void)
+{
+#if SLEEP_MANAGER_LIGHT_SLEEP
+    // Failed uplinks back off in deep sleep
+    if (!wake_budget_uplink_ok() || sleep_started)
+        return false;
+
+    const uint32_t sleep_sec = remote_config_get_sleep_sec();
+    if (sleep_manager_plan(sleep_sec * 1000) != SLEEP_PLAN_LIGHT)
+        return false;
+
+    if (!light_sleep_ready)
+    {
+        // Same DFS and automatic light sleep setup as the continuous mode
+        if (continuous_mode_pm_init() != ESP_OK)
+            return false;
+        light_sleep_ready = true;
+    }
+
+    // Keeps the association through the light sleep, the AP buffers frames until the next DTIM
+    esp_err_t err = esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        return false;
+    }
+
+    link_adapt_update(true);
+    wake_budget_next_sleep_sec(sleep_sec);
+    wake_budget_stop();
+    // No DHT22 readings and no PM lock in the light sleep
+    sensor_interface_pause();
+    cycle_profiler_set_sleep_duration(sleep_sec * 1000);
+    cycle_profiler_set_flags(CYCLE_FLAG_LIGHT_SLEEP);
+    task_monitor_save();
+    cycle_profiler_mark(CYCLE_PHASE_SLEEP);
+    ESP_LOGW(TAG, "Entering light sleep for %" PRIu32 "s...", sleep_sec);
+
+    // Idle task puts the chip in light sleep between the Wi-Fi beacons
+    vTaskDelay(pdMS_TO_TICKS(sleep_sec * 1000));
+
+    cycle_profiler_resume();
+    // Reads at once, the resumed cycle waits for this reading and not the one from before the sleep
+    sensor_interface_resume();
+    wake_budget_start();
+    wake_budget_register(WAKE_BUDGET_PHASE_MQTT, WAKE_BUDGET_MQTT_MS);
+    DEFERRED_LOGI(TAG, DLOG_SLEEP_RESUMED, "Resumed from light sleep");
+
+    return true;
+#else
+    return false;
+#endif
+}
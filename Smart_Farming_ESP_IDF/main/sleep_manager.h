@@ -0,0 +1,30 @@
+/**
+ * Deep sleep entry shared by the uplink transports, and the light sleep of the MQTT
+ * uplink. The sleep planner picks light sleep when the interval is short enough that
+ * keeping Wi-Fi and the MQTT session costs less than a cold wake.
+ */
+
+#ifndef SLEEP_MANAGER_H_
+#define SLEEP_MANAGER_H_
+
+#include <stdbool.h>
+
+// 1 = choose between light and deep sleep from the measured wake costs, 0 = always deep sleep
+#define SLEEP_MANAGER_ADAPTIVE  1
+
+/**
+ * @brief Configure ESP deep sleep then start the deep sleep
+ * @note The sleep interval comes from the remote config, with backoff if the uplink failed.
+ *       Undelivered sensor data is saved for the next wake. This function does not return.
+ */
+void sleep_manager_enter_deep_sleep(void);
+
+/**
+ * @brief Sleep until the next wake in light sleep if the planner finds it cheaper
+ * @return true after the light sleep, the next wake cycle has started. false if deep sleep should be used.
+ * @note Only after a delivered uplink, failed ones back off in deep sleep. Wi-Fi stays connected in
+ *       modem sleep and the MQTT client keeps its session, the caller publishes again right away.
+ */
+bool sleep_manager_light_sleep(void);
+
+#endif /* SLEEP_MANAGER_H_ */
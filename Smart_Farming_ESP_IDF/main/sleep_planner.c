@@ -0,0 +1,64 @@
+#include "sleep_planner.h"
+
+#include <stddef.h>
+
+void sleep_planner_init(sleep_planner_t *planner)
+{
+    planner->cold_wake_mas = SLEEP_PLANNER_COLD_WAKE_MAS;
+    planner->resume_mas = SLEEP_PLANNER_RESUME_MAS;
+    planner->cold_samples = 0;
+    planner->resume_samples = 0;
+    planner->last_plan = SLEEP_PLAN_DEEP;
+}
+
+void sleep_planner_record(sleep_planner_t *planner, sleep_plan_e woke_from, float wake_mas)
+{
+    if (wake_mas <= 0.0f)
+        return;
+
+    float *average = (woke_from == SLEEP_PLAN_LIGHT) ? &planner->resume_mas : &planner->cold_wake_mas;
+    uint16_t *samples = (woke_from == SLEEP_PLAN_LIGHT) ? &planner->resume_samples : &planner->cold_samples;
+
+    *average = (*samples == 0) ? wake_mas : *average + SLEEP_PLANNER_ALPHA * (wake_mas - *average);
+    if (*samples < UINT16_MAX)
+        (*samples)++;
+}
+
+float sleep_planner_cost_mas(const sleep_planner_t *planner, const sleep_planner_currents_t *currents, sleep_plan_e plan, uint32_t interval_ms)
+{
+    float interval_s = (float) interval_ms / 1000.0f;
+
+    if (plan == SLEEP_PLAN_LIGHT)
+        return planner->resume_mas + currents->light_sleep_ma * interval_s;
+
+    return planner->cold_wake_mas + currents->deep_sleep_ma * interval_s;
+}
+
+uint32_t sleep_planner_break_even_ms(const sleep_planner_t *planner, const sleep_planner_currents_t *currents)
+{
+    float saved_mas = planner->cold_wake_mas - planner->resume_mas;
+    float extra_ma = currents->light_sleep_ma - currents->deep_sleep_ma;
+
+    if (saved_mas <= 0.0f)
+        return 0;
+    if (extra_ma <= 0.0f)
+        return UINT32_MAX;
+
+    float break_even_ms = saved_mas / extra_ma * 1000.0f;
+    return (break_even_ms >= (float) UINT32_MAX) ? UINT32_MAX : (uint32_t) break_even_ms;
+}
+
+sleep_plan_e sleep_planner_choose(sleep_planner_t *planner, const sleep_planner_currents_t *currents, uint32_t interval_ms)
+{
+    float deep = sleep_planner_cost_mas(planner, currents, SLEEP_PLAN_DEEP, interval_ms);
+    float light = sleep_planner_cost_mas(planner, currents, SLEEP_PLAN_LIGHT, interval_ms);
+
+    sleep_plan_e plan = planner->last_plan;
+    if (plan == SLEEP_PLAN_DEEP && light < deep * (1.0f - SLEEP_PLANNER_HYSTERESIS))
+        plan = SLEEP_PLAN_LIGHT;
+    else if (plan == SLEEP_PLAN_LIGHT && deep < light * (1.0f - SLEEP_PLANNER_HYSTERESIS))
+        plan = SLEEP_PLAN_DEEP;
+
+    planner->last_plan = plan;
+    return plan;
+}
@@ -0,0 +1,89 @@
+/**
+ * Sleep planner. Chooses deep sleep or light sleep for the next interval from the
+ * measured cost of a cold wake (boot, Wi-Fi association, MQTT connect) and of a
+ * light sleep resume (Wi-Fi and MQTT session kept). Pure logic, no ESP-IDF
+ * dependencies, so it can be compiled and checked on the host.
+ *
+ * Cost of one interval T in mA*s:
+ *   deep  = cold wake charge   + deep sleep current  * T
+ *   light = resume charge      + light sleep current * T
+ * Light sleep wins below the break-even interval (cold - resume) / (light - deep).
+ */
+
+#ifndef SLEEP_PLANNER_H_
+#define SLEEP_PLANNER_H_
+
+#include <stdint.h>
+
+// Initial costs before anything is measured, from the energy model coefficients
+#define SLEEP_PLANNER_COLD_WAKE_MAS     325.0f  // ~2.5 s at 130 mA
+#define SLEEP_PLANNER_RESUME_MAS        40.0f   // ~0.3 s at 130 mA
+#define SLEEP_PLANNER_ALPHA             0.25f   // Weight of a new measurement
+#define SLEEP_PLANNER_HYSTERESIS        0.10f   // Switch mode only if 10 % cheaper
+
+typedef enum sleep_plan
+{
+    SLEEP_PLAN_DEEP = 0,
+    SLEEP_PLAN_LIGHT,
+} sleep_plan_e;
+
+// Average sleep currents in mA, including the board current
+typedef struct sleep_planner_currents
+{
+    float deep_sleep_ma;
+    float light_sleep_ma;       // Light sleep with Wi-Fi connected in modem sleep
+} sleep_planner_currents_t;
+
+// Measured wake costs, keep it in RTC memory
+typedef struct sleep_planner
+{
+    float cold_wake_mas;        // Average charge of a cold wake
+    float resume_mas;           // Average charge of a light sleep resume
+    uint16_t cold_samples;
+    uint16_t resume_samples;
+    sleep_plan_e last_plan;
+} sleep_planner_t;
+
+/**
+ * @brief Initialize planner with the default costs
+ * @param planner Planner
+ */
+void sleep_planner_init(sleep_planner_t *planner);
+
+/**
+ * @brief Add a measured wake cost
+ * @param planner Planner
+ * @param woke_from How the measured wake started: SLEEP_PLAN_DEEP for a cold wake, SLEEP_PLAN_LIGHT for a resume
+ * @param wake_mas Charge of the awake part of the cycle in mA*s
+ * @note The first measurement replaces the default, later ones are averaged with SLEEP_PLANNER_ALPHA
+ */
+void sleep_planner_record(sleep_planner_t *planner, sleep_plan_e woke_from, float wake_mas);
+
+/**
+ * @brief Compute the cost of one interval
+ * @param planner Planner
+ * @param currents Sleep currents
+ * @param plan Sleep mode
+ * @param interval_ms Sleep interval in milliseconds
+ * @return Charge in mA*s
+ */
+float sleep_planner_cost_mas(const sleep_planner_t *planner, const sleep_planner_currents_t *currents, sleep_plan_e plan, uint32_t interval_ms);
+
+/**
+ * @brief Compute the interval below which light sleep is cheaper
+ * @param planner Planner
+ * @param currents Sleep currents
+ * @return Break-even interval in milliseconds, 0 if light sleep never wins, UINT32_MAX if it always wins
+ */
+uint32_t sleep_planner_break_even_ms(const sleep_planner_t *planner, const sleep_planner_currents_t *currents);
+
+/**
+ * @brief Choose the sleep mode of the next interval and remember it
+ * @param planner Planner
+ * @param currents Sleep currents
+ * @param interval_ms Sleep interval in milliseconds
+ * @return Cheaper sleep mode, the last one is kept unless the other is cheaper by SLEEP_PLANNER_HYSTERESIS
+ */
+sleep_plan_e sleep_planner_choose(sleep_planner_t *planner, const sleep_planner_currents_t *currents, uint32_t interval_ms);
+
+#endif /* SLEEP_PLANNER_H_ */
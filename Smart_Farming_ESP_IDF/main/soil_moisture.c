@@ -1,5 +1,7 @@
 #include "soil_moisture.h"
 
+#include <math.h>
+
 static const char TAG[] = "soil_moisture";
 
 float getSoilMoisture(void)
@@ -8,7 +10,10 @@ float getSoilMoisture(void)
     
     esp_err_t err = ads111x_measure_raw(&my_ads111x_cfg, &adc_raw);
     if (err != ESP_OK)
+    {
         ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        return NAN;
+    }
     
     return (float) adc_raw;
 }
\ No newline at end of file
@@ -8,7 +8,7 @@
 
 /**
  * @brief Get soil moisture value by calling appropriate ADC functions
- * @return Soil moisture value
+ * @return Soil moisture value, NAN if the ADC does not answer
  */
 float getSoilMoisture(void);
 
@@ -0,0 +1,241 @@
+#include "static_alloc.h"
+
+#include <stdio.h>
+
+#include "freertos/semphr.h"
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "benchmark.h"
+
+#if STATIC_ALLOC_ENABLE && BENCHMARK_ENABLE
+#error "The benchmark build counts allocations with the same heap hook, disable STATIC_ALLOC_ENABLE"
+#endif
+
+// The guard needs the heap hook of the chip
+#define STATIC_ALLOC_GUARD (STATIC_ALLOC_ENABLE && CONFIG_HEAP_USE_HOOKS && !CONFIG_IDF_TARGET_LINUX)
+
+#if STATIC_ALLOC_GUARD
+#include "esp_system.h"
+#endif
+
+#if STATIC_ALLOC_ENABLE
+static const char TAG[] = "static_alloc";
+
+// cJSON arena, a bump allocator that starts over when every block is freed
+static uint8_t arena[STATIC_ALLOC_ARENA_SIZE] __attribute__((aligned(8)));
+static size_t arena_used = 0;
+static uint32_t arena_blocks = 0;
+static size_t arena_peak = 0;
+static uint32_t arena_failures = 0;
+
+static StaticSemaphore_t arena_mutex_buffer;
+static SemaphoreHandle_t arena_mutex = NULL;
+
+/**
+ * @brief Allocate from the arena
+ * @param size Requested size
+ * @return Block or NULL if the arena is full
+ * @note cJSON allocate hook. A payload is built, printed and freed before the next one,
+ *       so the arena is empty again after each message
+ */
+static void *static_alloc_arena_malloc(size_t size)
+{
+    size = (size + 7) & ~(size_t) 7;
+    void *ptr = NULL;
+
+    xSemaphoreTake(arena_mutex, portMAX_DELAY);
+    if (size <= STATIC_ALLOC_ARENA_SIZE - arena_used)
+    {
+        ptr = &arena[arena_used];
+        arena_used += size;
+        arena_blocks++;
+        if (arena_used > arena_peak)
+            arena_peak = arena_used;
+    }
+    else
+    {
+        arena_failures++;
+    }
+    xSemaphoreGive(arena_mutex);
+
+    if (ptr == NULL)
+    {
+        ESP_LOGE(TAG, "cJSON arena full, %u bytes requested, raise STATIC_ALLOC_ARENA_SIZE", (unsigned) size);
+    }
+
+    return ptr;
+}
+
+/**
+ * @brief Free a block of the arena
+ * @param ptr Block from static_alloc_arena_malloc
+ * @note cJSON deallocate hook, the space comes back when the last block is freed
+ */
+static void static_alloc_arena_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    xSemaphoreTake(arena_mutex, portMAX_DELAY);
+    if (arena_blocks > 0 && --arena_blocks == 0)
+    {
+        arena_used = 0;
+    }
+    xSemaphoreGive(arena_mutex);
+}
+#endif
+
+#if STATIC_ALLOC_GUARD
+// Tasks with the guard armed, and whether each is in a paused section
+static TaskHandle_t guarded_tasks[STATIC_ALLOC_GUARD_MAX_TASKS];
+static uint8_t guard_paused[STATIC_ALLOC_GUARD_MAX_TASKS];
+static uint32_t guarded_count = 0;
+
+/**
+ * @brief Find the guard slot of the calling task
+ * @return Slot index, -1 if the task has no guard
+ */
+static int IRAM_ATTR static_alloc_guard_slot(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint32_t count = __atomic_load_n(&guarded_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (guarded_tasks[i] == self)
+            return (int) i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Heap hook, called by the heap after each successful allocation
+ * @param ptr Allocated block
+ * @param size Requested size
+ * @param caps Capabilities of the block
+ * @note Can be called from an ISR and from both cores
+ */
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    (void) ptr;
+    (void) caps;
+    if (__atomic_load_n(&guarded_count, __ATOMIC_ACQUIRE) == 0 || xPortInIsrContext())
+        return;
+
+    int slot = static_alloc_guard_slot();
+    if (slot >= 0 && guard_paused[slot] == 0)
+    {
+        ESP_DRAM_LOGE(DRAM_STR("static_alloc"), "%u byte heap allocation after init in %s", (unsigned) size, pcTaskGetName(NULL));
+        esp_system_abort("Heap allocation after init in a static allocation build");
+    }
+}
+#endif
+
+void static_alloc_init(void)
+{
+#if STATIC_ALLOC_ENABLE
+    arena_mutex = xSemaphoreCreateMutexStatic(&arena_mutex_buffer);
+
+    cJSON_Hooks hooks = {
+        .malloc_fn = &static_alloc_arena_malloc,
+        .free_fn = &static_alloc_arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+
+    ESP_LOGI(TAG, "Static allocation mode, %u byte cJSON arena", (unsigned) STATIC_ALLOC_ARENA_SIZE);
+#endif
+}
+
+BaseType_t static_alloc_task_create(static_alloc_task_t *task, TaskFunction_t function, const char *name, void *parameter,
+                                    UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    TaskHandle_t created = NULL;
+
+    if (task->stack != NULL)
+    {
+        created = xTaskCreateStaticPinnedToCore(function, name, task->stack_size, parameter, priority, task->stack, task->tcb, core_id);
+    }
+    else if (xTaskCreatePinnedToCore(function, name, task->stack_size, parameter, priority, &created, core_id) != pdPASS)
+    {
+        created = NULL;
+    }
+
+    if (handle != NULL)
+        *handle = created;
+
+    return (created != NULL) ? pdPASS : pdFAIL;
+}
+
+EventGroupHandle_t static_alloc_event_group_create(static_alloc_event_group_t *event_group)
+{
+    if (event_group->buffer != NULL)
+        return xEventGroupCreateStatic(event_group->buffer);
+
+    return xEventGroupCreate();
+}
+
+QueueHandle_t static_alloc_queue_create(static_alloc_queue_t *queue, UBaseType_t length, UBaseType_t item_size)
+{
+    if (queue->storage != NULL)
+        return xQueueCreateStatic(length, item_size, queue->storage, queue->buffer);
+
+    return xQueueCreate(length, item_size);
+}
+
+void static_alloc_guard_arm(void)
+{
+#if STATIC_ALLOC_GUARD
+    // newlib allocates the float conversion buffers of a task on first use and keeps them
+    char warm_up[48];
+    snprintf(warm_up, sizeof(warm_up), "%.1f %.2f %.15g", 1.5, 2.25, 1.0 / 3.0);
+
+    if (static_alloc_guard_slot() >= 0)
+        return;
+
+    uint32_t count = __atomic_load_n(&guarded_count, __ATOMIC_ACQUIRE);
+    if (count >= STATIC_ALLOC_GUARD_MAX_TASKS)
+    {
+        ESP_LOGE(TAG, "No guard slot left for %s", pcTaskGetName(NULL));
+        return;
+    }
+
+    guarded_tasks[count] = xTaskGetCurrentTaskHandle();
+    guard_paused[count] = 0;
+    __atomic_store_n(&guarded_count, count + 1, __ATOMIC_RELEASE);
+    ESP_LOGI(TAG, "Allocation guard armed for %s", pcTaskGetName(NULL));
+#endif
+}
+
+void static_alloc_guard_pause(void)
+{
+#if STATIC_ALLOC_GUARD
+    int slot = static_alloc_guard_slot();
+    if (slot >= 0)
+        guard_paused[slot]++;
+#endif
+}
+
+void static_alloc_guard_resume(void)
+{
+#if STATIC_ALLOC_GUARD
+    int slot = static_alloc_guard_slot();
+    if (slot >= 0 && guard_paused[slot] > 0)
+        guard_paused[slot]--;
+#endif
+}
+
+void static_alloc_get_arena_stats(size_t *peak, uint32_t *failures)
+{
+#if STATIC_ALLOC_ENABLE
+    xSemaphoreTake(arena_mutex, portMAX_DELAY);
+    *peak = arena_peak;
+    *failures = arena_failures;
+    xSemaphoreGive(arena_mutex);
+#else
+    *peak = 0;
+    *failures = 0;
+#endif
+}
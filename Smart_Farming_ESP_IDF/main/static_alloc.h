@@ -0,0 +1,153 @@
+/**
+ * Static allocation mode. With STATIC_ALLOC_ENABLE set, the tasks, event groups
+ * and queues of the application are created with the FreeRTOS *Static functions
+ * on buffers reserved at link time, and cJSON allocates from a fixed arena instead
+ * of the heap. The RAM used by the application is then known from the map file
+ * and the heap is left to the Wi-Fi, lwIP and MQTT stacks, so a long-running
+ * continuous mode node cannot fragment it.
+ *
+ * The allocation guard checks that it stays that way. Each application task arms
+ * it once its setup is done; from then on a heap allocation made by that task
+ * aborts with the task name and size (heap hook, needs CONFIG_HEAP_USE_HOOKS).
+ * Library calls that allocate by design, like queueing an MQTT message in the
+ * client outbox, are wrapped in static_alloc_guard_pause() and
+ * static_alloc_guard_resume().
+ *
+ * Without STATIC_ALLOC_ENABLE the same calls create the objects on the heap and
+ * the guard does nothing, so the callers do not change between the two modes.
+ */
+
+#ifndef STATIC_ALLOC_H_
+#define STATIC_ALLOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+
+#include "device_role.h"
+
+// 1 = static RTOS objects, cJSON arena and allocation guard
+#define STATIC_ALLOC_ENABLE         0
+
+// cJSON arena, the gateway batch holds up to ESPNOW_BATCH_MAX_FRAMES frames
+#if DEVICE_ROLE == DEVICE_ROLE_GATEWAY
+#define STATIC_ALLOC_ARENA_SIZE     (48 * 1024)
+#else
+#define STATIC_ALLOC_ARENA_SIZE     (12 * 1024)
+#endif
+
+// Tasks that can arm the guard
+#define STATIC_ALLOC_GUARD_MAX_TASKS 4
+
+// Buffers of one task
+typedef struct static_alloc_task
+{
+    StackType_t *stack;         // NULL = allocated on the heap
+    StaticTask_t *tcb;
+    uint32_t stack_size;        // Bytes
+} static_alloc_task_t;
+
+// Buffer of one event group
+typedef struct static_alloc_event_group
+{
+    StaticEventGroup_t *buffer; // NULL = allocated on the heap
+} static_alloc_event_group_t;
+
+// Buffers of one queue
+typedef struct static_alloc_queue
+{
+    uint8_t *storage;           // NULL = allocated on the heap
+    StaticQueue_t *buffer;
+} static_alloc_queue_t;
+
+// Declare the buffers at file scope, they are only reserved with STATIC_ALLOC_ENABLE
+#if STATIC_ALLOC_ENABLE
+#define STATIC_ALLOC_TASK(name, stack_size) \
+    static StackType_t name##_stack[stack_size]; \
+    static StaticTask_t name##_tcb; \
+    static static_alloc_task_t name = { name##_stack, &name##_tcb, stack_size }
+
+#define STATIC_ALLOC_EVENT_GROUP(name) \
+    static StaticEventGroup_t name##_buffer; \
+    static static_alloc_event_group_t name = { &name##_buffer }
+
+#define STATIC_ALLOC_QUEUE(name, length, item_size) \
+    static uint8_t name##_storage[(length) * (item_size)]; \
+    static StaticQueue_t name##_buffer; \
+    static static_alloc_queue_t name = { name##_storage, &name##_buffer }
+#else
+#define STATIC_ALLOC_TASK(name, stack_size) \
+    static static_alloc_task_t name = { NULL, NULL, stack_size }
+
+#define STATIC_ALLOC_EVENT_GROUP(name) \
+    static static_alloc_event_group_t name = { NULL }
+
+#define STATIC_ALLOC_QUEUE(name, length, item_size) \
+    static static_alloc_queue_t name = { NULL, NULL }
+#endif
+
+/**
+ * @brief Route the cJSON allocations to the arena
+ * @note Call once at boot before anything uses cJSON, does nothing without STATIC_ALLOC_ENABLE
+ */
+void static_alloc_init(void);
+
+/**
+ * @brief Create a task
+ * @param task Buffers from STATIC_ALLOC_TASK
+ * @param function Task function
+ * @param name Task name
+ * @param parameter Task parameter
+ * @param priority Task priority
+ * @param handle Output task handle, can be NULL
+ * @param core_id Core to run on, tskNO_AFFINITY for either
+ * @return pdPASS if created
+ */
+BaseType_t static_alloc_task_create(static_alloc_task_t *task, TaskFunction_t function, const char *name, void *parameter,
+                                    UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id);
+
+/**
+ * @brief Create an event group
+ * @param event_group Buffer from STATIC_ALLOC_EVENT_GROUP
+ * @return Event group handle, NULL if out of memory
+ */
+EventGroupHandle_t static_alloc_event_group_create(static_alloc_event_group_t *event_group);
+
+/**
+ * @brief Create a queue
+ * @param queue Buffers from STATIC_ALLOC_QUEUE, with the same length and item size
+ * @param length Number of items
+ * @param item_size Size of one item
+ * @return Queue handle, NULL if out of memory
+ */
+QueueHandle_t static_alloc_queue_create(static_alloc_queue_t *queue, UBaseType_t length, UBaseType_t item_size);
+
+/**
+ * @brief Arm the allocation guard for the calling task
+ * @note Call when the task setup is done, before its main loop
+ */
+void static_alloc_guard_arm(void);
+
+/**
+ * @brief Allow heap allocations in the calling task until static_alloc_guard_resume
+ * @note For library calls that allocate by design, e.g. the MQTT client outbox
+ */
+void static_alloc_guard_pause(void);
+
+/**
+ * @brief Check the heap allocations of the calling task again
+ */
+void static_alloc_guard_resume(void);
+
+/**
+ * @brief Get the arena use
+ * @param peak Output, most bytes in use at once since boot
+ * @param failures Output, allocations that did not fit
+ */
+void static_alloc_get_arena_stats(size_t *peak, uint32_t *failures);
+
+#endif /* STATIC_ALLOC_H_ */
@@ -0,0 +1,193 @@
+#include "task_monitor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_attr.h"
+
+#if TASK_MONITOR_ENABLE
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#endif
+
+#define TASK_MONITOR_MAGIC  0x5441534B  // "TASK"
+
+// Room for the tasks that do not fit the snapshot, uxTaskGetSystemState needs all of them
+#define TASK_MONITOR_STATUS_SLOTS   (TASK_MONITOR_MAX_TASKS + 8)
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR uint32_t saved_magic = 0;
+static RTC_DATA_ATTR task_monitor_snapshot_t saved_snapshot;
+
+#if TASK_MONITOR_ENABLE
+// Too big for the stack of the tasks being measured
+static TaskStatus_t task_status[TASK_MONITOR_STATUS_SLOTS];
+
+// Run time counters of the previous snapshot, the window of the next one starts there
+static TaskHandle_t previous_handles[TASK_MONITOR_STATUS_SLOTS];
+static uint32_t previous_run_time[TASK_MONITOR_STATUS_SLOTS];
+static uint32_t previous_task_count = 0;
+static uint32_t previous_total = 0;
+
+/**
+ * @brief Get the run time of a task at the previous snapshot
+ * @param handle Task
+ * @return Run time counter, 0 if the task is new
+ */
+static uint32_t task_monitor_previous_run_time(TaskHandle_t handle)
+{
+    for (uint32_t i = 0; i < previous_task_count; i++)
+    {
+        if (previous_handles[i] == handle)
+            return previous_run_time[i];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get a run time over the window in permille
+ * @param run_time Run time in the window
+ * @param window Window length in the same unit
+ * @return Permille, at most 1000
+ */
+static uint16_t task_monitor_permille(uint32_t run_time, uint32_t window)
+{
+    if (window == 0)
+        return 0;
+
+    uint64_t permille = (uint64_t) run_time * 1000 / window;
+    return (permille > 1000) ? 1000 : (uint16_t) permille;
+}
+
+/**
+ * @brief Order the tasks by free stack, least first
+ * @param order Output, indexes into task_status
+ * @param count Number of tasks
+ * @note The tightest stacks stay in the snapshot when there are more tasks than slots
+ */
+static void task_monitor_sort(uint8_t *order, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint8_t index = (uint8_t) i;
+        uint32_t j = i;
+        while (j > 0 && task_status[order[j - 1]].usStackHighWaterMark > task_status[index].usStackHighWaterMark)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = index;
+    }
+}
+#endif
+
+bool task_monitor_capture(task_monitor_snapshot_t *snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+
+#if TASK_MONITOR_ENABLE
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(task_status, TASK_MONITOR_STATUS_SLOTS, &total);
+    uint32_t window = (uint32_t) total - previous_total;
+    snapshot->window_ms = window / 1000;
+
+    // Busy = not in the idle task of that core
+    for (BaseType_t core = 0; core < TASK_MONITOR_MAX_CORES && core < portNUM_PROCESSORS; core++)
+    {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+        for (UBaseType_t i = 0; i < count; i++)
+        {
+            if (task_status[i].xHandle == idle)
+            {
+                uint32_t idle_time = (uint32_t) task_status[i].ulRunTimeCounter - task_monitor_previous_run_time(idle);
+                snapshot->core_load_permille[core] = 1000 - task_monitor_permille(idle_time, window);
+            }
+        }
+    }
+
+    uint16_t cpu_permille[TASK_MONITOR_STATUS_SLOTS];
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        uint32_t run_time = (uint32_t) task_status[i].ulRunTimeCounter;
+        cpu_permille[i] = task_monitor_permille(run_time - task_monitor_previous_run_time(task_status[i].xHandle), window);
+        previous_handles[i] = task_status[i].xHandle;
+        previous_run_time[i] = run_time;
+    }
+    previous_task_count = count;
+    previous_total = (uint32_t) total;
+
+    uint8_t order[TASK_MONITOR_STATUS_SLOTS];
+    task_monitor_sort(order, count);
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        if (snapshot->task_count >= TASK_MONITOR_MAX_TASKS)
+        {
+            snapshot->tasks_left_out++;
+            continue;
+        }
+
+        const TaskStatus_t *status = &task_status[order[i]];
+        task_monitor_task_t *task = &snapshot->tasks[snapshot->task_count++];
+        strncpy(task->name, status->pcTaskName, sizeof(task->name) - 1);
+        BaseType_t core = xTaskGetCoreID(status->xHandle);
+        task->core = (core == tskNO_AFFINITY) ? -1 : (int8_t) core;
+        // Bytes on ESP-IDF, same value as uxTaskGetStackHighWaterMark
+        task->stack_free = (status->usStackHighWaterMark > UINT16_MAX) ? UINT16_MAX : (uint16_t) status->usStackHighWaterMark;
+        task->cpu_permille = cpu_permille[order[i]];
+    }
+
+    snapshot->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    snapshot->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    snapshot->heap_largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void task_monitor_save(void)
+{
+    if (task_monitor_capture(&saved_snapshot))
+    {
+        saved_magic = TASK_MONITOR_MAGIC;
+    }
+}
+
+size_t task_monitor_format(const task_monitor_snapshot_t *snapshot, char *buf, size_t size)
+{
+    int len = snprintf(buf, size, "{\"mode\":\"tasks\",\"win_ms\":%lu,\"load\":[%u,%u],\"heap\":[%lu,%lu,%lu],\"tasks\":[",
+                       (unsigned long) snapshot->window_ms,
+                       snapshot->core_load_permille[0], snapshot->core_load_permille[1],
+                       (unsigned long) snapshot->heap_free, (unsigned long) snapshot->heap_min_free,
+                       (unsigned long) snapshot->heap_largest_block);
+    if (len < 0 || (size_t) len >= size)
+        return 0;
+
+    size_t used = (size_t) len;
+    for (uint8_t i = 0; i < snapshot->task_count && i < TASK_MONITOR_MAX_TASKS; i++)
+    {
+        const task_monitor_task_t *task = &snapshot->tasks[i];
+        len = snprintf(&buf[used], size - used, "%s[\"%.*s\",%d,%u,%u]", (i > 0) ? "," : "",
+                       (int) sizeof(task->name), task->name, task->core, task->stack_free, task->cpu_permille);
+        if (len < 0 || (size_t) len >= size - used)
+            return 0;
+        used += (size_t) len;
+    }
+
+    len = snprintf(&buf[used], size - used, "],\"more\":%u}", snapshot->tasks_left_out);
+    if (len < 0 || (size_t) len >= size - used)
+        return 0;
+
+    return used + (size_t) len;
+}
+
+size_t task_monitor_format_previous(char *buf, size_t size)
+{
+    if (saved_magic != TASK_MONITOR_MAGIC)
+        return 0;
+
+    return task_monitor_format(&saved_snapshot, buf, size);
+}
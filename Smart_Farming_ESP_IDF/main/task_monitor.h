@@ -0,0 +1,94 @@
+/**
+ * Task, stack and heap telemetry, to size the task stacks and the heap from field
+ * data. A snapshot holds per task the lowest free stack since the task started
+ * (the FreeRTOS stack high water mark) and its share of the CPU time, the load of
+ * each core, and the current and lowest free heap and the largest free block.
+ *
+ * In deep sleep mode the snapshot is taken just before sleeping, kept in RTC
+ * memory and published by the next wake to /smartfarming/<device id>/diag, like
+ * the cycle profile. The continuous mode publishes one with each report. Record:
+ *
+ *   {"mode":"tasks","win_ms":2412,"load":[318,97],"heap":[181244,160032,110592],
+ *    "tasks":[["My_MQTT_task",-1,5364,41],["mqtt_task",-1,2788,36],...],"more":0}
+ *
+ * tasks: name, core (-1 = either core), lowest free stack in bytes, CPU time in
+ * permille of one core over the window. load: permille busy per core. heap: free,
+ * lowest free since boot and largest free block in bytes. more: tasks left out
+ * because the table was full.
+ *
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+ * (set in sdkconfig), the run time counter is the esp_timer time in us.
+ */
+
+#ifndef TASK_MONITOR_H_
+#define TASK_MONITOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && !CONFIG_IDF_TARGET_LINUX
+#define TASK_MONITOR_ENABLE         1
+#else
+#define TASK_MONITOR_ENABLE         0
+#endif
+
+#define TASK_MONITOR_MAX_TASKS      16
+#define TASK_MONITOR_MAX_CORES      2
+#define TASK_MONITOR_NAME_LEN       16      // configMAX_TASK_NAME_LEN
+#define TASK_MONITOR_RECORD_SIZE    768     // Longest record with all task slots used
+
+typedef struct task_monitor_task
+{
+    char name[TASK_MONITOR_NAME_LEN];
+    int8_t core;                // -1 = no core affinity
+    uint16_t stack_free;        // Lowest free stack in bytes since the task started
+    uint16_t cpu_permille;      // CPU time over the window, in permille of one core
+} task_monitor_task_t;
+
+typedef struct task_monitor_snapshot
+{
+    uint32_t window_ms;         // Time since the previous snapshot, or since boot
+    uint16_t core_load_permille[TASK_MONITOR_MAX_CORES];
+    uint32_t heap_free;         // 8-bit capable heap, bytes
+    uint32_t heap_min_free;     // Lowest heap_free since boot
+    uint32_t heap_largest_block;
+    uint8_t task_count;         // Tasks in tasks[]
+    uint8_t tasks_left_out;     // Tasks running but not in tasks[]
+    task_monitor_task_t tasks[TASK_MONITOR_MAX_TASKS];
+} task_monitor_snapshot_t;
+
+/**
+ * @brief Take a snapshot of the tasks and the heap
+ * @param snapshot Output snapshot
+ * @return true if taken, false if the task monitor is disabled
+ * @note CPU times cover the time since the previous snapshot, or since boot for the first one
+ */
+bool task_monitor_capture(task_monitor_snapshot_t *snapshot);
+
+/**
+ * @brief Take a snapshot and keep it in RTC memory for the next wake
+ * @note Call just before sleeping, when every task of the wake has run
+ */
+void task_monitor_save(void);
+
+/**
+ * @brief Format a snapshot as a diagnostics record
+ * @param snapshot Snapshot to format
+ * @param buf Output buffer, TASK_MONITOR_RECORD_SIZE fits any snapshot
+ * @param size Size of the output buffer
+ * @return Length of the record, 0 if it does not fit
+ */
+size_t task_monitor_format(const task_monitor_snapshot_t *snapshot, char *buf, size_t size);
+
+/**
+ * @brief Format the snapshot saved before the last sleep
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ * @return Length of the record, 0 if there is no saved snapshot or it does not fit
+ */
+size_t task_monitor_format_previous(char *buf, size_t size);
+
+#endif /* TASK_MONITOR_H_ */
@@ -0,0 +1,230 @@
+#include "udp_uplink.h"
+
+#include <string.h>
+#include <errno.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_attr.h"
+#include "lwip/sockets.h"
+#include "mbedtls/md.h"
+#include "cJSON.h"
+
+#include "cycle_profiler.h"
+#include "error_handler.h"
+#include "sensor_payload.h"
+#include "sensor_interface_task.h"
+#include "sleep_manager.h"
+#include "static_alloc.h"
+#include "wake_budget.h"
+
+static const char TAG[] = "udp_uplink";
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR uint32_t uplink_session = 0;
+static RTC_DATA_ATTR uint32_t uplink_sequence = 0;
+
+static bool udp_uplink_started = false;
+
+/**
+ * @brief Write a 32-bit value in big-endian order
+ * @note Helper function for the datagram encoding
+ */
+static void udp_uplink_put_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t) (value >> 24);
+    buffer[1] = (uint8_t) (value >> 16);
+    buffer[2] = (uint8_t) (value >> 8);
+    buffer[3] = (uint8_t) value;
+}
+
+/**
+ * @brief Compute the truncated HMAC-SHA256 tag
+ * @param data Data to authenticate
+ * @param data_len Data length
+ * @param tag Output tag, UDP_UPLINK_TAG_LEN bytes
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t udp_uplink_tag(const uint8_t *data, size_t data_len, uint8_t *tag)
+{
+    uint8_t hmac[32];
+    const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    if (mbedtls_md_hmac(md_info, (const unsigned char *) UDP_UPLINK_KEY, strlen(UDP_UPLINK_KEY), data, data_len, hmac) != 0)
+    {
+        ESP_LOGE(TAG, "HMAC failed");
+        return ESP_FAIL;
+    }
+
+    memcpy(tag, hmac, UDP_UPLINK_TAG_LEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Check the ack received from the gateway
+ * @param ack Ack datagram
+ * @param ack_len Ack length
+ * @param sequence Expected sequence number
+ * @return true if the ack is valid
+ */
+static bool udp_uplink_check_ack(const uint8_t *ack, int ack_len, uint32_t sequence)
+{
+    uint8_t expected[12];
+    uint8_t tag[UDP_UPLINK_TAG_LEN];
+
+    if (ack_len != sizeof(expected) + UDP_UPLINK_TAG_LEN)
+        return false;
+
+    expected[0] = 'S';
+    expected[1] = 'A';
+    expected[2] = UDP_UPLINK_VERSION;
+    expected[3] = 0;
+    udp_uplink_put_u32(&expected[4], uplink_session);
+    udp_uplink_put_u32(&expected[8], sequence);
+
+    if (memcmp(ack, expected, sizeof(expected)) != 0 || udp_uplink_tag(expected, sizeof(expected), tag) != ESP_OK)
+        return false;
+
+    return memcmp(&ack[sizeof(expected)], tag, UDP_UPLINK_TAG_LEN) == 0;
+}
+
+esp_err_t udp_uplink_send(const char *payload, size_t payload_len)
+{
+    static uint8_t datagram[UDP_UPLINK_HEADER_LEN + UDP_UPLINK_MAX_PAYLOAD + UDP_UPLINK_TAG_LEN];
+
+    if (payload_len > UDP_UPLINK_MAX_PAYLOAD)
+    {
+        ESP_LOGE(TAG, "Payload too large: %u", (unsigned) payload_len);
+        return ESP_FAIL;
+    }
+
+    if (uplink_session == 0)
+    {
+        uplink_session = esp_random() | 1;
+    }
+    uint32_t sequence = ++uplink_sequence;
+
+    // Header
+    datagram[0] = 'S';
+    datagram[1] = 'F';
+    datagram[2] = UDP_UPLINK_VERSION;
+    datagram[3] = UDP_UPLINK_ACK ? UDP_UPLINK_FLAG_ACK : 0;
+    udp_uplink_put_u32(&datagram[4], uplink_session);
+    udp_uplink_put_u32(&datagram[8], sequence);
+    esp_read_mac(&datagram[12], ESP_MAC_WIFI_STA);
+    datagram[18] = (uint8_t) (payload_len >> 8);
+    datagram[19] = (uint8_t) payload_len;
+
+    memcpy(&datagram[UDP_UPLINK_HEADER_LEN], payload, payload_len);
+    size_t datagram_len = UDP_UPLINK_HEADER_LEN + payload_len;
+    if (udp_uplink_tag(datagram, datagram_len, &datagram[datagram_len]) != ESP_OK)
+        return ESP_FAIL;
+    datagram_len += UDP_UPLINK_TAG_LEN;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    struct timeval timeout = {
+        .tv_sec = UDP_UPLINK_ACK_TIMEOUT_MS / 1000,
+        .tv_usec = (UDP_UPLINK_ACK_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in gateway = {
+        .sin_family = AF_INET,
+        .sin_port = htons(UDP_UPLINK_GATEWAY_PORT),
+    };
+    inet_pton(AF_INET, UDP_UPLINK_GATEWAY_ADDRESS, &gateway.sin_addr);
+
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+    for (int attempt = 0; attempt <= UDP_UPLINK_RETRIES; attempt++)
+    {
+        if (sendto(sock, datagram, datagram_len, 0, (struct sockaddr *) &gateway, sizeof(gateway)) < 0)
+        {
+            ESP_LOGE(TAG, "Error sending datagram: errno %d", errno);
+            ret = ESP_FAIL;
+            break;
+        }
+
+        if (!UDP_UPLINK_ACK)
+        {
+            ret = ESP_OK;
+            break;
+        }
+
+        uint8_t ack[32];
+        int ack_len = recv(sock, ack, sizeof(ack), 0);
+        if (ack_len > 0 && udp_uplink_check_ack(ack, ack_len, sequence))
+        {
+            ret = ESP_OK;
+            break;
+        }
+
+        ESP_LOGW(TAG, "No valid ack for seq %lu, attempt %d", (unsigned long) sequence, attempt + 1);
+    }
+
+    close(sock);
+    return ret;
+}
+
+/**
+ * @brief UDP uplink task to run
+ * @param pvParameters
+ */
+static void udp_uplink_task(void *pvParameters)
+{
+    // Leave the UDP phase enough time to send and wait for the acks
+    uint32_t remaining_ms = wake_budget_phase_remaining_ms(WAKE_BUDGET_PHASE_UDP);
+    uint32_t wait_ms = (remaining_ms > UDP_UPLINK_SEND_MS) ? remaining_ms - UDP_UPLINK_SEND_MS : 0;
+    sensor_interface_wait_ready((wait_ms < SENSOR_INTERFACE_READY_TIMEOUT_MS) ? wait_ms : SENSOR_INTERFACE_READY_TIMEOUT_MS);
+
+    // Pending readings and soil history that do not fit the datagram are dropped, oldest first
+    char *json_string = sensor_payload_create_max(UDP_UPLINK_MAX_PAYLOAD);
+
+    if (json_string != NULL)
+    {
+        esp_err_t err = udp_uplink_send(json_string, strlen(json_string));
+        if (err == ESP_OK)
+        {
+            cycle_profiler_mark(CYCLE_PHASE_PUBLISH);
+            wake_budget_set_uplink_ok();
+            wake_budget_phase_done(WAKE_BUDGET_PHASE_UDP);
+            sensor_payload_clear_pending();
+            ESP_LOGI(TAG, "Sent seq %lu: %s", (unsigned long) uplink_sequence, json_string);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        }
+
+        cJSON_free(json_string);
+    }
+
+    sleep_manager_enter_deep_sleep();
+}
+
+STATIC_ALLOC_TASK(udp_uplink_task_buffers, UDP_UPLINK_TASK_STACK_SIZE);
+
+void udp_uplink_start(void)
+{
+    if (udp_uplink_started) {
+        ESP_LOGW(TAG, "UDP uplink task already started, skipping.");
+        return;
+    }
+    udp_uplink_started = true;
+
+    wake_budget_register(WAKE_BUDGET_PHASE_UDP, WAKE_BUDGET_UDP_MS);
+
+    BaseType_t err = static_alloc_task_create(&udp_uplink_task_buffers, &udp_uplink_task, "udp_uplink_task", NULL, UDP_UPLINK_TASK_PRIORITY, NULL, tskNO_AFFINITY);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "UDP uplink task create failed");
+        my_error_handler(TAG);
+    }
+}
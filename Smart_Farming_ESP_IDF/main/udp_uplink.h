@@ -0,0 +1,62 @@
+/**
+ * Lightweight UDP uplink. Sends the sensor data as one authenticated datagram to
+ * a gateway which republishes it to the MQTT broker (see tools/udp_gateway.py).
+ *
+ * Datagram layout (multi-byte fields are big-endian):
+ *   0  magic "SF"
+ *   2  version
+ *   3  flags (bit 0: ack requested)
+ *   4  session, random per power-on
+ *   8  sequence number
+ *  12  device MAC address (6 bytes)
+ *  18  payload length
+ *  20  payload (JSON)
+ *  ..  HMAC-SHA256 of all previous bytes, truncated to 16 bytes
+ *
+ * Ack layout: magic "SA", version, 0, session, sequence number, HMAC of the first 12 bytes (16 bytes)
+ */
+
+#ifndef UDP_UPLINK_H_
+#define UDP_UPLINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// UDP uplink task config
+#define UDP_UPLINK_TASK_STACK_SIZE  4096
+#define UDP_UPLINK_TASK_PRIORITY    5
+
+// Gateway config
+#define UDP_UPLINK_GATEWAY_ADDRESS  "192.168.0.248"
+#define UDP_UPLINK_GATEWAY_PORT     5683
+#define UDP_UPLINK_KEY              "Your_UDP_Uplink_Key"
+
+#define UDP_UPLINK_ACK              true    // Wait for the gateway ack
+#define UDP_UPLINK_ACK_TIMEOUT_MS   300
+#define UDP_UPLINK_RETRIES          2
+// Longest send, every attempt waits the whole ack timeout
+#define UDP_UPLINK_SEND_MS          (UDP_UPLINK_ACK ? UDP_UPLINK_ACK_TIMEOUT_MS * (UDP_UPLINK_RETRIES + 1) : 0)
+
+#define UDP_UPLINK_VERSION          1
+#define UDP_UPLINK_FLAG_ACK         0x01
+#define UDP_UPLINK_HEADER_LEN       20
+#define UDP_UPLINK_TAG_LEN          16
+#define UDP_UPLINK_MAX_PAYLOAD      1400    // Whole datagram fits a 1500 byte MTU without IP fragments
+
+/**
+ * @brief Send one payload to the gateway
+ * @param payload Payload data
+ * @param payload_len Payload length
+ * @return ESP_OK if sent (and acked when UDP_UPLINK_ACK is set), ESP_ERR_TIMEOUT if not acked, ESP_FAIL otherwise
+ */
+esp_err_t udp_uplink_send(const char *payload, size_t payload_len);
+
+/**
+ * @brief Start UDP uplink task. It sends the sensor data then puts the device to deep sleep.
+ */
+void udp_uplink_start(void);
+
+#endif /* UDP_UPLINK_H_ */
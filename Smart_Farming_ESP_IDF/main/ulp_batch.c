@@ -0,0 +1,70 @@
+#include "ulp_batch.h"
+
+// The ULP uses the low 16 bits of each word
+#define ULP_BATCH_VALUE_MASK    0xFFFF
+
+bool ulp_batch_plan(uint32_t sleep_sec, uint32_t min_period_sec, ulp_batch_plan_t *plan)
+{
+    if (min_period_sec == 0)
+        min_period_sec = 1;
+
+    // Round up so the batch never holds more than the buffer
+    uint32_t period_sec = (sleep_sec + ULP_BATCH_MAX_SAMPLES - 1) / ULP_BATCH_MAX_SAMPLES;
+    if (period_sec < min_period_sec)
+        period_sec = min_period_sec;
+
+    plan->period_sec = period_sec;
+    plan->samples = sleep_sec / period_sec;
+
+    return plan->samples >= 2;
+}
+
+void ulp_batch_window(int32_t reference, uint16_t delta, uint16_t *low, uint16_t *high)
+{
+    if (reference < 0)
+    {
+        *low = 0;
+        *high = ULP_BATCH_VALUE_MASK;
+        return;
+    }
+
+    if (reference > ULP_BATCH_VALUE_MASK)
+        reference = ULP_BATCH_VALUE_MASK;
+
+    *low = (reference > delta) ? (uint16_t) (reference - delta) : 0;
+    *high = (reference + delta < ULP_BATCH_VALUE_MASK) ? (uint16_t) (reference + delta) : ULP_BATCH_VALUE_MASK;
+}
+
+bool ulp_batch_trips(uint16_t sample, uint16_t low, uint16_t high)
+{
+    // The ULP subtracts and branches on the borrow: sample - low and high - sample
+    return sample < low || sample > high;
+}
+
+size_t ulp_batch_decode(const volatile uint32_t *words, uint32_t count_word, uint16_t *samples, size_t max_samples)
+{
+    size_t count = count_word & ULP_BATCH_VALUE_MASK;
+    if (count > ULP_BATCH_MAX_SAMPLES)
+        count = ULP_BATCH_MAX_SAMPLES;
+    if (count > max_samples)
+        count = max_samples;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        samples[i] = words[i] & ULP_BATCH_VALUE_MASK;
+    }
+
+    return count;
+}
+
+uint32_t ulp_batch_reason(uint32_t reason_word)
+{
+    uint32_t reason = reason_word & ULP_BATCH_VALUE_MASK;
+    return (reason < ULP_BATCH_REASON_COUNT) ? reason : ULP_BATCH_REASON_NONE;
+}
+
+const char *ulp_batch_reason_name(uint32_t reason)
+{
+    static const char *const names[ULP_BATCH_REASON_COUNT] = { "none", "batch_full", "threshold", "sensor_error" };
+    return (reason < ULP_BATCH_REASON_COUNT) ? names[reason] : names[ULP_BATCH_REASON_NONE];
+}
@@ -0,0 +1,95 @@
+/**
+ * ULP soil moisture batch. Layout of the sample buffer shared with the ULP program
+ * (ulp/soil_sampler.S), the threshold window and the batch plan. Pure logic, no
+ * ESP-IDF dependencies, so it can be compiled and checked on the host.
+ *
+ * The ULP stores each sample with ST, which puts the value in the low 16 bits of a
+ * 32-bit word of RTC slow memory and the address of the ST instruction in the high
+ * 16 bits. It wakes the main CPU when the buffer is full or a sample is outside
+ * [low, high], and leaves the reason in a shared word.
+ *
+ * This header is also included by the ULP assembly source, only the defines are
+ * visible there.
+ */
+
+#ifndef ULP_BATCH_H_
+#define ULP_BATCH_H_
+
+#define ULP_BATCH_MAX_SAMPLES           32      // Size of the ULP sample buffer
+
+// Why the ULP woke the main CPU, shared with the ULP program
+#define ULP_BATCH_REASON_NONE           0       // Not woken by the ULP
+#define ULP_BATCH_REASON_FULL           1       // Batch complete, scheduled upload
+#define ULP_BATCH_REASON_THRESHOLD      2       // Sample outside the window
+#define ULP_BATCH_REASON_SENSOR_ERROR   3       // ADS111x did not ack
+#define ULP_BATCH_REASON_COUNT          4
+
+#ifndef __ASSEMBLER__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sampling schedule of one batch
+typedef struct ulp_batch_plan
+{
+    uint32_t period_sec;        // ULP wakeup period
+    uint32_t samples;           // Samples before the main CPU wakes
+} ulp_batch_plan_t;
+
+/**
+ * @brief Spread one upload interval over a batch
+ * @param sleep_sec Time until the next upload
+ * @param min_period_sec Shortest sampling period
+ * @param plan Output plan, samples * period_sec <= sleep_sec
+ * @return true if the interval holds at least 2 samples, false to sleep without the ULP
+ * @note Long intervals get a longer period so the batch fits ULP_BATCH_MAX_SAMPLES
+ */
+bool ulp_batch_plan(uint32_t sleep_sec, uint32_t min_period_sec, ulp_batch_plan_t *plan);
+
+/**
+ * @brief Get the threshold window around a reference sample
+ * @param reference Last sample of the previous batch, negative if there is none
+ * @param delta Change that wakes the main CPU
+ * @param low Output, lowest sample that does not wake the main CPU
+ * @param high Output, highest sample that does not wake the main CPU
+ * @note The window saturates at 0 and 0xFFFF, without a reference it is the full range
+ */
+void ulp_batch_window(int32_t reference, uint16_t delta, uint16_t *low, uint16_t *high);
+
+/**
+ * @brief Check a sample against the window, the same test as the ULP program
+ * @param sample Raw ADC value
+ * @param low Window low end
+ * @param high Window high end
+ * @return true if the sample wakes the main CPU
+ */
+bool ulp_batch_trips(uint16_t sample, uint16_t low, uint16_t high);
+
+/**
+ * @brief Decode the samples written by the ULP
+ * @param words Sample buffer in RTC slow memory
+ * @param count_word Sample count word
+ * @param samples Output array of raw ADC values, oldest first
+ * @param max_samples Size of the output array
+ * @return Number of samples written
+ */
+size_t ulp_batch_decode(const volatile uint32_t *words, uint32_t count_word, uint16_t *samples, size_t max_samples);
+
+/**
+ * @brief Decode the reason word written by the ULP
+ * @param reason_word Reason word
+ * @return ULP_BATCH_REASON_*, ULP_BATCH_REASON_NONE if not valid
+ */
+uint32_t ulp_batch_reason(uint32_t reason_word);
+
+/**
+ * @brief Get the name of a reason
+ * @param reason ULP_BATCH_REASON_*
+ * @return Name, "none" if not valid
+ */
+const char *ulp_batch_reason_name(uint32_t reason);
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* ULP_BATCH_H_ */
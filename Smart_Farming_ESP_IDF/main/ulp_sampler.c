@@ -0,0 +1,180 @@
+#include "ulp_sampler.h"
+
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "wall_clock.h"
+
+#if ULP_SAMPLER_ENABLE
+#include "esp_sleep.h"
+#include "driver/rtc_io.h"
+#include "soc/rtc.h"
+#include "ulp.h"
+#include "ulp_main.h"   // Generated, ulp_ + the global symbols of ulp/soil_sampler.S
+
+extern const uint8_t ulp_main_bin_start[] asm("_binary_ulp_main_bin_start");
+extern const uint8_t ulp_main_bin_end[] asm("_binary_ulp_main_bin_end");
+
+static const char TAG[] = "ulp_sampler";
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR bool ulp_started = false;
+static RTC_DATA_ATTR int32_t last_sample = -1;     // Reference of the next batch, -1 before the first one
+static RTC_DATA_ATTR uint16_t collected[ULP_BATCH_MAX_SAMPLES];
+static RTC_DATA_ATTR uint32_t collected_stamps[ULP_BATCH_MAX_SAMPLES];    // wall_clock_stamp of each sample
+static RTC_DATA_ATTR uint16_t collected_count = 0;
+static RTC_DATA_ATTR uint32_t batch_stamp = 0;      // wall_clock_stamp of the first sample of the batch
+static RTC_DATA_ATTR uint32_t batch_period_sec = 0;
+#endif
+
+static uint32_t boot_reason = ULP_BATCH_REASON_NONE;
+
+#if ULP_SAMPLER_ENABLE
+/**
+ * @brief Hand a sensor pin to the ULP, released to the pull-up
+ * @param gpio GPIO number
+ * @note The ULP drives the line low by enabling the output, the output value stays 0
+ */
+static void ulp_sampler_init_pin(gpio_num_t gpio)
+{
+    rtc_gpio_init(gpio);
+    rtc_gpio_set_direction(gpio, RTC_GPIO_MODE_INPUT_ONLY);
+    rtc_gpio_set_level(gpio, 0);
+    rtc_gpio_pulldown_dis(gpio);
+    rtc_gpio_pullup_en(gpio);
+}
+#endif
+
+void ulp_sampler_collect(void)
+{
+#if ULP_SAMPLER_ENABLE
+    if (!ulp_started)
+        return;
+    ulp_started = false;
+
+    ulp_timer_stop();
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_ULP)
+    {
+        boot_reason = ulp_batch_reason(ulp_wake_reason);
+    }
+    else if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER)
+    {
+        ESP_LOGW(TAG, "ULP did not wake the CPU, woken by the backstop timer");
+    }
+
+    uint16_t batch[ULP_BATCH_MAX_SAMPLES];
+    size_t count = ulp_batch_decode(&ulp_samples, ulp_sample_count, batch, ULP_BATCH_MAX_SAMPLES);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (collected_count == ULP_BATCH_MAX_SAMPLES)
+        {
+            // Not delivered yet, drop the oldest
+            memmove(&collected[0], &collected[1], (ULP_BATCH_MAX_SAMPLES - 1) * sizeof(collected[0]));
+            memmove(&collected_stamps[0], &collected_stamps[1], (ULP_BATCH_MAX_SAMPLES - 1) * sizeof(collected_stamps[0]));
+            collected_count--;
+        }
+        // The first sample is taken by ulp_run, the next ones one ULP wakeup period apart
+        collected_stamps[collected_count] = batch_stamp + i * batch_period_sec;
+        collected[collected_count++] = batch[i];
+    }
+    if (count > 0)
+    {
+        last_sample = batch[count - 1];
+    }
+
+    // Back to the digital IO MUX for the I2C driver
+    rtc_gpio_deinit(ULP_SAMPLER_SDA_GPIO);
+    rtc_gpio_deinit(ULP_SAMPLER_SCL_GPIO);
+
+    ESP_LOGI(TAG, "Woken by %s, %u samples", ulp_batch_reason_name(boot_reason), (unsigned) count);
+#endif
+}
+
+esp_err_t ulp_sampler_start(uint32_t sleep_sec)
+{
+#if ULP_SAMPLER_ENABLE
+    // A sensor that does not ack would wake the CPU again after one sampling period
+    if (boot_reason == ULP_BATCH_REASON_SENSOR_ERROR)
+    {
+        ESP_LOGW(TAG, "Sensor error, no ULP sampling until the next upload");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ulp_batch_plan_t plan;
+    if (!ulp_batch_plan(sleep_sec, ULP_SAMPLER_PERIOD_SEC, &plan))
+        return ESP_ERR_INVALID_SIZE;
+
+    esp_err_t err = ulp_load_binary(0, ulp_main_bin_start, (ulp_main_bin_end - ulp_main_bin_start) / sizeof(uint32_t));
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        return err;
+    }
+
+    uint16_t low, high;
+    ulp_batch_window(last_sample, ULP_SAMPLER_SOIL_DELTA, &low, &high);
+    ulp_soil_low = low;
+    ulp_soil_high = high;
+    ulp_sample_max = plan.samples;
+    ulp_sample_count = 0;
+    ulp_wake_reason = ULP_BATCH_REASON_NONE;
+
+    ulp_sampler_init_pin(ULP_SAMPLER_SDA_GPIO);
+    ulp_sampler_init_pin(ULP_SAMPLER_SCL_GPIO);
+
+    // RTC GPIOs and their pull-ups stay powered for the ULP
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    ulp_set_wakeup_period(0, plan.period_sec * 1000000);
+    ESP_ERROR_CHECK(esp_sleep_enable_ulp_wakeup());
+
+    err = ulp_run(&ulp_entry - RTC_SLOW_MEM);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        rtc_gpio_deinit(ULP_SAMPLER_SDA_GPIO);
+        rtc_gpio_deinit(ULP_SAMPLER_SCL_GPIO);
+        return err;
+    }
+    ulp_started = true;
+    batch_stamp = wall_clock_stamp();
+    batch_period_sec = plan.period_sec;
+
+    ESP_LOGI(TAG, "%lu samples every %lus, window %u..%u", (unsigned long) plan.samples,
+             (unsigned long) plan.period_sec, low, high);
+    return ESP_OK;
+#else
+    (void) sleep_sec;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t ulp_sampler_boot_reason(void)
+{
+    return boot_reason;
+}
+
+size_t ulp_sampler_get_samples(uint16_t *samples, uint32_t *stamps, size_t max_samples)
+{
+    size_t count = 0;
+#if ULP_SAMPLER_ENABLE
+    for (; count < collected_count && count < max_samples; count++)
+    {
+        samples[count] = collected[count];
+        stamps[count] = collected_stamps[count];
+    }
+#else
+    (void) samples;
+    (void) stamps;
+    (void) max_samples;
+#endif
+    return count;
+}
+
+void ulp_sampler_clear_samples(void)
+{
+#if ULP_SAMPLER_ENABLE
+    collected_count = 0;
+#endif
+}
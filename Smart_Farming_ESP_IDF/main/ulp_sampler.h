@@ -0,0 +1,92 @@
+/**
+ * ULP soil moisture sampler. During deep sleep the ULP coprocessor reads the ADS111x
+ * over a bit-banged I2C bus on RTC GPIOs (ulp/soil_sampler.S) and collects the
+ * samples in RTC slow memory. The main CPU stays asleep until the batch is full
+ * (the upload interval is over), a sample moves more than ULP_SAMPLER_SOIL_DELTA
+ * from the last one of the previous batch, or the sensor does not answer.
+ *
+ * Needs CONFIG_ULP_COPROC_ENABLED with the FSM ULP. Takes over from the wake stub
+ * when enabled.
+ *
+ * This header is also included by the ULP assembly source, only the defines are
+ * visible there.
+ */
+
+#ifndef ULP_SAMPLER_H_
+#define ULP_SAMPLER_H_
+
+#include "sdkconfig.h"
+#include "ulp_batch.h"
+
+// 1 = sample the soil moisture with the ULP during deep sleep, 0 = main CPU only
+#if CONFIG_ULP_COPROC_ENABLED
+#define ULP_SAMPLER_ENABLE          1
+#else
+#define ULP_SAMPLER_ENABLE          0
+#endif
+
+#define ULP_SAMPLER_PERIOD_SEC      15      // Shortest sampling period, longer if the upload interval needs more than ULP_BATCH_MAX_SAMPLES
+#define ULP_SAMPLER_SOIL_DELTA      1000    // Raw ADC change that wakes the main CPU (irrigation started or stopped)
+#define ULP_SAMPLER_BACKSTOP_SEC    30      // Timer wakeup after the upload interval, in case the ULP stalls
+
+// Same pins as ADC_SDA and ADC_SCL in sensor_interface_task.h, as RTC GPIO numbers
+#define ULP_SAMPLER_SDA_GPIO        27
+#define ULP_SAMPLER_SCL_GPIO        26
+#define ULP_SAMPLER_SDA_RTCIO       17      // GPIO27
+#define ULP_SAMPLER_SCL_RTCIO       7       // GPIO26
+
+#define ULP_SAMPLER_ADS111X_ADDR    0x48    // ADDR pin to GND
+// Start single shot, AIN0 to GND, 4.096 V, 860 SPS, comparator off
+#define ULP_SAMPLER_ADS111X_CONFIG  0xC3E3
+// ULP clock cycles, ~8.5 MHz: 5 us half bit (~100 kHz) and 1.5 ms conversion
+#define ULP_SAMPLER_HALF_BIT_CYCLES 40
+#define ULP_SAMPLER_CONVERSION_CYCLES 13000
+
+#ifndef __ASSEMBLER__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief Collect the batch of the last deep sleep and release the sensor pins
+ * @note Call at boot before the sensor I2C bus is set up
+ */
+void ulp_sampler_collect(void);
+
+/**
+ * @brief Load and start the ULP program for the coming deep sleep
+ * @param sleep_sec Time until the next upload
+ * @return ESP_OK if the ULP runs and wakes the main CPU, ESP_ERR_INVALID_STATE if this boot was a sensor
+ *         error of the ULP, so the node sleeps on the timer until the next upload instead of booting
+ *         again every sampling period
+ * @note Call right before esp_deep_sleep_start. Arm a timer wakeup ULP_SAMPLER_BACKSTOP_SEC after
+ *       sleep_sec as well, the ULP does not wake the main CPU if it stalls.
+ */
+esp_err_t ulp_sampler_start(uint32_t sleep_sec);
+
+/**
+ * @brief Get why the ULP woke the main CPU
+ * @return ULP_BATCH_REASON_*
+ */
+uint32_t ulp_sampler_boot_reason(void);
+
+/**
+ * @brief Get the soil moisture samples collected by the ULP
+ * @param samples Output array of raw ADC values, oldest first
+ * @param stamps Output array, wall_clock_stamp of each sample
+ * @param max_samples Size of the output arrays
+ * @return Number of samples written
+ */
+size_t ulp_sampler_get_samples(uint16_t *samples, uint32_t *stamps, size_t max_samples);
+
+/**
+ * @brief Drop the ULP samples after they were delivered
+ */
+void ulp_sampler_clear_samples(void);
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* ULP_SAMPLER_H_ */
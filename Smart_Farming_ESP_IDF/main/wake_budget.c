@@ -0,0 +1,234 @@
+#include "wake_budget.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "error_handler.h"
+#include "sleep_manager.h"
+#include "static_alloc.h"
+
+static const char TAG[] = "wake_budget";
+
+static const char *const phase_names[WAKE_BUDGET_PHASE_MAX] = {
+    "wifi",
+    "mqtt",
+    "udp",
+    "espnow",
+};
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR uint32_t uplink_failures = 0;
+
+static esp_timer_handle_t budget_timer = NULL;
+static int64_t wake_deadline_us = 0;
+static int64_t phase_deadline_us[WAKE_BUDGET_PHASE_MAX];
+static bool uplink_ok = false;
+
+// Saves the data and enters deep sleep for the budget timer, which must not block the esp_timer task
+static TaskHandle_t abort_task = NULL;
+static const char *volatile expired_reason = "wake";
+
+STATIC_ALLOC_TASK(abort_task_buffers, WAKE_BUDGET_TASK_STACK_SIZE);
+
+static portMUX_TYPE budget_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t wake_budget_backoff_sec(uint32_t base_sec, uint32_t failures)
+{
+    uint32_t shift = (failures < WAKE_BUDGET_MAX_BACKOFF_SHIFT) ? failures : WAKE_BUDGET_MAX_BACKOFF_SHIFT;
+    uint64_t sleep_sec = (uint64_t) base_sec << shift;
+
+    if (failures > 0 && sleep_sec > WAKE_BUDGET_MAX_SLEEP_SEC)
+        sleep_sec = (base_sec > WAKE_BUDGET_MAX_SLEEP_SEC) ? base_sec : WAKE_BUDGET_MAX_SLEEP_SEC;
+
+    return (uint32_t) sleep_sec;
+}
+
+/**
+ * @brief Arm the budget timer to the earliest active deadline
+ * @note Helper function, call with budget_lock released
+ */
+static void wake_budget_arm(void)
+{
+    // Budget not started, e.g. on the always-on ESP-NOW gateway
+    if (budget_timer == NULL)
+        return;
+
+    portENTER_CRITICAL(&budget_lock);
+    int64_t deadline = wake_deadline_us;
+    for (int i = 0; i < WAKE_BUDGET_PHASE_MAX; i++)
+    {
+        if (phase_deadline_us[i] != 0 && phase_deadline_us[i] < deadline)
+            deadline = phase_deadline_us[i];
+    }
+    portEXIT_CRITICAL(&budget_lock);
+
+    int64_t now = esp_timer_get_time();
+    esp_timer_stop(budget_timer);
+    esp_timer_start_once(budget_timer, (deadline > now) ? (uint64_t) (deadline - now) : 1);
+}
+
+/**
+ * @brief Task that gives up on the wake once the budget timer expired
+ * @param pvParameters Not used
+ */
+static void wake_budget_task(void *pvParameters)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        wake_budget_abort(expired_reason);
+    }
+}
+
+/**
+ * @brief Budget timer callback, runs in the esp_timer task
+ * @param arg Not used
+ * @note Only wakes wake_budget_task, the deep sleep entry reads the sensors and waits for SNTP
+ *       and Wi-Fi, which would hold up every other esp_timer user (esp-mqtt, the Wi-Fi driver)
+ */
+static void wake_budget_expired_cb(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    const char *reason = "wake";
+
+    for (int i = 0; i < WAKE_BUDGET_PHASE_MAX; i++)
+    {
+        if (phase_deadline_us[i] != 0 && phase_deadline_us[i] <= now)
+        {
+            reason = phase_names[i];
+            break;
+        }
+    }
+
+    expired_reason = reason;
+    xTaskNotifyGive(abort_task);
+}
+
+void wake_budget_start(void)
+{
+    // The timer and the task are kept across light sleeps
+    if (budget_timer == NULL)
+    {
+        BaseType_t err = static_alloc_task_create(&abort_task_buffers, &wake_budget_task, "wake_budget", NULL,
+                                                  WAKE_BUDGET_TASK_PRIORITY, &abort_task, tskNO_AFFINITY);
+        if (err != pdPASS)
+        {
+            ESP_LOGE(TAG, "Wake budget task creation failed");
+            my_error_handler(TAG);
+        }
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = &wake_budget_expired_cb,
+            .name = "wake_budget",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &budget_timer));
+    }
+
+    wake_deadline_us = esp_timer_get_time() + (int64_t) WAKE_BUDGET_TOTAL_MS * 1000;
+    wake_budget_arm();
+}
+
+void wake_budget_stop(void)
+{
+    if (budget_timer != NULL)
+        esp_timer_stop(budget_timer);
+
+    portENTER_CRITICAL(&budget_lock);
+    for (int i = 0; i < WAKE_BUDGET_PHASE_MAX; i++)
+    {
+        phase_deadline_us[i] = 0;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+
+    uplink_ok = false;
+}
+
+void wake_budget_register(wake_budget_phase_e phase, uint32_t budget_ms)
+{
+    if (phase >= WAKE_BUDGET_PHASE_MAX)
+        return;
+
+    int64_t deadline = esp_timer_get_time() + (int64_t) budget_ms * 1000;
+
+    portENTER_CRITICAL(&budget_lock);
+    phase_deadline_us[phase] = (deadline < wake_deadline_us) ? deadline : wake_deadline_us;
+    portEXIT_CRITICAL(&budget_lock);
+
+    ESP_LOGI(TAG, "Phase %s: %lu ms", phase_names[phase], (unsigned long) budget_ms);
+    wake_budget_arm();
+}
+
+void wake_budget_phase_done(wake_budget_phase_e phase)
+{
+    if (phase >= WAKE_BUDGET_PHASE_MAX)
+        return;
+
+    portENTER_CRITICAL(&budget_lock);
+    phase_deadline_us[phase] = 0;
+    portEXIT_CRITICAL(&budget_lock);
+
+    wake_budget_arm();
+}
+
+uint32_t wake_budget_remaining_ms(void)
+{
+    int64_t remaining = wake_deadline_us - esp_timer_get_time();
+    return (remaining > 0) ? (uint32_t) (remaining / 1000) : 0;
+}
+
+uint32_t wake_budget_phase_remaining_ms(wake_budget_phase_e phase)
+{
+    int64_t deadline = wake_deadline_us;
+
+    if (phase < WAKE_BUDGET_PHASE_MAX)
+    {
+        portENTER_CRITICAL(&budget_lock);
+        if (phase_deadline_us[phase] != 0)
+            deadline = phase_deadline_us[phase];
+        portEXIT_CRITICAL(&budget_lock);
+    }
+
+    int64_t remaining = deadline - esp_timer_get_time();
+    return (remaining > 0) ? (uint32_t) (remaining / 1000) : 0;
+}
+
+void wake_budget_abort(const char *reason)
+{
+    ESP_LOGW(TAG, "Budget of %s exhausted, %lu failed wakes before this one", reason, (unsigned long) uplink_failures);
+    sleep_manager_enter_deep_sleep();
+}
+
+void wake_budget_set_uplink_ok(void)
+{
+    uplink_ok = true;
+    // The node works again, the next fault restarts straight away
+    error_handler_clear();
+}
+
+bool wake_budget_uplink_ok(void)
+{
+    return uplink_ok;
+}
+
+uint32_t wake_budget_previous_failures(void)
+{
+    return uplink_failures;
+}
+
+uint32_t wake_budget_next_sleep_sec(uint32_t base_sec)
+{
+    if (uplink_ok)
+    {
+        uplink_failures = 0;
+        return base_sec;
+    }
+
+    uplink_failures++;
+    uint32_t sleep_sec = wake_budget_backoff_sec(base_sec, uplink_failures);
+    ESP_LOGW(TAG, "Uplink failed %lu times in a row, sleeping %lus", (unsigned long) uplink_failures, (unsigned long) sleep_sec);
+
+    return sleep_sec;
+}
@@ -0,0 +1,118 @@
+/**
+ * Awake-time budget. Every phase of the wake registers its own deadline, and the
+ * whole wake has a hard limit. When a deadline passes, the budget timer wakes a task
+ * that saves the pending data and puts the node back to sleep. The sleep interval
+ * grows exponentially while the uplink keeps failing.
+ */
+
+#ifndef WAKE_BUDGET_H_
+#define WAKE_BUDGET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Budget of the whole wake and of each phase, in milliseconds
+#define WAKE_BUDGET_TOTAL_MS            20000
+#define WAKE_BUDGET_WIFI_MS             8000
+#define WAKE_BUDGET_MQTT_MS             8000
+#define WAKE_BUDGET_UDP_MS              2000
+#define WAKE_BUDGET_ESPNOW_MS           2000
+
+// Task that enters deep sleep when a deadline passes, above the uplink tasks so a stuck one cannot delay it
+#define WAKE_BUDGET_TASK_STACK_SIZE     4096
+#define WAKE_BUDGET_TASK_PRIORITY       6
+
+// Sleep backoff while the uplink keeps failing: interval << failures, capped
+#define WAKE_BUDGET_MAX_BACKOFF_SHIFT   4
+#define WAKE_BUDGET_MAX_SLEEP_SEC       3600
+
+// Phases with their own deadline
+typedef enum wake_budget_phase
+{
+    WAKE_BUDGET_PHASE_WIFI = 0,
+    WAKE_BUDGET_PHASE_MQTT,
+    WAKE_BUDGET_PHASE_UDP,
+    WAKE_BUDGET_PHASE_ESPNOW,
+    WAKE_BUDGET_PHASE_MAX,
+} wake_budget_phase_e;
+
+/**
+ * @brief Start the budget of this wake
+ * @note Call this early in app_main, and after each light sleep
+ */
+void wake_budget_start(void);
+
+/**
+ * @brief Stop the budget while the node stays in light sleep
+ * @note Clears the phase deadlines and the uplink status, wake_budget_start starts the next wake
+ */
+void wake_budget_stop(void);
+
+/**
+ * @brief Register a phase with its deadline
+ * @param phase Phase enum
+ * @param budget_ms Time the phase may take from now, bounded by the wake budget
+ */
+void wake_budget_register(wake_budget_phase_e phase, uint32_t budget_ms);
+
+/**
+ * @brief Mark a phase as finished so its deadline no longer applies
+ * @param phase Phase enum
+ */
+void wake_budget_phase_done(wake_budget_phase_e phase);
+
+/**
+ * @brief Get the time left before the wake budget is exhausted
+ * @return Remaining time in milliseconds
+ */
+uint32_t wake_budget_remaining_ms(void);
+
+/**
+ * @brief Get the time left before the deadline of a phase
+ * @param phase Phase enum
+ * @return Remaining time in milliseconds, the time left of the wake if the phase is not registered
+ */
+uint32_t wake_budget_phase_remaining_ms(wake_budget_phase_e phase);
+
+/**
+ * @brief Give up on this wake, save the pending data and go to sleep with backoff
+ * @param reason Appropriate TAG or phase name for the log
+ * @note This function does not return
+ */
+void wake_budget_abort(const char *reason);
+
+/**
+ * @brief Mark the sensor data of this wake as delivered
+ * @note Also resets the restart count of the error handler
+ */
+void wake_budget_set_uplink_ok(void);
+
+/**
+ * @brief Check if the sensor data of this wake was delivered
+ * @return true if delivered
+ */
+bool wake_budget_uplink_ok(void);
+
+/**
+ * @brief Get the number of wakes in a row that failed to deliver before this one
+ * @return Consecutive failed wakes, 0 if the last wake delivered its data
+ */
+uint32_t wake_budget_previous_failures(void);
+
+/**
+ * @brief Get the next sleep interval and update the failure count
+ * @param base_sec Configured sleep interval
+ * @return Sleep interval in seconds, with backoff if the uplink failed
+ * @note Call this once per wake, right before sleep
+ */
+uint32_t wake_budget_next_sleep_sec(uint32_t base_sec);
+
+/**
+ * @brief Compute the backoff sleep interval
+ * @param base_sec Configured sleep interval
+ * @param failures Consecutive failed wakes
+ * @return base_sec << failures, at most WAKE_BUDGET_MAX_BACKOFF_SHIFT times and WAKE_BUDGET_MAX_SLEEP_SEC
+ */
+uint32_t wake_budget_backoff_sec(uint32_t base_sec, uint32_t failures);
+
+#endif /* WAKE_BUDGET_H_ */
@@ -0,0 +1,286 @@
+#include "wake_stub.h"
+
+#include <stdbool.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_wake_stub.h"
+#include "esp_rom_sys.h"
+#include "soc/gpio_reg.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/io_mux_reg.h"
+#include "soc/rtc.h"
+
+#include "wall_clock.h"
+
+static const char TAG[] = "wake_stub";
+
+typedef struct wake_stub_state
+{
+    uint32_t wakes_left;        // Stub wakes before the next full boot
+    uint64_t interval_us;       // Deep sleep between stub wakes
+    uint16_t reference;         // First sample after the last full boot
+    bool reference_valid;
+    uint8_t boot_reason;
+    uint16_t head;
+    uint16_t count;
+    uint16_t samples[WAKE_STUB_MAX_SAMPLES];
+    uint32_t stamps[WAKE_STUB_MAX_SAMPLES];     // wall_clock_stamp of each sample
+    uint32_t next_stamp;        // wall_clock_stamp of the next stub wake
+    uint32_t stub_wakes;        // Since power-on
+    uint32_t sensor_errors;     // Since power-on
+    uint32_t cycle_errors;      // Failed reads since the last full boot
+} wake_stub_state_t;
+
+// Kept across deep sleep and read by the stub, zeroed on power-on
+static RTC_DATA_ATTR wake_stub_state_t stub_state;
+
+/**
+ * @brief Pull a line low or release it to the pull-up
+ * @param gpio GPIO number
+ * @param high true to release
+ * @note The output value stays 0, the line is driven by enabling the output
+ */
+static void RTC_IRAM_ATTR wake_stub_i2c_line(uint32_t gpio, bool high)
+{
+    REG_WRITE(high ? GPIO_ENABLE_W1TC_REG : GPIO_ENABLE_W1TS_REG, BIT(gpio));
+    esp_rom_delay_us(WAKE_STUB_I2C_HALF_BIT_US);
+}
+
+static bool RTC_IRAM_ATTR wake_stub_i2c_sda(void)
+{
+    return (REG_READ(GPIO_IN_REG) >> WAKE_STUB_SDA_GPIO) & 1;
+}
+
+/**
+ * @brief Configure SDA and SCL as open-drain GPIOs, both released
+ */
+static void RTC_IRAM_ATTR wake_stub_i2c_init(void)
+{
+    PIN_FUNC_SELECT(WAKE_STUB_SDA_MUX_REG, PIN_FUNC_GPIO);
+    PIN_FUNC_SELECT(WAKE_STUB_SCL_MUX_REG, PIN_FUNC_GPIO);
+    PIN_INPUT_ENABLE(WAKE_STUB_SDA_MUX_REG);
+    PIN_PULLUP_EN(WAKE_STUB_SDA_MUX_REG);
+    PIN_PULLUP_EN(WAKE_STUB_SCL_MUX_REG);
+
+    REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + WAKE_STUB_SDA_GPIO * 4, SIG_GPIO_OUT_IDX);
+    REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + WAKE_STUB_SCL_GPIO * 4, SIG_GPIO_OUT_IDX);
+    REG_WRITE(GPIO_OUT_W1TC_REG, BIT(WAKE_STUB_SDA_GPIO) | BIT(WAKE_STUB_SCL_GPIO));
+
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, true);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+}
+
+static void RTC_IRAM_ATTR wake_stub_i2c_start(void)
+{
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, true);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, false);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, false);
+}
+
+static void RTC_IRAM_ATTR wake_stub_i2c_stop(void)
+{
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, false);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, true);
+}
+
+/**
+ * @brief Write one byte
+ * @param byte Byte to write
+ * @return true if the device acked
+ */
+static bool RTC_IRAM_ATTR wake_stub_i2c_write(uint8_t byte)
+{
+    for (int bit = 7; bit >= 0; bit--)
+    {
+        wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, (byte >> bit) & 1);
+        wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+        wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, false);
+    }
+
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, true);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+    bool ack = !wake_stub_i2c_sda();
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, false);
+
+    return ack;
+}
+
+/**
+ * @brief Read one byte
+ * @param ack true to ack the byte, false for the last byte
+ * @return Byte read
+ */
+static uint8_t RTC_IRAM_ATTR wake_stub_i2c_read(bool ack)
+{
+    uint8_t byte = 0;
+
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, true);
+    for (int bit = 0; bit < 8; bit++)
+    {
+        wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+        byte = (byte << 1) | wake_stub_i2c_sda();
+        wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, false);
+    }
+
+    wake_stub_i2c_line(WAKE_STUB_SDA_GPIO, !ack);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, true);
+    wake_stub_i2c_line(WAKE_STUB_SCL_GPIO, false);
+
+    return byte;
+}
+
+/**
+ * @brief Run one single-shot conversion of the ADS111x
+ * @param raw Output raw ADC value
+ * @return true if success
+ * @note The application writes its own config again at the next full boot
+ */
+static bool RTC_IRAM_ATTR wake_stub_read_soil(uint16_t *raw)
+{
+    wake_stub_i2c_init();
+
+    // Config register, OS bit starts the conversion
+    wake_stub_i2c_start();
+    bool ok = wake_stub_i2c_write(WAKE_STUB_ADS111X_ADDR << 1)
+           && wake_stub_i2c_write(0x01)
+           && wake_stub_i2c_write(WAKE_STUB_ADS111X_CONFIG >> 8)
+           && wake_stub_i2c_write(WAKE_STUB_ADS111X_CONFIG & 0xFF);
+    wake_stub_i2c_stop();
+    if (!ok)
+        return false;
+
+    esp_rom_delay_us(WAKE_STUB_CONVERSION_US);
+
+    // Conversion register
+    wake_stub_i2c_start();
+    ok = wake_stub_i2c_write(WAKE_STUB_ADS111X_ADDR << 1) && wake_stub_i2c_write(0x00);
+    wake_stub_i2c_stop();
+    if (!ok)
+        return false;
+
+    wake_stub_i2c_start();
+    ok = wake_stub_i2c_write((WAKE_STUB_ADS111X_ADDR << 1) | 1);
+    if (ok)
+    {
+        uint16_t msb = wake_stub_i2c_read(true);
+        uint16_t lsb = wake_stub_i2c_read(false);
+        *raw = (msb << 8) | lsb;
+    }
+    wake_stub_i2c_stop();
+
+    return ok;
+}
+
+/**
+ * @brief Wake stub entry, runs before the bootloader
+ */
+static void RTC_IRAM_ATTR wake_stub_entry(void)
+{
+    uint16_t raw = 0;
+
+    if (!(esp_wake_stub_get_wakeup_cause() & RTC_TIMER_TRIG_EN))
+    {
+        stub_state.boot_reason = WAKE_STUB_BOOT_OTHER;
+        goto full_boot;
+    }
+
+    if (stub_state.wakes_left == 0)
+    {
+        stub_state.boot_reason = stub_state.cycle_errors > 0 ? WAKE_STUB_BOOT_SENSOR_ERROR : WAKE_STUB_BOOT_SCHEDULED;
+        goto full_boot;
+    }
+    stub_state.wakes_left--;
+    stub_state.stub_wakes++;
+
+    // The stub has no clock, its wakes are one interval apart
+    uint32_t stamp = stub_state.next_stamp;
+    stub_state.next_stamp += WAKE_STUB_SAMPLE_SEC;
+
+    // A dead sensor is reported at the scheduled boot, booting now would repeat every stub wake
+    if (!wake_stub_read_soil(&raw))
+    {
+        stub_state.sensor_errors++;
+        stub_state.cycle_errors++;
+        goto stub_sleep;
+    }
+
+    stub_state.samples[(stub_state.head + stub_state.count) % WAKE_STUB_MAX_SAMPLES] = raw;
+    stub_state.stamps[(stub_state.head + stub_state.count) % WAKE_STUB_MAX_SAMPLES] = stamp;
+    if (stub_state.count == WAKE_STUB_MAX_SAMPLES)
+        stub_state.head = (stub_state.head + 1) % WAKE_STUB_MAX_SAMPLES;
+    else
+        stub_state.count++;
+
+    if (!stub_state.reference_valid)
+    {
+        stub_state.reference = raw;
+        stub_state.reference_valid = true;
+    }
+    else if ((raw > stub_state.reference ? raw - stub_state.reference : stub_state.reference - raw) >= WAKE_STUB_SOIL_DELTA)
+    {
+        stub_state.boot_reason = WAKE_STUB_BOOT_THRESHOLD;
+        goto full_boot;
+    }
+
+stub_sleep:
+    esp_wake_stub_set_wakeup_time(stub_state.interval_us);
+    esp_wake_stub_sleep(&wake_stub_entry);
+
+full_boot:
+    esp_default_wake_deep_sleep();
+}
+
+uint32_t wake_stub_arm(uint32_t sleep_sec)
+{
+    // The stub sets the reason of the boot it starts
+    stub_state.boot_reason = WAKE_STUB_BOOT_OTHER;
+    stub_state.cycle_errors = 0;
+
+#if WAKE_STUB_ENABLE
+    uint32_t wakes = sleep_sec / WAKE_STUB_SAMPLE_SEC;
+    if (wakes >= 2)
+    {
+        stub_state.wakes_left = wakes - 1;
+        stub_state.interval_us = (uint64_t) WAKE_STUB_SAMPLE_SEC * 1000000;
+        stub_state.reference_valid = false;
+        esp_set_deep_sleep_wake_stub(&wake_stub_entry);
+
+        ESP_LOGI(TAG, "%lu stub wakes before the next full boot", (unsigned long) stub_state.wakes_left);
+        // The remainder goes to the first sleep, the last stub wake boots right on time
+        uint32_t first_sleep_sec = sleep_sec - stub_state.wakes_left * WAKE_STUB_SAMPLE_SEC;
+        stub_state.next_stamp = wall_clock_stamp() + first_sleep_sec;
+        return first_sleep_sec;
+    }
+#endif
+
+    stub_state.wakes_left = 0;
+    esp_set_deep_sleep_wake_stub(NULL);
+    return sleep_sec;
+}
+
+wake_stub_boot_reason_e wake_stub_boot_reason(void)
+{
+    return (wake_stub_boot_reason_e) stub_state.boot_reason;
+}
+
+size_t wake_stub_get_samples(uint16_t *samples, uint32_t *stamps, size_t max_samples)
+{
+    size_t count = 0;
+    for (uint16_t i = 0; i < stub_state.count && count < max_samples; i++)
+    {
+        samples[count] = stub_state.samples[(stub_state.head + i) % WAKE_STUB_MAX_SAMPLES];
+        stamps[count++] = stub_state.stamps[(stub_state.head + i) % WAKE_STUB_MAX_SAMPLES];
+    }
+
+    return count;
+}
+
+void wake_stub_clear_samples(void)
+{
+    stub_state.count = 0;
+    stub_state.head = 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * Deep sleep wake stub. Runs from RTC fast memory right after a timer wake, before
+ * the bootloader. It reads the soil moisture from the ADS111x over a bit-banged I2C
+ * bus, keeps the sample in RTC memory and goes back to deep sleep. The full
+ * application only boots when the upload interval is over or when the soil moisture
+ * moved by more than WAKE_STUB_SOIL_DELTA. Failed reads are counted and reported
+ * at the scheduled boot.
+ *
+ * Only ROM functions and code and data in RTC memory can be used in the stub.
+ */
+
+#ifndef WAKE_STUB_H_
+#define WAKE_STUB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 1 = sample the soil moisture from the wake stub between uploads, 0 = full boot on every wake
+#define WAKE_STUB_ENABLE            1
+
+#define WAKE_STUB_SAMPLE_SEC        15      // Soil moisture sampling interval, the upload interval is the sleep interval
+#define WAKE_STUB_MAX_SAMPLES       32      // Oldest sample is dropped first
+#define WAKE_STUB_SOIL_DELTA        1000    // Raw ADC change that starts a full boot (irrigation started or stopped)
+
+// Bit-banged I2C, same pins as ADC_SDA and ADC_SCL in sensor_interface_task.h
+#define WAKE_STUB_SDA_GPIO          27
+#define WAKE_STUB_SCL_GPIO          26
+#define WAKE_STUB_SDA_MUX_REG       IO_MUX_GPIO27_REG
+#define WAKE_STUB_SCL_MUX_REG       IO_MUX_GPIO26_REG
+#define WAKE_STUB_I2C_HALF_BIT_US   5       // ~100 kHz
+#define WAKE_STUB_ADS111X_ADDR      0x48    // ADDR pin to GND
+
+// ADS111x config for the stub: start single shot, AIN0 to GND, 4.096 V, 860 SPS, comparator off
+#define WAKE_STUB_ADS111X_CONFIG    0xC3E3
+#define WAKE_STUB_CONVERSION_US     1500
+
+// Why the last full boot happened
+typedef enum wake_stub_boot_reason
+{
+    WAKE_STUB_BOOT_OTHER = 0,       // Power-on, reset or stub not armed
+    WAKE_STUB_BOOT_SCHEDULED,       // Upload interval over
+    WAKE_STUB_BOOT_THRESHOLD,       // Soil moisture moved by more than WAKE_STUB_SOIL_DELTA
+    WAKE_STUB_BOOT_SENSOR_ERROR,    // Upload interval over, the ADS111x did not answer a stub read
+} wake_stub_boot_reason_e;
+
+/**
+ * @brief Install the wake stub for the coming deep sleep
+ * @param sleep_sec Time until the next full boot
+ * @return Timer wakeup of the first deep sleep in seconds
+ * @note Call right before esp_deep_sleep_start. Without enough time for a stub wake
+ *       the stub is removed and sleep_sec is returned.
+ */
+uint32_t wake_stub_arm(uint32_t sleep_sec);
+
+/**
+ * @brief Get the reason of this full boot
+ * @return Boot reason enum
+ */
+wake_stub_boot_reason_e wake_stub_boot_reason(void);
+
+/**
+ * @brief Get the soil moisture samples taken by the stub
+ * @param samples Output array of raw ADC values, oldest first
+ * @param stamps Output array, wall_clock_stamp of each sample
+ * @param max_samples Size of the output arrays
+ * @return Number of samples written
+ */
+size_t wake_stub_get_samples(uint16_t *samples, uint32_t *stamps, size_t max_samples);
+
+/**
+ * @brief Drop the stub samples after they were delivered
+ */
+void wake_stub_clear_samples(void);
+
+#endif /* WAKE_STUB_H_ */
@@ -0,0 +1,173 @@
+#include "wall_clock.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_netif_sntp.h"
+#endif
+
+#include "continuous_mode.h"
+#include "cycle_profiler.h"
+#include "device_role.h"
+
+static const char TAG[] = "wall_clock";
+
+// Always-on builds start SNTP once, lwIP polls the server every CONFIG_LWIP_SNTP_UPDATE_DELAY
+#define WALL_CLOCK_ALWAYS_ON    (OPERATING_MODE == OPERATING_MODE_CONTINUOUS || DEVICE_ROLE == DEVICE_ROLE_GATEWAY)
+
+// Kept across deep sleep, zeroed on power-on
+static RTC_DATA_ATTR int64_t step_total_us = 0;     // Sum of the SNTP steps, the system time minus this is monotonic
+static RTC_DATA_ATTR int64_t last_sync_us = 0;      // System time of the last sync, 0 = never
+static RTC_DATA_ATTR uint32_t wakes_since_sync = 0;
+static RTC_DATA_ATTR int32_t drift_ppm = 0;         // Measured drift, 0 = not measured yet
+
+// step_total_us is changed by the SNTP callback in the lwIP task
+static portMUX_TYPE clock_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if !CONFIG_IDF_TARGET_LINUX
+// System time and esp_timer time at the sync start or the last reply, the step is measured from there
+static int64_t reference_sys_us = 0;
+static int64_t reference_timer_us = 0;
+
+static bool sync_started = false;
+static volatile bool sync_done = false;
+#endif
+
+/**
+ * @brief Get the system time
+ * @note Helper function, the system time is stepped by SNTP
+ */
+static int64_t wall_clock_system_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Estimate the clock error since the last sync
+ * @note Helper function for wall_clock_sync_start
+ */
+static uint32_t wall_clock_error_ms(void)
+{
+    int64_t elapsed_ms = (wall_clock_system_us() - last_sync_us) / 1000;
+    int32_t ppm = (drift_ppm != 0) ? drift_ppm : WALL_CLOCK_DRIFT_PPM;
+    int64_t error_ms = llabs(elapsed_ms) * ppm / 1000000;
+
+    return (error_ms > UINT32_MAX) ? UINT32_MAX : (uint32_t) error_ms;
+}
+
+/**
+ * @brief SNTP callback, runs in the lwIP task after the system time was set
+ * @param tv New system time
+ */
+static void wall_clock_sync_cb(struct timeval *tv)
+{
+    int64_t synced_us = (int64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+    int64_t timer_us = esp_timer_get_time();
+    // Difference to where the clock would be without this sync
+    int64_t step_us = synced_us - (reference_sys_us + (timer_us - reference_timer_us));
+
+    if (last_sync_us != 0 && synced_us - last_sync_us >= (int64_t) WALL_CLOCK_MEASURE_SEC * 1000000)
+    {
+        int64_t ppm = llabs(step_us) * 1000000 / (synced_us - last_sync_us);
+        drift_ppm = (ppm < WALL_CLOCK_MIN_DRIFT_PPM) ? WALL_CLOCK_MIN_DRIFT_PPM : (ppm > INT32_MAX) ? INT32_MAX : (int32_t) ppm;
+    }
+
+    portENTER_CRITICAL(&clock_lock);
+    step_total_us += step_us;
+    portEXIT_CRITICAL(&clock_lock);
+
+    last_sync_us = synced_us;
+    wakes_since_sync = 0;
+    reference_sys_us = synced_us;
+    reference_timer_us = timer_us;
+    sync_done = true;
+
+    ESP_LOGI(TAG, "Clock synced, step %" PRId64 " ms, drift %" PRId32 " ppm", step_us / 1000, drift_ppm);
+}
+#endif
+
+void wall_clock_init(void)
+{
+    if (wakes_since_sync < UINT32_MAX)
+        wakes_since_sync++;
+}
+
+uint32_t wall_clock_stamp(void)
+{
+    // gettimeofday takes a lock, only the step is read in the critical section
+    portENTER_CRITICAL(&clock_lock);
+    int64_t step_us = step_total_us;
+    portEXIT_CRITICAL(&clock_lock);
+
+    return (uint32_t) ((wall_clock_system_us() - step_us) / 1000000);
+}
+
+bool wall_clock_to_unix(uint32_t stamp, uint32_t *unix_sec)
+{
+    int64_t now_sec = wall_clock_system_us() / 1000000;
+    if (now_sec < WALL_CLOCK_MIN_UNIX)
+        return false;
+
+    *unix_sec = (uint32_t) (now_sec - wall_clock_age(stamp));
+    return true;
+}
+
+uint32_t wall_clock_age(uint32_t stamp)
+{
+    uint32_t now = wall_clock_stamp();
+    return (now > stamp) ? now - stamp : 0;
+}
+
+void wall_clock_sync_start(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    if (sync_started)
+        return;
+
+#if !WALL_CLOCK_ALWAYS_ON
+    bool clock_set = (last_sync_us != 0) && (wall_clock_system_us() >= (int64_t) WALL_CLOCK_MIN_UNIX * 1000000);
+    if (clock_set && wakes_since_sync < WALL_CLOCK_SYNC_WAKES && wall_clock_error_ms() <= WALL_CLOCK_MAX_ERROR_MS)
+        return;
+#endif
+
+    reference_sys_us = wall_clock_system_us();
+    reference_timer_us = esp_timer_get_time();
+
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(WALL_CLOCK_SNTP_SERVER);
+    config.sync_cb = &wall_clock_sync_cb;
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "SNTP start failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    sync_started = true;
+    cycle_profiler_set_flags(CYCLE_FLAG_CLOCK_SYNC);
+    ESP_LOGI(TAG, "SNTP sync, %" PRIu32 " wakes since the last one", wakes_since_sync);
+#endif
+}
+
+void wall_clock_sync_finish(uint32_t timeout_ms)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    if (!sync_started || sync_done)
+        return;
+
+    if (esp_netif_sntp_sync_wait(pdMS_TO_TICKS(timeout_ms)) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No SNTP reply, trying again next wake");
+    }
+#else
+    (void) timeout_ms;
+#endif
+}
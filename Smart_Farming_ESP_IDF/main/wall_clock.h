@@ -0,0 +1,72 @@
+/**
+ * Wall-clock time for the sensor readings. The system time keeps counting in deep
+ * sleep (RTC timer), so it only has to be set by SNTP once after power-on and
+ * corrected now and then. A wake that joined the network starts SNTP only when the
+ * clock was never set, when WALL_CLOCK_SYNC_WAKES wakes passed since the last sync,
+ * or when the drift since the last sync may exceed WALL_CLOCK_MAX_ERROR_MS. The other
+ * wakes do not send a single SNTP packet.
+ *
+ * Readings are stamped with a monotonic clock (the system time minus the steps made
+ * by SNTP), so a reading kept in RTC memory over several wakes keeps its age when the
+ * clock is corrected in between. The stamp becomes a Unix time when the payload is built.
+ */
+
+#ifndef WALL_CLOCK_H_
+#define WALL_CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WALL_CLOCK_SNTP_SERVER      "pool.ntp.org"
+#define WALL_CLOCK_SYNC_WAKES       720     // Sync at least every N wakes (12 hours at the default 60 s sleep)
+#define WALL_CLOCK_MAX_ERROR_MS     2000    // Sync when the estimated drift since the last sync exceeds this
+#define WALL_CLOCK_DRIFT_PPM        500     // Assumed RTC drift until two syncs measured it (internal 150 kHz RC)
+#define WALL_CLOCK_MIN_DRIFT_PPM    20      // Lower bound of the measured drift
+#define WALL_CLOCK_MEASURE_SEC      600     // Shortest time between two syncs that measures the drift
+#define WALL_CLOCK_SYNC_WAIT_MS     1000    // Longest wait for the SNTP reply before deep sleep, only on sync wakes
+#define WALL_CLOCK_MIN_UNIX         1704067200  // 2024-01-01, an earlier system time was never set
+
+/**
+ * @brief Count the wake for the sync interval
+ * @note Call once per boot from app_main
+ */
+void wall_clock_init(void);
+
+/**
+ * @brief Get the monotonic time stamp of a reading
+ * @return Seconds, counts through deep sleep and is not changed by SNTP
+ * @note Restarts at 0 on power-on, like the RTC memory the readings are kept in
+ */
+uint32_t wall_clock_stamp(void);
+
+/**
+ * @brief Convert a time stamp to Unix time
+ * @param stamp Time stamp from wall_clock_stamp
+ * @param unix_sec Output, Unix time in seconds
+ * @return true if the clock is set, false if SNTP never answered since power-on
+ */
+bool wall_clock_to_unix(uint32_t stamp, uint32_t *unix_sec);
+
+/**
+ * @brief Get the age of a time stamp
+ * @param stamp Time stamp from wall_clock_stamp
+ * @return Seconds since the stamp
+ */
+uint32_t wall_clock_age(uint32_t stamp);
+
+/**
+ * @brief Start SNTP if a sync is due
+ * @note Called from the got IP event. The always-on builds (continuous mode, ESP-NOW gateway)
+ *       start SNTP at once and let it poll in the background.
+ */
+void wall_clock_sync_start(void);
+
+/**
+ * @brief Wait for the SNTP reply of this wake before the radio is turned off
+ * @param timeout_ms Longest wait in milliseconds
+ * @note Returns at once when no sync was started or it is already done. A sync that
+ *       times out is tried again next wake.
+ */
+void wall_clock_sync_finish(uint32_t timeout_ms);
+
+#endif /* WALL_CLOCK_H_ */
@@ -0,0 +1,241 @@
+#include "wifi_ap_store.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char TAG[] = "wifi_ap_store";
+
+#define WIFI_AP_STORE_VERSION   1
+#define WIFI_AP_STORE_NO_SLOT   0xFF
+
+// Stored as one NVS blob
+typedef struct wifi_ap_list
+{
+    uint8_t version;
+    uint8_t count;
+    uint8_t last_ok;            // Slot of the last successful join, WIFI_AP_STORE_NO_SLOT if none
+    wifi_ap_entry_t entries[WIFI_AP_STORE_MAX];
+} wifi_ap_list_t;
+
+static wifi_ap_list_t ap_list;
+static bool ap_list_dirty = false;
+
+/**
+ * @brief Compute the ranking score of an AP
+ * @param slot Slot number
+ * @return Score in dB, higher is better
+ * @note Helper function for the ranking
+ */
+static int wifi_ap_store_score(uint8_t slot)
+{
+    const wifi_ap_entry_t *entry = &ap_list.entries[slot];
+    int score = (entry->rssi != 0) ? entry->rssi : WIFI_AP_STORE_UNKNOWN_RSSI;
+
+    score -= WIFI_AP_STORE_FAIL_PENALTY_DB * entry->failures;
+    if (slot == ap_list.last_ok)
+        score += WIFI_AP_STORE_LAST_OK_BONUS_DB;
+
+    return score;
+}
+
+/**
+ * @brief Find an AP by SSID
+ * @param ssid SSID
+ * @return Slot number, WIFI_AP_STORE_NO_SLOT if not stored
+ * @note Helper function
+ */
+static uint8_t wifi_ap_store_find(const char *ssid)
+{
+    for (uint8_t i = 0; i < ap_list.count; i++)
+    {
+        if (strcmp(ap_list.entries[i].ssid, ssid) == 0)
+            return i;
+    }
+
+    return WIFI_AP_STORE_NO_SLOT;
+}
+
+/**
+ * @brief Add or update an AP in RAM
+ * @param ssid SSID
+ * @param password Password
+ * @return ESP_OK or ESP_ERR_INVALID_ARG
+ * @note Helper function for wifi_ap_store_load and wifi_ap_store_add
+ */
+static esp_err_t wifi_ap_store_put(const char *ssid, const char *password)
+{
+    if (ssid == NULL || password == NULL || ssid[0] == '\0' ||
+        strlen(ssid) >= sizeof(ap_list.entries[0].ssid) || strlen(password) >= sizeof(ap_list.entries[0].password))
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t slot = wifi_ap_store_find(ssid);
+    if (slot == WIFI_AP_STORE_NO_SLOT)
+    {
+        if (ap_list.count < WIFI_AP_STORE_MAX)
+        {
+            slot = ap_list.count++;
+        }
+        else
+        {
+            // Replace the lowest ranked AP, never the one that works
+            uint8_t order[WIFI_AP_STORE_MAX];
+            uint8_t count = wifi_ap_store_rank(order, WIFI_AP_STORE_MAX);
+            slot = order[count - 1];
+            if (slot == ap_list.last_ok && count > 1)
+                slot = order[count - 2];
+            if (slot == ap_list.last_ok)
+                ap_list.last_ok = WIFI_AP_STORE_NO_SLOT;
+            ESP_LOGW(TAG, "List full, replacing %s", ap_list.entries[slot].ssid);
+        }
+
+        memset(&ap_list.entries[slot], 0, sizeof(ap_list.entries[slot]));
+        strcpy(ap_list.entries[slot].ssid, ssid);
+        ap_list_dirty = true;
+    }
+
+    if (strcmp(ap_list.entries[slot].password, password) != 0)
+    {
+        strcpy(ap_list.entries[slot].password, password);
+        ap_list.entries[slot].failures = 0;
+        ap_list_dirty = true;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t wifi_ap_store_load(void)
+{
+    memset(&ap_list, 0, sizeof(ap_list));
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(WIFI_AP_STORE_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_OK)
+    {
+        size_t len = sizeof(ap_list);
+        err = nvs_get_blob(handle, WIFI_AP_STORE_KEY, &ap_list, &len);
+        nvs_close(handle);
+
+        if (err == ESP_OK && (len != sizeof(ap_list) || ap_list.version != WIFI_AP_STORE_VERSION || ap_list.count > WIFI_AP_STORE_MAX))
+        {
+            ESP_LOGW(TAG, "Stored list not valid, reseeding");
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    // Namespace or key not written yet on first boot
+    if (err != ESP_OK)
+    {
+        memset(&ap_list, 0, sizeof(ap_list));
+        ap_list.last_ok = WIFI_AP_STORE_NO_SLOT;
+        ap_list_dirty = true;
+    }
+    ap_list.version = WIFI_AP_STORE_VERSION;
+
+    static const struct { const char *ssid; const char *password; } seed[] = WIFI_AP_STORE_SEED;
+    for (size_t i = 0; i < sizeof(seed) / sizeof(seed[0]); i++)
+    {
+        if (wifi_ap_store_find(seed[i].ssid) == WIFI_AP_STORE_NO_SLOT && wifi_ap_store_put(seed[i].ssid, seed[i].password) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Seed AP %u not valid", (unsigned) i);
+        }
+    }
+
+    ESP_LOGI(TAG, "%u APs stored", ap_list.count);
+    return (err == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : err;
+}
+
+uint8_t wifi_ap_store_rank(uint8_t *order, uint8_t max)
+{
+    uint8_t count = 0;
+
+    // Insertion sort, stable so equal scores keep the slot order
+    for (uint8_t slot = 0; slot < ap_list.count && count < max; slot++)
+    {
+        int score = wifi_ap_store_score(slot);
+        uint8_t i = count++;
+        while (i > 0 && wifi_ap_store_score(order[i - 1]) < score)
+        {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = slot;
+    }
+
+    return count;
+}
+
+const wifi_ap_entry_t *wifi_ap_store_get(uint8_t slot)
+{
+    return (slot < ap_list.count) ? &ap_list.entries[slot] : NULL;
+}
+
+void wifi_ap_store_connected(uint8_t slot, int8_t rssi)
+{
+    if (slot >= ap_list.count)
+        return;
+
+    wifi_ap_entry_t *entry = &ap_list.entries[slot];
+    int delta = rssi - entry->rssi;
+    if (entry->rssi == 0 || delta >= WIFI_AP_STORE_RSSI_STEP_DB || delta <= -WIFI_AP_STORE_RSSI_STEP_DB)
+    {
+        entry->rssi = rssi;
+        ap_list_dirty = true;
+    }
+
+    if (entry->failures != 0 || ap_list.last_ok != slot)
+    {
+        entry->failures = 0;
+        ap_list.last_ok = slot;
+        ap_list_dirty = true;
+    }
+}
+
+void wifi_ap_store_failed(uint8_t slot)
+{
+    if (slot >= ap_list.count || ap_list.entries[slot].failures == UINT8_MAX)
+        return;
+
+    ap_list.entries[slot].failures++;
+    ap_list_dirty = true;
+}
+
+esp_err_t wifi_ap_store_add(const char *ssid, const char *password)
+{
+    esp_err_t err = wifi_ap_store_put(ssid, password);
+    if (err != ESP_OK)
+        return err;
+
+    return wifi_ap_store_commit();
+}
+
+esp_err_t wifi_ap_store_commit(void)
+{
+    if (!ap_list_dirty)
+        return ESP_OK;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(WIFI_AP_STORE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        return err;
+    }
+
+    err = nvs_set_blob(handle, WIFI_AP_STORE_KEY, &ap_list, sizeof(ap_list));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error: %s (0x%x)", esp_err_to_name(err), err);
+        return err;
+    }
+
+    ap_list_dirty = false;
+    return ESP_OK;
+}
@@ -0,0 +1,92 @@
+/**
+ * Wi-Fi credential store. Keeps a list of APs in NVS with the signal and failure
+ * history of each one, and ranks them so the node joins the AP most likely to work
+ * first and falls back in ranked order, without scanning for every SSID.
+ *
+ * The list is seeded from WIFI_AP_STORE_SEED on first boot. Seed entries missing from
+ * the stored list are added on every boot, so new APs can be shipped with a firmware update.
+ */
+
+#ifndef WIFI_AP_STORE_H_
+#define WIFI_AP_STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "network_connection.h"
+
+#define WIFI_AP_STORE_MAX               4
+#define WIFI_AP_STORE_NAMESPACE         "wifi_aps"
+#define WIFI_AP_STORE_KEY               "list"
+
+// Seed list, { SSID, password } per AP
+#define WIFI_AP_STORE_SEED              { { WIFI_SSID, WIFI_PASSWORD }, }
+
+// Ranking: score = RSSI - penalty per failed join + bonus for the AP that worked last
+#define WIFI_AP_STORE_UNKNOWN_RSSI      -90     // Never joined
+#define WIFI_AP_STORE_FAIL_PENALTY_DB   10
+#define WIFI_AP_STORE_LAST_OK_BONUS_DB  10
+#define WIFI_AP_STORE_RSSI_STEP_DB      6       // Store a new RSSI only if it moved this much, saves flash writes
+
+typedef struct wifi_ap_entry
+{
+    char ssid[33];
+    char password[65];
+    int8_t rssi;                // RSSI of the last join, 0 if never joined
+    uint8_t failures;           // Failed joins since the last successful one
+} wifi_ap_entry_t;
+
+/**
+ * @brief Load the list from NVS, seed it if empty
+ * @return ESP_OK or error code, the seed list is used on error
+ * @note Call after nvs_flash_init
+ */
+esp_err_t wifi_ap_store_load(void);
+
+/**
+ * @brief Rank the stored APs, best first
+ * @param order Output array of slot numbers
+ * @param max Size of the output array
+ * @return Number of slots written
+ */
+uint8_t wifi_ap_store_rank(uint8_t *order, uint8_t max);
+
+/**
+ * @brief Get a stored AP
+ * @param slot Slot number
+ * @return Address of the entry, NULL if the slot is empty
+ */
+const wifi_ap_entry_t *wifi_ap_store_get(uint8_t slot);
+
+/**
+ * @brief Record a successful join
+ * @param slot Slot number
+ * @param rssi RSSI of the AP in dBm
+ */
+void wifi_ap_store_connected(uint8_t slot, int8_t rssi);
+
+/**
+ * @brief Record a failed join
+ * @param slot Slot number
+ */
+void wifi_ap_store_failed(uint8_t slot);
+
+/**
+ * @brief Add an AP or update its password, then save the list
+ * @param ssid SSID
+ * @param password Password
+ * @return ESP_OK or error code, ESP_ERR_INVALID_ARG if a string is too long
+ * @note When the list is full, the lowest ranked AP other than the last working one is replaced
+ */
+esp_err_t wifi_ap_store_add(const char *ssid, const char *password);
+
+/**
+ * @brief Save the list to NVS if it changed
+ * @return ESP_OK or error code
+ * @note Off the critical path, call once the connection is up or failed
+ */
+esp_err_t wifi_ap_store_commit(void);
+
+#endif /* WIFI_AP_STORE_H_ */
@@ -0,0 +1,10 @@
+/**
+ * Host test stub of the ESP-IDF section attributes. RTC memory is plain memory here.
+ */
+
+#ifndef FAKE_ESP_ATTR_H_
+#define FAKE_ESP_ATTR_H_
+
+#define RTC_DATA_ATTR
+
+#endif /* FAKE_ESP_ATTR_H_ */
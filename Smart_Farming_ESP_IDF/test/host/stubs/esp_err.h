@@ -0,0 +1,19 @@
+/**
+ * Host test stub of the ESP-IDF error codes, the subset used by the tested modules.
+ */
+
+#ifndef FAKE_ESP_ERR_H_
+#define FAKE_ESP_ERR_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK      0
+#define ESP_FAIL    -1
+#define ESP_ERR_TIMEOUT 0x107
+
+#define ESP_ERROR_CHECK(x) do { if ((x) != ESP_OK) abort(); } while (0)
+
+#endif /* FAKE_ESP_ERR_H_ */
@@ -0,0 +1,10 @@
+/**
+ * Host test stub of the ESP-IDF event loop API, included by network_connection.h.
+ */
+
+#ifndef FAKE_ESP_EVENT_H_
+#define FAKE_ESP_EVENT_H_
+
+#include "esp_err.h"
+
+#endif /* FAKE_ESP_EVENT_H_ */
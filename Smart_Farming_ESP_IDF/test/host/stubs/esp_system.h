@@ -0,0 +1,10 @@
+/**
+ * Host test stub of the ESP-IDF system API, included by error_handler.h.
+ */
+
+#ifndef FAKE_ESP_SYSTEM_H_
+#define FAKE_ESP_SYSTEM_H_
+
+#include "esp_err.h"
+
+#endif /* FAKE_ESP_SYSTEM_H_ */
@@ -0,0 +1,28 @@
+/**
+ * Host test stub of the ESP-IDF high resolution timer API. The test defines the
+ * functions, so it controls the time and fires the callbacks itself.
+ */
+
+#ifndef FAKE_ESP_TIMER_H_
+#define FAKE_ESP_TIMER_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif /* FAKE_ESP_TIMER_H_ */
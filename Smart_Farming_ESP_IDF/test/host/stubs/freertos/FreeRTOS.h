@@ -0,0 +1,31 @@
+/**
+ * Host test stub of the FreeRTOS base types. The tests run on one thread, so the
+ * critical sections do nothing.
+ */
+
+#ifndef FAKE_FREERTOS_FREERTOS_H_
+#define FAKE_FREERTOS_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          1
+#define portMAX_DELAY   UINT32_MAX
+
+// One tick per millisecond
+#define configTICK_RATE_HZ  1000
+#define pdMS_TO_TICKS(ms)   ((TickType_t) (ms))
+
+// The tests run on one thread
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define portENTER_CRITICAL(mux)         (void) (mux)
+#define portEXIT_CRITICAL(mux)          (void) (mux)
+
+#endif /* FAKE_FREERTOS_FREERTOS_H_ */
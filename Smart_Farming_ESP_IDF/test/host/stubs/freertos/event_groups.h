@@ -0,0 +1,13 @@
+/**
+ * Host test stub of the FreeRTOS event group types, included by static_alloc.h.
+ */
+
+#ifndef FAKE_FREERTOS_EVENT_GROUPS_H_
+#define FAKE_FREERTOS_EVENT_GROUPS_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+typedef struct { int unused; } StaticEventGroup_t;
+
+#endif /* FAKE_FREERTOS_EVENT_GROUPS_H_ */
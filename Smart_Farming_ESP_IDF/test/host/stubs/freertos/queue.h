@@ -0,0 +1,13 @@
+/**
+ * Host test stub of the FreeRTOS queue types, included by static_alloc.h.
+ */
+
+#ifndef FAKE_FREERTOS_QUEUE_H_
+#define FAKE_FREERTOS_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct QueueDefinition *QueueHandle_t;
+typedef struct { int unused; } StaticQueue_t;
+
+#endif /* FAKE_FREERTOS_QUEUE_H_ */
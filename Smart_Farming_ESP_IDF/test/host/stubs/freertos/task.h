@@ -0,0 +1,25 @@
+/**
+ * Host test stub of the FreeRTOS task API. The test defines the functions, so it
+ * runs the tasks and moves the time itself.
+ */
+
+#ifndef FAKE_FREERTOS_TASK_H_
+#define FAKE_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef struct { int unused; } StaticTask_t;
+
+#define tskNO_AFFINITY  0x7FFFFFFF
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_size, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+
+#endif /* FAKE_FREERTOS_TASK_H_ */
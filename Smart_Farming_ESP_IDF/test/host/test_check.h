@@ -0,0 +1,55 @@
+/**
+ * Minimal checks for the host unit tests. A failed check prints its location and
+ * the test goes on, the test program fails if any check failed.
+ */
+
+#ifndef TEST_CHECK_H_
+#define TEST_CHECK_H_
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+// Compares as long long, prints both values
+#define TEST_CHECK_EQ(actual, expected) \
+    do { \
+        long long test_actual_ = (long long) (actual); \
+        long long test_expected_ = (long long) (expected); \
+        if (test_actual_ != test_expected_) \
+        { \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, test_actual_, test_expected_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+// Compares as double, within tolerance
+#define TEST_CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double test_actual_ = (double) (actual); \
+        double test_expected_ = (double) (expected); \
+        if (test_actual_ < test_expected_ - (tolerance) || test_actual_ > test_expected_ + (tolerance)) \
+        { \
+            printf("%s:%d: %s is %g, expected %g\n", __FILE__, __LINE__, #actual, test_actual_, test_expected_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test) \
+    do { \
+        int test_before_ = test_failures; \
+        test(); \
+        printf("%s %s\n", (test_failures == test_before_) ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif /* TEST_CHECK_H_ */
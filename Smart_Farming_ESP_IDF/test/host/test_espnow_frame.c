@@ -0,0 +1,214 @@
+#include <math.h>
+#include <string.h>
+
+#include "espnow_frame.h"
+#include "test_check.h"
+
+static const uint8_t node_a[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+static const uint8_t node_b[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x02 };
+
+/**
+ * @brief Encode and decode a frame of one reading
+ * @return true if the frame decoded
+ */
+static bool make_frame(const uint8_t *mac, uint32_t session, uint32_t sequence, espnow_frame_t *frame)
+{
+    uint8_t buffer[ESPNOW_FRAME_MAX_LEN];
+    espnow_reading_t reading = espnow_reading_from_float(21.5f, 40.0f, 12000.0f, 0);
+    size_t len = espnow_frame_encode(session, sequence, &reading, 1, buffer);
+    return espnow_frame_decode(mac, buffer, len, frame);
+}
+
+static void test_encode_decode(void)
+{
+    espnow_reading_t readings[ESPNOW_FRAME_MAX_READINGS];
+    for (int i = 0; i < ESPNOW_FRAME_MAX_READINGS; i++)
+    {
+        readings[i] = espnow_reading_from_float(-5.25f + i, 55.5f, 1000.0f * i, 60u * i);
+    }
+
+    uint8_t buffer[ESPNOW_FRAME_MAX_LEN];
+    size_t len = espnow_frame_encode(0xA1B2C3D4, 42, readings, ESPNOW_FRAME_MAX_READINGS, buffer);
+    TEST_CHECK_EQ(len, ESPNOW_FRAME_MAX_LEN);
+    TEST_CHECK(buffer[0] == 'S' && buffer[1] == 'N');
+    TEST_CHECK_EQ(buffer[2], ESPNOW_FRAME_VERSION);
+
+    espnow_frame_t frame;
+    TEST_CHECK(espnow_frame_decode(node_a, buffer, len, &frame));
+    TEST_CHECK(memcmp(frame.mac, node_a, sizeof(node_a)) == 0);
+    TEST_CHECK_EQ(frame.session, 0xA1B2C3D4);
+    TEST_CHECK_EQ(frame.sequence, 42);
+    TEST_CHECK_EQ(frame.count, ESPNOW_FRAME_MAX_READINGS);
+    TEST_CHECK_EQ(frame.received_sec, 0);
+    for (int i = 0; i < ESPNOW_FRAME_MAX_READINGS; i++)
+    {
+        TEST_CHECK_EQ(frame.readings[i].temperature_dc, readings[i].temperature_dc);
+        TEST_CHECK_EQ(frame.readings[i].humidity_dpct, 555);
+        TEST_CHECK_EQ(frame.readings[i].soil_raw, 1000 * i);
+        TEST_CHECK_EQ(frame.readings[i].age_sec, 60 * i);
+    }
+    // Rounded away from zero
+    TEST_CHECK_EQ(frame.readings[0].temperature_dc, -53);
+
+    // One to ESPNOW_FRAME_MAX_READINGS readings
+    TEST_CHECK_EQ(espnow_frame_encode(1, 1, readings, 0, buffer), 0);
+    TEST_CHECK_EQ(espnow_frame_encode(1, 1, readings, ESPNOW_FRAME_MAX_READINGS + 1, buffer), 0);
+}
+
+static void test_reading_from_float(void)
+{
+    espnow_reading_t reading = espnow_reading_from_float(NAN, NAN, NAN, 5);
+    TEST_CHECK_EQ(reading.temperature_dc, ESPNOW_READING_NO_TEMPERATURE);
+    TEST_CHECK_EQ(reading.humidity_dpct, ESPNOW_READING_NO_VALUE);
+    TEST_CHECK_EQ(reading.soil_raw, ESPNOW_READING_NO_VALUE);
+    TEST_CHECK_EQ(reading.age_sec, 5);
+
+    // Out of range values are clamped and never read as the sentinel
+    reading = espnow_reading_from_float(0.0f, -1.0f, 70000.0f, 0);
+    TEST_CHECK_EQ(reading.humidity_dpct, 0);
+    TEST_CHECK_EQ(reading.soil_raw, ESPNOW_READING_NO_VALUE - 1);
+    reading = espnow_reading_from_float(0.0f, 0.0f, -3.0f, 0);
+    TEST_CHECK_EQ(reading.soil_raw, 0);
+}
+
+static void test_decode_rejects(void)
+{
+    espnow_reading_t readings[2] = {
+        espnow_reading_from_float(20.0f, 50.0f, 100.0f, 0),
+        espnow_reading_from_float(21.0f, 51.0f, 200.0f, 600),
+    };
+    uint8_t buffer[ESPNOW_FRAME_MAX_LEN];
+    size_t len = espnow_frame_encode(7, 8, readings, 2, buffer);
+    espnow_frame_t frame;
+    TEST_CHECK(espnow_frame_decode(node_a, buffer, len, &frame));
+
+    // Every single bit error is caught by the CRC
+    for (size_t i = 0; i < len * 8; i++)
+    {
+        buffer[i / 8] ^= (uint8_t) (1u << (i % 8));
+        TEST_CHECK(!espnow_frame_decode(node_a, buffer, len, &frame));
+        buffer[i / 8] ^= (uint8_t) (1u << (i % 8));
+    }
+
+    // Truncated, padded and too short
+    TEST_CHECK(!espnow_frame_decode(node_a, buffer, len - 1, &frame));
+    TEST_CHECK(!espnow_frame_decode(node_a, buffer, len + 1, &frame));
+    TEST_CHECK(!espnow_frame_decode(node_a, buffer, ESPNOW_FRAME_HEADER_LEN, &frame));
+
+    // Older frame version
+    buffer[2] = ESPNOW_FRAME_VERSION - 1;
+    TEST_CHECK(!espnow_frame_decode(node_a, buffer, len, &frame));
+}
+
+static void test_dedup(void)
+{
+    static espnow_dedup_t dedup;
+    memset(&dedup, 0, sizeof(dedup));
+    espnow_frame_t frame;
+
+    TEST_CHECK(make_frame(node_a, 100, 1, &frame));
+    TEST_CHECK(espnow_dedup_accept(&dedup, &frame, 0));
+    // Retry of a frame whose ack was lost
+    TEST_CHECK(!espnow_dedup_accept(&dedup, &frame, 10));
+
+    TEST_CHECK(make_frame(node_a, 100, 2, &frame));
+    TEST_CHECK(espnow_dedup_accept(&dedup, &frame, 20));
+    // Late copy of an older frame
+    TEST_CHECK(make_frame(node_a, 100, 1, &frame));
+    TEST_CHECK(!espnow_dedup_accept(&dedup, &frame, 30));
+
+    // Same sequence from another node
+    TEST_CHECK(make_frame(node_b, 100, 2, &frame));
+    TEST_CHECK(espnow_dedup_accept(&dedup, &frame, 40));
+
+    // Power cycled node starts a new session at sequence 1
+    TEST_CHECK(make_frame(node_a, 200, 1, &frame));
+    TEST_CHECK(espnow_dedup_accept(&dedup, &frame, 50));
+}
+
+static void test_dedup_full(void)
+{
+    static espnow_dedup_t dedup;
+    memset(&dedup, 0, sizeof(dedup));
+    espnow_frame_t frame;
+
+    // Fill the table, node i last heard at time i
+    for (uint32_t i = 0; i < ESPNOW_DEDUP_MAX_NODES; i++)
+    {
+        uint8_t mac[6] = { 0x24, 0x0A, 0xC4, 0x01, 0x00, (uint8_t) i };
+        TEST_CHECK(make_frame(mac, 1, 1, &frame));
+        TEST_CHECK(espnow_dedup_accept(&dedup, &frame, i));
+    }
+
+    // A new node replaces node 0, heard from least recently
+    TEST_CHECK(make_frame(node_a, 1, 1, &frame));
+    TEST_CHECK(espnow_dedup_accept(&dedup, &frame, 1000));
+    uint8_t mac0[6] = { 0x24, 0x0A, 0xC4, 0x01, 0x00, 0 };
+    TEST_CHECK(make_frame(mac0, 1, 1, &frame));
+    TEST_CHECK(espnow_dedup_accept(&dedup, &frame, 1001));
+
+    // Node 2 was kept
+    uint8_t mac2[6] = { 0x24, 0x0A, 0xC4, 0x01, 0x00, 2 };
+    TEST_CHECK(make_frame(mac2, 1, 1, &frame));
+    TEST_CHECK(!espnow_dedup_accept(&dedup, &frame, 1002));
+}
+
+static void test_batch_flush(void)
+{
+    static espnow_batch_t batch;
+    espnow_batch_clear(&batch);
+    espnow_frame_t frame;
+    TEST_CHECK(make_frame(node_a, 1, 1, &frame));
+
+    TEST_CHECK(!espnow_batch_ready(&batch, 0));
+    TEST_CHECK_EQ(espnow_batch_wait_ms(&batch, 0), UINT32_MAX);
+
+    // Published ESPNOW_BATCH_MAX_AGE_MS after the first frame, whatever arrives later
+    TEST_CHECK(espnow_batch_add(&batch, &frame, 1000));
+    TEST_CHECK(espnow_batch_add(&batch, &frame, 3000));
+    TEST_CHECK_EQ(espnow_batch_wait_ms(&batch, 3000), ESPNOW_BATCH_MAX_AGE_MS - 2000);
+    TEST_CHECK(!espnow_batch_ready(&batch, 1000 + ESPNOW_BATCH_MAX_AGE_MS - 1));
+    TEST_CHECK(espnow_batch_ready(&batch, 1000 + ESPNOW_BATCH_MAX_AGE_MS));
+    TEST_CHECK_EQ(espnow_batch_wait_ms(&batch, 1000 + ESPNOW_BATCH_MAX_AGE_MS + 50), 0);
+
+    espnow_batch_clear(&batch);
+    TEST_CHECK_EQ(batch.count, 0);
+    TEST_CHECK(!espnow_batch_ready(&batch, 100000));
+
+    // Published when full, and refuses more frames until then
+    for (int i = 0; i < ESPNOW_BATCH_MAX_FRAMES; i++)
+    {
+        TEST_CHECK(!espnow_batch_ready(&batch, 100000));
+        TEST_CHECK(espnow_batch_add(&batch, &frame, 100000));
+    }
+    TEST_CHECK(espnow_batch_ready(&batch, 100000));
+    TEST_CHECK(!espnow_batch_add(&batch, &frame, 100000));
+    TEST_CHECK_EQ(batch.count, ESPNOW_BATCH_MAX_FRAMES);
+}
+
+static void test_batch_time_wraps(void)
+{
+    static espnow_batch_t batch;
+    espnow_batch_clear(&batch);
+    espnow_frame_t frame;
+    TEST_CHECK(make_frame(node_a, 1, 1, &frame));
+
+    // The millisecond counter wraps after 49 days
+    TEST_CHECK(espnow_batch_add(&batch, &frame, UINT32_MAX - 1000));
+    TEST_CHECK(!espnow_batch_ready(&batch, 1000));
+    TEST_CHECK_EQ(espnow_batch_wait_ms(&batch, 1000), ESPNOW_BATCH_MAX_AGE_MS - 2001);
+    TEST_CHECK(espnow_batch_ready(&batch, ESPNOW_BATCH_MAX_AGE_MS));
+}
+
+int main(void)
+{
+    TEST_RUN(test_encode_decode);
+    TEST_RUN(test_reading_from_float);
+    TEST_RUN(test_decode_rejects);
+    TEST_RUN(test_dedup);
+    TEST_RUN(test_dedup_full);
+    TEST_RUN(test_batch_flush);
+    TEST_RUN(test_batch_time_wraps);
+
+    return TEST_RESULT();
+}
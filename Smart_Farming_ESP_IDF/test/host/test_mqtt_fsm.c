@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "mqtt_fsm.h"
+#include "test_check.h"
+
+/**
+ * @brief Run a sequence of events from a state
+ * @return State after the last event
+ */
+static mqtt_fsm_state_e run_events(mqtt_fsm_state_e state, const uint32_t *events, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        state = mqtt_fsm_next(state, events[i]);
+    }
+    return state;
+}
+
+static void test_qos1_cycle(void)
+{
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_CONNECTING, MQTT_FSM_EVT_CONNECTED), MQTT_FSM_CONNECTED);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_CONNECTED, MQTT_FSM_EVT_PUBLISH_QUEUED), MQTT_FSM_PUBLISHING);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_PUBLISHING, MQTT_FSM_EVT_PUBLISHED), MQTT_FSM_FLUSHED);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_FLUSHED, MQTT_FSM_EVT_DATA), MQTT_FSM_SLEEP);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_SLEEP, MQTT_FSM_EVT_RESUME), MQTT_FSM_CONNECTING);
+}
+
+static void test_qos0_skips_publishing(void)
+{
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_CONNECTED, MQTT_FSM_EVT_PUBLISHED), MQTT_FSM_FLUSHED);
+}
+
+static void test_disconnect(void)
+{
+    // Not connected yet, the client reconnects on its own
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_CONNECTING, MQTT_FSM_EVT_DISCONNECTED), MQTT_FSM_CONNECTING);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_CONNECTED, MQTT_FSM_EVT_DISCONNECTED), MQTT_FSM_CONNECTING);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_PUBLISHING, MQTT_FSM_EVT_DISCONNECTED), MQTT_FSM_CONNECTING);
+    // Data already delivered
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_FLUSHED, MQTT_FSM_EVT_DISCONNECTED), MQTT_FSM_SLEEP);
+
+    // QoS 1 data is sent again after the reconnect
+    const uint32_t events[] = {
+        MQTT_FSM_EVT_CONNECTED, MQTT_FSM_EVT_PUBLISH_QUEUED, MQTT_FSM_EVT_DISCONNECTED,
+        MQTT_FSM_EVT_CONNECTED, MQTT_FSM_EVT_PUBLISH_QUEUED, MQTT_FSM_EVT_PUBLISHED, MQTT_FSM_EVT_TIMEOUT,
+    };
+    TEST_CHECK_EQ(run_events(MQTT_FSM_CONNECTING, events, sizeof(events) / sizeof(events[0])), MQTT_FSM_SLEEP);
+}
+
+static void test_errors_ignored(void)
+{
+    // Errors only end the wait through the state timeout
+    for (int state = 0; state < MQTT_FSM_STATE_MAX; state++)
+    {
+        TEST_CHECK_EQ(mqtt_fsm_next((mqtt_fsm_state_e) state, MQTT_FSM_EVT_ERROR), state);
+    }
+}
+
+static void test_timeouts(void)
+{
+    TEST_CHECK_EQ(mqtt_fsm_timeout_ms(MQTT_FSM_CONNECTING), MQTT_FSM_CONNECT_TIMEOUT_MS);
+    TEST_CHECK_EQ(mqtt_fsm_timeout_ms(MQTT_FSM_CONNECTED), MQTT_FSM_CONNECTED_TIMEOUT_MS);
+    TEST_CHECK_EQ(mqtt_fsm_timeout_ms(MQTT_FSM_PUBLISHING), MQTT_FSM_PUBLISH_TIMEOUT_MS);
+    TEST_CHECK_EQ(mqtt_fsm_timeout_ms(MQTT_FSM_FLUSHED), MQTT_FSM_FLUSH_LINGER_MS);
+    TEST_CHECK_EQ(mqtt_fsm_timeout_ms(MQTT_FSM_SLEEP), 0);
+    TEST_CHECK_EQ(mqtt_fsm_timeout_ms(MQTT_FSM_STATE_MAX), 0);
+
+    // Every state with a timeout ends in SLEEP when it expires, SLEEP waits for the resume
+    for (int state = 0; state < MQTT_FSM_STATE_MAX; state++)
+    {
+        mqtt_fsm_state_e expected = (mqtt_fsm_timeout_ms((mqtt_fsm_state_e) state) != 0) ? MQTT_FSM_SLEEP : (mqtt_fsm_state_e) state;
+        TEST_CHECK_EQ(mqtt_fsm_next((mqtt_fsm_state_e) state, MQTT_FSM_EVT_TIMEOUT), expected);
+    }
+}
+
+static void test_sleep_waits_for_resume(void)
+{
+    for (int bit = 0; bit < MQTT_FSM_EVT_COUNT; bit++)
+    {
+        uint32_t event = 1UL << bit;
+        mqtt_fsm_state_e expected = (event == MQTT_FSM_EVT_RESUME) ? MQTT_FSM_CONNECTING : MQTT_FSM_SLEEP;
+        TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_SLEEP, event), expected);
+    }
+
+    // Only the CONNACK leaves CONNECTING before the timeout
+    for (int bit = 0; bit < MQTT_FSM_EVT_COUNT; bit++)
+    {
+        uint32_t event = 1UL << bit;
+        mqtt_fsm_state_e state = mqtt_fsm_next(MQTT_FSM_CONNECTING, event);
+        if (event != MQTT_FSM_EVT_CONNECTED && event != MQTT_FSM_EVT_TIMEOUT)
+            TEST_CHECK_EQ(state, MQTT_FSM_CONNECTING);
+    }
+}
+
+static void test_state_names(void)
+{
+    TEST_CHECK(strcmp(mqtt_fsm_state_name(MQTT_FSM_CONNECTING), "CONNECTING") == 0);
+    TEST_CHECK(strcmp(mqtt_fsm_state_name(MQTT_FSM_SLEEP), "SLEEP") == 0);
+    TEST_CHECK(strcmp(mqtt_fsm_state_name(MQTT_FSM_STATE_MAX), "UNKNOWN") == 0);
+    TEST_CHECK_EQ(mqtt_fsm_next(MQTT_FSM_STATE_MAX, MQTT_FSM_EVT_CONNECTED), MQTT_FSM_STATE_MAX);
+}
+
+int main(void)
+{
+    TEST_RUN(test_qos1_cycle);
+    TEST_RUN(test_qos0_skips_publishing);
+    TEST_RUN(test_disconnect);
+    TEST_RUN(test_errors_ignored);
+    TEST_RUN(test_timeouts);
+    TEST_RUN(test_sleep_waits_for_resume);
+    TEST_RUN(test_state_names);
+
+    return TEST_RESULT();
+}
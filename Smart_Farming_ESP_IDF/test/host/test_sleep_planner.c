@@ -0,0 +1,114 @@
+#include "sleep_planner.h"
+#include "test_check.h"
+
+static const sleep_planner_currents_t currents = {
+    .deep_sleep_ma = 0.15f,
+    .light_sleep_ma = 2.15f,
+};
+
+static void test_defaults(void)
+{
+    sleep_planner_t planner;
+    sleep_planner_init(&planner);
+
+    TEST_CHECK_EQ(planner.last_plan, SLEEP_PLAN_DEEP);
+    // (325 - 40) mA*s / 2 mA = 142.5 s
+    TEST_CHECK_NEAR(sleep_planner_break_even_ms(&planner, &currents), 142500, 1);
+}
+
+static void test_break_even_limits(void)
+{
+    sleep_planner_t planner;
+    sleep_planner_init(&planner);
+
+    // A resume that costs as much as a cold wake never pays off
+    planner.resume_mas = planner.cold_wake_mas;
+    TEST_CHECK_EQ(sleep_planner_break_even_ms(&planner, &currents), 0);
+
+    // Light sleep that draws no more than deep sleep always wins
+    sleep_planner_init(&planner);
+    sleep_planner_currents_t same = { .deep_sleep_ma = 1.0f, .light_sleep_ma = 1.0f };
+    TEST_CHECK_EQ(sleep_planner_break_even_ms(&planner, &same), UINT32_MAX);
+
+    // Too long for 32 bits
+    sleep_planner_currents_t tiny = { .deep_sleep_ma = 1.0f, .light_sleep_ma = 1.0f + 1e-6f };
+    TEST_CHECK_EQ(sleep_planner_break_even_ms(&planner, &tiny), UINT32_MAX);
+}
+
+static void test_record(void)
+{
+    sleep_planner_t planner;
+    sleep_planner_init(&planner);
+
+    // The first measurement replaces the default, later ones are averaged
+    sleep_planner_record(&planner, SLEEP_PLAN_DEEP, 200.0f);
+    TEST_CHECK_NEAR(planner.cold_wake_mas, 200, 0.01);
+    sleep_planner_record(&planner, SLEEP_PLAN_DEEP, 600.0f);
+    TEST_CHECK_NEAR(planner.cold_wake_mas, 300, 0.01);
+    TEST_CHECK_EQ(planner.cold_samples, 2);
+
+    sleep_planner_record(&planner, SLEEP_PLAN_LIGHT, 20.0f);
+    TEST_CHECK_NEAR(planner.resume_mas, 20, 0.01);
+    TEST_CHECK_EQ(planner.resume_samples, 1);
+
+    // Not a measurement
+    sleep_planner_record(&planner, SLEEP_PLAN_LIGHT, 0.0f);
+    TEST_CHECK_NEAR(planner.resume_mas, 20, 0.01);
+    TEST_CHECK_EQ(planner.resume_samples, 1);
+
+    // (300 - 20) mA*s / 2 mA = 140 s
+    TEST_CHECK_NEAR(sleep_planner_break_even_ms(&planner, &currents), 140000, 1);
+}
+
+static void test_choose(void)
+{
+    sleep_planner_t planner;
+    sleep_planner_init(&planner);
+
+    // Well below the break-even interval
+    TEST_CHECK_EQ(sleep_planner_choose(&planner, &currents, 10000), SLEEP_PLAN_LIGHT);
+    TEST_CHECK_EQ(planner.last_plan, SLEEP_PLAN_LIGHT);
+
+    // Well above it
+    TEST_CHECK_EQ(sleep_planner_choose(&planner, &currents, 600000), SLEEP_PLAN_DEEP);
+    TEST_CHECK_EQ(planner.last_plan, SLEEP_PLAN_DEEP);
+}
+
+static void test_choose_hysteresis(void)
+{
+    sleep_planner_t planner;
+    sleep_planner_init(&planner);
+
+    // Just below the break-even, light sleep is cheaper but not by 10 %: keep deep sleep
+    uint32_t interval_ms = sleep_planner_break_even_ms(&planner, &currents) - 5000;
+    TEST_CHECK(sleep_planner_cost_mas(&planner, &currents, SLEEP_PLAN_LIGHT, interval_ms) <
+               sleep_planner_cost_mas(&planner, &currents, SLEEP_PLAN_DEEP, interval_ms));
+    TEST_CHECK_EQ(sleep_planner_choose(&planner, &currents, interval_ms), SLEEP_PLAN_DEEP);
+
+    // Once in light sleep, the same holds just above the break-even
+    planner.last_plan = SLEEP_PLAN_LIGHT;
+    interval_ms = sleep_planner_break_even_ms(&planner, &currents) + 5000;
+    TEST_CHECK_EQ(sleep_planner_choose(&planner, &currents, interval_ms), SLEEP_PLAN_LIGHT);
+}
+
+static void test_cost(void)
+{
+    sleep_planner_t planner;
+    sleep_planner_init(&planner);
+
+    // 325 + 0.15 * 60 and 40 + 2.15 * 60
+    TEST_CHECK_NEAR(sleep_planner_cost_mas(&planner, &currents, SLEEP_PLAN_DEEP, 60000), 334, 0.01);
+    TEST_CHECK_NEAR(sleep_planner_cost_mas(&planner, &currents, SLEEP_PLAN_LIGHT, 60000), 169, 0.01);
+}
+
+int main(void)
+{
+    TEST_RUN(test_defaults);
+    TEST_RUN(test_break_even_limits);
+    TEST_RUN(test_record);
+    TEST_RUN(test_choose);
+    TEST_RUN(test_choose_hysteresis);
+    TEST_RUN(test_cost);
+
+    return TEST_RESULT();
+}
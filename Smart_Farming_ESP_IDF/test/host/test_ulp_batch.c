@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "ulp_batch.h"
+#include "test_check.h"
+
+static void test_plan(void)
+{
+    ulp_batch_plan_t plan;
+
+    // Short interval, sampled at the minimum period
+    TEST_CHECK(ulp_batch_plan(300, 30, &plan));
+    TEST_CHECK_EQ(plan.period_sec, 30);
+    TEST_CHECK_EQ(plan.samples, 10);
+
+    // Long interval, the period grows so the batch fits the buffer
+    TEST_CHECK(ulp_batch_plan(3600, 30, &plan));
+    TEST_CHECK_EQ(plan.period_sec, 113);
+    TEST_CHECK_EQ(plan.samples, 31);
+
+    // Never more samples than the buffer, never past the upload
+    for (uint32_t sleep_sec = 2; sleep_sec <= 86400; sleep_sec += 37)
+    {
+        if (ulp_batch_plan(sleep_sec, 10, &plan))
+        {
+            TEST_CHECK(plan.samples >= 2);
+            TEST_CHECK(plan.samples <= ULP_BATCH_MAX_SAMPLES);
+            TEST_CHECK(plan.samples * plan.period_sec <= sleep_sec);
+            TEST_CHECK(plan.period_sec >= 10);
+        }
+    }
+
+    // Too short for two samples, sleep on the timer
+    TEST_CHECK(!ulp_batch_plan(50, 30, &plan));
+    TEST_CHECK(!ulp_batch_plan(0, 30, &plan));
+
+    // A zero minimum period is taken as one second
+    TEST_CHECK(ulp_batch_plan(10, 0, &plan));
+    TEST_CHECK_EQ(plan.period_sec, 1);
+    TEST_CHECK_EQ(plan.samples, 10);
+}
+
+static void test_window(void)
+{
+    uint16_t low;
+    uint16_t high;
+
+    ulp_batch_window(10000, 500, &low, &high);
+    TEST_CHECK_EQ(low, 9500);
+    TEST_CHECK_EQ(high, 10500);
+
+    // No reference, the window never trips
+    ulp_batch_window(-1, 500, &low, &high);
+    TEST_CHECK_EQ(low, 0);
+    TEST_CHECK_EQ(high, 0xFFFF);
+
+    // Saturates at both ends
+    ulp_batch_window(200, 500, &low, &high);
+    TEST_CHECK_EQ(low, 0);
+    TEST_CHECK_EQ(high, 700);
+    ulp_batch_window(65300, 500, &low, &high);
+    TEST_CHECK_EQ(low, 64800);
+    TEST_CHECK_EQ(high, 0xFFFF);
+    ulp_batch_window(100000, 500, &low, &high);
+    TEST_CHECK_EQ(low, 0xFFFF - 500);
+    TEST_CHECK_EQ(high, 0xFFFF);
+}
+
+static void test_trips(void)
+{
+    TEST_CHECK(!ulp_batch_trips(9500, 9500, 10500));
+    TEST_CHECK(!ulp_batch_trips(10500, 9500, 10500));
+    TEST_CHECK(ulp_batch_trips(9499, 9500, 10500));
+    TEST_CHECK(ulp_batch_trips(10501, 9500, 10500));
+    TEST_CHECK(!ulp_batch_trips(0, 0, 0xFFFF));
+    TEST_CHECK(!ulp_batch_trips(0xFFFF, 0, 0xFFFF));
+}
+
+static void test_decode(void)
+{
+    // ST puts the instruction address in the high 16 bits
+    volatile uint32_t words[ULP_BATCH_MAX_SAMPLES + 4];
+    for (uint32_t i = 0; i < ULP_BATCH_MAX_SAMPLES + 4; i++)
+    {
+        words[i] = (0x01C0u + i) << 16 | (1000u + i);
+    }
+
+    uint16_t samples[ULP_BATCH_MAX_SAMPLES + 4];
+    memset(samples, 0, sizeof(samples));
+    TEST_CHECK_EQ(ulp_batch_decode(words, 0x00AB0000u | 5, samples, ULP_BATCH_MAX_SAMPLES), 5);
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_CHECK_EQ(samples[i], 1000 + i);
+    }
+    TEST_CHECK_EQ(samples[5], 0);
+
+    // A count past the buffer or the output array is cut
+    TEST_CHECK_EQ(ulp_batch_decode(words, 0xFFFF, samples, sizeof(samples) / sizeof(samples[0])), ULP_BATCH_MAX_SAMPLES);
+    TEST_CHECK_EQ(ulp_batch_decode(words, 20, samples, 8), 8);
+    TEST_CHECK_EQ(ulp_batch_decode(words, 0x12340000u, samples, 8), 0);
+}
+
+static void test_reason(void)
+{
+    TEST_CHECK_EQ(ulp_batch_reason(0x01C40000u | ULP_BATCH_REASON_THRESHOLD), ULP_BATCH_REASON_THRESHOLD);
+    TEST_CHECK_EQ(ulp_batch_reason(ULP_BATCH_REASON_SENSOR_ERROR), ULP_BATCH_REASON_SENSOR_ERROR);
+    TEST_CHECK_EQ(ulp_batch_reason(ULP_BATCH_REASON_COUNT), ULP_BATCH_REASON_NONE);
+    TEST_CHECK_EQ(ulp_batch_reason(0xFFFFFFFFu), ULP_BATCH_REASON_NONE);
+
+    TEST_CHECK(strcmp(ulp_batch_reason_name(ULP_BATCH_REASON_FULL), "batch_full") == 0);
+    TEST_CHECK(strcmp(ulp_batch_reason_name(ULP_BATCH_REASON_THRESHOLD), "threshold") == 0);
+    TEST_CHECK(strcmp(ulp_batch_reason_name(ULP_BATCH_REASON_SENSOR_ERROR), "sensor_error") == 0);
+    TEST_CHECK(strcmp(ulp_batch_reason_name(ULP_BATCH_REASON_COUNT), "none") == 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_plan);
+    TEST_RUN(test_window);
+    TEST_RUN(test_trips);
+    TEST_RUN(test_decode);
+    TEST_RUN(test_reason);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,335 @@
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wake_budget.h"
+#include "cycle_profiler.h"
+#include "link_adapt.h"
+#include "network_connection.h"
+#include "sleep_manager.h"
+#include "static_alloc.h"
+#include "esp_timer.h"
+#include "test_check.h"
+
+// Configured sleep interval of the scripted wakes
+#define TEST_SLEEP_SEC  60
+
+// Stand-ins for the calls of wake_budget.c and host/fake_network.c, they record what happened
+static int64_t fake_now_us = 0;
+static esp_timer_cb_t fake_timer_cb = NULL;
+static bool fake_timer_armed = false;
+static int64_t fake_timer_deadline_us = 0;
+static uint64_t fake_timer_timeout_us = 0;
+static TaskFunction_t fake_task_function = NULL;
+static TaskHandle_t fake_task_handle = (TaskHandle_t) &fake_task_function;
+static bool fake_notified = false;
+static int fake_notify_count = 0;
+static int fake_error_clear_count = 0;
+
+// Deep sleep ends the wake, it jumps back to run_wake
+static jmp_buf fake_sleep_jump;
+static bool fake_sleep_armed = false;
+static int fake_deep_sleep_count = 0;
+static uint32_t fake_sleep_sec = 0;
+static int64_t fake_sleep_at_us = 0;
+
+int64_t esp_timer_get_time(void)
+{
+    return fake_now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    fake_timer_cb = create_args->callback;
+    *out_handle = (esp_timer_handle_t) &fake_timer_cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    fake_timer_armed = true;
+    fake_timer_timeout_us = timeout_us;
+    fake_timer_deadline_us = fake_now_us + (int64_t) timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    fake_timer_armed = false;
+    return ESP_OK;
+}
+
+BaseType_t static_alloc_task_create(static_alloc_task_t *task, TaskFunction_t function, const char *name, void *parameter,
+                                    UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    // The budget task waits for the timer, it runs when notified
+    fake_task_function = function;
+    *handle = fake_task_handle;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_size, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    // The network task runs to its end or to the deep sleep
+    function(parameter);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    int64_t end_us = fake_now_us + (int64_t) ticks * 1000;
+
+    // The budget timer fires in the middle of the delay, the budget task preempts the caller
+    if (fake_timer_armed && fake_timer_deadline_us <= end_us)
+    {
+        fake_now_us = fake_timer_deadline_us;
+        fake_timer_armed = false;
+        fake_timer_cb(NULL);
+        if (fake_notified)
+            fake_task_function(NULL);
+    }
+
+    fake_now_us = end_us;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t) (fake_now_us / 1000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    TEST_CHECK(task == fake_task_handle);
+    fake_notified = true;
+    fake_notify_count++;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    TEST_CHECK(fake_notified);
+    fake_notified = false;
+    return 1;
+}
+
+void sleep_manager_enter_deep_sleep(void)
+{
+    // Same order as sleep_manager.c
+    fake_deep_sleep_count++;
+    fake_sleep_sec = wake_budget_next_sleep_sec(TEST_SLEEP_SEC);
+    fake_sleep_at_us = fake_now_us;
+    esp_wifi_stop();
+
+    if (fake_sleep_armed)
+    {
+        fake_sleep_armed = false;
+        longjmp(fake_sleep_jump, 1);
+    }
+}
+
+void error_handler_clear(void)
+{
+    fake_error_clear_count++;
+}
+
+void my_error_handler(const char *error_source)
+{
+    printf("my_error_handler(%s)\n", error_source);
+    test_failures++;
+}
+
+void cycle_profiler_mark(cycle_phase_e phase)
+{
+}
+
+void link_adapt_apply_power(void)
+{
+}
+
+void link_adapt_apply_phy(void)
+{
+}
+
+void link_adapt_record_rssi(int8_t rssi)
+{
+}
+
+/**
+ * @brief Run one deep sleep wake over the fake network: join, publish if joined, sleep
+ * @param wifi_fail SF_FAKE_WIFI_FAIL, 1 = the AP is never found
+ * @param wifi_ms SF_FAKE_WIFI_MS, time to associate
+ * @return Sleep interval chosen at the end of the wake
+ */
+static uint32_t run_wake(int wifi_fail, int wifi_ms)
+{
+    char value[16];
+    snprintf(value, sizeof(value), "%d", wifi_fail);
+    setenv("SF_FAKE_WIFI_FAIL", value, 1);
+    snprintf(value, sizeof(value), "%d", wifi_ms);
+    setenv("SF_FAKE_WIFI_MS", value, 1);
+
+    fake_sleep_sec = 0;
+    fake_sleep_armed = true;
+    if (setjmp(fake_sleep_jump) == 0)
+    {
+        // RAM is cleared by the deep sleep, the RTC failure count is not
+        wake_budget_stop();
+        wake_budget_start();
+        network_start();
+
+        // Joined, the uplink delivers
+        if (network_wait_connected(0) == ESP_OK)
+            wake_budget_set_uplink_ok();
+
+        sleep_manager_enter_deep_sleep();
+    }
+
+    return fake_sleep_sec;
+}
+
+static void test_backoff(void)
+{
+    // Doubles per failure up to WAKE_BUDGET_MAX_BACKOFF_SHIFT
+    TEST_CHECK_EQ(wake_budget_backoff_sec(60, 0), 60);
+    TEST_CHECK_EQ(wake_budget_backoff_sec(60, 1), 120);
+    TEST_CHECK_EQ(wake_budget_backoff_sec(60, 4), 960);
+    TEST_CHECK_EQ(wake_budget_backoff_sec(60, UINT32_MAX), 960);
+
+    // Capped at WAKE_BUDGET_MAX_SLEEP_SEC
+    TEST_CHECK_EQ(wake_budget_backoff_sec(300, 3), 2400);
+    TEST_CHECK_EQ(wake_budget_backoff_sec(300, 4), WAKE_BUDGET_MAX_SLEEP_SEC);
+
+    // A configured interval above the cap is never shortened, and never overflows
+    TEST_CHECK_EQ(wake_budget_backoff_sec(86400, 4), 86400);
+    TEST_CHECK_EQ(wake_budget_backoff_sec(UINT32_MAX, 4), UINT32_MAX);
+}
+
+static void test_scripted_network(void)
+{
+    // Scripted wakes over the fake network
+    static const struct
+    {
+        int wifi_fail;
+        int wifi_ms;
+        uint32_t sleep_sec;
+        uint32_t failures;
+        uint32_t awake_ms;          // Time from the start of the wake to the deep sleep
+    } wakes[] = {
+        { 1, 250,  120, 1, 0 },                       // AP not found, the wake ends at once
+        { 1, 250,  240, 2, 0 },
+        { 0, 9000, 480, 3, WAKE_BUDGET_WIFI_MS },     // Join slower than the Wi-Fi phase budget
+        { 0, 9000, 960, 4, WAKE_BUDGET_WIFI_MS },
+        { 1, 250,  960, 5, 0 },                       // Backoff capped
+        { 0, 250,  60,  0, 300 },                     // Joined and delivered, back to the interval
+        { 1, 250,  120, 1, 0 },
+        { 0, 7000, 60,  0, 7050 },                    // Slow but within the budget
+    };
+
+    for (size_t i = 0; i < sizeof(wakes) / sizeof(wakes[0]); i++)
+    {
+        int64_t start_us = fake_now_us;
+        int sleeps = fake_deep_sleep_count;
+
+        TEST_CHECK_EQ(run_wake(wakes[i].wifi_fail, wakes[i].wifi_ms), wakes[i].sleep_sec);
+        TEST_CHECK_EQ(fake_deep_sleep_count, sleeps + 1);
+        TEST_CHECK_EQ(wake_budget_previous_failures(), wakes[i].failures);
+        TEST_CHECK_EQ((fake_sleep_at_us - start_us) / 1000, wakes[i].awake_ms);
+
+        // Next wake after the sleep
+        fake_now_us += (int64_t) wakes[i].sleep_sec * 1000000;
+    }
+}
+
+static void test_deadlines(void)
+{
+    fake_now_us = 1000000;
+    wake_budget_stop();
+    wake_budget_start();
+    TEST_CHECK(fake_task_function != NULL);
+    TEST_CHECK(fake_timer_armed);
+    TEST_CHECK_EQ(fake_timer_timeout_us, (uint64_t) WAKE_BUDGET_TOTAL_MS * 1000);
+    TEST_CHECK_EQ(wake_budget_remaining_ms(), WAKE_BUDGET_TOTAL_MS);
+
+    // The earliest deadline arms the timer
+    wake_budget_register(WAKE_BUDGET_PHASE_WIFI, WAKE_BUDGET_WIFI_MS);
+    TEST_CHECK_EQ(fake_timer_timeout_us, (uint64_t) WAKE_BUDGET_WIFI_MS * 1000);
+    TEST_CHECK_EQ(wake_budget_phase_remaining_ms(WAKE_BUDGET_PHASE_WIFI), WAKE_BUDGET_WIFI_MS);
+
+    fake_now_us += 2000000;
+    TEST_CHECK_EQ(wake_budget_phase_remaining_ms(WAKE_BUDGET_PHASE_WIFI), WAKE_BUDGET_WIFI_MS - 2000);
+    wake_budget_phase_done(WAKE_BUDGET_PHASE_WIFI);
+    TEST_CHECK_EQ(fake_timer_timeout_us, (uint64_t) (WAKE_BUDGET_TOTAL_MS - 2000) * 1000);
+    TEST_CHECK_EQ(wake_budget_remaining_ms(), WAKE_BUDGET_TOTAL_MS - 2000);
+    // A finished phase falls back to the wake budget
+    TEST_CHECK_EQ(wake_budget_phase_remaining_ms(WAKE_BUDGET_PHASE_WIFI), WAKE_BUDGET_TOTAL_MS - 2000);
+
+    // A phase never gets past the wake budget
+    wake_budget_register(WAKE_BUDGET_PHASE_MQTT, WAKE_BUDGET_TOTAL_MS);
+    TEST_CHECK_EQ(fake_timer_timeout_us, (uint64_t) (WAKE_BUDGET_TOTAL_MS - 2000) * 1000);
+
+    // Past the deadline, the timer fires at once
+    fake_now_us += (int64_t) WAKE_BUDGET_TOTAL_MS * 1000;
+    wake_budget_phase_done(WAKE_BUDGET_PHASE_MQTT);
+    TEST_CHECK_EQ(fake_timer_timeout_us, 1);
+    TEST_CHECK_EQ(wake_budget_remaining_ms(), 0);
+
+    wake_budget_stop();
+    TEST_CHECK(!fake_timer_armed);
+}
+
+static void test_expiry_in_task(void)
+{
+    wake_budget_stop();
+    wake_budget_start();
+    wake_budget_register(WAKE_BUDGET_PHASE_ESPNOW, WAKE_BUDGET_ESPNOW_MS);
+
+    // The timer callback runs in the esp_timer task, it only wakes the budget task
+    int notifies = fake_notify_count;
+    int sleeps = fake_deep_sleep_count;
+    fake_now_us += (int64_t) WAKE_BUDGET_ESPNOW_MS * 1000;
+    fake_timer_cb(NULL);
+    TEST_CHECK_EQ(fake_notify_count, notifies + 1);
+    TEST_CHECK_EQ(fake_deep_sleep_count, sleeps);
+
+    // The budget task does the deep sleep entry
+    fake_sleep_armed = true;
+    if (setjmp(fake_sleep_jump) == 0)
+    {
+        fake_task_function(NULL);
+        TEST_CHECK(false);
+    }
+    TEST_CHECK_EQ(fake_deep_sleep_count, sleeps + 1);
+    TEST_CHECK(!fake_notified);
+
+    wake_budget_stop();
+}
+
+static void test_uplink_ok(void)
+{
+    int clears = fake_error_clear_count;
+    wake_budget_stop();
+    TEST_CHECK(!wake_budget_uplink_ok());
+
+    // A delivered uplink also ends the restart backoff of the error handler
+    wake_budget_set_uplink_ok();
+    TEST_CHECK(wake_budget_uplink_ok());
+    TEST_CHECK_EQ(fake_error_clear_count, clears + 1);
+    TEST_CHECK_EQ(wake_budget_next_sleep_sec(TEST_SLEEP_SEC), TEST_SLEEP_SEC);
+    TEST_CHECK_EQ(wake_budget_previous_failures(), 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_backoff);
+    TEST_RUN(test_scripted_network);
+    TEST_RUN(test_deadlines);
+    TEST_RUN(test_expiry_in_task);
+    TEST_RUN(test_uplink_ok);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Compare the micro-benchmark results of two firmware builds.
+
+The benchmark build (BENCHMARK_ENABLE in benchmark.h) prints one record per case:
+    bench {"name":"dht22_read","unit":"cycles","cpu_mhz":240,"n":5,"errors":0,
+           "min":...,"median":...,"p99":...,"max":...,"alloc_bytes":...,"allocs":...}
+Save the console output of each build (idf.py monitor, or the host build's stdout),
+other lines are ignored. Cycles are converted to microseconds with cpu_mhz, so a
+change of CPU frequency does not show up as a regression.
+
+A case regresses when its median time grows more than --threshold percent, or when
+it allocates more heap bytes per call than --alloc-slack allows. The exit status is 1
+if any case regressed or is missing, so the script can gate a CI job.
+
+Usage:
+    python3 bench_compare.py baseline.log candidate.log [--threshold 10] [--json]
+    python3 bench_compare.py results.log                 (print one build)
+"""
+
+import argparse
+import json
+import sys
+
+
+def load_results(path):
+    """Return {case name: record} from a console log."""
+    results = {}
+    with open(path, errors="replace") as source:
+        for line in source:
+            # Serial monitors may add a prefix or color codes before the record
+            start = line.find("bench {")
+            if start < 0:
+                continue
+            try:
+                record = json.loads(line[start + len("bench "):].strip())
+            except ValueError:
+                continue
+            if "name" in record:
+                results[record["name"]] = record
+    return results
+
+
+def to_us(record, key):
+    value = record.get(key, 0)
+    if record.get("unit") == "cycles":
+        mhz = record.get("cpu_mhz") or 1
+        return value / float(mhz)
+    if record.get("unit") == "ns":
+        return value / 1000.0
+    return float(value)
+
+
+def change(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) / old * 100.0
+
+
+def compare(baseline, candidate, args):
+    """Return (rows, regressed)."""
+    rows = []
+    regressed = False
+    for name in list(baseline) + [n for n in candidate if n not in baseline]:
+        old = baseline.get(name)
+        new = candidate.get(name)
+        row = {"name": name}
+        if old is None or new is None:
+            row["status"] = "missing" if new is None else "new"
+            regressed |= new is None
+            rows.append(row)
+            continue
+
+        row["median_us"] = [to_us(old, "median"), to_us(new, "median")]
+        row["p99_us"] = [to_us(old, "p99"), to_us(new, "p99")]
+        row["alloc_bytes"] = [old.get("alloc_bytes", 0), new.get("alloc_bytes", 0)]
+        row["errors"] = [old.get("errors", 0), new.get("errors", 0)]
+        row["median_change"] = change(*row["median_us"])
+        row["p99_change"] = change(*row["p99_us"])
+
+        reasons = []
+        if row["median_change"] > args.threshold:
+            reasons.append("median")
+        if row["alloc_bytes"][1] > row["alloc_bytes"][0] + args.alloc_slack:
+            reasons.append("alloc")
+        if row["errors"][1] > row["errors"][0]:
+            reasons.append("errors")
+        row["status"] = "regressed (%s)" % ", ".join(reasons) if reasons else "ok"
+        regressed |= bool(reasons)
+        rows.append(row)
+    return rows, regressed
+
+
+def print_one(results):
+    print("%-26s %5s %12s %12s %12s %8s %6s %6s" % ("case", "n", "min_us", "median_us", "p99_us", "alloc_B", "allocs", "errors"))
+    for name, record in results.items():
+        print("%-26s %5d %12.1f %12.1f %12.1f %8d %6d %6d" % (
+            name, record.get("n", 0), to_us(record, "min"), to_us(record, "median"), to_us(record, "p99"),
+            record.get("alloc_bytes", 0), record.get("allocs", 0), record.get("errors", 0)))
+
+
+def print_rows(rows):
+    print("%-26s %12s %12s %8s %8s %15s  %s" % ("case", "median_us", "p99_us", "median", "p99", "alloc_B", "status"))
+    for row in rows:
+        if "median_us" not in row:
+            print("%-26s %12s %12s %8s %8s %15s  %s" % (row["name"], "-", "-", "-", "-", "-", row["status"]))
+            continue
+        print("%-26s %12.1f %12.1f %+7.1f%% %+7.1f%% %15s  %s" % (
+            row["name"], row["median_us"][1], row["p99_us"][1], row["median_change"], row["p99_change"],
+            "%d -> %d" % tuple(row["alloc_bytes"]), row["status"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="+", help="Console log of the baseline build, then of the candidate build")
+    parser.add_argument("--threshold", type=float, default=10.0, help="Allowed median time increase in percent")
+    parser.add_argument("--alloc-slack", type=int, default=0, help="Allowed increase of heap bytes per call")
+    parser.add_argument("--json", action="store_true", help="Print the comparison as JSON")
+    args = parser.parse_args()
+
+    if len(args.files) > 2:
+        parser.error("give one log, or a baseline and a candidate log")
+
+    baseline = load_results(args.files[0])
+    if not baseline:
+        sys.exit("%s: no benchmark records" % args.files[0])
+
+    if len(args.files) == 1:
+        if args.json:
+            print(json.dumps(baseline, indent=2))
+        else:
+            print_one(baseline)
+        return
+
+    candidate = load_results(args.files[1])
+    rows, regressed = compare(baseline, candidate, args)
+    if args.json:
+        print(json.dumps({"regressed": regressed, "cases": rows}, indent=2))
+    else:
+        print_rows(rows)
+
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == "__main__":
+    main()
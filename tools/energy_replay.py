@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+Replay wake-cycle phase records through the energy model and compare builds.
+
+Uses the same model as energy_model.c: the charge of one cycle is
+    cpu_active_ma * awake + wifi_on_ma * wifi_on + sensor_ma * sensor_on + deep_sleep_ma * sleep
+with awake = boot to sleep, wifi_on = esp_wifi_start to sleep and sensor_on = NVS init to first
+sensor reading. Sample latency is boot to publish. Cycles resumed from light sleep (flag 4) keep
+Wi-Fi on the whole awake time, and a light sleep (flag 8) is charged at
+sleep_ma + light_sleep_ma + wifi_modem_ma.
+
+Continuous mode reports ({"mode":"continuous",...}) are replayed too:
+    (cpu_active_ma + wifi_ma) * active + sensor_ma * sensor_on
+    + (light_sleep_ma + wifi_modem_ma) * (period - active) + sleep_ma * period
+so a deep-sleep build and a continuous build can be compared in one table.
+
+Usage:
+    python3 energy_replay.py build_a.txt [build_b.txt ...] [--wifi-ma 85] [--sleep-ma 20]
+
+Each file holds diagnostics records collected from one firmware build, one per line
+(raw JSON or "<topic> <json>" as printed by mosquitto_sub -v).
+"""
+
+import argparse
+import json
+
+PHASES = ["boot", "nvs", "wifi_start", "wifi", "dhcp", "net", "connack", "sensor", "publish", "sleep"]
+
+FLAG_RESUMED = 0x04
+FLAG_LIGHT_SLEEP = 0x08
+
+
+def load_records(path):
+    """Return (deep sleep records, continuous mode reports)."""
+    records = []
+    reports = []
+    with open(path) as source:
+        for line in source:
+            line = line.strip()
+            if not line:
+                continue
+            if not line.startswith("{"):
+                line = line.partition(" ")[2]
+            try:
+                record = json.loads(line)
+            except ValueError:
+                continue
+            if record.get("mode") == "continuous":
+                reports.append(record)
+                continue
+            stamps = record.get("t_ms")
+            if isinstance(stamps, list) and len(stamps) == len(PHASES):
+                records.append((dict(zip(PHASES, stamps)), record.get("sleep_ms", 0), record.get("flags", 0)))
+    return records, reports
+
+
+def cycle_cost(stamps, sleep_ms, flags, coeff):
+    if stamps["sleep"] <= 0:
+        return None
+
+    awake = stamps["sleep"]
+    wifi_on = stamps["sleep"] - stamps["wifi_start"] if 0 < stamps["wifi_start"] < stamps["sleep"] else 0
+    if flags & FLAG_RESUMED:
+        wifi_on = awake
+    sensor_on = stamps["sensor"] - stamps["nvs"] if stamps["nvs"] > 0 and stamps["sensor"] > stamps["nvs"] else 0
+
+    sleep_ma = coeff.sleep_ma
+    if flags & FLAG_LIGHT_SLEEP:
+        sleep_ma += coeff.light_sleep_ma + coeff.wifi_modem_ma
+
+    charge = (coeff.cpu_ma * awake + coeff.wifi_ma * wifi_on + coeff.sensor_ma * sensor_on
+              + sleep_ma * sleep_ms)
+    period = awake + sleep_ms
+    if period <= 0:
+        return None
+
+    latency = stamps["publish"] if stamps["publish"] > 0 else None
+    return charge / 3600000.0, charge / period, awake, latency
+
+
+def continuous_cost(report, coeff):
+    period = report.get("period_ms", 0)
+    if period <= 0:
+        return None
+
+    active = min(report.get("active_ms", 0), period)
+    samples = max(report.get("samples", 1), 1)
+    charge = ((coeff.cpu_ma + coeff.wifi_ma) * active
+              + (coeff.light_sleep_ma + coeff.wifi_modem_ma) * (period - active)
+              + coeff.sleep_ma * period)
+    charge += coeff.sensor_ma * report.get("sensor_ms", coeff.dht_ms * samples)
+
+    # Per sample, so the column is comparable with one deep sleep cycle
+    return charge / 3600000.0 / samples, charge / period, active / samples, report.get("lat_ms_avg")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="+", help="Record file per build")
+    parser.add_argument("--cpu-ma", type=float, default=45.0, help="CPU active current")
+    parser.add_argument("--wifi-ma", type=float, default=85.0, help="Wi-Fi current on top of CPU active")
+    parser.add_argument("--sensor-ma", type=float, default=1.5, help="Sensor current while measuring")
+    parser.add_argument("--sleep-ma", type=float, default=20.0, help="Deep sleep current")
+    parser.add_argument("--light-sleep-ma", type=float, default=0.8, help="Light sleep current on top of deep sleep")
+    parser.add_argument("--wifi-modem-ma", type=float, default=4.0, help="Wi-Fi modem sleep current on top of deep sleep")
+    parser.add_argument("--dht-ms", type=float, default=25.0, help="DHT22 reading time, for continuous reports without sensor_ms")
+    parser.add_argument("--battery-mah", type=float, default=2000.0, help="Battery capacity")
+    coeff = parser.parse_args()
+
+    baseline = None
+    print("%-24s %6s %10s %10s %10s %12s %8s %9s" % ("build", "cycles", "awake_ms", "uAh/cycle", "avg_mA", "battery_h", "lat_ms", "delta"))
+    for path in coeff.files:
+        records, reports = load_records(path)
+        costs = [c for c in (cycle_cost(s, sleep, flags, coeff) for s, sleep, flags in records) if c]
+        costs += [c for c in (continuous_cost(r, coeff) for r in reports) if c]
+        if not costs:
+            print("%-24s no complete cycles" % path)
+            continue
+
+        mah = sum(c[0] for c in costs) / len(costs)
+        avg_ma = sum(c[1] for c in costs) / len(costs)
+        awake = sum(c[2] for c in costs) / len(costs)
+        latencies = [c[3] for c in costs if c[3] is not None]
+        latency = "%.0f" % (sum(latencies) / len(latencies)) if latencies else "-"
+        life_h = coeff.battery_mah / avg_ma if avg_ma > 0 else 0
+
+        if baseline is None:
+            baseline = mah
+        delta = "%+.1f%%" % ((mah - baseline) / baseline * 100.0) if baseline else "-"
+
+        print("%-24s %6d %10.0f %10.2f %10.2f %12.1f %8s %9s" % (path, len(costs), awake, mah * 1000.0, avg_ma, life_h, latency, delta))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,283 @@
+#!/usr/bin/env python3
+"""
+Fleet load generator. Simulates many sensor nodes against an MQTT broker with the
+same wake cycle as the firmware: connect with a persistent session, publish one
+reading to /smartfarming/<device id>/data, disconnect and sleep. A monitor client
+subscribed to all data topics measures the end-to-end delivery latency.
+
+Usage:
+    python3 fleet_loadgen.py --nodes 1000 --sleep 60 --duration 600 --broker localhost
+
+Node i gets the device ID sf-025346<i as 6 hex digits>, a locally administered MAC, so
+simulated nodes never collide with real ones. Raise the open file limit
+(ulimit -n) when simulating more than about 1000 nodes.
+
+Only the Python standard library is used (asyncio with a minimal MQTT 3.1.1
+client), so thousands of nodes fit in one process.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import struct
+import sys
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK, SUBSCRIBE, SUBACK, DISCONNECT = 1, 2, 3, 4, 8, 9, 14
+
+TOPIC_ROOT = "/smartfarming"
+MAC_PREFIX = bytes([0x02, 0x53, 0x46])
+
+
+class ProtocolError(Exception):
+    pass
+
+
+def encode_length(length):
+    out = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        out.append(byte | 0x80 if length else byte)
+        if not length:
+            return bytes(out)
+
+
+def encode_string(value):
+    data = value.encode()
+    return struct.pack(">H", len(data)) + data
+
+
+def packet(ptype, flags, body):
+    return bytes([ptype << 4 | flags]) + encode_length(len(body)) + body
+
+
+def connect_packet(client_id, username, password, clean, keepalive):
+    flags = 0x02 if clean else 0
+    payload = encode_string(client_id)
+    if username:
+        flags |= 0x80
+        payload += encode_string(username)
+        if password:
+            flags |= 0x40
+            payload += encode_string(password)
+    return packet(CONNECT, 0, encode_string("MQTT") + bytes([4, flags]) + struct.pack(">H", keepalive) + payload)
+
+
+def publish_packet(topic, payload, qos, packet_id):
+    body = encode_string(topic)
+    if qos:
+        body += struct.pack(">H", packet_id)
+    return packet(PUBLISH, qos << 1, body + payload)
+
+
+async def read_packet(reader):
+    header = await reader.readexactly(1)
+    length, shift = 0, 0
+    while True:
+        byte = (await reader.readexactly(1))[0]
+        length |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            break
+        shift += 7
+        if shift > 21:
+            raise ProtocolError("malformed remaining length")
+    return header[0] >> 4, header[0] & 0x0F, await reader.readexactly(length)
+
+
+def parse_publish(flags, body):
+    topic_len = struct.unpack_from(">H", body)[0]
+    topic = body[2:2 + topic_len].decode(errors="replace")
+    offset = 2 + topic_len
+    qos = (flags >> 1) & 0x03
+    if qos:
+        offset += 2
+    return topic, body[offset:]
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+class Stats:
+    def __init__(self):
+        self.wakes = 0
+        self.published = 0
+        self.acked = 0
+        self.received = 0
+        self.errors = 0
+        self.connect_ms = []
+        self.puback_ms = []
+        self.delivery_ms = []
+        self.awake_ms = []
+
+    def summary_row(self, name, values):
+        values = sorted(values)
+        return "%-10s %8d %9.1f %9.1f %9.1f %9.1f" % (
+            name, len(values), percentile(values, 50), percentile(values, 90), percentile(values, 99),
+            values[-1] if values else 0.0)
+
+
+async def one_wake(args, device_id, seq, stats):
+    start = time.monotonic()
+    reader, writer = await asyncio.wait_for(asyncio.open_connection(args.broker, args.port), args.timeout)
+    try:
+        writer.write(connect_packet(device_id, args.username, args.password, clean=False, keepalive=30))
+        ptype, _, body = await asyncio.wait_for(read_packet(reader), args.timeout)
+        if ptype != CONNACK or len(body) < 2 or body[1] != 0:
+            raise ProtocolError("connection refused")
+        stats.connect_ms.append((time.monotonic() - start) * 1000.0)
+
+        # Sensor reading overlaps the network bring-up on the node, model what is left of it
+        if args.sensor_ms:
+            await asyncio.sleep(args.sensor_ms / 1000.0)
+
+        payload = json.dumps({
+            "temperature": round(random.gauss(25.0, 2.0), 1),
+            "humidity": round(random.uniform(40.0, 80.0), 1),
+            "soil_moisture": random.randint(8000, 16000),
+            "seq": seq,
+            "ts": int(time.time()),
+            "sent_ms": time.time() * 1000.0,
+        }).encode()
+
+        topic = "%s/%s/data" % (TOPIC_ROOT, device_id)
+        packet_id = seq % 65535 + 1
+        sent = time.monotonic()
+        writer.write(publish_packet(topic, payload, args.qos, packet_id))
+        stats.published += 1
+
+        if args.qos:
+            while True:
+                ptype, _, body = await asyncio.wait_for(read_packet(reader), args.timeout)
+                if ptype == PUBACK and struct.unpack(">H", body[:2])[0] == packet_id:
+                    break
+            stats.acked += 1
+            stats.puback_ms.append((time.monotonic() - sent) * 1000.0)
+
+        writer.write(packet(DISCONNECT, 0, b""))
+        await writer.drain()
+    finally:
+        writer.close()
+        try:
+            await writer.wait_closed()
+        except OSError:
+            pass
+
+    stats.awake_ms.append((time.monotonic() - start) * 1000.0)
+
+
+async def node(index, args, stats, stop_at):
+    device_id = "sf-" + (MAC_PREFIX + index.to_bytes(3, "big")).hex()
+
+    # Nodes powered up at random times, spread the first wake over one period
+    await asyncio.sleep(random.uniform(0, args.sleep))
+
+    seq = 0
+    while time.monotonic() < stop_at:
+        wake = time.monotonic()
+        seq += 1
+        stats.wakes += 1
+        try:
+            await one_wake(args, device_id, seq, stats)
+        except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError, ProtocolError):
+            stats.errors += 1
+
+        period = args.sleep * random.uniform(1.0 - args.jitter, 1.0 + args.jitter)
+        await asyncio.sleep(max(0.0, period - (time.monotonic() - wake)))
+
+
+async def monitor(args, stats, ready):
+    reader, writer = await asyncio.open_connection(args.broker, args.port)
+    writer.write(connect_packet("sf-loadgen-monitor", args.username, args.password, clean=True, keepalive=0))
+    ptype, _, body = await read_packet(reader)
+    if ptype != CONNACK or body[1] != 0:
+        raise ProtocolError("monitor connection refused")
+
+    writer.write(packet(SUBSCRIBE, 0x02, struct.pack(">H", 1) + encode_string(TOPIC_ROOT + "/+/data") + bytes([0])))
+    while True:
+        ptype, flags, body = await read_packet(reader)
+        if ptype == SUBACK:
+            ready.set()
+        elif ptype == PUBLISH:
+            _, payload = parse_publish(flags, body)
+            try:
+                sent_ms = json.loads(payload)["sent_ms"]
+            except (ValueError, KeyError, TypeError):
+                continue
+            stats.received += 1
+            stats.delivery_ms.append(time.time() * 1000.0 - sent_ms)
+
+
+async def reporter(args, stats, stop_at):
+    last_published, last_received = 0, 0
+    while time.monotonic() < stop_at:
+        await asyncio.sleep(args.report)
+        print("published %6.1f/s  received %6.1f/s  errors %d" % (
+            (stats.published - last_published) / args.report,
+            (stats.received - last_received) / args.report, stats.errors), flush=True)
+        last_published, last_received = stats.published, stats.received
+
+
+async def run(args):
+    stats = Stats()
+    ready = asyncio.Event()
+    monitor_task = asyncio.create_task(monitor(args, stats, ready))
+    await asyncio.wait_for(ready.wait(), args.timeout)
+
+    start = time.monotonic()
+    stop_at = start + args.duration
+    tasks = [asyncio.create_task(node(i, args, stats, stop_at)) for i in range(args.nodes)]
+    report_task = asyncio.create_task(reporter(args, stats, stop_at))
+
+    await asyncio.gather(*tasks)
+    elapsed = time.monotonic() - start
+    # Let the last deliveries arrive
+    await asyncio.sleep(min(args.timeout, 2.0))
+    report_task.cancel()
+    monitor_task.cancel()
+
+    print()
+    print("nodes %d, wakes %d, published %d, acked %d, received %d, errors %d, %.1f msg/s" % (
+        args.nodes, stats.wakes, stats.published, stats.acked, stats.received, stats.errors,
+        stats.published / elapsed if elapsed > 0 else 0.0))
+    print("%-10s %8s %9s %9s %9s %9s" % ("ms", "n", "p50", "p90", "p99", "max"))
+    print(stats.summary_row("connack", stats.connect_ms))
+    if args.qos:
+        print(stats.summary_row("puback", stats.puback_ms))
+    print(stats.summary_row("delivery", stats.delivery_ms))
+    print(stats.summary_row("awake", stats.awake_ms))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--nodes", type=int, default=100, help="Number of simulated nodes")
+    parser.add_argument("--sleep", type=float, default=60.0, help="Wake period in seconds")
+    parser.add_argument("--jitter", type=float, default=0.05, help="Relative wake period jitter (RTC drift)")
+    parser.add_argument("--duration", type=float, default=300.0, help="Test duration in seconds")
+    parser.add_argument("--sensor-ms", type=float, default=0.0, help="Extra awake time before publishing")
+    parser.add_argument("--qos", type=int, choices=(0, 1), default=1)
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--username")
+    parser.add_argument("--password")
+    parser.add_argument("--timeout", type=float, default=10.0, help="Per-operation timeout in seconds")
+    parser.add_argument("--report", type=float, default=10.0, help="Progress report interval in seconds")
+    args = parser.parse_args()
+
+    try:
+        asyncio.run(run(args))
+    except KeyboardInterrupt:
+        return 1
+    except (OSError, ProtocolError, asyncio.TimeoutError) as err:
+        print("monitor failed: %s" % err, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
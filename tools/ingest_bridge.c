@@ -0,0 +1,1109 @@
+/**
+ * Ingest bridge. Subscribes to the sensor data and ESP-NOW batch topics and writes
+ * the readings to PostgreSQL in batches, in place of the insert in the NodeRED flow.
+ *
+ * The MQTT client thread decodes each message into rows (the current reading, the
+ * pending readings with their "ts", and each reading of a gateway batch) and puts
+ * them in a bounded queue. A writer thread takes up to --batch rows, or what
+ * arrived within --flush-ms, and writes them with one COPY (default) or one
+ * prepared multi-row INSERT. When the database is slow or down, the queue fills
+ * and the message callback waits for room: the broker keeps the QoS 1 messages
+ * of the persistent session instead of the bridge dropping rows. Rows already in
+ * the queue are lost if the bridge is killed.
+ *
+ * Every --stats seconds one JSON line reports the messages and rows per second,
+ * the batch size, the queue depth, the time the MQTT thread waited on a full queue,
+ * the write time per batch and the lag from message arrival to commit (p50, p99, max).
+ *
+ * Rows go to the table of the NodeRED flow:
+ *   CREATE TABLE smart_farming (time bigint, device text, temperature double precision,
+ *                               humidity double precision, soil_moisture double precision);
+ * A reading without "ts" gets the arrival time, a pending reading without "ts" is skipped.
+ *
+ * Build (libmosquitto-dev and libpq-dev):
+ *   cc -O2 -Wall -o ingest_bridge ingest_bridge.c $(pkg-config --cflags --libs libmosquitto libpq) -lpthread -lm
+ *
+ * Usage:
+ *   ./ingest_bridge --host localhost --db "dbname=smartfarming"
+ *   ./ingest_bridge --db "dbname=sf_bench" --table smart_farming_bench --mode insert --batch 500 --stats 5
+ *
+ * Benchmark with the traffic of the load generator, against a local Mosquitto and PostgreSQL:
+ *   ./ingest_bridge --db "dbname=sf_bench" --stats 5 &
+ *   python3 fleet_loadgen.py --nodes 2000 --sleep 10 --duration 120
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libpq-fe.h>
+#include <mosquitto.h>
+
+#define INGEST_DEVICE_MAX           40      // Device ID and NUL, "sf-" + 12 hex digits in practice
+#define INGEST_KEY_MAX              32
+#define INGEST_MAX_ROWS_PER_MESSAGE 256     // A gateway batch is at most 16 frames of 9 readings
+#define INGEST_MAX_TOPICS           8
+#define INGEST_LATENCY_SAMPLES      8192    // Samples kept per stats interval, reservoir sampled
+#define INGEST_RETRY_MAX_SEC        30
+#define INGEST_ROW_TEXT_MAX         192     // One row in COPY text or the INSERT arrays
+
+typedef struct ingest_row
+{
+    int64_t time;                   // Unix seconds
+    char device[INGEST_DEVICE_MAX];
+    double temperature;             // NAN is stored as NULL
+    double humidity;
+    double soil_moisture;
+    int64_t received_us;            // Arrival, for the commit lag
+} ingest_row_t;
+
+// Command line options
+typedef struct ingest_options
+{
+    const char *host;
+    int port;
+    const char *username;
+    const char *password;
+    const char *client_id;
+    bool clean_session;
+    const char *topics[INGEST_MAX_TOPICS];
+    int topic_count;
+    const char *conninfo;
+    const char *table;
+    bool use_copy;
+    int batch;
+    int flush_ms;
+    int queue;
+    int stats_sec;
+} ingest_options_t;
+
+// Bounded row queue between the MQTT thread and the writer
+typedef struct ingest_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    ingest_row_t *rows;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool stopping;
+} ingest_queue_t;
+
+// Latency samples of one stats interval
+typedef struct ingest_latency
+{
+    double samples[INGEST_LATENCY_SAMPLES];
+    uint64_t seen;
+} ingest_latency_t;
+
+// Counters, under stats_lock
+typedef struct ingest_stats
+{
+    uint64_t messages;
+    uint64_t rows;
+    uint64_t rows_written;
+    uint64_t batches;
+    uint64_t invalid;
+    uint64_t db_errors;
+    uint64_t blocked_us;
+    size_t queue_max;
+    ingest_latency_t write_ms;
+    ingest_latency_t lag_ms;
+} ingest_stats_t;
+
+// Simple JSON reader, enough for the flat sensor payloads
+typedef struct json_reader
+{
+    const char *p;
+    const char *end;
+} json_reader_t;
+
+typedef bool (*json_member_cb_t)(json_reader_t *r, const char *key, void *ctx);
+typedef bool (*json_item_cb_t)(json_reader_t *r, void *ctx);
+
+// One reading object while it is parsed
+typedef struct json_reading
+{
+    double temperature;
+    double humidity;
+    double soil_moisture;
+    int64_t ts;                     // 0 = not in the payload
+} json_reading_t;
+
+// Rows decoded from one message
+typedef struct ingest_message
+{
+    ingest_row_t rows[INGEST_MAX_ROWS_PER_MESSAGE];
+    size_t count;
+    char device[INGEST_DEVICE_MAX];
+    int64_t received_us;
+    int64_t received_sec;
+    json_reading_t frame_readings[INGEST_MAX_ROWS_PER_MESSAGE];
+    size_t frame_count;             // Readings of the gateway frame being parsed
+} ingest_message_t;
+
+static ingest_options_t options = {
+    .host = "localhost",
+    .port = 1883,
+    .client_id = "sf-ingest-bridge",
+    .conninfo = "dbname=smartfarming",
+    .table = "smart_farming",
+    .use_copy = true,
+    .batch = 1000,
+    .flush_ms = 500,
+    .queue = 50000,
+    .stats_sec = 10,
+};
+
+static ingest_queue_t queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static ingest_stats_t stats;
+static ingest_stats_t totals;
+
+static volatile sig_atomic_t running = 1;
+
+/**
+ * @brief Get the monotonic time
+ * @return Microseconds
+ */
+static int64_t ingest_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void ingest_signal(int sig)
+{
+    (void) sig;
+    running = 0;
+}
+
+/* ---------------------------------------------------------------------------------
+ * JSON
+ * ------------------------------------------------------------------------------- */
+
+static void json_skip_ws(json_reader_t *r)
+{
+    while (r->p < r->end && isspace((unsigned char) *r->p))
+        r->p++;
+}
+
+static bool json_expect(json_reader_t *r, char c)
+{
+    json_skip_ws(r);
+    if (r->p >= r->end || *r->p != c)
+        return false;
+    r->p++;
+    return true;
+}
+
+static bool json_peek(json_reader_t *r, char c)
+{
+    json_skip_ws(r);
+    return r->p < r->end && *r->p == c;
+}
+
+/**
+ * @brief Read a string, escapes are kept as they are
+ * @param out Output buffer, truncated to out_len - 1 characters, NULL to skip the string
+ */
+static bool json_read_string(json_reader_t *r, char *out, size_t out_len)
+{
+    if (!json_expect(r, '"'))
+        return false;
+
+    size_t len = 0;
+    while (r->p < r->end && *r->p != '"')
+    {
+        if (*r->p == '\\' && r->p + 1 < r->end)
+            r->p++;
+        if (out != NULL && len + 1 < out_len)
+            out[len++] = *r->p;
+        r->p++;
+    }
+    if (out != NULL && out_len > 0)
+        out[len] = '\0';
+
+    return json_expect(r, '"');
+}
+
+static bool json_read_number(json_reader_t *r, double *value)
+{
+    json_skip_ws(r);
+    char buffer[64];
+    size_t len = 0;
+    while (r->p < r->end && len + 1 < sizeof(buffer) && strchr("+-0123456789.eE", *r->p) != NULL)
+        buffer[len++] = *r->p++;
+    buffer[len] = '\0';
+
+    char *end;
+    *value = strtod(buffer, &end);
+    return len > 0 && *end == '\0' && isfinite(*value);
+}
+
+static bool json_skip_value(json_reader_t *r);
+
+static bool json_parse_object(json_reader_t *r, json_member_cb_t member, void *ctx)
+{
+    if (!json_expect(r, '{'))
+        return false;
+    if (json_peek(r, '}'))
+        return json_expect(r, '}');
+
+    do
+    {
+        char key[INGEST_KEY_MAX];
+        if (!json_read_string(r, key, sizeof(key)) || !json_expect(r, ':'))
+            return false;
+        if (!((member != NULL) ? member(r, key, ctx) : json_skip_value(r)))
+            return false;
+    } while (json_expect(r, ','));
+
+    return json_expect(r, '}');
+}
+
+static bool json_parse_array(json_reader_t *r, json_item_cb_t item, void *ctx)
+{
+    if (!json_expect(r, '['))
+        return false;
+    if (json_peek(r, ']'))
+        return json_expect(r, ']');
+
+    do
+    {
+        if (!((item != NULL) ? item(r, ctx) : json_skip_value(r)))
+            return false;
+    } while (json_expect(r, ','));
+
+    return json_expect(r, ']');
+}
+
+static bool json_skip_value(json_reader_t *r)
+{
+    json_skip_ws(r);
+    if (r->p >= r->end)
+        return false;
+
+    switch (*r->p)
+    {
+        case '{':
+            return json_parse_object(r, NULL, NULL);
+        case '[':
+            return json_parse_array(r, NULL, NULL);
+        case '"':
+            return json_read_string(r, NULL, 0);
+        case 't':
+        case 'f':
+        case 'n':
+            while (r->p < r->end && isalpha((unsigned char) *r->p))
+                r->p++;
+            return true;
+        default:
+        {
+            double value;
+            return json_read_number(r, &value);
+        }
+    }
+}
+
+/**
+ * @brief Keep a device ID to the characters the NodeRED flow allows
+ */
+static void ingest_sanitize_device(const char *in, size_t in_len, char *out)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < in_len && len + 1 < INGEST_DEVICE_MAX; i++)
+    {
+        if (isalnum((unsigned char) in[i]) || in[i] == '_' || in[i] == '-')
+            out[len++] = in[i];
+    }
+    out[len] = '\0';
+}
+
+/**
+ * @brief Sensor fields of a reading object, other members are skipped
+ */
+static bool json_reading_member(json_reader_t *r, const char *key, void *ctx)
+{
+    json_reading_t *reading = ctx;
+    double *field = NULL;
+    double ts;
+
+    if (strcmp(key, "temperature") == 0)
+        field = &reading->temperature;
+    else if (strcmp(key, "humidity") == 0)
+        field = &reading->humidity;
+    else if (strcmp(key, "soil_moisture") == 0)
+        field = &reading->soil_moisture;
+    else if (strcmp(key, "ts") == 0)
+    {
+        if (!json_read_number(r, &ts) || ts <= 0 || ts > INT32_MAX * 2.0)
+            return false;
+        reading->ts = (int64_t) ts;
+        return true;
+    }
+
+    // A sensor that did not answer is left out, or null from other publishers
+    if (field == NULL || json_peek(r, 'n'))
+        return json_skip_value(r);
+
+    return json_read_number(r, field);
+}
+
+static void json_reading_init(json_reading_t *reading)
+{
+    reading->temperature = NAN;
+    reading->humidity = NAN;
+    reading->soil_moisture = NAN;
+    reading->ts = 0;
+}
+
+/**
+ * @brief Add a decoded reading as a row
+ * @param fallback_sec Time for a reading without "ts", 0 to skip it
+ */
+static void ingest_add_row(ingest_message_t *msg, const char *device, const json_reading_t *reading, int64_t fallback_sec)
+{
+    int64_t time_sec = (reading->ts != 0) ? reading->ts : fallback_sec;
+    if (time_sec == 0 || msg->count >= INGEST_MAX_ROWS_PER_MESSAGE)
+        return;
+
+    ingest_row_t *row = &msg->rows[msg->count++];
+    row->time = time_sec;
+    snprintf(row->device, sizeof(row->device), "%s", device);
+    row->temperature = reading->temperature;
+    row->humidity = reading->humidity;
+    row->soil_moisture = reading->soil_moisture;
+    row->received_us = msg->received_us;
+}
+
+// Sensor data message: {"temperature":T,...,"ts":U,"pending":[{...},...],...}
+
+typedef struct data_ctx
+{
+    ingest_message_t *msg;
+    json_reading_t current;
+} data_ctx_t;
+
+static bool data_pending_item(json_reader_t *r, void *ctx)
+{
+    ingest_message_t *msg = ctx;
+    json_reading_t reading;
+    json_reading_init(&reading);
+    if (!json_parse_object(r, &json_reading_member, &reading))
+        return false;
+
+    // Without a time it cannot be placed on the time axis
+    ingest_add_row(msg, msg->device, &reading, 0);
+    return true;
+}
+
+static bool data_member(json_reader_t *r, const char *key, void *ctx)
+{
+    data_ctx_t *data = ctx;
+    if (strcmp(key, "pending") == 0)
+        return json_parse_array(r, &data_pending_item, data->msg);
+
+    return json_reading_member(r, key, &data->current);
+}
+
+// Gateway batch message: [{"device":"sf-...","seq":N,"readings":[{...},...]},...]
+
+static bool batch_reading_item(json_reader_t *r, void *ctx)
+{
+    ingest_message_t *msg = ctx;
+    json_reading_t reading;
+    json_reading_init(&reading);
+    if (!json_parse_object(r, &json_reading_member, &reading))
+        return false;
+
+    if (msg->frame_count < INGEST_MAX_ROWS_PER_MESSAGE)
+        msg->frame_readings[msg->frame_count++] = reading;
+    return true;
+}
+
+static bool batch_frame_member(json_reader_t *r, const char *key, void *ctx)
+{
+    ingest_message_t *msg = ctx;
+    if (strcmp(key, "device") == 0)
+    {
+        char device[INGEST_DEVICE_MAX];
+        if (!json_read_string(r, device, sizeof(device)))
+            return false;
+        ingest_sanitize_device(device, strlen(device), msg->device);
+        return true;
+    }
+    if (strcmp(key, "readings") == 0)
+        return json_parse_array(r, &batch_reading_item, msg);
+
+    return json_skip_value(r);
+}
+
+static bool batch_frame_item(json_reader_t *r, void *ctx)
+{
+    ingest_message_t *msg = ctx;
+    msg->device[0] = '\0';
+    msg->frame_count = 0;
+    if (!json_parse_object(r, &batch_frame_member, msg) || msg->device[0] == '\0')
+        return false;
+
+    // The gateway fills in "ts" once its clock is set, the arrival time is close enough before that
+    for (size_t i = 0; i < msg->frame_count; i++)
+        ingest_add_row(msg, msg->device, &msg->frame_readings[i], msg->received_sec);
+    return true;
+}
+
+/**
+ * @brief Decode one MQTT message into rows
+ * @param topic /smartfarming/<device id>/data or /smartfarming/<gateway device id>/batch
+ * @return false if the message is not a valid payload
+ */
+static bool ingest_decode(const char *topic, const char *payload, size_t len, ingest_message_t *msg)
+{
+    json_reader_t r = { .p = payload, .end = payload + len };
+    msg->count = 0;
+    msg->received_us = ingest_now_us();
+    msg->received_sec = (int64_t) time(NULL);
+
+    const char *leaf = strrchr(topic, '/');
+    if (leaf == NULL)
+        return false;
+
+    if (strcmp(leaf, "/batch") == 0)
+    {
+        if (!json_parse_array(&r, &batch_frame_item, msg))
+            return false;
+    }
+    else
+    {
+        // Device ID is the level before the leaf
+        const char *start = leaf;
+        while (start > topic && start[-1] != '/')
+            start--;
+        ingest_sanitize_device(start, (size_t) (leaf - start), msg->device);
+        if (msg->device[0] == '\0')
+            return false;
+
+        data_ctx_t data = { .msg = msg };
+        json_reading_init(&data.current);
+        if (!json_parse_object(&r, &data_member, &data))
+            return false;
+        // Current reading first, as in the payload
+        if (msg->count < INGEST_MAX_ROWS_PER_MESSAGE)
+        {
+            memmove(&msg->rows[1], &msg->rows[0], msg->count * sizeof(msg->rows[0]));
+            size_t pending = msg->count;
+            msg->count = 0;
+            ingest_add_row(msg, msg->device, &data.current, msg->received_sec);
+            msg->count += pending;
+        }
+    }
+
+    json_skip_ws(&r);
+    return r.p == r.end;
+}
+
+/* ---------------------------------------------------------------------------------
+ * Stats
+ * ------------------------------------------------------------------------------- */
+
+static void ingest_latency_add(ingest_latency_t *latency, double value)
+{
+    if (latency->seen < INGEST_LATENCY_SAMPLES)
+    {
+        latency->samples[latency->seen] = value;
+    }
+    else
+    {
+        uint64_t slot = (uint64_t) rand() % (latency->seen + 1);
+        if (slot < INGEST_LATENCY_SAMPLES)
+            latency->samples[slot] = value;
+    }
+    latency->seen++;
+}
+
+static int ingest_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Format p50, p99 and max of the samples as a JSON array
+ * @note Sorts the samples
+ */
+static void ingest_latency_format(ingest_latency_t *latency, char *out, size_t out_len)
+{
+    size_t n = (latency->seen < INGEST_LATENCY_SAMPLES) ? (size_t) latency->seen : INGEST_LATENCY_SAMPLES;
+    if (n == 0)
+    {
+        snprintf(out, out_len, "[0,0,0]");
+        return;
+    }
+
+    qsort(latency->samples, n, sizeof(latency->samples[0]), &ingest_compare_double);
+    snprintf(out, out_len, "[%.1f,%.1f,%.1f]", latency->samples[(n - 1) / 2],
+             latency->samples[(size_t) ((n - 1) * 0.99)], latency->samples[n - 1]);
+}
+
+static void ingest_stats_add(ingest_stats_t *total, const ingest_stats_t *interval)
+{
+    total->messages += interval->messages;
+    total->rows += interval->rows;
+    total->rows_written += interval->rows_written;
+    total->batches += interval->batches;
+    total->invalid += interval->invalid;
+    total->db_errors += interval->db_errors;
+    total->blocked_us += interval->blocked_us;
+    if (interval->queue_max > total->queue_max)
+        total->queue_max = interval->queue_max;
+}
+
+/**
+ * @brief Print one stats line and start a new interval
+ * @param seconds Length of the interval
+ */
+static void ingest_stats_report(double seconds)
+{
+    static ingest_stats_t interval;
+
+    pthread_mutex_lock(&stats_lock);
+    interval = stats;
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&stats_lock);
+
+    pthread_mutex_lock(&queue.lock);
+    size_t depth = queue.count;
+    pthread_mutex_unlock(&queue.lock);
+
+    ingest_stats_add(&totals, &interval);
+
+    char write_ms[64];
+    char lag_ms[64];
+    ingest_latency_format(&interval.write_ms, write_ms, sizeof(write_ms));
+    ingest_latency_format(&interval.lag_ms, lag_ms, sizeof(lag_ms));
+
+    printf("{\"interval_s\":%.1f,\"msgs_s\":%.1f,\"rows_s\":%.1f,\"written_s\":%.1f,\"batches\":%" PRIu64
+           ",\"avg_batch\":%.1f,\"queue\":%zu,\"queue_max\":%zu,\"blocked_ms\":%.1f,\"invalid\":%" PRIu64
+           ",\"db_errors\":%" PRIu64 ",\"write_ms\":%s,\"lag_ms\":%s}\n",
+           seconds, interval.messages / seconds, interval.rows / seconds, interval.rows_written / seconds,
+           interval.batches, interval.batches ? (double) interval.rows_written / interval.batches : 0.0,
+           depth, interval.queue_max, interval.blocked_us / 1000.0, interval.invalid, interval.db_errors,
+           write_ms, lag_ms);
+    fflush(stdout);
+}
+
+/* ---------------------------------------------------------------------------------
+ * Queue
+ * ------------------------------------------------------------------------------- */
+
+/**
+ * @brief Add the rows of one message, waits while the queue is full
+ * @return Microseconds spent waiting for room
+ */
+static int64_t ingest_queue_push(const ingest_row_t *rows, size_t count)
+{
+    int64_t blocked_us = 0;
+
+    pthread_mutex_lock(&queue.lock);
+    if (queue.capacity - queue.count < count && !queue.stopping)
+    {
+        // Backpressure: the MQTT thread stops reading and the broker keeps the messages
+        int64_t start = ingest_now_us();
+        while (queue.capacity - queue.count < count && !queue.stopping)
+            pthread_cond_wait(&queue.not_full, &queue.lock);
+        blocked_us = ingest_now_us() - start;
+    }
+
+    for (size_t i = 0; i < count && queue.count < queue.capacity; i++)
+    {
+        queue.rows[(queue.head + queue.count) % queue.capacity] = rows[i];
+        queue.count++;
+    }
+    size_t depth = queue.count;
+    pthread_cond_signal(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+
+    pthread_mutex_lock(&stats_lock);
+    if (depth > stats.queue_max)
+        stats.queue_max = depth;
+    pthread_mutex_unlock(&stats_lock);
+
+    return blocked_us;
+}
+
+/**
+ * @brief Take the next batch
+ * @return Number of rows, 0 once the queue is stopped and empty
+ * @note Returns when max_rows are waiting or flush_ms after the first row arrived
+ */
+static size_t ingest_queue_pop(ingest_row_t *rows, size_t max_rows, int flush_ms)
+{
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == 0 && !queue.stopping)
+        pthread_cond_wait(&queue.not_empty, &queue.lock);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += flush_ms / 1000;
+    deadline.tv_nsec += (long) (flush_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (queue.count < max_rows && !queue.stopping)
+    {
+        if (pthread_cond_timedwait(&queue.not_empty, &queue.lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+
+    size_t count = (queue.count < max_rows) ? queue.count : max_rows;
+    for (size_t i = 0; i < count; i++)
+        rows[i] = queue.rows[(queue.head + i) % queue.capacity];
+    queue.head = (queue.head + count) % queue.capacity;
+    queue.count -= count;
+
+    pthread_cond_broadcast(&queue.not_full);
+    pthread_mutex_unlock(&queue.lock);
+
+    return count;
+}
+
+static void ingest_queue_stop(void)
+{
+    pthread_mutex_lock(&queue.lock);
+    queue.stopping = true;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_cond_broadcast(&queue.not_full);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+/* ---------------------------------------------------------------------------------
+ * PostgreSQL
+ * ------------------------------------------------------------------------------- */
+
+static int ingest_format_number(char *out, size_t out_len, double value, const char *null_text)
+{
+    return isnan(value) ? snprintf(out, out_len, "%s", null_text) : snprintf(out, out_len, "%.10g", value);
+}
+
+/**
+ * @brief Connect and prepare the insert statement
+ * @return Connection or NULL
+ */
+static PGconn *ingest_db_connect(void)
+{
+    PGconn *conn = PQconnectdb(options.conninfo);
+    if (PQstatus(conn) != CONNECTION_OK)
+    {
+        fprintf(stderr, "database: %s", PQerrorMessage(conn));
+        PQfinish(conn);
+        return NULL;
+    }
+
+    if (!options.use_copy)
+    {
+        // One statement for any batch size, the columns come as arrays
+        char sql[512];
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO %s (time, device, temperature, humidity, soil_moisture) "
+                 "SELECT * FROM unnest($1::bigint[], $2::text[], $3::float8[], $4::float8[], $5::float8[])",
+                 options.table);
+        PGresult *res = PQprepare(conn, "ingest_insert", sql, 5, NULL);
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        if (!ok)
+            fprintf(stderr, "database: prepare failed: %s", PQerrorMessage(conn));
+        PQclear(res);
+        if (!ok)
+        {
+            PQfinish(conn);
+            return NULL;
+        }
+    }
+
+    fprintf(stderr, "database: connected, %s into %s\n", options.use_copy ? "COPY" : "INSERT", options.table);
+    return conn;
+}
+
+/**
+ * @brief Write a batch with COPY, text format
+ */
+static bool ingest_db_copy(PGconn *conn, const ingest_row_t *rows, size_t count, char *buffer)
+{
+    char sql[256];
+    snprintf(sql, sizeof(sql), "COPY %s (time, device, temperature, humidity, soil_moisture) FROM STDIN", options.table);
+    PGresult *res = PQexec(conn, sql);
+    bool ok = PQresultStatus(res) == PGRES_COPY_IN;
+    PQclear(res);
+    if (!ok)
+        return false;
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const ingest_row_t *row = &rows[i];
+        char *out = &buffer[len];
+        int n = snprintf(out, INGEST_ROW_TEXT_MAX, "%" PRId64 "\t%s\t", row->time, row->device);
+        n += ingest_format_number(&out[n], INGEST_ROW_TEXT_MAX - n, row->temperature, "\\N");
+        out[n++] = '\t';
+        n += ingest_format_number(&out[n], INGEST_ROW_TEXT_MAX - n, row->humidity, "\\N");
+        out[n++] = '\t';
+        n += ingest_format_number(&out[n], INGEST_ROW_TEXT_MAX - n, row->soil_moisture, "\\N");
+        out[n++] = '\n';
+        len += (size_t) n;
+    }
+
+    ok = PQputCopyData(conn, buffer, (int) len) == 1 && PQputCopyEnd(conn, NULL) == 1;
+    while ((res = PQgetResult(conn)) != NULL)
+    {
+        ok &= PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+    }
+    return ok;
+}
+
+/**
+ * @brief Write a batch with the prepared INSERT, one text array per column
+ */
+static bool ingest_db_insert(PGconn *conn, const ingest_row_t *rows, size_t count, char *buffer)
+{
+    // Column arrays share the buffer, each one gets a fifth of it
+    const size_t column_len = (size_t) INGEST_ROW_TEXT_MAX * count / 5 + 64;
+    char *columns[5];
+    size_t lengths[5];
+    for (int c = 0; c < 5; c++)
+    {
+        columns[c] = &buffer[c * column_len];
+        columns[c][0] = '{';
+        lengths[c] = 1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const ingest_row_t *row = &rows[i];
+        const char *sep = (i + 1 < count) ? "," : "}";
+        lengths[0] += snprintf(&columns[0][lengths[0]], column_len - lengths[0], "%" PRId64 "%s", row->time, sep);
+        lengths[1] += snprintf(&columns[1][lengths[1]], column_len - lengths[1], "\"%s\"%s", row->device, sep);
+        const double values[3] = { row->temperature, row->humidity, row->soil_moisture };
+        for (int c = 0; c < 3; c++)
+        {
+            lengths[c + 2] += ingest_format_number(&columns[c + 2][lengths[c + 2]], column_len - lengths[c + 2], values[c], "NULL");
+            lengths[c + 2] += snprintf(&columns[c + 2][lengths[c + 2]], column_len - lengths[c + 2], "%s", sep);
+        }
+    }
+
+    const char *params[5] = { columns[0], columns[1], columns[2], columns[3], columns[4] };
+    PGresult *res = PQexecPrepared(conn, "ingest_insert", 5, params, NULL, NULL, 0);
+    bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    PQclear(res);
+    return ok;
+}
+
+/**
+ * @brief Writer thread, moves the queue to the database in batches
+ */
+static void *ingest_writer(void *arg)
+{
+    (void) arg;
+    PGconn *conn = NULL;
+    ingest_row_t *rows = calloc((size_t) options.batch, sizeof(ingest_row_t));
+    char *buffer = malloc((size_t) options.batch * INGEST_ROW_TEXT_MAX + 5 * 64);
+    if (rows == NULL || buffer == NULL)
+    {
+        fprintf(stderr, "writer: out of memory\n");
+        exit(1);
+    }
+
+    size_t count;
+    while ((count = ingest_queue_pop(rows, (size_t) options.batch, options.flush_ms)) > 0)
+    {
+        // The batch is kept until it is written, the queue fills meanwhile
+        for (int retry_sec = 1; ; retry_sec = (retry_sec * 2 > INGEST_RETRY_MAX_SEC) ? INGEST_RETRY_MAX_SEC : retry_sec * 2)
+        {
+            if (conn == NULL)
+                conn = ingest_db_connect();
+
+            int64_t start = ingest_now_us();
+            bool ok = (conn != NULL) && (options.use_copy ? ingest_db_copy(conn, rows, count, buffer)
+                                                          : ingest_db_insert(conn, rows, count, buffer));
+            int64_t end = ingest_now_us();
+
+            pthread_mutex_lock(&stats_lock);
+            if (ok)
+            {
+                stats.batches++;
+                stats.rows_written += count;
+                ingest_latency_add(&stats.write_ms, (end - start) / 1000.0);
+                for (size_t i = 0; i < count; i++)
+                    ingest_latency_add(&stats.lag_ms, (end - rows[i].received_us) / 1000.0);
+            }
+            else
+            {
+                stats.db_errors++;
+            }
+            pthread_mutex_unlock(&stats_lock);
+
+            if (ok)
+                break;
+
+            if (conn != NULL)
+            {
+                fprintf(stderr, "database: write failed: %s", PQerrorMessage(conn));
+                PQfinish(conn);
+                conn = NULL;
+            }
+            if (!running)
+            {
+                fprintf(stderr, "writer: stopping, %zu rows not written\n", count);
+                break;
+            }
+            sleep((unsigned) retry_sec);
+        }
+    }
+
+    if (conn != NULL)
+        PQfinish(conn);
+    free(rows);
+    free(buffer);
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------------
+ * MQTT
+ * ------------------------------------------------------------------------------- */
+
+static void ingest_on_connect(struct mosquitto *mosq, void *obj, int rc)
+{
+    (void) obj;
+    if (rc != 0)
+    {
+        fprintf(stderr, "mqtt: %s\n", mosquitto_connack_string(rc));
+        return;
+    }
+
+    // Subscribed again on every connect, a clean session forgets the subscriptions
+    for (int i = 0; i < options.topic_count; i++)
+        mosquitto_subscribe(mosq, NULL, options.topics[i], 1);
+    fprintf(stderr, "mqtt: connected to %s:%d\n", options.host, options.port);
+}
+
+static void ingest_on_disconnect(struct mosquitto *mosq, void *obj, int rc)
+{
+    (void) mosq;
+    (void) obj;
+    if (rc != 0)
+        fprintf(stderr, "mqtt: connection lost, reconnecting\n");
+}
+
+static void ingest_on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message)
+{
+    (void) mosq;
+    (void) obj;
+    static ingest_message_t msg;   // Only the MQTT thread decodes
+
+    bool valid = ingest_decode(message->topic, message->payload, (size_t) message->payloadlen, &msg);
+    int64_t blocked_us = (valid && msg.count > 0) ? ingest_queue_push(msg.rows, msg.count) : 0;
+
+    pthread_mutex_lock(&stats_lock);
+    stats.messages++;
+    if (valid)
+        stats.rows += msg.count;
+    else
+        stats.invalid++;
+    stats.blocked_us += (uint64_t) blocked_us;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/* ---------------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------------- */
+
+static void ingest_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --host HOST          MQTT broker (default localhost)\n"
+            "  --port PORT          MQTT port (default 1883)\n"
+            "  --username USER      MQTT user name\n"
+            "  --password PASS      MQTT password\n"
+            "  --client-id ID       MQTT client ID of the persistent session (default sf-ingest-bridge)\n"
+            "  --clean              Clean session, messages published while the bridge is down are lost\n"
+            "  --topic TOPIC        Topic filter, repeat for more (default /smartfarming/+/data and /smartfarming/+/batch)\n"
+            "  --db CONNINFO        libpq connection string (default \"dbname=smartfarming\")\n"
+            "  --table NAME         Table (default smart_farming)\n"
+            "  --mode copy|insert   COPY or prepared multi-row INSERT (default copy)\n"
+            "  --batch ROWS         Rows per write (default 1000)\n"
+            "  --flush-ms MS        Longest wait for a full batch (default 500)\n"
+            "  --queue ROWS         Queue size, the MQTT thread waits when it is full (default 50000)\n"
+            "  --stats SEC          Stats interval (default 10)\n",
+            name);
+}
+
+static bool ingest_parse_options(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        { "host",       required_argument, NULL, 'h' },
+        { "port",       required_argument, NULL, 'p' },
+        { "username",   required_argument, NULL, 'u' },
+        { "password",   required_argument, NULL, 'P' },
+        { "client-id",  required_argument, NULL, 'i' },
+        { "clean",      no_argument,       NULL, 'c' },
+        { "topic",      required_argument, NULL, 't' },
+        { "db",         required_argument, NULL, 'd' },
+        { "table",      required_argument, NULL, 'T' },
+        { "mode",       required_argument, NULL, 'm' },
+        { "batch",      required_argument, NULL, 'b' },
+        { "flush-ms",   required_argument, NULL, 'f' },
+        { "queue",      required_argument, NULL, 'q' },
+        { "stats",      required_argument, NULL, 's' },
+        { "help",       no_argument,       NULL, '?' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'h': options.host = optarg; break;
+            case 'p': options.port = atoi(optarg); break;
+            case 'u': options.username = optarg; break;
+            case 'P': options.password = optarg; break;
+            case 'i': options.client_id = optarg; break;
+            case 'c': options.clean_session = true; break;
+            case 't':
+                if (options.topic_count >= INGEST_MAX_TOPICS)
+                    return false;
+                options.topics[options.topic_count++] = optarg;
+                break;
+            case 'd': options.conninfo = optarg; break;
+            case 'T': options.table = optarg; break;
+            case 'm':
+                if (strcmp(optarg, "copy") != 0 && strcmp(optarg, "insert") != 0)
+                    return false;
+                options.use_copy = strcmp(optarg, "copy") == 0;
+                break;
+            case 'b': options.batch = atoi(optarg); break;
+            case 'f': options.flush_ms = atoi(optarg); break;
+            case 'q': options.queue = atoi(optarg); break;
+            case 's': options.stats_sec = atoi(optarg); break;
+            default: return false;
+        }
+    }
+
+    if (options.topic_count == 0)
+    {
+        options.topics[options.topic_count++] = "/smartfarming/+/data";
+        options.topics[options.topic_count++] = "/smartfarming/+/batch";
+    }
+
+    // The table name goes into the SQL text
+    for (const char *c = options.table; *c; c++)
+    {
+        if (!isalnum((unsigned char) *c) && *c != '_' && *c != '.')
+            return false;
+    }
+
+    return optind == argc && options.port > 0 && options.batch > 0 && options.flush_ms >= 0 &&
+           options.queue >= INGEST_MAX_ROWS_PER_MESSAGE && options.stats_sec > 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (!ingest_parse_options(argc, argv))
+    {
+        ingest_usage(argv[0]);
+        return 2;
+    }
+
+    queue.capacity = (size_t) options.queue;
+    queue.rows = calloc(queue.capacity, sizeof(ingest_row_t));
+    if (queue.rows == NULL)
+    {
+        fprintf(stderr, "queue: out of memory\n");
+        return 1;
+    }
+
+    signal(SIGINT, &ingest_signal);
+    signal(SIGTERM, &ingest_signal);
+
+    pthread_t writer;
+    pthread_create(&writer, NULL, &ingest_writer, NULL);
+
+    mosquitto_lib_init();
+    struct mosquitto *mosq = mosquitto_new(options.client_id, options.clean_session, NULL);
+    if (mosq == NULL)
+    {
+        fprintf(stderr, "mqtt: %s\n", strerror(errno));
+        return 1;
+    }
+    if (options.username != NULL)
+        mosquitto_username_pw_set(mosq, options.username, options.password);
+    mosquitto_connect_callback_set(mosq, &ingest_on_connect);
+    mosquitto_disconnect_callback_set(mosq, &ingest_on_disconnect);
+    mosquitto_message_callback_set(mosq, &ingest_on_message);
+    mosquitto_reconnect_delay_set(mosq, 1, INGEST_RETRY_MAX_SEC, true);
+
+    int rc = mosquitto_connect_async(mosq, options.host, options.port, 60);
+    if (rc != MOSQ_ERR_SUCCESS)
+        fprintf(stderr, "mqtt: %s, retrying\n", mosquitto_strerror(rc));
+    rc = mosquitto_loop_start(mosq);
+    if (rc != MOSQ_ERR_SUCCESS)
+    {
+        fprintf(stderr, "mqtt: %s\n", mosquitto_strerror(rc));
+        return 1;
+    }
+
+    int64_t started_us = ingest_now_us();
+    int64_t last_us = started_us;
+    while (running)
+    {
+        usleep(100000);
+        int64_t now_us = ingest_now_us();
+        if (now_us - last_us >= (int64_t) options.stats_sec * 1000000)
+        {
+            ingest_stats_report((now_us - last_us) / 1e6);
+            last_us = now_us;
+        }
+    }
+
+    // Stop taking messages, then write what is queued
+    mosquitto_disconnect(mosq);
+    mosquitto_loop_stop(mosq, false);
+    ingest_queue_stop();
+    pthread_join(writer, NULL);
+    ingest_stats_report((ingest_now_us() - last_us) / 1e6);
+
+    double seconds = (ingest_now_us() - started_us) / 1e6;
+    fprintf(stderr, "total: %" PRIu64 " messages, %" PRIu64 " rows, %" PRIu64 " written in %" PRIu64
+            " batches, %" PRIu64 " invalid, %" PRIu64 " database errors, %.1f rows/s\n",
+            totals.messages, totals.rows, totals.rows_written, totals.batches, totals.invalid, totals.db_errors,
+            totals.rows_written / seconds);
+
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+    free(queue.rows);
+    return 0;
+}
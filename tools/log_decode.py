@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Decode the deferred binary log of the nodes back into log lines.
+
+With DEFERRED_LOG_ENABLE set (deferred_log.h), the event handlers store a 20 byte
+entry per message in a ring in RTC memory instead of printing it. A node publishes
+the ring as binary on /smartfarming/<device id>/log when the "log_req" number of
+its remote config changes, the host build prints it as a "host/log <hex>" line.
+
+Record, little endian:
+    u8 version, u8 entry size, u16 entry count, u32 entries dropped since the last drain
+    entries, oldest first: u32 time_ms, u16 message ID, u8 level, u8 wake, u32 args[3]
+
+The message IDs are read from deferred_log_id_e in deferred_log.h and the format
+and tag of each ID from its DEFERRED_LOGx call, so point --src at the source of
+the firmware that wrote the log. Integer arguments are printed with their C
+format, float arguments (%f, %e, %g) are stored as their IEEE 754 bits.
+
+Usage:
+    mosquitto_pub -h <broker> -r -q 1 -t '/smartfarming/<device id>/config' -m '{"log_req":7}'
+    mosquitto_sub -h <broker> -t '/smartfarming/+/log' -F '%t %x' | python3 log_decode.py
+    ./build_linux/Smart_Farming_ESP_IDF.elf | grep host/log | python3 log_decode.py
+    python3 log_decode.py logs.txt --src ../Smart_Farming_ESP_IDF/main
+
+Input lines may be the hex record or "<topic> <hex>".
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+DEFAULT_SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Smart_Farming_ESP_IDF", "main")
+
+HEADER = struct.Struct("<BBHI")
+ENTRY_HEAD = struct.Struct("<IHBB")
+MAX_ARGS = 3
+
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+
+ENUM_RE = re.compile(r"typedef enum deferred_log_id\s*\{(.*?)\}\s*deferred_log_id_e;", re.S)
+CALL_RE = re.compile(r'DEFERRED_LOG[EWIDV]\(\s*([^,]+?)\s*,\s*(DLOG_\w+)\s*,\s*((?:"(?:[^"\\]|\\.)*"\s*)+)')
+TAG_RE = re.compile(r'static\s+const\s+char\s*(?:\*\s*TAG|TAG\s*\[\s*\])\s*=\s*"([^"]*)"')
+SPEC_RE = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diuxXoeEfgGc%])")
+
+
+def load_ids(src):
+    """Return the message names by ID."""
+    with open(os.path.join(src, "deferred_log.h")) as header:
+        match = ENUM_RE.search(header.read())
+    if match is None:
+        sys.exit("deferred_log_id_e not found in %s" % src)
+    body = re.sub(r"//[^\n]*", "", match.group(1))
+    return [name for name in re.findall(r"\b(DLOG_\w+)\b", body) if name != "DLOG_ID_MAX"]
+
+
+def load_messages(src):
+    """Return {name: (tag, format)} from the DEFERRED_LOGx calls."""
+    messages = {}
+    for root, _, files in os.walk(src):
+        for name in sorted(files):
+            if not name.endswith(".c"):
+                continue
+            with open(os.path.join(root, name), errors="replace") as source:
+                text = source.read()
+            tag_match = TAG_RE.search(text)
+            file_tag = tag_match.group(1) if tag_match else os.path.splitext(name)[0]
+            for tag, message_id, literals in CALL_RE.findall(text):
+                fmt = "".join(re.findall(r'"((?:[^"\\]|\\.)*)"', literals))
+                fmt = fmt.encode().decode("unicode_escape")
+                tag = tag[1:-1] if tag.startswith('"') else file_tag
+                if message_id in messages and messages[message_id] != (tag, fmt):
+                    print("warning: %s has two formats, using the first" % message_id, file=sys.stderr)
+                    continue
+                messages[message_id] = (tag, fmt)
+    return messages
+
+
+def format_message(fmt, args):
+    """Apply a C format to the 32-bit arguments."""
+    out = []
+    position = 0
+    arg_index = 0
+    for match in SPEC_RE.finditer(fmt):
+        out.append(fmt[position:match.start()])
+        position = match.end()
+        flags, _, conversion = match.groups()
+        if conversion == "%":
+            out.append("%")
+            continue
+        value = args[arg_index] if arg_index < len(args) else 0
+        arg_index += 1
+        if conversion in "di":
+            value = struct.unpack("<i", struct.pack("<I", value))[0]
+            out.append(("%" + flags + "d") % value)
+        elif conversion == "u":
+            out.append(("%" + flags + "d") % value)
+        elif conversion in "xXo":
+            out.append(("%" + flags + conversion) % value)
+        elif conversion in "eEfgG":
+            out.append(("%" + flags + conversion) % struct.unpack("<f", struct.pack("<I", value))[0])
+        else:
+            out.append(chr(value & 0xFF))
+    out.append(fmt[position:])
+    return "".join(out).rstrip("\n")
+
+
+def parse_line(line):
+    """Return (device, record bytes) or (None, None)."""
+    parts = line.split()
+    if not parts:
+        return None, None
+    topic = parts[0] if len(parts) > 1 else None
+    try:
+        record = bytes.fromhex(parts[-1])
+    except ValueError:
+        return None, None
+
+    device = None
+    if topic is not None:
+        levels = topic.strip("/").split("/")
+        device = levels[1] if len(levels) >= 3 and levels[0] == "smartfarming" else levels[0]
+    return device, record
+
+
+def decode_record(record, names, messages):
+    """Yield the decoded lines of one record."""
+    if len(record) < HEADER.size:
+        yield "record too short (%d bytes)" % len(record)
+        return
+    version, entry_size, count, dropped = HEADER.unpack_from(record)
+    if version != 1 or entry_size != ENTRY_HEAD.size + 4 * MAX_ARGS:
+        yield "unknown record version %d, entry size %d" % (version, entry_size)
+        return
+    if dropped:
+        yield "%d older entries were overwritten" % dropped
+
+    offset = HEADER.size
+    for _ in range(count):
+        if offset + entry_size > len(record):
+            yield "record truncated"
+            return
+        time_ms, message_id, level, wake = ENTRY_HEAD.unpack_from(record, offset)
+        args = struct.unpack_from("<%dI" % MAX_ARGS, record, offset + ENTRY_HEAD.size)
+        offset += entry_size
+
+        name = names[message_id] if message_id < len(names) else None
+        if name in messages:
+            tag, fmt = messages[name]
+            text = format_message(fmt, args)
+        else:
+            tag = "?"
+            text = "message %d (%s) args %s" % (message_id, name or "unknown", " ".join("0x%08x" % a for a in args))
+        yield "wake %3d %s (%d) %s: %s" % (wake, LEVELS.get(level, "?"), time_ms, tag, text)
+
+
+def decode_lines(lines, names, messages):
+    """Print the decoded records of the input lines."""
+    for line in lines:
+        device, record = parse_line(line)
+        if record is None:
+            continue
+        for text in decode_record(record, names, messages):
+            print("%s %s" % (device, text) if device else text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="*", help="Record files, stdin if omitted")
+    parser.add_argument("--src", default=DEFAULT_SRC, help="Firmware source directory with deferred_log.h (default: %(default)s)")
+    args = parser.parse_args()
+
+    names = load_ids(args.src)
+    messages = load_messages(args.src)
+
+    if args.files:
+        for path in args.files:
+            with open(path, errors="replace") as source:
+                decode_lines(source, names, messages)
+    else:
+        decode_lines(sys.stdin, names, messages)
+
+
+if __name__ == "__main__":
+    main()
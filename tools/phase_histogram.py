@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Aggregate wake-cycle phase records into per-phase latency histograms.
+
+The nodes publish the previous cycle's phase timings on the diagnostics topic as
+{"cycle":N,"sleep_ms":S,"flags":F,"t_ms":[boot,nvs,wifi_start,wifi,dhcp,net,connack,sensor,publish,sleep]}
+(milliseconds since the cycle started, 0 = phase not reached). Flag 1 means the node connected
+with the cached BSSID and channel, flag 2 that it reused the cached DHCP lease, flag 4 that the
+cycle resumed from light sleep with the MQTT session open, flag 8 that it ended in light sleep
+and flag 16 that it ran on the single run-to-completion task.
+
+Usage:
+    mosquitto_sub -h <broker> -t '/smartfarming/+/diag' -v | python3 phase_histogram.py
+    python3 phase_histogram.py records.txt
+    python3 phase_histogram.py records.txt --connect fast
+    python3 phase_histogram.py records.txt --wake resume
+
+Input lines may be the raw JSON record or "<topic> <json>" as printed by mosquitto_sub -v.
+"""
+
+import argparse
+import json
+import sys
+
+PHASES = ["boot", "nvs", "wifi_start", "wifi", "dhcp", "net", "connack", "sensor", "publish", "sleep"]
+
+# Phase -> phase it is measured from. Sensor reading runs in parallel with the
+# network bring-up, so it is measured from the NVS init.
+PREDECESSOR = {
+    "nvs": "boot",
+    "wifi_start": "nvs",
+    "wifi": "wifi_start",
+    "dhcp": "wifi",
+    "net": "dhcp",
+    "connack": "net",
+    "sensor": "nvs",
+    "publish": "connack",
+    "sleep": "publish",
+}
+
+FLAG_FAST_CONNECT = 0x01
+FLAG_RESUMED = 0x04
+
+BUCKETS_MS = [10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000]
+
+
+def parse_line(line):
+    line = line.strip()
+    if not line:
+        return None, None, 0
+
+    topic = None
+    if not line.startswith("{"):
+        topic, _, line = line.partition(" ")
+
+    try:
+        record = json.loads(line)
+    except ValueError:
+        return None, None, 0
+
+    stamps = record.get("t_ms")
+    if not isinstance(stamps, list) or len(stamps) != len(PHASES):
+        return None, None, 0
+
+    return topic, dict(zip(PHASES, stamps)), record.get("flags", 0)
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def histogram(values):
+    counts = [0] * (len(BUCKETS_MS) + 1)
+    for value in values:
+        for i, bound in enumerate(BUCKETS_MS):
+            if value <= bound:
+                counts[i] += 1
+                break
+        else:
+            counts[-1] += 1
+    return counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("file", nargs="?", help="Record file, stdin if omitted")
+    parser.add_argument("--json", action="store_true", help="Print the summary as JSON")
+    parser.add_argument("--connect", choices=("any", "fast", "full"), default="any",
+                        help="Only cycles that used the cached AP (fast) or a full scan (full)")
+    parser.add_argument("--wake", choices=("any", "cold", "resume"), default="any",
+                        help="Only cycles that started from deep sleep (cold) or light sleep (resume)")
+    args = parser.parse_args()
+
+    source = open(args.file) if args.file else sys.stdin
+
+    durations = {phase: [] for phase in PHASES}
+    devices = set()
+    records = 0
+
+    for line in source:
+        topic, stamps, flags = parse_line(line)
+        if stamps is None:
+            continue
+        if args.connect != "any" and bool(flags & FLAG_FAST_CONNECT) != (args.connect == "fast"):
+            continue
+        if args.wake != "any" and bool(flags & FLAG_RESUMED) != (args.wake == "resume"):
+            continue
+
+        records += 1
+        if topic:
+            devices.add(topic)
+
+        # A resumed cycle starts at its boot stamp, there is no boot time to measure
+        if stamps["boot"] > 0 and not flags & FLAG_RESUMED:
+            durations["boot"].append(stamps["boot"])
+
+        for phase, start in PREDECESSOR.items():
+            if stamps[phase] > 0 and stamps[start] > 0 and stamps[phase] >= stamps[start]:
+                durations[phase].append(stamps[phase] - stamps[start])
+
+    summary = {"records": records, "topics": len(devices), "phases": {}}
+    for phase in PHASES:
+        values = sorted(durations[phase])
+        summary["phases"][phase] = {
+            "count": len(values),
+            "p50": percentile(values, 50),
+            "p90": percentile(values, 90),
+            "p99": percentile(values, 99),
+            "max": values[-1] if values else 0,
+            "histogram": histogram(values),
+        }
+
+    if args.json:
+        summary["buckets_ms"] = BUCKETS_MS
+        print(json.dumps(summary, indent=2))
+        return
+
+    print("records: %d, topics: %d" % (records, len(devices)))
+    header = "%-10s %6s %7s %7s %7s %7s  " % ("phase", "n", "p50", "p90", "p99", "max")
+    header += " ".join("<=%-5d" % b for b in BUCKETS_MS) + " >%d" % BUCKETS_MS[-1]
+    print(header)
+    for phase in PHASES:
+        stats = summary["phases"][phase]
+        row = "%-10s %6d %7d %7d %7d %7d  " % (phase, stats["count"], stats["p50"], stats["p90"], stats["p99"], stats["max"])
+        row += " ".join("%-7d" % c for c in stats["histogram"])
+        print(row)
+
+
+if __name__ == "__main__":
+    main()
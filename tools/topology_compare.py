@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+Compare the wake-to-sleep time and RAM use of the multi-task and run-to-completion wakes.
+
+Each wake publishes two records of the previous wake on the diagnostics topic, the
+cycle profile and the task monitor snapshot:
+    {"cycle":N,"sleep_ms":S,"flags":F,"t_ms":[boot,nvs,wifi_start,wifi,dhcp,net,connack,sensor,publish,sleep]}
+    {"mode":"tasks","win_ms":W,"load":[a,b],"heap":[free,min_free,largest],"tasks":[...],"more":0}
+Flag 16 marks a wake that ran on the single run-to-completion task (RUN_TO_COMPLETION_ENABLE
+in run_to_completion.h), the others ran on the sensor, network and MQTT tasks. The task
+record is paired with the cycle record published just before it on the same topic.
+
+Wake-to-sleep is the sleep stamp, publish is boot to sensor data handed to the client.
+Peak RAM is read from the lowest free heap of the wake: the task stacks and the
+buffers of the application come from the heap unless STATIC_ALLOC_ENABLE is set,
+so a topology that needs less RAM leaves a higher low-water mark.
+
+Usage:
+    mosquitto_sub -h <broker> -t '/smartfarming/+/diag' -v | python3 topology_compare.py
+    python3 topology_compare.py tasks.txt single.txt
+    python3 topology_compare.py records.txt --wake cold --json
+
+Input lines may be the raw JSON record or "<topic> <json>" as printed by mosquitto_sub -v.
+"""
+
+import argparse
+import json
+import sys
+
+PHASES = ["boot", "nvs", "wifi_start", "wifi", "dhcp", "net", "connack", "sensor", "publish", "sleep"]
+
+FLAG_RESUMED = 0x04
+FLAG_RUN_TO_COMPLETION = 0x10
+
+TOPOLOGIES = ("tasks", "single")
+
+
+def parse_line(line):
+    """Return (topic, record) or (None, None)."""
+    line = line.strip()
+    if not line:
+        return None, None
+
+    topic = None
+    if not line.startswith("{"):
+        topic, _, line = line.partition(" ")
+
+    try:
+        record = json.loads(line)
+    except ValueError:
+        return None, None
+    if not isinstance(record, dict):
+        return None, None
+    return topic, record
+
+
+def load_wakes(lines, wake):
+    """Return a list of wakes {"topology", "sleep", "publish", "heap_min"}."""
+    wakes = []
+    last = {}
+    for line in lines:
+        topic, record = parse_line(line)
+        if record is None:
+            continue
+
+        stamps = record.get("t_ms")
+        if isinstance(stamps, list) and len(stamps) == len(PHASES):
+            stamps = dict(zip(PHASES, stamps))
+            flags = record.get("flags", 0)
+            last.pop(topic, None)
+            if stamps["sleep"] <= 0:
+                continue
+            if wake != "any" and bool(flags & FLAG_RESUMED) != (wake == "resume"):
+                continue
+            entry = {
+                "topology": "single" if flags & FLAG_RUN_TO_COMPLETION else "tasks",
+                "sleep": stamps["sleep"],
+                "publish": stamps["publish"],
+                "heap_min": None,
+            }
+            wakes.append(entry)
+            last[topic] = entry
+        elif record.get("mode") == "tasks":
+            # Same wake as the cycle record just before it on this topic
+            entry = last.pop(topic, None)
+            heap = record.get("heap")
+            if entry is not None and isinstance(heap, list) and len(heap) >= 2:
+                entry["heap_min"] = heap[1]
+    return wakes
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def summarize(wakes):
+    summary = {}
+    for topology in TOPOLOGIES:
+        selected = [w for w in wakes if w["topology"] == topology]
+        sleep = sorted(w["sleep"] for w in selected)
+        publish = sorted(w["publish"] for w in selected if w["publish"] > 0)
+        heap_min = sorted(w["heap_min"] for w in selected if w["heap_min"] is not None)
+        summary[topology] = {
+            "wakes": len(selected),
+            "sleep_p50": percentile(sleep, 50),
+            "sleep_p90": percentile(sleep, 90),
+            "publish_p50": percentile(publish, 50),
+            "heap_records": len(heap_min),
+            "heap_min_p50": percentile(heap_min, 50),
+            "heap_min_low": heap_min[0] if heap_min else 0,
+        }
+
+    tasks, single = summary["tasks"], summary["single"]
+    if tasks["wakes"] and single["wakes"]:
+        summary["change"] = {
+            "sleep_p50_ms": single["sleep_p50"] - tasks["sleep_p50"],
+            "publish_p50_ms": single["publish_p50"] - tasks["publish_p50"],
+        }
+        if tasks["heap_records"] and single["heap_records"]:
+            # Positive = the single task leaves more heap free
+            summary["change"]["heap_min_p50_bytes"] = single["heap_min_p50"] - tasks["heap_min_p50"]
+    return summary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="*", help="Record files, stdin if omitted")
+    parser.add_argument("--wake", choices=("any", "cold", "resume"), default="cold",
+                        help="Only wakes from deep sleep (cold, default) or light sleep (resume)")
+    parser.add_argument("--json", action="store_true", help="Print the summary as JSON")
+    args = parser.parse_args()
+
+    wakes = []
+    if args.files:
+        for path in args.files:
+            with open(path, errors="replace") as source:
+                wakes += load_wakes(source, args.wake)
+    else:
+        wakes = load_wakes(sys.stdin, args.wake)
+
+    summary = summarize(wakes)
+    if args.json:
+        print(json.dumps(summary, indent=2))
+        return
+
+    print("%-8s %6s %10s %10s %12s %8s %13s %13s" % (
+        "topology", "wakes", "sleep_p50", "sleep_p90", "publish_p50", "heap_n", "heap_min_p50", "heap_min_low"))
+    for topology in TOPOLOGIES:
+        stats = summary[topology]
+        print("%-8s %6d %10d %10d %12d %8d %13d %13d" % (
+            topology, stats["wakes"], stats["sleep_p50"], stats["sleep_p90"], stats["publish_p50"],
+            stats["heap_records"], stats["heap_min_p50"], stats["heap_min_low"]))
+    change = summary.get("change")
+    if change:
+        line = "single - tasks: wake-to-sleep %+d ms, publish %+d ms" % (change["sleep_p50_ms"], change["publish_p50_ms"])
+        if "heap_min_p50_bytes" in change:
+            line += ", lowest free heap %+d bytes" % change["heap_min_p50_bytes"]
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
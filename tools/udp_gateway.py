@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""
+UDP uplink gateway. Receives the authenticated sensor datagrams sent by the nodes
+in UDP transport mode (see udp_uplink.h for the layout), acks them and republishes
+the payload to the MQTT broker.
+
+Run the gateway:
+    python3 udp_gateway.py serve --key Your_UDP_Uplink_Key --broker localhost
+
+Send a datagram like a node would (for testing on Linux against a local broker):
+    python3 udp_gateway.py send --key Your_UDP_Uplink_Key --payload '{"temperature":25.1,"humidity":60,"soil_moisture":12000}'
+
+The MQTT side uses paho-mqtt when it is installed and falls back to mosquitto_pub.
+"""
+
+import argparse
+import hashlib
+import hmac
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+VERSION = 1
+FLAG_ACK = 0x01
+HEADER = struct.Struct(">2sBBII6sH")
+ACK_HEADER = struct.Struct(">2sBBII")
+TAG_LEN = 16
+SEQ_WINDOW = 64
+
+
+def tag(key, data):
+    return hmac.new(key, data, hashlib.sha256).digest()[:TAG_LEN]
+
+
+def encode(key, session, seq, mac, payload, ack=True):
+    header = HEADER.pack(b"SF", VERSION, FLAG_ACK if ack else 0, session, seq, mac, len(payload))
+    return header + payload + tag(key, header + payload)
+
+
+def decode(key, datagram):
+    """Return (flags, session, seq, mac, payload) or None if the datagram is not valid."""
+    if len(datagram) < HEADER.size + TAG_LEN:
+        return None
+
+    magic, version, flags, session, seq, mac, length = HEADER.unpack_from(datagram)
+    if magic != b"SF" or version != VERSION or len(datagram) != HEADER.size + length + TAG_LEN:
+        return None
+
+    body = datagram[:-TAG_LEN]
+    if not hmac.compare_digest(tag(key, body), datagram[-TAG_LEN:]):
+        return None
+
+    return flags, session, seq, mac, body[HEADER.size:]
+
+
+def encode_ack(key, session, seq):
+    header = ACK_HEADER.pack(b"SA", VERSION, 0, session, seq)
+    return header + tag(key, header)
+
+
+class ReplayFilter:
+    """Accepts each (device, session, seq) once. A new session means the node was power cycled,
+    the sessions it had before are retired and never accepted again."""
+
+    def __init__(self):
+        self.devices = {}
+        self.retired = {}
+
+    def accept(self, mac, session, seq):
+        retired = self.retired.setdefault(mac, set())
+        if session in retired:
+            return False
+
+        state = self.devices.get(mac)
+        if state is None or state[0] != session:
+            if state is not None:
+                retired.add(state[0])
+            self.devices[mac] = (session, seq, {seq})
+            return True
+
+        _, highest, seen = state
+        if seq in seen or seq + SEQ_WINDOW <= highest:
+            return False
+
+        seen.add(seq)
+        highest = max(highest, seq)
+        seen = {s for s in seen if s + SEQ_WINDOW > highest}
+        self.devices[mac] = (session, highest, seen)
+        return True
+
+
+class Publisher:
+    def __init__(self, host, port, username, password):
+        self.host, self.port, self.username, self.password = host, port, username, password
+        self.client = None
+        try:
+            import paho.mqtt.client as mqtt
+        except ImportError:
+            return
+
+        try:
+            self.client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2, client_id="udp-gateway")
+        except AttributeError:
+            self.client = mqtt.Client(client_id="udp-gateway")
+        if username:
+            self.client.username_pw_set(username, password)
+        self.client.connect(host, port, keepalive=60)
+        self.client.loop_start()
+
+    def publish(self, topic, payload):
+        if self.client is not None:
+            self.client.publish(topic, payload, qos=0)
+            return
+
+        cmd = ["mosquitto_pub", "-h", self.host, "-p", str(self.port), "-t", topic, "-s"]
+        if self.username:
+            cmd += ["-u", self.username, "-P", self.password or ""]
+        try:
+            subprocess.run(cmd, input=payload, check=False)
+        except OSError as err:
+            print("mosquitto_pub failed: %s" % err, file=sys.stderr)
+
+
+def serve(args):
+    key = args.key.encode()
+    publisher = Publisher(args.broker, args.broker_port, args.username, args.password)
+    replay = ReplayFilter()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    print("listening on %s:%d, publishing to %s:%d %s" % (args.bind, args.port, args.broker, args.broker_port, args.topic))
+
+    received = duplicates = rejected = 0
+    while True:
+        datagram, addr = sock.recvfrom(2048)
+        frame = decode(key, datagram)
+        if frame is None:
+            rejected += 1
+            print("rejected datagram from %s:%d" % addr, file=sys.stderr)
+            continue
+
+        flags, session, seq, mac, payload = frame
+        if flags & FLAG_ACK:
+            sock.sendto(encode_ack(key, session, seq), addr)
+
+        if not replay.accept(mac, session, seq):
+            duplicates += 1
+            continue
+
+        received += 1
+        topic = args.topic.replace("{mac}", mac.hex())
+        publisher.publish(topic, payload)
+        if args.verbose:
+            print("%s seq %d -> %s: %s (received %d, duplicates %d, rejected %d)"
+                  % (mac.hex(), seq, topic, payload.decode(errors="replace"), received, duplicates, rejected))
+
+
+def send(args):
+    key = args.key.encode()
+    mac = bytes.fromhex(args.mac.replace(":", ""))
+    session = args.session or (int.from_bytes(os.urandom(4), "big") | 1)
+    datagram = encode(key, session, args.seq, mac, args.payload.encode(), ack=not args.no_ack)
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(args.timeout)
+    start = time.monotonic()
+    sock.sendto(datagram, (args.host, args.port))
+    if args.no_ack:
+        print("sent %d bytes" % len(datagram))
+        return 0
+
+    try:
+        ack, _ = sock.recvfrom(64)
+    except socket.timeout:
+        print("no ack")
+        return 1
+
+    if ack != encode_ack(key, session, args.seq):
+        print("invalid ack")
+        return 1
+
+    print("sent %d bytes, acked in %.1f ms" % (len(datagram), (time.monotonic() - start) * 1000.0))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("serve", help="Run the gateway")
+    p.add_argument("--key", required=True, help="Shared key, UDP_UPLINK_KEY in udp_uplink.h")
+    p.add_argument("--bind", default="0.0.0.0")
+    p.add_argument("--port", type=int, default=5683)
+    p.add_argument("--broker", default="localhost")
+    p.add_argument("--broker-port", type=int, default=1883)
+    p.add_argument("--username")
+    p.add_argument("--password")
+    p.add_argument("--topic", default="/smartfarming/sf-{mac}/data", help="Target topic, {mac} is replaced by the node MAC")
+    p.add_argument("-v", "--verbose", action="store_true")
+
+    p = sub.add_parser("send", help="Send one datagram like a node")
+    p.add_argument("--key", required=True)
+    p.add_argument("--host", default="127.0.0.1")
+    p.add_argument("--port", type=int, default=5683)
+    p.add_argument("--mac", default="24:0a:c4:00:00:01")
+    p.add_argument("--session", type=int, default=0, help="Session id, random if 0")
+    p.add_argument("--seq", type=int, default=1)
+    p.add_argument("--payload", required=True)
+    p.add_argument("--timeout", type=float, default=0.3)
+    p.add_argument("--no-ack", action="store_true")
+
+    args = parser.parse_args()
+    if args.command == "serve":
+        serve(args)
+        return 0
+    return send(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())